@@ -0,0 +1,389 @@
+#pragma once
+// Drives a callback-mode sample source (the shape of the Media Foundation
+// source reader created with MF_SOURCE_READER_ASYNC_CALLBACK) with several
+// reads in flight, and hands the completed samples to the calling thread
+// through a bounded completion queue:
+//
+//   source (its own threads)   read completes -> completion queue -> next read
+//   calling thread             completion queue -> consume (convert, write)
+//
+// A blocking ReadSample loop waits out the demux and decode of every sample
+// before it can write the previous one; here the source is already working
+// on the next reads while the consumer writes. Completions must arrive in
+// request order, which the source reader guarantees for a single stream.
+//
+// Stall counters say which side is the bottleneck: a consumer that keeps
+// finding the queue empty is waiting on the source, completions that find
+// the read-ahead limit reached are waiting on the consumer.
+//
+// A sample may arrive in several buffers (an IMFSample with more than one
+// media buffer). They are passed on as a list rather than copied into one
+// contiguous buffer, and WriteGathered writes them down a sink chain in
+// place; only samples with more than MaxBuffers buffers are copied.
+//
+// With several streams selected (every audio track of a container, read
+// with MF_SOURCE_READER_ANY_STREAM) samples carry their stream index for
+// the consumer to route on, and the read ends once each selected stream
+// has reported its end.
+#include "SampleClock.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct SourceSampleFlags
+{
+    static const uint32_t EndOfStream = 1;      // MF_SOURCE_READERF_ENDOFSTREAM
+    static const uint32_t StreamTick = 2;       // gap in the stream; MF_SOURCE_READERF_STREAMTICK
+    static const uint32_t TypeChanged = 4;      // MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED
+};
+
+struct PcmSpan
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct SourceSample
+{
+    static const uint32_t MaxBuffers = 8;
+
+    int32_t status = 0;             // negative on failure (an HRESULT on Windows)
+    uint32_t flags = 0;             // SourceSampleFlags
+    int64_t timestamp = 0;          // 100 ns units
+    uint32_t streamIndex = 0;       // source stream the sample belongs to
+    PcmSpan buffers[MaxBuffers];    // decoded PCM in order; none for ticks and end of stream
+    uint32_t bufferCount = 0;
+    size_t size = 0;                // bytes across the buffers
+    bool copied = false;            // had more than MaxBuffers buffers, made contiguous by the source
+    std::shared_ptr<const void> owner;  // keeps the buffers alive, e.g. the locked media buffers
+
+    bool Failed() const { return status < 0; }
+};
+
+class AsyncSampleSource
+{
+public:
+    using Completion = std::function<void(SourceSample& sample)>;
+
+    virtual ~AsyncSampleSource() = default;
+
+    // Set before the first RequestSample. Called once per request, on any
+    // thread but never concurrently with itself; it may request more reads.
+    virtual void SetCompletion(Completion completion) = 0;
+
+    // Starts one read and returns without waiting for it. A negative status
+    // means the read was not started and will not complete.
+    virtual int32_t RequestSample() = 0;
+
+    // Abandons reads still pending. When it returns the completion is not
+    // running and is not called again.
+    virtual void CancelPending() = 0;
+};
+
+struct AsyncReaderOptions
+{
+    uint32_t readsInFlight = 4;     // requests outstanding at the source
+    uint32_t queueDepth = 8;        // further samples read ahead of the consumer
+    uint32_t streams = 1;           // selected streams: end of stream is final once all have ended
+
+    // At most this many samples are held at once, in flight or queued.
+    uint32_t MaxOutstanding() const { return readsInFlight + queueDepth; }
+};
+
+struct AsyncReaderStats
+{
+    uint64_t requests = 0;
+    uint64_t samples = 0;           // completions carrying data
+    uint64_t bytes = 0;
+    uint64_t gatheredSamples = 0;   // passed on as several buffers, without a copy
+    uint64_t contiguousCopies = 0;  // copied into one buffer by the source (the fallback)
+    uint64_t copiedBytes = 0;
+    uint64_t ticks = 0;
+    uint32_t maxInFlight = 0;
+    uint32_t maxQueued = 0;
+    uint64_t consumerWaits = 0;     // consumer found the queue empty
+    double consumerWaitSeconds = 0;
+    uint64_t sourceStalls = 0;      // completions that could not start a read: queue full
+    int32_t status = 0;             // first failure, from the source or RequestSample
+    uint32_t streamsEnded = 0;
+    bool endOfStream = false;       // every selected stream ended
+    bool typeChanged = false;
+    bool stopped = false;           // the consumer asked to stop
+    double seconds = 0;
+};
+
+namespace AsyncReaderDetail
+{
+    class CompletionQueue
+    {
+    public:
+        CompletionQueue(AsyncSampleSource& source, const AsyncReaderOptions& options, AsyncReaderStats& stats)
+            : source(source), options(options), stats(stats)
+        {
+        }
+
+        // Source side: called by the source for every completed read.
+        void Complete(SourceSample& sample)
+        {
+            uint32_t reads;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                completed++;
+                bool last = sample.Failed() || (sample.flags & SourceSampleFlags::TypeChanged) != 0;
+                if ((sample.flags & SourceSampleFlags::EndOfStream) != 0)
+                {
+                    if (sample.streamIndex >= ended.size())
+                    {
+                        ended.resize(sample.streamIndex + 1, false);
+                    }
+                    if (!ended[sample.streamIndex])
+                    {
+                        ended[sample.streamIndex] = true;
+                        stats.streamsEnded++;
+                    }
+                    last = last || stats.streamsEnded >= options.streams;
+                }
+                if (last)
+                {
+                    // The consumer stops when it gets here.
+                    finished = true;
+                }
+                queue.push_back({ std::move(sample), last });
+                if (queue.size() > stats.maxQueued)
+                {
+                    stats.maxQueued = (uint32_t)queue.size();
+                }
+                reads = Reserve();
+                if (reads == 0 && !finished && issued - consumed >= options.MaxOutstanding())
+                {
+                    stats.sourceStalls++;
+                }
+            }
+            ready.notify_one();
+            Issue(reads);
+        }
+
+        // Consumer side: starts the first reads.
+        void Start()
+        {
+            uint32_t reads;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                reads = Reserve();
+            }
+            Issue(reads);
+        }
+
+        // Consumer side: blocks until the next sample has completed. True
+        // for the completion that ends the read.
+        bool Pop(SourceSample& sample)
+        {
+            bool last;
+            uint32_t reads;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (queue.empty())
+                {
+                    stats.consumerWaits++;
+                    auto start = std::chrono::steady_clock::now();
+                    ready.wait(lock, [&] { return !queue.empty(); });
+                    stats.consumerWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+                sample = std::move(queue.front().sample);
+                last = queue.front().last;
+                queue.pop_front();
+                consumed++;
+                reads = Reserve();
+            }
+            Issue(reads);
+            return last;
+        }
+
+        // Consumer side: no further reads are started.
+        void Stop()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+
+    private:
+        // Number of reads to start now, counted as issued. Called locked;
+        // the reads themselves are started unlocked, since a source may
+        // complete one before RequestSample returns.
+        uint32_t Reserve()
+        {
+            uint32_t reads = 0;
+            while (!finished && issued - completed < options.readsInFlight && issued - consumed < options.MaxOutstanding())
+            {
+                issued++;
+                reads++;
+            }
+            stats.requests += reads;
+            if (issued - completed > stats.maxInFlight)
+            {
+                stats.maxInFlight = (uint32_t)(issued - completed);
+            }
+            return reads;
+        }
+
+        void Issue(uint32_t reads)
+        {
+            for (uint32_t i = 0; i < reads; i++)
+            {
+                auto status = source.RequestSample();
+                if (status < 0)
+                {
+                    // Queued as a failed completion, so the consumer sees it in order.
+                    SourceSample failed;
+                    failed.status = status;
+                    Complete(failed);
+                }
+            }
+        }
+
+        struct Completed
+        {
+            SourceSample sample;
+            bool last;
+        };
+
+        AsyncSampleSource& source;
+        const AsyncReaderOptions options;
+        AsyncReaderStats& stats;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Completed> queue;
+        std::vector<bool> ended;        // by stream index
+        uint64_t issued = 0;
+        uint64_t completed = 0;
+        uint64_t consumed = 0;
+        bool finished = false;
+    };
+}
+
+// Reads samples until every selected stream has ended, a read fails, a
+// media type changes, or consume(const SourceSample&) returns false, e.g.
+// once a range is written. Ticks are counted and not passed on.
+template <class Consume>
+AsyncReaderStats ReadSamplesAsync(AsyncSampleSource& source, Consume&& consume, const AsyncReaderOptions& options = {})
+{
+    AsyncReaderStats stats;
+    auto start = std::chrono::steady_clock::now();
+    AsyncReaderOptions bounded = options;
+    bounded.readsInFlight = bounded.readsInFlight != 0 ? bounded.readsInFlight : 1;
+    AsyncReaderDetail::CompletionQueue queue{ source, bounded, stats };
+    source.SetCompletion([&](SourceSample& sample) { queue.Complete(sample); });
+    queue.Start();
+
+    SourceSample sample;
+    while (true)
+    {
+        bool last = queue.Pop(sample);
+        if (sample.Failed())
+        {
+            stats.status = sample.status;
+            break;
+        }
+        if ((sample.flags & SourceSampleFlags::TypeChanged) != 0)
+        {
+            stats.typeChanged = true;
+            break;
+        }
+        if ((sample.flags & SourceSampleFlags::EndOfStream) != 0)
+        {
+            if (last)
+            {
+                stats.endOfStream = true;
+                break;
+            }
+            // One of several streams ended; the others go on.
+            sample = SourceSample();
+            continue;
+        }
+        if ((sample.flags & SourceSampleFlags::StreamTick) != 0)
+        {
+            stats.ticks++;
+        }
+        if (sample.bufferCount != 0)
+        {
+            stats.samples++;
+            stats.bytes += sample.size;
+            stats.gatheredSamples += sample.bufferCount > 1 ? 1 : 0;
+            if (sample.copied)
+            {
+                stats.contiguousCopies++;
+                stats.copiedBytes += sample.size;
+            }
+            if (!consume(static_cast<const SourceSample&>(sample)))
+            {
+                stats.stopped = true;
+                break;
+            }
+        }
+        sample = SourceSample();
+    }
+
+    // Reads still in flight would complete into a queue that is going away.
+    queue.Stop();
+    source.CancelPending();
+    source.SetCompletion(nullptr);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Writes a sample held in several buffers as if it were one contiguous
+// buffer: each buffer goes down the sink chain in place, with its position
+// (see WriteDecoded). A frame split across two buffers is reassembled in
+// staging, which holds a single frame and is reused from call to call.
+template <class Sink>
+void WriteGathered(Sink& sink, const PcmSpan* buffers, uint32_t count, size_t frameBytes, int64_t sampleTime,
+    std::vector<uint8_t>& staging)
+{
+    if (staging.size() < frameBytes)
+    {
+        staging.resize(frameBytes);
+    }
+    auto advance = [&](uint64_t frames)
+    {
+        if (sampleTime >= 0)
+        {
+            sampleTime += (int64_t)frames;
+        }
+    };
+    size_t staged = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto bytes = buffers[i].data;
+        auto size = buffers[i].size;
+        if (staged != 0)
+        {
+            auto take = frameBytes - staged < size ? frameBytes - staged : size;
+            memcpy(staging.data() + staged, bytes, take);
+            staged += take;
+            bytes += take;
+            size -= take;
+            if (staged < frameBytes)
+            {
+                continue;
+            }
+            WriteDecoded(sink, staging.data(), frameBytes, sampleTime, 1);
+            advance(1);
+            staged = 0;
+        }
+        auto frames = size / frameBytes;
+        if (frames != 0)
+        {
+            WriteDecoded(sink, bytes, frames * frameBytes, sampleTime, (uint32_t)frames);
+            advance(frames);
+        }
+        staged = size - frames * frameBytes;
+        memcpy(staging.data(), bytes + frames * frameBytes, staged);
+    }
+}
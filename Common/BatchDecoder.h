@@ -0,0 +1,456 @@
+#pragma once
+// File-level decoding and the batch engine built on it.
+//
+// DecodeFile runs one WAV-wrapped bitstream, or a time range of it, through
+// a DecoderTransform into a WAVE file. DecodeBatch spreads a manifest of (input, output) pairs over
+// a WorkStealingPool; every worker creates its own decoder on first use and
+// reuses it, flushed, for every file it picks up, or leases a decoder for
+// each file's format from a DecoderPool.
+//
+// Manifest format: one job per line, input and output path separated by a
+// tab. Blank lines and lines starting with '#' are ignored.
+#include "BitstreamSource.h"
+#include "BufferPool.h"
+#include "ChannelMixer.h"
+#include "DecodePipeline.h"
+#include "DecoderPool.h"
+#include "FileIO.h"
+#include "FrameIndex.h"
+#include "FrameIndexFile.h"
+#include "ParallelDecoder.h"
+#include "PcmConverter.h"
+#include "PipelinedDecoder.h"
+#include "PlanarPcm.h"
+#include "SampleClock.h"
+#include "WaveFileWriter.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// How far input page release trails the decoder. A few MiB covers the units
+// the decoder still holds, so they are not faulted back in from the file,
+// while keeping the resident part of the mapping close to what the copy path
+// keeps in its buffers.
+#define DDPIN_RELEASE_WINDOW (4ull << 20)
+
+// Access units decoded ahead of a seek target to warm the decoder up.
+#define DDPIN_PREROLL_UNITS 1
+
+struct BatchJob
+{
+    std::string input;
+    std::string output;
+    uint64_t inputBytes = 0;
+};
+
+struct BatchFileResult
+{
+    BatchJob job;
+    DecodeStats stats;
+    PcmWriterStats writerStats;
+    TimelineStats timeline;
+    uint32_t sampleRate = 0;
+    unsigned worker = 0;
+    double setupSeconds = 0;        // decoder creation, or getting one from the pool
+    bool reusedDecoder = false;     // the decoder had decoded an earlier file
+    bool ok = false;
+
+    double AudioSeconds() const { return sampleRate != 0 ? stats.outputSamples / (double)sampleRate : 0; }
+    double RealtimeFactor() const { return stats.RealtimeFactor(sampleRate); }
+};
+
+struct BatchResult
+{
+    std::vector<BatchFileResult> files;
+    double seconds = 0;
+    uint64_t steals = 0;
+    unsigned workers = 0;
+
+    double AudioSeconds() const
+    {
+        double total = 0;
+        for (const auto& file : files)
+        {
+            total += file.AudioSeconds();
+        }
+        return total;
+    }
+
+    // Aggregate real-time factor: audio decoded per wall-clock second.
+    double RealtimeFactor() const { return seconds > 0 ? AudioSeconds() / seconds : 0; }
+
+    size_t Failures() const
+    {
+        return (size_t)std::count_if(files.begin(), files.end(), [](const BatchFileResult& file) { return !file.ok; });
+    }
+};
+
+inline bool LoadBatchManifest(const char* path, std::vector<BatchJob>& jobs)
+{
+    FILE* file = OpenFile(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string line;
+    auto addLine = [&]()
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        auto tab = line.find('\t');
+        if (!line.empty() && line[0] != '#' && tab != std::string::npos && tab > 0 && tab + 1 < line.size())
+        {
+            BatchJob job;
+            job.input = line.substr(0, tab);
+            job.output = line.substr(tab + 1);
+            jobs.push_back(std::move(job));
+        }
+        line.clear();
+    };
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        if (c == '\n')
+        {
+            addLine();
+        }
+        else
+        {
+            line.push_back((char)c);
+        }
+    }
+    addLine();
+    fclose(file);
+    return true;
+}
+
+inline uint64_t FileSize64(const char* path)
+{
+    FILE* file = OpenFile(path, "rb");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+    uint64_t size = SeekFileEnd64(file) ? TellFile64(file) : 0;
+    fclose(file);
+    return size;
+}
+
+// Orders jobs largest input first, so one long file does not end up running
+// alone at the end of a batch.
+inline void SortLargestFirst(std::vector<BatchJob>& jobs)
+{
+    for (auto& job : jobs)
+    {
+        job.inputBytes = FileSize64(job.input.c_str());
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.inputBytes > b.inputBytes; });
+}
+
+struct DecodeFileOptions
+{
+    // Sample format written to the file; the decoder's float output is
+    // converted (see PcmConverter) unless this matches it.
+    PcmSampleType outputType = PcmSampleType::Float32;
+    bool dither = true;         // TPDF dither when converting to integers
+
+    // Downmix or channel reorder applied before conversion (see ChannelMixer).
+    MixOptions mix;
+
+    // One mono file per channel instead of one interleaved file; the target
+    // path becomes the base name (out.wav -> out.FL.wav, out.FR.wav, ...).
+    bool planar = false;
+
+    // Continuity checking of decoded timestamps, with optional repair.
+    TimelineOptions timeline;
+
+    // Decode only [startSeconds, endSeconds); endSeconds <= 0 means to the
+    // end. Decoding starts on the sync frame before the range, found in a
+    // frame index, and the output is cut to the exact sample.
+    double startSeconds = 0;
+    double endSeconds = 0;
+
+    // Keep the frame index in a sidecar next to the source (see
+    // FrameIndexFile.h): loaded when current, otherwise built and saved,
+    // also on full decodes so that later range decodes start instantly.
+    bool indexFile = false;
+
+    // Input granularity of the serial decode loop (see DecodeLoopOptions);
+    // unitsPerPull 1 is the low-latency mode for live monitoring.
+    DecodeLoopOptions loop;
+
+    // Record first-output and per-unit latency into DecodeFileStats::latency
+    // (serial decode only).
+    bool measureLatency = false;
+
+    // When set, the read, decode and write stages run on separate threads
+    // (see PipelinedDecodeStream); otherwise everything runs on the calling
+    // thread, which is what batch workers want.
+    const PipelineOptions* pipeline = nullptr;
+
+    // When set, the stream is cut into chunks decoded on a pool of decoder
+    // instances (see ParallelDecodeStream); takes precedence over pipeline.
+    const ParallelDecodeOptions* parallel = nullptr;
+};
+
+struct DecodeFileStats
+{
+    DecodeStats decode;
+    PcmWriterStats writer;
+    PipelineStats pipeline;
+    ParallelDecodeStats parallel;
+    TimelineStats timeline;
+    DecodeLatencyStats latency;     // with DecodeFileOptions::measureLatency
+    SeekPlan range;                 // what a time range decode fed the decoder
+    double indexSeconds = 0;        // time spent getting the frame index
+    bool indexLoaded = false;       // from the sidecar rather than a scan
+};
+
+// Decodes one file. outputPool must hold buffers of at least
+// decoder.MaxOutputBytes().
+inline bool DecodeFile(const char* sourceFile, const char* targetFile, DecoderTransform& decoder, BufferPool& outputPool,
+    DecodeFileStats& stats, const DecodeFileOptions& options = DecodeFileOptions())
+{
+    MappedBitstreamSource bitStream;
+    if (!bitStream.Open(sourceFile))
+    {
+        return false;
+    }
+    auto decodedFormat = decoder.OutputFormat();
+
+    auto& plan = stats.range;
+    plan = SeekPlan();
+    plan.endOffset = bitStream.Size();
+    plan.endSample = INT64_MAX;
+    bool ranged = options.startSeconds > 0 || options.endSeconds > 0;
+    stats.indexLoaded = false;
+    FrameIndex index;
+    if (ranged || options.indexFile || options.parallel != nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto toSamples = [&](double seconds) { return (int64_t)std::llround(seconds * decodedFormat.sampleRate); };
+        bool indexed = options.indexFile
+            ? LoadOrBuildFrameIndex(index, sourceFile, bitStream.Data(), bitStream.Size(), stats.indexLoaded)
+            : index.Build(bitStream.Data(), bitStream.Size());
+        bool planned = indexed
+            && (!ranged || index.Plan(toSamples(options.startSeconds), toSamples(options.endSeconds), DDPIN_PREROLL_UNITS, plan));
+        stats.indexSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!planned)
+        {
+            return false;
+        }
+    }
+    DdpFrameSplitter splitter{ bitStream.Data(), plan.endOffset };
+    splitter.Seek(plan.beginOffset);
+
+    auto fileFormat = decodedFormat;
+    std::unique_ptr<ChannelMixer> mixer;
+    if (decodedFormat.sampleType == PcmSampleType::Float32)
+    {
+        fileFormat.sampleType = options.outputType;
+        if (options.mix.preset != MixPreset::None)
+        {
+            mixer.reset(new ChannelMixer(BuildMixMatrix(decodedFormat.channelMask, decodedFormat.channels, options.mix)));
+            if (mixer->Outputs() == 0)
+            {
+                return false;
+            }
+            fileFormat.channels = mixer->Outputs();
+            fileFormat.channelMask = mixer->Matrix().outputMask;
+        }
+    }
+    auto releaseConsumed = [&](uint64_t position)
+    {
+        if (position > DDPIN_RELEASE_WINDOW)
+        {
+            bitStream.ReleaseConsumed(position - DDPIN_RELEASE_WINDOW);
+        }
+    };
+    // Decoded buffers are cut to the range, then checked for continuity
+    // ahead of any mixing, so filled silence goes through the same mix and
+    // conversion.
+    auto decode = [&](auto& output)
+    {
+        using Timeline = TimelineSink<std::remove_reference_t<decltype(output)>>;
+        Timeline timeline{ output, decodedFormat.BlockAlign(), options.timeline };
+        RangeSink<Timeline> sink{ timeline, decodedFormat.BlockAlign(), plan.startSample, plan.endSample };
+        bool ok = options.parallel != nullptr
+            ? ParallelDecodeStream(bitStream.Data(), index, plan.startSample, plan.endSample, decodedFormat.BlockAlign(), sink,
+                stats.decode, *options.parallel, &stats.parallel, bitStream.Owner())
+            : options.pipeline != nullptr
+            ? PipelinedDecodeStream(splitter, decoder, outputPool, sink, stats.decode, bitStream.Owner(), releaseConsumed,
+                *options.pipeline, &stats.pipeline, plan.firstSample)
+            : DecodeStream(splitter, decoder, outputPool, sink, stats.decode, bitStream.Owner(), releaseConsumed, plan.firstSample,
+                options.loop, options.measureLatency ? &stats.latency : nullptr);
+        stats.timeline = timeline.Stats();
+        return ok;
+    };
+
+    if (options.planar)
+    {
+        PlanarWaveWriter writer;
+        if (decodedFormat.sampleType != PcmSampleType::Float32 || !writer.Open(targetFile, fileFormat, options.dither))
+        {
+            return false;
+        }
+        MixingSink<PlanarWaveWriter> sink{ writer, mixer.get() };
+        bool ok = decode(sink);
+        writer.Close();
+        stats.writer = writer.GetStats();
+        return ok && !writer.Failed();
+    }
+
+    PcmConverter converter{ fileFormat.sampleType, options.dither };
+    WaveFileWriter writer;
+    if (!writer.Open(targetFile, fileFormat))
+    {
+        return false;
+    }
+    ConvertingSink<WaveFileWriter> converting{ writer, converter };
+    MixingSink<ConvertingSink<WaveFileWriter>> sink{ converting, mixer.get() };
+    bool ok = decode(sink);
+    writer.Close();
+    stats.writer = writer.GetStats();
+    return ok && !writer.Failed();
+}
+
+// Decodes every job on the pool, largest first, and waits for all of them.
+inline BatchResult DecodeBatch(std::vector<BatchJob> jobs, WorkStealingPool& pool, const DecoderFactory& createDecoder,
+    const DecodeFileOptions& options = DecodeFileOptions())
+{
+    auto start = std::chrono::steady_clock::now();
+    auto stealsBefore = pool.Steals();
+    SortLargestFirst(jobs);
+
+    struct Worker
+    {
+        std::unique_ptr<DecoderTransform> decoder;
+        std::unique_ptr<BufferPool> outputPool;
+    };
+    std::vector<Worker> workers(pool.Size());
+
+    BatchResult result;
+    result.workers = pool.Size();
+    result.files.resize(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        result.files[i].job = jobs[i];
+        pool.Submit([&, i](unsigned index)
+        {
+            auto& worker = workers[index];
+            auto& file = result.files[i];
+            file.worker = index;
+            if (worker.decoder == nullptr)
+            {
+                auto setupStart = std::chrono::steady_clock::now();
+                worker.decoder = createDecoder();
+                file.setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+                if (worker.decoder == nullptr)
+                {
+                    return;
+                }
+                worker.outputPool.reset(new BufferPool(worker.decoder->MaxOutputBytes(), 1));
+                worker.outputPool->Reserve(1);
+            }
+            else
+            {
+                worker.decoder->Flush();
+                file.reusedDecoder = true;
+            }
+            file.sampleRate = worker.decoder->OutputFormat().sampleRate;
+            DecodeFileStats fileStats;
+            file.ok = DecodeFile(file.job.input.c_str(), file.job.output.c_str(), *worker.decoder, *worker.outputPool,
+                fileStats, options);
+            file.stats = fileStats.decode;
+            file.writerStats = fileStats.writer;
+            file.timeline = fileStats.timeline;
+        });
+    }
+    pool.Wait();
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.steals = pool.Steals() - stealsBefore;
+    return result;
+}
+
+// Reads the format of the stream in a WAV-wrapped bitstream file.
+inline bool ProbeStreamSignature(const char* sourceFile, StreamSignature& signature)
+{
+    MappedBitstreamSource probe;
+    return probe.Open(sourceFile) && ReadStreamSignature(probe.Data(), probe.Size(), signature);
+}
+
+// As above, but each file leases a decoder made for its own format from
+// decoders and hands it back, reset, when done; decoders outlive the batch.
+inline BatchResult DecodeBatch(std::vector<BatchJob> jobs, WorkStealingPool& pool, DecoderPool& decoders,
+    const DecodeFileOptions& options = DecodeFileOptions())
+{
+    auto start = std::chrono::steady_clock::now();
+    auto stealsBefore = pool.Steals();
+    SortLargestFirst(jobs);
+
+    struct Worker
+    {
+        std::unique_ptr<BufferPool> outputPool;
+        size_t bufferBytes = 0;
+    };
+    std::vector<Worker> workers(pool.Size());
+
+    BatchResult result;
+    result.workers = pool.Size();
+    result.files.resize(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        result.files[i].job = jobs[i];
+        pool.Submit([&, i](unsigned index)
+        {
+            auto& worker = workers[index];
+            auto& file = result.files[i];
+            file.worker = index;
+            StreamSignature signature;
+            if (!ProbeStreamSignature(file.job.input.c_str(), signature))
+            {
+                return;
+            }
+            DecoderSetupStats setup;
+            auto decoder = decoders.Acquire(signature, &setup);
+            file.setupSeconds = setup.seconds;
+            file.reusedDecoder = setup.cached;
+            if (!decoder)
+            {
+                return;
+            }
+            if (worker.bufferBytes < decoder->MaxOutputBytes())
+            {
+                worker.bufferBytes = decoder->MaxOutputBytes();
+                worker.outputPool.reset(new BufferPool(worker.bufferBytes, 1));
+                worker.outputPool->Reserve(1);
+            }
+            file.sampleRate = decoder->OutputFormat().sampleRate;
+            DecodeFileStats fileStats;
+            file.ok = DecodeFile(file.job.input.c_str(), file.job.output.c_str(), *decoder, *worker.outputPool,
+                fileStats, options);
+            file.stats = fileStats.decode;
+            file.writerStats = fileStats.writer;
+            file.timeline = fileStats.timeline;
+            if (!file.ok)
+            {
+                // Whatever went wrong may have left the decoder in a bad state.
+                decoder.Discard();
+            }
+        });
+    }
+    pool.Wait();
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.steals = pool.Steals() - stealsBefore;
+    return result;
+}
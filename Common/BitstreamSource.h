@@ -0,0 +1,106 @@
+#pragma once
+// Zero-copy bitstream source: locates the data chunk with RiffReader, maps
+// the file read-only and serves slices that point straight into the mapping.
+#include "MappedFile.h"
+#include "RiffReader.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// A non-owning view of bitstream bytes.
+struct BitstreamSlice
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+class MappedBitstreamSource
+{
+public:
+    bool Open(const char* path)
+    {
+        Close();
+        {
+            RiffReader riff;
+            if (!riff.Open(path))
+            {
+                return false;
+            }
+            dataOffset = riff.DataOffset();
+            dataSize = riff.DataSize();
+        }
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(path) || dataOffset + dataSize > file->Size())
+        {
+            return false;
+        }
+        mapping = file;
+        return true;
+    }
+
+    void Close()
+    {
+        mapping.reset();
+        dataOffset = 0;
+        dataSize = 0;
+        position = 0;
+        released = 0;
+    }
+
+    // Returns the next slice of at most maxSize bytes; an empty slice at the end.
+    BitstreamSlice Next(size_t maxSize)
+    {
+        auto slice = Peek(maxSize);
+        position += slice.size;
+        return slice;
+    }
+
+    BitstreamSlice Peek(size_t maxSize) const
+    {
+        BitstreamSlice slice;
+        auto remaining = Remaining();
+        slice.size = (size_t)(remaining < maxSize ? remaining : maxSize);
+        slice.data = slice.size != 0 ? Data() + position : nullptr;
+        return slice;
+    }
+
+    bool Seek(uint64_t newPosition)
+    {
+        if (newPosition > dataSize)
+        {
+            return false;
+        }
+        position = newPosition;
+        return true;
+    }
+
+    // Lets the OS reclaim pages the decoder has finished with, so resident
+    // memory stays bounded on multi-GB inputs. Works in 1 MiB steps; partial
+    // pages at the edges of a step simply stay resident.
+    void ReleaseConsumed(uint64_t consumed)
+    {
+        const uint64_t granularity = 1 << 20;
+        if (mapping && consumed >= released + granularity)
+        {
+            mapping->Release(dataOffset + released, consumed - released);
+            released = consumed;
+        }
+    }
+
+    // Whole data chunk; empty when nothing is mapped.
+    const uint8_t* Data() const { return mapping ? mapping->Data() + dataOffset : nullptr; }
+    uint64_t Size() const { return dataSize; }
+    uint64_t Position() const { return position; }
+    uint64_t Remaining() const { return dataSize - position; }
+
+    // Keeps the mapping alive for consumers that outlive the source (e.g. an
+    // IMFMediaBuffer still referenced by the decoder).
+    std::shared_ptr<const void> Owner() const { return mapping; }
+
+private:
+    std::shared_ptr<MappedFile> mapping;
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    uint64_t position = 0;
+    uint64_t released = 0;
+};
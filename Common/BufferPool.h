@@ -0,0 +1,181 @@
+#pragma once
+// Fixed-capacity pool of aligned, equally sized buffers.
+//
+// Buffers are allocated lazily the first time the pool runs dry, up to the
+// capacity, and are never freed until the pool is destroyed. Returned
+// buffers go on a lock-free free list (a Treiber stack whose head carries a
+// tag to rule out ABA), so once the pipeline has warmed up Acquire/Release
+// never touch the heap. The counters make that checkable.
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+class BufferPool
+{
+public:
+    struct Counters
+    {
+        uint64_t heapAllocations = 0;   // buffers created so far (never exceeds capacity)
+        uint64_t acquires = 0;
+        uint64_t releases = 0;
+        uint64_t exhausted = 0;         // Acquire calls that found every buffer in use
+    };
+
+    BufferPool(size_t bufferSize, uint32_t capacity, size_t alignment = 64)
+        : bufferSize(bufferSize), capacity(capacity), alignment(alignment),
+          slots(new std::atomic<uint8_t*>[capacity]), next(new std::atomic<uint32_t>[capacity])
+    {
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+            next[i].store(EmptyIndex, std::memory_order_relaxed);
+        }
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool()
+    {
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            auto buffer = slots[i].load(std::memory_order_relaxed);
+            if (buffer != nullptr)
+            {
+                ::operator delete(buffer - HeaderSize(), std::align_val_t(alignment));
+            }
+        }
+    }
+
+    // Returns a buffer of BufferSize() bytes, or nullptr if all are in use.
+    uint8_t* Acquire()
+    {
+        acquires.fetch_add(1, std::memory_order_relaxed);
+        uint32_t index = Pop();
+        if (index != EmptyIndex)
+        {
+            return slots[index].load(std::memory_order_acquire);
+        }
+
+        index = created.load(std::memory_order_relaxed);
+        if (index >= capacity)
+        {
+            exhausted.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        auto block = (uint8_t*)::operator new(HeaderSize() + bufferSize, std::align_val_t(alignment), std::nothrow);
+        if (block == nullptr)
+        {
+            exhausted.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        // The slot is claimed only once the buffer exists: a slot index is
+        // never handed back, so a failed allocation cannot leave one that a
+        // later Acquire would reuse while it is taken.
+        while (!created.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+        {
+            if (index >= capacity)
+            {
+                ::operator delete(block, std::align_val_t(alignment));
+                exhausted.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        // The slot index lives just in front of the buffer so Release is O(1).
+        *(uint32_t*)block = index;
+        auto buffer = block + HeaderSize();
+        slots[index].store(buffer, std::memory_order_release);
+        return buffer;
+    }
+
+    // Creates buffers up front so the first frames do not pay for them.
+    void Reserve(uint32_t count)
+    {
+        std::unique_ptr<uint8_t*[]> held(new uint8_t*[count]);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            held[i] = Acquire();
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Release(held[i]);
+        }
+    }
+
+    void Release(uint8_t* buffer)
+    {
+        if (buffer == nullptr)
+        {
+            return;
+        }
+        releases.fetch_add(1, std::memory_order_relaxed);
+        Push(*(const uint32_t*)(buffer - HeaderSize()));
+    }
+
+    size_t BufferSize() const { return bufferSize; }
+    uint32_t Capacity() const { return capacity; }
+
+    Counters GetCounters() const
+    {
+        Counters counters;
+        counters.heapAllocations = heapAllocations.load(std::memory_order_relaxed);
+        counters.acquires = acquires.load(std::memory_order_relaxed);
+        counters.releases = releases.load(std::memory_order_relaxed);
+        counters.exhausted = exhausted.load(std::memory_order_relaxed);
+        return counters;
+    }
+
+private:
+    static const uint32_t EmptyIndex = 0xFFFFFFFF;
+
+    size_t HeaderSize() const
+    {
+        return alignment > sizeof(uint32_t) ? alignment : sizeof(uint32_t);
+    }
+
+    // head = (tag << 32) | index; the tag changes on every push so a stale
+    // compare-exchange after a pop/push/pop sequence fails.
+    void Push(uint32_t index)
+    {
+        auto head = freeHead.load(std::memory_order_relaxed);
+        uint64_t desired;
+        do
+        {
+            next[index].store((uint32_t)head, std::memory_order_relaxed);
+            desired = ((head >> 32) + 1) << 32 | index;
+        } while (!freeHead.compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t Pop()
+    {
+        auto head = freeHead.load(std::memory_order_acquire);
+        while (true)
+        {
+            auto index = (uint32_t)head;
+            if (index == EmptyIndex)
+            {
+                return EmptyIndex;
+            }
+            uint64_t desired = (head & 0xFFFFFFFF00000000ull) | next[index].load(std::memory_order_relaxed);
+            if (freeHead.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return index;
+            }
+        }
+    }
+
+    const size_t bufferSize;
+    const uint32_t capacity;
+    const size_t alignment;
+    std::unique_ptr<std::atomic<uint8_t*>[]> slots;
+    std::unique_ptr<std::atomic<uint32_t>[]> next;
+    std::atomic<uint64_t> freeHead{ EmptyIndex };
+    std::atomic<uint32_t> created{ 0 };
+    std::atomic<uint64_t> heapAllocations{ 0 };
+    std::atomic<uint64_t> acquires{ 0 };
+    std::atomic<uint64_t> releases{ 0 };
+    std::atomic<uint64_t> exhausted{ 0 };
+};
@@ -0,0 +1,290 @@
+#pragma once
+// Output writer that coalesces decoded PCM into large aligned blocks.
+//
+// Every Write() is a memcpy into the current block; only full blocks reach
+// the OS, as one unbuffered fwrite each. With writeBehind enabled, full
+// blocks are handed to a background thread and the decoder keeps filling
+// the next one (double buffering by default), so it only waits on the disk
+// when the disk is slower than the decoder for a whole block.
+#include "FileIO.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+struct PcmWriterOptions
+{
+    size_t blockSize = 4 << 20;
+    uint32_t blockCount = 2;    // blocks in flight when writeBehind is on
+    bool writeBehind = true;
+};
+
+struct PcmWriterStats
+{
+    uint64_t bytes = 0;         // bytes handed to Write()
+    uint64_t syscalls = 0;      // write calls issued to the OS
+    uint64_t stalls = 0;        // times Write() had to wait for a free block
+    double seconds = 0;         // wall time since Open()
+
+    double BytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+    double SyscallsPerSecond() const { return seconds > 0 ? syscalls / seconds : 0; }
+};
+
+class BufferedPcmWriter
+{
+public:
+    using Options = PcmWriterOptions;
+    using Stats = PcmWriterStats;
+
+    BufferedPcmWriter() = default;
+    template <class Char>
+    BufferedPcmWriter(const Char* path, const Options& options = Options())
+    {
+        Open(path, options);
+    }
+    BufferedPcmWriter(const BufferedPcmWriter&) = delete;
+    BufferedPcmWriter& operator=(const BufferedPcmWriter&) = delete;
+    ~BufferedPcmWriter()
+    {
+        Close();
+    }
+
+    bool Open(const char* path, const Options& newOptions = Options())
+    {
+        Close();
+        return Attach(OpenFile(path, "wb"), newOptions);
+    }
+
+#ifdef _WIN32
+    bool Open(const wchar_t* path, const Options& newOptions = Options())
+    {
+        Close();
+        return Attach(OpenFile(path, L"wb"), newOptions);
+    }
+#endif
+
+    // Without an open file (Open failed or was never called) nothing is
+    // written and the writer reports Failed().
+    void Write(const void* buffer, size_t size)
+    {
+        if (file == nullptr)
+        {
+            failed = true;
+            return;
+        }
+        auto bytes = (const uint8_t*)buffer;
+        stats.bytes += size;
+        while (size > 0)
+        {
+            auto& block = blocks[current];
+            auto space = options.blockSize - block.size;
+            auto chunk = size < space ? size : space;
+            memcpy(block.data + block.size, bytes, chunk);
+            block.size += chunk;
+            bytes += chunk;
+            size -= chunk;
+            if (block.size == options.blockSize)
+            {
+                SubmitCurrent();
+            }
+        }
+    }
+
+    // Pushes everything written so far to the file.
+    void Flush()
+    {
+        if (file == nullptr)
+        {
+            return;
+        }
+        if (blocks[current].size != 0)
+        {
+            SubmitCurrent();
+        }
+        if (options.writeBehind)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this]() { return queue.empty() && !writing; });
+        }
+        fflush(file);
+    }
+
+    void Close()
+    {
+        if (file == nullptr)
+        {
+            return;
+        }
+        Flush();
+        if (flushThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            flushThread.join();
+        }
+        UpdateElapsed();
+        fclose(file);
+        file = nullptr;
+        for (auto& block : blocks)
+        {
+            ::operator delete(block.data, std::align_val_t(BlockAlignment));
+        }
+        blocks.clear();
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+    bool Failed() const { return failed; }
+
+    Stats GetStats()
+    {
+        UpdateElapsed();
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+protected:
+    // Underlying stream, for subclasses that need to seek (e.g. to patch a
+    // header). Only valid after Flush().
+    FILE* File() const { return file; }
+
+private:
+    static const size_t BlockAlignment = 4096;
+
+    struct Block
+    {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        bool queued = false;
+    };
+
+    bool Attach(FILE* newFile, const Options& newOptions)
+    {
+        options = newOptions;
+        if (options.blockSize == 0)
+        {
+            options.blockSize = 4 << 20;
+        }
+        if (options.blockCount < 2)
+        {
+            options.blockCount = 2;
+        }
+        file = newFile;
+        if (file == nullptr)
+        {
+            return false;
+        }
+        // Blocks are already large; a second stdio buffer would only add a copy.
+        setvbuf(file, nullptr, _IONBF, 0);
+
+        auto count = options.writeBehind ? options.blockCount : 1;
+        blocks.resize(count);
+        for (auto& block : blocks)
+        {
+            block.data = (uint8_t*)::operator new(options.blockSize, std::align_val_t(BlockAlignment));
+            block.size = 0;
+            block.queued = false;
+        }
+        current = 0;
+        stats = Stats();
+        failed = false;
+        started = std::chrono::steady_clock::now();
+        if (options.writeBehind)
+        {
+            stopping = false;
+            flushThread = std::thread([this]() { FlushLoop(); });
+        }
+        return true;
+    }
+
+    void UpdateElapsed()
+    {
+        if (file != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        }
+    }
+
+    void WriteBlock(Block& block)
+    {
+        if (block.size != 0 && fwrite(block.data, 1, block.size, file) != block.size)
+        {
+            failed = true;
+        }
+        block.size = 0;
+    }
+
+    void SubmitCurrent()
+    {
+        if (!options.writeBehind)
+        {
+            WriteBlock(blocks[current]);
+            stats.syscalls++;
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks[current].queued = true;
+            queue.push_back(current);
+        }
+        wake.notify_one();
+
+        current = (current + 1) % (uint32_t)blocks.size();
+        std::unique_lock<std::mutex> lock(mutex);
+        if (blocks[current].queued)
+        {
+            stats.stalls++;
+            idle.wait(lock, [this]() { return !blocks[current].queued; });
+        }
+    }
+
+    void FlushLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty())
+            {
+                return;
+            }
+            auto index = queue.front();
+            queue.erase(queue.begin());
+            writing = true;
+            lock.unlock();
+
+            WriteBlock(blocks[index]);
+
+            lock.lock();
+            stats.syscalls++;
+            blocks[index].queued = false;
+            writing = false;
+            idle.notify_all();
+        }
+    }
+
+    Options options;
+    FILE* file = nullptr;
+    std::vector<Block> blocks;
+    uint32_t current = 0;
+    Stats stats;
+    std::atomic<bool> failed{ false };
+    std::chrono::steady_clock::time_point started;
+
+    std::thread flushThread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::vector<uint32_t> queue;
+    bool writing = false;
+    bool stopping = false;
+};
@@ -0,0 +1,622 @@
+#pragma once
+// Channel matrix mixing for interleaved float PCM: downmix (LoRo, LtRt),
+// reorder and LFE handling, all expressed as an outputs x inputs gain
+// matrix built from the decoder's WAVEFORMATEXTENSIBLE channel mask.
+//
+// ChannelMixer picks a kernel once per matrix: pure reorders are copied
+// (AVX2 lane permute for up to 8 channels), 6->2, 8->2 and 6->6 matrices get
+// kernels specialized at compile time (AVX2/SSE2/scalar), anything else
+// the generic loop. Every kernel accumulates inputs in channel order from
+// zero without fused multiply-add, so all of them agree bit for bit.
+#include "CpuFeatures.h"
+#include "PcmFormat.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ksmedia.h SPEAKER_* bits.
+#define SPEAKER_BIT_FL 0x1
+#define SPEAKER_BIT_FR 0x2
+#define SPEAKER_BIT_FC 0x4
+#define SPEAKER_BIT_LFE 0x8
+#define SPEAKER_BIT_BL 0x10
+#define SPEAKER_BIT_BR 0x20
+#define SPEAKER_BIT_FLC 0x40
+#define SPEAKER_BIT_FRC 0x80
+#define SPEAKER_BIT_BC 0x100
+#define SPEAKER_BIT_SL 0x200
+#define SPEAKER_BIT_SR 0x400
+
+enum class MixPreset
+{
+    None,
+    LoRo,       // stereo, surrounds folded into their own side
+    LtRt,       // matrix-surround stereo, surround sum in antiphase
+    Reorder,    // pick and reorder channels (MixOptions::order)
+};
+
+struct MixOptions
+{
+    MixPreset preset = MixPreset::None;
+    float lfeGain = 0.0f;           // LoRo/LtRt: LFE is dropped unless given a gain
+    bool normalize = true;          // LoRo/LtRt: scale so no output can exceed full scale
+    std::vector<uint32_t> order;    // Reorder: one SPEAKER_BIT_* per output channel
+};
+
+struct MixMatrix
+{
+    uint16_t inputs = 0;
+    uint16_t outputs = 0;
+    uint32_t outputMask = 0;        // 0 when the output order is not WAVE (mask bit) order
+    std::vector<float> gains;       // outputs x inputs, row-major
+
+    float& At(uint16_t output, uint16_t input) { return gains[(size_t)output * inputs + input]; }
+    float At(uint16_t output, uint16_t input) const { return gains[(size_t)output * inputs + input]; }
+};
+
+// Index of the speaker's channel in a mask-ordered interleave, or -1.
+inline int SpeakerIndex(uint32_t mask, uint32_t speaker)
+{
+    if ((mask & speaker) == 0)
+    {
+        return -1;
+    }
+    int index = 0;
+    for (uint32_t bit = 1; bit < speaker; bit <<= 1)
+    {
+        index += (mask & bit) != 0 ? 1 : 0;
+    }
+    return index;
+}
+
+inline bool ParseMixPreset(const char* name, MixPreset& preset)
+{
+    if (strcmp(name, "loro") == 0)
+    {
+        preset = MixPreset::LoRo;
+    }
+    else if (strcmp(name, "ltrt") == 0)
+    {
+        preset = MixPreset::LtRt;
+    }
+    else if (strcmp(name, "none") == 0)
+    {
+        preset = MixPreset::None;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+struct SpeakerNameEntry
+{
+    const char* name;
+    uint32_t bit;
+};
+
+inline const SpeakerNameEntry* SpeakerNames(size_t& count)
+{
+    static const SpeakerNameEntry names[] = {
+        { "FL", SPEAKER_BIT_FL }, { "FR", SPEAKER_BIT_FR }, { "FC", SPEAKER_BIT_FC }, { "LFE", SPEAKER_BIT_LFE },
+        { "BL", SPEAKER_BIT_BL }, { "BR", SPEAKER_BIT_BR }, { "FLC", SPEAKER_BIT_FLC }, { "FRC", SPEAKER_BIT_FRC },
+        { "BC", SPEAKER_BIT_BC }, { "SL", SPEAKER_BIT_SL }, { "SR", SPEAKER_BIT_SR },
+    };
+    count = sizeof(names) / sizeof(names[0]);
+    return names;
+}
+
+// Short name of one SPEAKER_BIT_*, or nullptr for bits without one.
+inline const char* SpeakerName(uint32_t speaker)
+{
+    size_t count = 0;
+    auto names = SpeakerNames(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (names[i].bit == speaker)
+        {
+            return names[i].name;
+        }
+    }
+    return nullptr;
+}
+
+// "FL,FR,FC,LFE,BL,BR" -> SPEAKER_BIT_* list.
+inline bool ParseSpeakerOrder(const char* text, std::vector<uint32_t>& order)
+{
+    size_t count = 0;
+    auto names = SpeakerNames(count);
+    order.clear();
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        auto end = list.find(',', start);
+        auto name = list.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        bool found = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (name == names[i].name)
+            {
+                order.push_back(names[i].bit);
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    return !order.empty();
+}
+
+// Builds the matrix for the preset. inputMask 0 means the default layout
+// for inputChannels. Preset None gives an identity matrix.
+inline MixMatrix BuildMixMatrix(uint32_t inputMask, uint16_t inputChannels, const MixOptions& options)
+{
+    if (inputMask == 0)
+    {
+        inputMask = DefaultChannelMask(inputChannels);
+    }
+    MixMatrix matrix;
+    matrix.inputs = inputChannels;
+
+    if (options.preset == MixPreset::Reorder)
+    {
+        matrix.outputs = (uint16_t)options.order.size();
+        matrix.gains.assign((size_t)matrix.outputs * matrix.inputs, 0.0f);
+        bool ascending = true;
+        uint32_t previous = 0;
+        for (uint16_t output = 0; output < matrix.outputs; output++)
+        {
+            auto speaker = options.order[output];
+            auto input = SpeakerIndex(inputMask, speaker);
+            if (input >= 0 && input < inputChannels)
+            {
+                matrix.At(output, (uint16_t)input) = 1.0f;
+            }
+            ascending = ascending && speaker > previous;
+            previous = speaker;
+            matrix.outputMask |= speaker;
+        }
+        if (!ascending)
+        {
+            matrix.outputMask = 0;
+        }
+        return matrix;
+    }
+
+    if (options.preset == MixPreset::None)
+    {
+        matrix.outputs = inputChannels;
+        matrix.outputMask = inputMask;
+        matrix.gains.assign((size_t)matrix.outputs * matrix.inputs, 0.0f);
+        for (uint16_t channel = 0; channel < inputChannels; channel++)
+        {
+            matrix.At(channel, channel) = 1.0f;
+        }
+        return matrix;
+    }
+
+    matrix.outputs = 2;
+    matrix.outputMask = SPEAKER_BIT_FL | SPEAKER_BIT_FR;
+    matrix.gains.assign((size_t)matrix.outputs * matrix.inputs, 0.0f);
+    const float minus3dB = 0.70710678f;
+    bool sides = (inputMask & (SPEAKER_BIT_SL | SPEAKER_BIT_SR)) != 0;
+    bool backs = (inputMask & (SPEAKER_BIT_BL | SPEAKER_BIT_BR | SPEAKER_BIT_BC)) != 0;
+    // With both side and back pairs each pair gets half the power.
+    float surround = sides && backs ? 0.5f : minus3dB;
+    bool ltrt = options.preset == MixPreset::LtRt;
+
+    uint16_t input = 0;
+    for (uint32_t bit = 1; bit != 0 && input < inputChannels; bit <<= 1)
+    {
+        if ((inputMask & bit) == 0)
+        {
+            continue;
+        }
+        float left = 0, right = 0;
+        switch (bit)
+        {
+        case SPEAKER_BIT_FL:
+            left = 1;
+            break;
+        case SPEAKER_BIT_FR:
+            right = 1;
+            break;
+        case SPEAKER_BIT_FC:
+            left = right = minus3dB;
+            break;
+        case SPEAKER_BIT_LFE:
+            left = right = options.lfeGain;
+            break;
+        case SPEAKER_BIT_FLC:
+            left = 1;
+            break;
+        case SPEAKER_BIT_FRC:
+            right = 1;
+            break;
+        case SPEAKER_BIT_BL:
+        case SPEAKER_BIT_SL:
+            left = ltrt ? -surround : surround;
+            right = ltrt ? surround : 0;
+            break;
+        case SPEAKER_BIT_BR:
+        case SPEAKER_BIT_SR:
+            left = ltrt ? -surround : 0;
+            right = surround;
+            break;
+        case SPEAKER_BIT_BC:
+            left = ltrt ? -surround : surround * minus3dB;
+            right = ltrt ? surround : surround * minus3dB;
+            break;
+        default:
+            // Height and other channels: centre-style fold.
+            left = right = 0.5f;
+            break;
+        }
+        matrix.At(0, input) = left;
+        matrix.At(1, input) = right;
+        input++;
+    }
+
+    if (options.normalize)
+    {
+        float peak = 0;
+        for (uint16_t output = 0; output < matrix.outputs; output++)
+        {
+            float sum = 0;
+            for (uint16_t i = 0; i < matrix.inputs; i++)
+            {
+                sum += std::fabs(matrix.At(output, i));
+            }
+            peak = sum > peak ? sum : peak;
+        }
+        if (peak > 1)
+        {
+            for (auto& gain : matrix.gains)
+            {
+                gain /= peak;
+            }
+        }
+    }
+    return matrix;
+}
+
+class ChannelMixer
+{
+public:
+    explicit ChannelMixer(const MixMatrix& matrix, SimdLevel level = SimdLevel::Avx2) : matrix(matrix)
+    {
+        level = ClampSimdLevel(level);
+        memset(columns, 0, sizeof(columns));
+        for (uint16_t input = 0; input < matrix.inputs && input < MaxFixedChannels; input++)
+        {
+            for (uint16_t output = 0; output < matrix.outputs && output < MaxFixedChannels; output++)
+            {
+                columns[input][output] = matrix.At(output, input);
+            }
+        }
+        ChooseKernel(level);
+    }
+
+    uint16_t Inputs() const { return matrix.inputs; }
+    uint16_t Outputs() const { return matrix.outputs; }
+    const MixMatrix& Matrix() const { return matrix; }
+    const char* KernelName() const { return kernelName; }
+
+    // in holds frames x Inputs() floats, out frames x Outputs().
+    void Mix(const float* in, size_t frames, float* out) const
+    {
+        kernel(*this, in, frames, out);
+    }
+
+private:
+    static const uint16_t MaxFixedChannels = 8;
+    using Kernel = void (*)(const ChannelMixer& mixer, const float* in, size_t frames, float* out);
+
+    void ChooseKernel(SimdLevel level)
+    {
+        auto in = matrix.inputs;
+        auto out = matrix.outputs;
+        if (IsSelection())
+        {
+#ifdef SIMD_X86
+            if (level == SimdLevel::Avx2 && in <= 8 && out <= 8)
+            {
+                Use(&ChannelMixer::SelectAvx2, "select-avx2");
+                return;
+            }
+#endif
+            Use(&ChannelMixer::SelectScalar, "select-scalar");
+            return;
+        }
+        if (in == 6 && out == 2)
+        {
+            UseFixed<6, 2>(level);
+        }
+        else if (in == 8 && out == 2)
+        {
+            UseFixed<8, 2>(level);
+        }
+        else if (in == 6 && out == 6)
+        {
+            UseFixed<6, 6>(level);
+        }
+        else
+        {
+            Use(&ChannelMixer::MixGeneric, "generic-scalar");
+        }
+    }
+
+    void Use(Kernel chosen, const char* name)
+    {
+        kernel = chosen;
+        kernelName = name;
+    }
+
+    template <int In, int Out>
+    void UseFixed(SimdLevel level)
+    {
+#ifdef SIMD_X86
+        if (level == SimdLevel::Avx2)
+        {
+            if (Out == 2)
+            {
+                Use(&ChannelMixer::MixPairsAvx2<In>, In == 6 ? "6to2-avx2" : "8to2-avx2");
+            }
+            else
+            {
+                Use(&ChannelMixer::MixColumnsAvx2<In, Out>, "6to6-avx2");
+            }
+            return;
+        }
+        if (level == SimdLevel::Sse2)
+        {
+            Use(&ChannelMixer::MixColumnsSse2<In, Out>, In == 6 && Out == 2 ? "6to2-sse2" : In == 8 ? "8to2-sse2" : "6to6-sse2");
+            return;
+        }
+#endif
+        Use(&ChannelMixer::MixFixed<In, Out>, In == 6 && Out == 2 ? "6to2-scalar" : In == 8 ? "8to2-scalar" : "6to6-scalar");
+    }
+
+    // Every output is one input at unity gain, or silent.
+    bool IsSelection()
+    {
+        selection.assign(matrix.outputs, -1);
+        for (uint16_t output = 0; output < matrix.outputs; output++)
+        {
+            for (uint16_t input = 0; input < matrix.inputs; input++)
+            {
+                auto gain = matrix.At(output, input);
+                if (gain == 0.0f)
+                {
+                    continue;
+                }
+                if (gain != 1.0f || selection[output] != -1)
+                {
+                    return false;
+                }
+                selection[output] = input;
+            }
+        }
+        return true;
+    }
+
+    static void MixGeneric(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        auto inputs = mixer.matrix.inputs;
+        auto outputs = mixer.matrix.outputs;
+        auto gains = mixer.matrix.gains.data();
+        for (size_t frame = 0; frame < frames; frame++, in += inputs, out += outputs)
+        {
+            for (uint16_t output = 0; output < outputs; output++)
+            {
+                float sum = 0;
+                for (uint16_t input = 0; input < inputs; input++)
+                {
+                    sum = sum + gains[(size_t)output * inputs + input] * in[input];
+                }
+                out[output] = sum;
+            }
+        }
+    }
+
+    template <int In, int Out>
+    static void MixFixed(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        for (size_t frame = 0; frame < frames; frame++, in += In, out += Out)
+        {
+            for (int output = 0; output < Out; output++)
+            {
+                float sum = 0;
+                for (int input = 0; input < In; input++)
+                {
+                    sum = sum + mixer.columns[input][output] * in[input];
+                }
+                out[output] = sum;
+            }
+        }
+    }
+
+    static void SelectScalar(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        auto inputs = mixer.matrix.inputs;
+        auto outputs = mixer.matrix.outputs;
+        const int* selection = mixer.selection.data();
+        for (size_t frame = 0; frame < frames; frame++, in += inputs, out += outputs)
+        {
+            for (uint16_t output = 0; output < outputs; output++)
+            {
+                out[output] = selection[output] >= 0 ? in[selection[output]] : 0.0f;
+            }
+        }
+    }
+
+#ifdef SIMD_X86
+    // Up to 4 outputs per register: out = sum over inputs of in[i] * column[i].
+    template <int In, int Out>
+    SIMD_TARGET_SSE2 static void MixColumnsSse2(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        static_assert(Out <= 8, "two registers at most");
+        __m128 low[In], high[In];
+        for (int input = 0; input < In; input++)
+        {
+            low[input] = _mm_loadu_ps(&mixer.columns[input][0]);
+            high[input] = _mm_loadu_ps(&mixer.columns[input][4]);
+        }
+        for (size_t frame = 0; frame < frames; frame++, in += In, out += Out)
+        {
+            auto sumLow = _mm_setzero_ps();
+            auto sumHigh = _mm_setzero_ps();
+            for (int input = 0; input < In; input++)
+            {
+                auto sample = _mm_set1_ps(in[input]);
+                sumLow = _mm_add_ps(sumLow, _mm_mul_ps(low[input], sample));
+                if (Out > 4)
+                {
+                    sumHigh = _mm_add_ps(sumHigh, _mm_mul_ps(high[input], sample));
+                }
+            }
+            if (Out == 2)
+            {
+                _mm_storel_pi((__m64*)out, sumLow);
+            }
+            else
+            {
+                _mm_storeu_ps(out, sumLow);
+                if (Out == 6)
+                {
+                    _mm_storel_pi((__m64*)(out + 4), sumHigh);
+                }
+                else if (Out == 8)
+                {
+                    _mm_storeu_ps(out + 4, sumHigh);
+                }
+            }
+        }
+    }
+
+    // Up to 8 outputs in one register.
+    template <int In, int Out>
+    SIMD_TARGET_AVX2 static void MixColumnsAvx2(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        __m256 column[In];
+        for (int input = 0; input < In; input++)
+        {
+            column[input] = _mm256_loadu_ps(mixer.columns[input]);
+        }
+        auto mask = _mm256_setr_epi32(Out > 0 ? -1 : 0, Out > 1 ? -1 : 0, Out > 2 ? -1 : 0, Out > 3 ? -1 : 0,
+            Out > 4 ? -1 : 0, Out > 5 ? -1 : 0, Out > 6 ? -1 : 0, Out > 7 ? -1 : 0);
+        for (size_t frame = 0; frame < frames; frame++, in += In, out += Out)
+        {
+            auto sum = _mm256_setzero_ps();
+            for (int input = 0; input < In; input++)
+            {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(column[input], _mm256_broadcast_ss(in + input)));
+            }
+            _mm256_maskstore_ps(out, mask, sum);
+        }
+    }
+
+    // Stereo output, four frames per register: lanes are L0 R0 L1 R1 ...
+    template <int In>
+    SIMD_TARGET_AVX2 static void MixPairsAvx2(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        __m256 gains[In];
+        for (int input = 0; input < In; input++)
+        {
+            auto left = mixer.columns[input][0];
+            auto right = mixer.columns[input][1];
+            gains[input] = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+        }
+        auto offsets = _mm256_setr_epi32(0, 0, In, In, 2 * In, 2 * In, 3 * In, 3 * In);
+        size_t frame = 0;
+        for (; frame + 4 <= frames; frame += 4, in += 4 * In, out += 8)
+        {
+            auto sum = _mm256_setzero_ps();
+            for (int input = 0; input < In; input++)
+            {
+                auto samples = _mm256_i32gather_ps(in + input, offsets, 4);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(gains[input], samples));
+            }
+            _mm256_storeu_ps(out, sum);
+        }
+        MixFixed<In, 2>(mixer, in, frames - frame, out);
+    }
+
+    SIMD_TARGET_AVX2 static void SelectAvx2(const ChannelMixer& mixer, const float* in, size_t frames, float* out)
+    {
+        auto inputs = mixer.matrix.inputs;
+        auto outputs = mixer.matrix.outputs;
+        alignas(32) int32_t indices[8] = {};
+        alignas(32) int32_t keep[8] = {};
+        alignas(32) int32_t store[8] = {};
+        for (uint16_t output = 0; output < outputs; output++)
+        {
+            indices[output] = mixer.selection[output] >= 0 ? mixer.selection[output] : 0;
+            keep[output] = mixer.selection[output] >= 0 ? -1 : 0;
+            store[output] = -1;
+        }
+        auto permute = _mm256_load_si256((const __m256i*)indices);
+        auto keepMask = _mm256_castsi256_ps(_mm256_load_si256((const __m256i*)keep));
+        auto storeMask = _mm256_load_si256((const __m256i*)store);
+        // Each frame loads 8 floats, which may run into the next frames; the
+        // last few frames, where that would pass the end, go scalar.
+        size_t frame = 0;
+        for (; frame * inputs + 8 <= frames * inputs; frame++, in += inputs, out += outputs)
+        {
+            auto samples = _mm256_permutevar8x32_ps(_mm256_loadu_ps(in), permute);
+            _mm256_maskstore_ps(out, storeMask, _mm256_and_ps(samples, keepMask));
+        }
+        SelectScalar(mixer, in, frames - frame, out);
+    }
+#endif
+
+    MixMatrix matrix;
+    alignas(32) float columns[MaxFixedChannels][MaxFixedChannels];    // columns[input][output]
+    std::vector<int> selection;     // selection kernels: input per output, -1 for silence
+    Kernel kernel = nullptr;
+    const char* kernelName = "";
+};
+
+// Sink adapter: mixes each float buffer and writes the result to the
+// wrapped sink. A null mixer passes buffers through.
+template <class Sink>
+class MixingSink
+{
+public:
+    MixingSink(Sink& sink, const ChannelMixer* mixer) : sink(sink), mixer(mixer) {}
+
+    void Write(const void* buffer, size_t size)
+    {
+        if (mixer == nullptr)
+        {
+            sink.Write(buffer, size);
+            return;
+        }
+        auto frames = size / (sizeof(float) * mixer->Inputs());
+        auto samples = frames * mixer->Outputs();
+        if (scratch.size() < samples)
+        {
+            scratch.resize(samples);
+        }
+        mixer->Mix((const float*)buffer, frames, scratch.data());
+        sink.Write(scratch.data(), samples * sizeof(float));
+    }
+
+private:
+    Sink& sink;
+    const ChannelMixer* mixer;
+    std::vector<float> scratch;
+};
@@ -0,0 +1,72 @@
+#pragma once
+// Runtime CPU feature detection for the SIMD kernels (PcmConverter,
+// ChannelMixer). Kernels are compiled with per-function target attributes
+// (GCC/Clang) or plain intrinsics (MSVC), so the binary runs on any x86-64
+// CPU and picks the widest supported kernel when it starts converting.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+inline const char* SimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Avx2:
+        return "avx2";
+    case SimdLevel::Sse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+inline SimdLevel DetectSimdLevel()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (osAvx && maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return avx2 ? SimdLevel::Avx2 : sse2 ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#elif defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdLevel::Avx2;
+    }
+    return __builtin_cpu_supports("sse2") ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// The widest supported level not above requested; detection runs once.
+inline SimdLevel ClampSimdLevel(SimdLevel requested)
+{
+    static const SimdLevel supported = DetectSimdLevel();
+    return (int)requested < (int)supported ? requested : supported;
+}
@@ -0,0 +1,258 @@
+#pragma once
+// AC-3 / E-AC-3 (Dolby Digital / Dolby Digital Plus) sync-frame parser.
+//
+// Finds the 0x0B77 syncword, decodes enough of the BSI to know the frame
+// size and audio layout, and groups frames into access units: an
+// independent frame followed by every frame up to the next independent
+// substream 0 (its dependent substreams and any extra programs). Each
+// access unit is what a decoder input sample should contain.
+#include "BitstreamSource.h"
+#include <cstdint>
+#include <cstddef>
+
+struct DdpFrameHeader
+{
+    bool isEac3 = false;
+    uint8_t bsid = 0;
+    uint8_t strmtyp = 0;        // 0 independent, 1 dependent, 2 AC-3 convert (E-AC-3 only)
+    uint8_t substreamid = 0;
+    uint8_t fscod = 0;
+    uint8_t numblkscod = 3;     // 0..3 -> 1, 2, 3, 6 audio blocks
+    uint8_t acmod = 0;
+    uint8_t lfeon = 0;
+    uint32_t frameSize = 0;     // bytes, including the syncword
+    uint32_t sampleRate = 0;
+    uint32_t samplesPerFrame = 0;
+    uint16_t channels = 0;
+
+    bool IsIndependent() const { return !isEac3 || strmtyp != 1; }
+};
+
+struct DdpAccessUnit
+{
+    BitstreamSlice slice;       // independent frame + dependent frames
+    uint64_t offset = 0;        // byte offset of the slice in the stream
+    DdpFrameHeader header;      // header of the leading independent frame
+    uint32_t frameCount = 0;
+};
+
+class DdpBitReader
+{
+public:
+    DdpBitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    uint32_t Read(int bits)
+    {
+        uint32_t value = 0;
+        while (bits-- > 0)
+        {
+            uint32_t bit = 0;
+            if ((position >> 3) < size)
+            {
+                bit = (data[position >> 3] >> (7 - (position & 7))) & 1;
+            }
+            value = (value << 1) | bit;
+            position++;
+        }
+        return value;
+    }
+
+    void Skip(int bits) { position += bits; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position = 0;
+};
+
+// Minimum bytes needed to parse any supported header.
+#define DDP_HEADER_BYTES 8
+#define DDP_SYNCWORD 0x0B77
+
+inline uint16_t DdpChannelCount(uint8_t acmod, uint8_t lfeon)
+{
+    static const uint8_t fullBandChannels[8] = { 2, 1, 2, 3, 3, 4, 4, 5 };
+    return (uint16_t)(fullBandChannels[acmod & 7] + lfeon);
+}
+
+// AC-3 frame size in 16-bit words, indexed by [frmsizecod >> 1][fscod].
+inline uint32_t Ac3FrameWords(uint8_t frmsizecod, uint8_t fscod)
+{
+    static const uint16_t words[19][3] =
+    {
+        { 64, 69, 96 }, { 80, 87, 120 }, { 96, 104, 144 }, { 112, 121, 168 },
+        { 128, 139, 192 }, { 160, 174, 240 }, { 192, 208, 288 }, { 224, 243, 336 },
+        { 256, 278, 384 }, { 320, 348, 480 }, { 384, 417, 576 }, { 448, 487, 672 },
+        { 512, 557, 768 }, { 640, 696, 960 }, { 768, 835, 1152 }, { 896, 975, 1344 },
+        { 1024, 1114, 1536 }, { 1152, 1253, 1728 }, { 1280, 1393, 1920 },
+    };
+    if (frmsizecod >= 38 || fscod >= 3)
+    {
+        return 0;
+    }
+    auto count = words[frmsizecod >> 1][fscod];
+    // 44.1 kHz frames alternate between two sizes to hit the exact bitrate.
+    return fscod == 1 ? count + (frmsizecod & 1) : count;
+}
+
+// Parses the header at data[0]; returns false if it is not a valid sync frame.
+inline bool ParseDdpFrameHeader(const uint8_t* data, size_t size, DdpFrameHeader& header)
+{
+    if (size < DDP_HEADER_BYTES || data[0] != (DDP_SYNCWORD >> 8) || data[1] != (DDP_SYNCWORD & 0xFF))
+    {
+        return false;
+    }
+
+    // bsid sits at the same bit position (40) in both syntaxes.
+    auto bsid = (uint8_t)(data[5] >> 3);
+    header = DdpFrameHeader();
+    header.bsid = bsid;
+    DdpBitReader bits(data, size);
+    bits.Skip(16);
+
+    if (bsid <= 10)
+    {
+        static const uint32_t sampleRates[3] = { 48000, 44100, 32000 };
+        bits.Skip(16);  // crc1
+        header.fscod = (uint8_t)bits.Read(2);
+        auto frmsizecod = (uint8_t)bits.Read(6);
+        bits.Skip(5 + 3);  // bsid, bsmod
+        header.acmod = (uint8_t)bits.Read(3);
+        if ((header.acmod & 1) && header.acmod != 1)
+        {
+            bits.Skip(2);  // cmixlev
+        }
+        if (header.acmod & 4)
+        {
+            bits.Skip(2);  // surmixlev
+        }
+        if (header.acmod == 2)
+        {
+            bits.Skip(2);  // dsurmod
+        }
+        header.lfeon = (uint8_t)bits.Read(1);
+        if (header.fscod == 3)
+        {
+            return false;
+        }
+        header.frameSize = Ac3FrameWords(frmsizecod, header.fscod) * 2;
+        header.sampleRate = sampleRates[header.fscod];
+        header.numblkscod = 3;
+    }
+    else if (bsid <= 16)
+    {
+        static const uint32_t sampleRates[3] = { 48000, 44100, 32000 };
+        static const uint32_t halfSampleRates[3] = { 24000, 22050, 16000 };
+        header.isEac3 = true;
+        header.strmtyp = (uint8_t)bits.Read(2);
+        header.substreamid = (uint8_t)bits.Read(3);
+        header.frameSize = (bits.Read(11) + 1) * 2;
+        header.fscod = (uint8_t)bits.Read(2);
+        if (header.fscod == 3)
+        {
+            auto fscod2 = bits.Read(2);
+            if (fscod2 == 3)
+            {
+                return false;
+            }
+            header.sampleRate = halfSampleRates[fscod2];
+            header.numblkscod = 3;
+        }
+        else
+        {
+            header.sampleRate = sampleRates[header.fscod];
+            header.numblkscod = (uint8_t)bits.Read(2);
+        }
+        header.acmod = (uint8_t)bits.Read(3);
+        header.lfeon = (uint8_t)bits.Read(1);
+        if (header.strmtyp == 3)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    static const uint32_t blocks[4] = { 1, 2, 3, 6 };
+    header.samplesPerFrame = blocks[header.numblkscod] * 256;
+    header.channels = DdpChannelCount(header.acmod, header.lfeon);
+    return header.frameSize >= DDP_HEADER_BYTES;
+}
+
+// Splits an in-memory (typically memory-mapped) bitstream into access units.
+// Garbage between frames is skipped by resyncing on the next syncword whose
+// header parses; the number of skipped bytes is reported.
+class DdpFrameSplitter
+{
+public:
+    DdpFrameSplitter(const uint8_t* data, uint64_t size) : data(data), size(size) {}
+
+    bool Next(DdpAccessUnit& unit)
+    {
+        DdpFrameHeader header;
+        if (!FindFrame(header))
+        {
+            return false;
+        }
+        unit.offset = position;
+        unit.header = header;
+        unit.frameCount = 1;
+        auto end = position + header.frameSize;
+
+        // Pull in everything up to the next independent substream 0.
+        DdpFrameHeader next;
+        while (end < size && ParseDdpFrameHeader(data + end, Available(end), next)
+            && !(next.IsIndependent() && next.substreamid == 0)
+            && end + next.frameSize <= size)
+        {
+            end += next.frameSize;
+            unit.frameCount++;
+        }
+
+        unit.slice.data = data + position;
+        unit.slice.size = (size_t)(end - position);
+        position = end;
+        frames += unit.frameCount;
+        return true;
+    }
+
+    // Moves to an arbitrary byte offset; the next call resyncs from there.
+    void Seek(uint64_t offset) { position = offset < size ? offset : size; }
+
+    uint64_t Position() const { return position; }
+    uint64_t FrameCount() const { return frames; }
+    uint64_t SkippedBytes() const { return skipped; }
+
+private:
+    size_t Available(uint64_t offset) const
+    {
+        auto remaining = size - offset;
+        return remaining < 64 ? (size_t)remaining : 64;
+    }
+
+    bool FindFrame(DdpFrameHeader& header)
+    {
+        while (position + DDP_HEADER_BYTES <= size)
+        {
+            if (ParseDdpFrameHeader(data + position, Available(position), header)
+                && header.IsIndependent()
+                && position + header.frameSize <= size)
+            {
+                return true;
+            }
+            position++;
+            skipped++;
+        }
+        skipped += size - position;
+        position = size;
+        return false;
+    }
+
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t position = 0;
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+};
@@ -0,0 +1,370 @@
+#pragma once
+// Process-wide decode metrics: event counters, per-stage timers in CPU
+// ticks and a tally of failed HRESULTs, for a JSON dump at the end of a
+// job.
+//
+// Every thread counts into its own block, found through a thread_local
+// pointer, so the hot path is a plain load, add and store with no lock and
+// no shared cache line. Blocks are linked into a lock-free list on first
+// use and outlive their threads, so a snapshot (TakeMetricsSnapshot) sums
+// every thread that ever counted. Stage timers read the time stamp counter
+// where there is one; ticks are converted to seconds in the snapshot.
+//
+// Instrumentation goes through the DDP_COUNT / DDP_TIMED / DDP_COUNT_HRESULT
+// macros. Defining DDP_NO_METRICS (e.g. for release builds) compiles them
+// to nothing; the snapshot and dump functions remain and report
+// "enabled": false.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DDP_METRICS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DDP_METRICS_RDTSC 1
+#endif
+
+enum class DecodeCounter
+{
+    InputUnits,
+    InputFrames,
+    InputBytes,
+    OutputBuffers,
+    OutputSamples,
+    OutputBytes,
+    NotAccepting,       // ProcessInput refusals (MF_E_NOTACCEPTING)
+    NeedMoreInput,      // ProcessOutput with nothing to give (MF_E_TRANSFORM_NEED_MORE_INPUT)
+    DecodeErrors,       // DecodeResult::Error from any decoder call
+    Count,
+};
+
+enum class DecodeStage
+{
+    Split,              // finding the next access unit
+    ProcessInput,
+    ProcessOutput,
+    Drain,
+    Write,              // handing decoded PCM to the sink
+    Count,
+};
+
+inline const char* DecodeCounterName(DecodeCounter counter)
+{
+    static const char* const names[] = { "input_units", "input_frames", "input_bytes", "output_buffers", "output_samples",
+        "output_bytes", "not_accepting", "need_more_input", "decode_errors" };
+    return names[(int)counter];
+}
+
+inline const char* DecodeStageName(DecodeStage stage)
+{
+    static const char* const names[] = { "split", "process_input", "process_output", "drain", "write" };
+    return names[(int)stage];
+}
+
+inline uint64_t MetricsTicks()
+{
+#ifdef DDP_METRICS_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct MetricsSnapshot
+{
+    bool enabled = false;
+    unsigned threads = 0;                           // threads that counted anything
+    uint64_t counters[(int)DecodeCounter::Count] = {};
+    uint64_t stageCalls[(int)DecodeStage::Count] = {};
+    uint64_t stageTicks[(int)DecodeStage::Count] = {};
+    double ticksPerSecond = 1e9;
+    std::vector<std::pair<int32_t, uint64_t>> hresults;    // failed code, times seen
+    uint64_t otherHresults = 0;                     // codes beyond the per-thread table
+
+    uint64_t Counter(DecodeCounter counter) const { return counters[(int)counter]; }
+    uint64_t StageCalls(DecodeStage stage) const { return stageCalls[(int)stage]; }
+    double StageSeconds(DecodeStage stage) const { return stageTicks[(int)stage] / ticksPerSecond; }
+
+    std::string ToJson() const
+    {
+        std::string json;
+        char text[128];
+        snprintf(text, sizeof(text), "{\"enabled\":%s,\"threads\":%u,\"ticks_per_second\":%.0f,\"counters\":{",
+            enabled ? "true" : "false", threads, ticksPerSecond);
+        json += text;
+        for (int i = 0; i < (int)DecodeCounter::Count; i++)
+        {
+            snprintf(text, sizeof(text), "%s\"%s\":%llu", i == 0 ? "" : ",", DecodeCounterName((DecodeCounter)i),
+                (unsigned long long)counters[i]);
+            json += text;
+        }
+        json += "},\"stages\":{";
+        for (int i = 0; i < (int)DecodeStage::Count; i++)
+        {
+            auto seconds = StageSeconds((DecodeStage)i);
+            snprintf(text, sizeof(text), "%s\"%s\":{\"calls\":%llu,\"ticks\":%llu,\"seconds\":%.6f,\"ns_per_call\":%.1f}",
+                i == 0 ? "" : ",", DecodeStageName((DecodeStage)i), (unsigned long long)stageCalls[i], (unsigned long long)stageTicks[i],
+                seconds, stageCalls[i] != 0 ? seconds * 1e9 / stageCalls[i] : 0.0);
+            json += text;
+        }
+        json += "},\"hresults\":{";
+        for (size_t i = 0; i < hresults.size(); i++)
+        {
+            snprintf(text, sizeof(text), "%s\"0x%08X\":%llu", i == 0 ? "" : ",", (uint32_t)hresults[i].first,
+                (unsigned long long)hresults[i].second);
+            json += text;
+        }
+        snprintf(text, sizeof(text), "},\"other_hresults\":%llu}", (unsigned long long)otherHresults);
+        json += text;
+        return json;
+    }
+};
+
+namespace DecodeMetricsDetail
+{
+    const int HresultSlots = 16;
+
+    // Written only by its own thread; atomics so snapshots may read it
+    // concurrently. Increments are a relaxed load and store, not an
+    // interlocked add, since no other thread writes. Cache-line aligned so
+    // neighbouring blocks never share a line.
+    struct alignas(64) ThreadBlock
+    {
+        std::atomic<uint64_t> counters[(int)DecodeCounter::Count];
+        std::atomic<uint64_t> stageCalls[(int)DecodeStage::Count];
+        std::atomic<uint64_t> stageTicks[(int)DecodeStage::Count];
+        std::atomic<int32_t> hresultCodes[HresultSlots];
+        std::atomic<uint64_t> hresultCounts[HresultSlots];
+        std::atomic<uint64_t> otherHresults;
+        ThreadBlock* next = nullptr;
+
+        ThreadBlock()
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            for (auto& value : counters)
+            {
+                value.store(0, std::memory_order_relaxed);
+            }
+            for (int i = 0; i < (int)DecodeStage::Count; i++)
+            {
+                stageCalls[i].store(0, std::memory_order_relaxed);
+                stageTicks[i].store(0, std::memory_order_relaxed);
+            }
+            for (int i = 0; i < HresultSlots; i++)
+            {
+                hresultCodes[i].store(0, std::memory_order_relaxed);
+                hresultCounts[i].store(0, std::memory_order_relaxed);
+            }
+            otherHresults.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    inline void Bump(std::atomic<uint64_t>& value, uint64_t amount)
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    class Registry
+    {
+    public:
+        static Registry& Instance()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        ThreadBlock* Register()
+        {
+            auto block = new ThreadBlock();
+            block->next = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            return block;
+        }
+
+        ThreadBlock* Head() const { return head.load(std::memory_order_acquire); }
+
+        // Time stamp counter rate, measured against steady_clock since the
+        // registry was created.
+        double TicksPerSecond()
+        {
+#ifdef DDP_METRICS_RDTSC
+            std::chrono::steady_clock::time_point now;
+            uint64_t ticks;
+            do
+            {
+                now = std::chrono::steady_clock::now();
+                ticks = MetricsTicks();
+            } while (now - startTime < std::chrono::milliseconds(10));
+            return (ticks - startTicks) / std::chrono::duration<double>(now - startTime).count();
+#else
+            return 1e9;
+#endif
+        }
+
+        ~Registry()
+        {
+            auto block = head.load();
+            while (block != nullptr)
+            {
+                auto next = block->next;
+                delete block;
+                block = next;
+            }
+        }
+
+    private:
+        Registry() : startTime(std::chrono::steady_clock::now()), startTicks(MetricsTicks()) {}
+
+        std::atomic<ThreadBlock*> head{ nullptr };
+        std::chrono::steady_clock::time_point startTime;
+        uint64_t startTicks;
+    };
+
+    inline ThreadBlock& Local()
+    {
+        thread_local ThreadBlock* block = Registry::Instance().Register();
+        return *block;
+    }
+
+    inline void Count(DecodeCounter counter, uint64_t amount)
+    {
+        Bump(Local().counters[(int)counter], amount);
+    }
+
+    inline void CountHresult(int32_t code)
+    {
+        if (code >= 0)
+        {
+            return;
+        }
+        auto& block = Local();
+        for (int i = 0; i < HresultSlots; i++)
+        {
+            auto slot = block.hresultCodes[i].load(std::memory_order_relaxed);
+            if (slot == 0)
+            {
+                block.hresultCodes[i].store(code, std::memory_order_relaxed);
+                slot = code;
+            }
+            if (slot == code)
+            {
+                Bump(block.hresultCounts[i], 1);
+                return;
+            }
+        }
+        Bump(block.otherHresults, 1);
+    }
+
+    // Adds the ticks from construction to destruction to a stage.
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(DecodeStage stage) : stage(stage), start(MetricsTicks()) {}
+        ~StageTimer()
+        {
+            auto& block = Local();
+            Bump(block.stageTicks[(int)stage], MetricsTicks() - start);
+            Bump(block.stageCalls[(int)stage], 1);
+        }
+
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+    private:
+        DecodeStage stage;
+        uint64_t start;
+    };
+}
+
+#ifdef DDP_NO_METRICS
+#define DDP_COUNT(counter, amount) ((void)0)
+#define DDP_COUNT_HRESULT(hr) ((void)0)
+#define DDP_TIMED(stage, ...) (__VA_ARGS__)
+#else
+// Adds amount to a DecodeCounter.
+#define DDP_COUNT(counter, amount) DecodeMetricsDetail::Count(counter, (uint64_t)(amount))
+// Tallies a failed HRESULT (or any negative status code); successes are ignored.
+#define DDP_COUNT_HRESULT(hr) DecodeMetricsDetail::CountHresult((int32_t)(hr))
+// Evaluates the expression, timing it as the given DecodeStage.
+#define DDP_TIMED(stage, ...) (DecodeMetricsDetail::StageTimer(stage), __VA_ARGS__)
+#endif
+
+// Sums every thread's counters. Safe while other threads count; totals
+// are then a moment's view.
+inline MetricsSnapshot TakeMetricsSnapshot()
+{
+    MetricsSnapshot snapshot;
+#ifndef DDP_NO_METRICS
+    using namespace DecodeMetricsDetail;
+    snapshot.enabled = true;
+    auto& registry = Registry::Instance();
+    snapshot.ticksPerSecond = registry.TicksPerSecond();
+    for (auto block = registry.Head(); block != nullptr; block = block->next)
+    {
+        bool counted = false;
+        auto sum = [&](uint64_t& total, const std::atomic<uint64_t>& value)
+        {
+            auto amount = value.load(std::memory_order_relaxed);
+            total += amount;
+            counted = counted || amount != 0;
+        };
+        for (int i = 0; i < (int)DecodeCounter::Count; i++)
+        {
+            sum(snapshot.counters[i], block->counters[i]);
+        }
+        for (int i = 0; i < (int)DecodeStage::Count; i++)
+        {
+            sum(snapshot.stageCalls[i], block->stageCalls[i]);
+            sum(snapshot.stageTicks[i], block->stageTicks[i]);
+        }
+        for (int i = 0; i < HresultSlots; i++)
+        {
+            auto code = block->hresultCodes[i].load(std::memory_order_relaxed);
+            auto count = block->hresultCounts[i].load(std::memory_order_relaxed);
+            if (code == 0 || count == 0)
+            {
+                continue;
+            }
+            counted = true;
+            bool merged = false;
+            for (auto& entry : snapshot.hresults)
+            {
+                if (entry.first == code)
+                {
+                    entry.second += count;
+                    merged = true;
+                }
+            }
+            if (!merged)
+            {
+                snapshot.hresults.emplace_back(code, count);
+            }
+        }
+        sum(snapshot.otherHresults, block->otherHresults);
+        snapshot.threads += counted ? 1 : 0;
+    }
+#endif
+    return snapshot;
+}
+
+// Zeroes every thread's counters, between jobs. Counts made while this
+// runs may be lost.
+inline void ResetMetrics()
+{
+#ifndef DDP_NO_METRICS
+    for (auto block = DecodeMetricsDetail::Registry::Instance().Head(); block != nullptr; block = block->next)
+    {
+        block->Clear();
+    }
+#endif
+}
@@ -0,0 +1,332 @@
+#pragma once
+// The decode loop shared by every DecoderTransform: feed access units until
+// the decoder refuses input, pull output until it needs more input, repeat;
+// at the end of the stream drain the decoder and pull what is left.
+//
+// RunDecodeLoop is written against two small adapters so the same loop runs
+// serially (DecodeStream) and as the middle stage of PipelinedDecodeStream:
+//   Input:  bool Next(DecoderInput&)    next access unit, false at the end
+//           void Accepted()             the decoder took the last unit
+//   Output: uint8_t* Acquire(size_t&)   buffer for ProcessOutput (kept until committed)
+//           bool Commit(const DecoderOutput&)  hand a filled buffer on
+//           void Finish()               give back a buffer still held
+//
+// By default the loop fills the decoder until it refuses input, which
+// keeps the most work queued and gives the best throughput. For live
+// monitoring DecodeLoopOptions::unitsPerPull bounds how many units go in
+// before output is pulled again (1 alternates input and output per access
+// unit), trading throughput for latency, which DecodeLatencyStats measures.
+#include "BufferPool.h"
+#include "DdpFrameParser.h"
+#include "DecodeMetrics.h"
+#include "DecoderTransform.h"
+#include "LatencyHistogram.h"
+#include "SampleClock.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+
+struct DecodeStats
+{
+    uint64_t inputUnits = 0;
+    uint64_t inputFrames = 0;
+    uint64_t inputBytes = 0;
+    uint64_t notAccepting = 0;      // ProcessInput refusals
+    uint64_t outputBuffers = 0;
+    uint64_t outputSamples = 0;
+    uint64_t outputBytes = 0;
+    double seconds = 0;
+
+    double RealtimeFactor(uint32_t sampleRate) const
+    {
+        return seconds > 0 ? outputSamples / (double)sampleRate / seconds : 0;
+    }
+};
+
+struct DecodeLoopOptions
+{
+    // Access units fed before pulling output; 0 feeds until the decoder
+    // refuses input.
+    uint32_t unitsPerPull = 0;
+};
+
+// Latency of a decode, from the decoding thread's point of view.
+struct DecodeLatencyStats
+{
+    double firstOutputSeconds = -1;     // BeginStreaming to the first decoded buffer
+    LatencyHistogram unitLatency;       // a unit's acceptance to the output that completes it
+    uint32_t maxUnitsInFlight = 0;      // accepted units not yet fully decoded
+
+    std::string ToJson() const
+    {
+        char text[96];
+        snprintf(text, sizeof(text), "{\"first_output_us\":%.3f,\"max_units_in_flight\":%u,\"unit_latency\":",
+            firstOutputSeconds * 1e6, maxUnitsInFlight);
+        return text + unitLatency.ToJson() + "}";
+    }
+};
+
+// Optional per-unit hook, called after each access unit is accepted with the
+// splitter position; DecodeFile uses it to release consumed input pages.
+struct NoInputHook
+{
+    void operator()(uint64_t) const {}
+};
+
+// Input adapter over a DdpFrameSplitter. Stamps each unit with its position
+// on a 64-bit sample clock driven by frame sizes and counts frames into stats.
+template <class InputHook = NoInputHook>
+class SplitterInput
+{
+public:
+    // startSample is the position of the splitter's next unit (after a seek).
+    SplitterInput(DdpFrameSplitter& splitter, DecodeStats& stats, std::shared_ptr<const void> owner = nullptr, InputHook hook = InputHook(),
+        int64_t startSample = 0)
+        : splitter(splitter), stats(stats), owner(std::move(owner)), hook(hook), clock(startSample)
+    {
+    }
+
+    bool Next(DecoderInput& input)
+    {
+        DdpAccessUnit unit;
+        if (!DDP_TIMED(DecodeStage::Split, splitter.Next(unit)))
+        {
+            return false;
+        }
+        input.slice = unit.slice;
+        input.sampleTime = clock.Stamp(unit.header.samplesPerFrame);
+        input.sampleCount = unit.header.samplesPerFrame;
+        input.owner = owner;
+        stats.inputFrames += unit.frameCount;
+        DDP_COUNT(DecodeCounter::InputFrames, unit.frameCount);
+        return true;
+    }
+
+    void Accepted()
+    {
+        hook(splitter.Position());
+    }
+
+private:
+    DdpFrameSplitter& splitter;
+    DecodeStats& stats;
+    std::shared_ptr<const void> owner;
+    InputHook hook;
+    SampleClock clock;
+};
+
+// Output adapter that writes every buffer to the sink on the decoding
+// thread, reusing one pooled buffer.
+template <class Sink>
+class SinkOutput
+{
+public:
+    SinkOutput(BufferPool& pool, Sink& sink) : pool(pool), sink(sink) {}
+
+    uint8_t* Acquire(size_t& capacity)
+    {
+        if (buffer == nullptr)
+        {
+            buffer = pool.Acquire();
+        }
+        capacity = pool.BufferSize();
+        return buffer;
+    }
+
+    bool Commit(const DecoderOutput& output)
+    {
+        DDP_TIMED(DecodeStage::Write, WriteDecoded(sink, output.buffer, output.size, output.sampleTime, output.sampleCount));
+        return true;
+    }
+
+    void Finish()
+    {
+        if (buffer != nullptr)
+        {
+            pool.Release(buffer);
+            buffer = nullptr;
+        }
+    }
+
+private:
+    BufferPool& pool;
+    Sink& sink;
+    uint8_t* buffer = nullptr;
+};
+
+// latency, if given, is filled in as the loop runs.
+template <class Input, class Output>
+bool RunDecodeLoop(Input& input, DecoderTransform& decoder, Output& output, DecodeStats& stats,
+    const DecodeLoopOptions& loop = DecodeLoopOptions(), DecodeLatencyStats* latency = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Units are matched to output by sample count rather than timestamp,
+    // so decoders that stamp nothing are measured too: a unit is done once
+    // the output total reaches the input total at its end.
+    struct InFlight
+    {
+        uint64_t endSample;
+        std::chrono::steady_clock::time_point accepted;
+    };
+    std::deque<InFlight> inFlight;
+    uint64_t acceptedSamples = 0;
+    uint64_t decodedSamples = 0;
+    auto unitAccepted = [&](const DecoderInput& unit)
+    {
+        acceptedSamples += unit.sampleCount;
+        inFlight.push_back({ acceptedSamples, std::chrono::steady_clock::now() });
+        if (inFlight.size() > latency->maxUnitsInFlight)
+        {
+            latency->maxUnitsInFlight = (uint32_t)inFlight.size();
+        }
+    };
+    auto outputCommitted = [&](const DecoderOutput& decoded)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (latency->firstOutputSeconds < 0)
+        {
+            latency->firstOutputSeconds = std::chrono::duration<double>(now - start).count();
+        }
+        decodedSamples += decoded.sampleCount;
+        while (!inFlight.empty() && inFlight.front().endSample <= decodedSamples)
+        {
+            auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(now - inFlight.front().accepted);
+            latency->unitLatency.RecordNanoseconds((uint64_t)waited.count());
+            inFlight.pop_front();
+        }
+    };
+
+    // Pulls output until the decoder needs more input.
+    auto pullOutput = [&](uint64_t& produced) -> bool
+    {
+        produced = 0;
+        while (true)
+        {
+            DecoderOutput decoded;
+            decoded.buffer = output.Acquire(decoded.capacity);
+            if (decoded.buffer == nullptr || decoded.capacity < decoder.MaxOutputBytes())
+            {
+                return false;
+            }
+            auto result = DDP_TIMED(DecodeStage::ProcessOutput, decoder.ProcessOutput(decoded));
+            if (result == DecodeResult::NeedMoreInput)
+            {
+                DDP_COUNT(DecodeCounter::NeedMoreInput, 1);
+                return true;
+            }
+            if (result != DecodeResult::Ok)
+            {
+                DDP_COUNT(DecodeCounter::DecodeErrors, 1);
+                return false;
+            }
+            if (!output.Commit(decoded))
+            {
+                return false;
+            }
+            if (latency != nullptr)
+            {
+                outputCommitted(decoded);
+            }
+            stats.outputBuffers++;
+            stats.outputSamples += decoded.sampleCount;
+            stats.outputBytes += decoded.size;
+            DDP_COUNT(DecodeCounter::OutputBuffers, 1);
+            DDP_COUNT(DecodeCounter::OutputSamples, decoded.sampleCount);
+            DDP_COUNT(DecodeCounter::OutputBytes, decoded.size);
+            produced++;
+        }
+    };
+
+    bool ok = decoder.BeginStreaming() == DecodeResult::Ok;
+    // A unit refused with NotAccepting is kept and offered again after the
+    // output has been pulled.
+    DecoderInput pending;
+    bool hasPending = false;
+    bool endOfInput = false;
+    uint32_t idleRefusals = 0;
+    const uint32_t MaxIdleRefusals = 16;
+    while (ok && !endOfInput)
+    {
+        bool refused = false;
+        uint32_t fed = 0;
+        while (!refused && (loop.unitsPerPull == 0 || fed < loop.unitsPerPull))
+        {
+            if (!hasPending)
+            {
+                if (!input.Next(pending))
+                {
+                    endOfInput = true;
+                    break;
+                }
+                hasPending = true;
+            }
+            auto result = DDP_TIMED(DecodeStage::ProcessInput, decoder.ProcessInput(pending));
+            if (result == DecodeResult::NotAccepting)
+            {
+                stats.notAccepting++;
+                DDP_COUNT(DecodeCounter::NotAccepting, 1);
+                refused = true;
+            }
+            else if (result == DecodeResult::Ok)
+            {
+                stats.inputUnits++;
+                stats.inputBytes += pending.slice.size;
+                DDP_COUNT(DecodeCounter::InputUnits, 1);
+                DDP_COUNT(DecodeCounter::InputBytes, pending.slice.size);
+                if (latency != nullptr)
+                {
+                    unitAccepted(pending);
+                }
+                hasPending = false;
+                fed++;
+                input.Accepted();
+            }
+            else
+            {
+                DDP_COUNT(DecodeCounter::DecodeErrors, 1);
+                ok = false;
+                break;
+            }
+        }
+
+        uint64_t produced = 0;
+        if (ok && !pullOutput(produced))
+        {
+            ok = false;
+        }
+        // A decoder that keeps refusing input without producing output
+        // would spin forever.
+        idleRefusals = refused && produced == 0 ? idleRefusals + 1 : 0;
+        if (idleRefusals > MaxIdleRefusals)
+        {
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        uint64_t produced = 0;
+        ok = DDP_TIMED(DecodeStage::Drain, decoder.Drain()) == DecodeResult::Ok && pullOutput(produced);
+    }
+    output.Finish();
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+// Serial decode: splitter, decoder and sink all run on the calling thread.
+// The sink needs a Write(const void*, size_t) method (BufferedPcmWriter,
+// WaveFileWriter, ...), or WriteAt to also receive positions. startSample
+// is the stream position of the splitter's next unit when it was seeked.
+template <class Sink, class InputHook = NoInputHook>
+bool DecodeStream(DdpFrameSplitter& splitter, DecoderTransform& decoder, BufferPool& outputPool, Sink& sink,
+    DecodeStats& stats, std::shared_ptr<const void> owner = nullptr, InputHook inputHook = InputHook(), int64_t startSample = 0,
+    const DecodeLoopOptions& loop = DecodeLoopOptions(), DecodeLatencyStats* latency = nullptr)
+{
+    SplitterInput<InputHook> input{ splitter, stats, std::move(owner), inputHook, startSample };
+    SinkOutput<Sink> output{ outputPool, sink };
+    return RunDecodeLoop(input, decoder, output, stats, loop, latency);
+}
@@ -0,0 +1,225 @@
+#pragma once
+// Pool of ready decoder instances, kept per source format.
+//
+// Creating a decoder (activating the MFT, setting its types, allocating its
+// internal buffers) costs more than decoding a short clip. A decoder
+// handed back to the pool is Reset (flushed and taken out of streaming)
+// and handed out again for the next file of the same format, where
+// RunDecodeLoop's BeginStreaming starts it up again. Decoders that fail
+// to reset, or that the user discards after an error, are destroyed
+// rather than reused.
+//
+// Every instance is accounted for: created == destroyed + idle + leased at
+// all times, so a lease that is never returned shows up in Stats() as a
+// leak instead of going unnoticed.
+#include "DecoderTransform.h"
+#include "NegotiationCache.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct DecoderPoolStats
+{
+    uint64_t created = 0;
+    uint64_t reused = 0;            // leases served from an idle decoder
+    uint64_t destroyed = 0;
+    uint64_t resetFailures = 0;     // returned decoders that could not be reset
+    uint64_t discarded = 0;         // returned with Discard()
+    size_t idle = 0;
+    size_t leased = 0;
+    double createSeconds = 0;       // total time in the factory
+
+    uint64_t Live() const { return created - destroyed; }
+    // Instances neither idle, leased nor destroyed; always 0 unless the
+    // accounting itself is broken.
+    int64_t Unaccounted() const { return (int64_t)Live() - (int64_t)idle - (int64_t)leased; }
+};
+
+class DecoderPool
+{
+public:
+    using Factory = std::function<std::unique_ptr<DecoderTransform>(const StreamSignature&)>;
+
+    // A decoder on loan; goes back to the pool when destroyed.
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept : pool(other.pool), signature(other.signature), decoder(std::move(other.decoder)), discard(other.discard)
+        {
+            other.pool = nullptr;
+        }
+        Lease& operator=(Lease&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Return();
+                pool = other.pool;
+                signature = other.signature;
+                decoder = std::move(other.decoder);
+                discard = other.discard;
+                other.pool = nullptr;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease()
+        {
+            Return();
+        }
+
+        DecoderTransform* Get() const { return decoder.get(); }
+        DecoderTransform* operator->() const { return decoder.get(); }
+        DecoderTransform& operator*() const { return *decoder; }
+        explicit operator bool() const { return decoder != nullptr; }
+
+        // Destroy instead of reusing, e.g. after a decode error.
+        void Discard() { discard = true; }
+
+        // Gives the decoder back now.
+        void Return()
+        {
+            if (pool != nullptr)
+            {
+                pool->Give(signature, std::move(decoder), discard);
+                pool = nullptr;
+            }
+        }
+
+    private:
+        friend class DecoderPool;
+
+        DecoderPool* pool = nullptr;
+        StreamSignature signature;
+        std::unique_ptr<DecoderTransform> decoder;
+        bool discard = false;
+    };
+
+    // maxIdle bounds the decoders kept per format; extra returns are destroyed.
+    explicit DecoderPool(Factory factory, size_t maxIdle = 16) : factory(std::move(factory)), maxIdle(maxIdle) {}
+
+    DecoderPool(const DecoderPool&) = delete;
+    DecoderPool& operator=(const DecoderPool&) = delete;
+
+    // Leases must have been returned by now; idle decoders are destroyed.
+    ~DecoderPool()
+    {
+        Clear();
+    }
+
+    // An idle decoder for the format, or a new one. Empty if the factory
+    // fails. setup, if given, receives the time this took.
+    Lease Acquire(const StreamSignature& signature, DecoderSetupStats* setup = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Lease lease;
+        lease.signature = signature;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& list = idle[signature.Key()];
+            if (!list.empty())
+            {
+                lease.decoder = std::move(list.back());
+                list.pop_back();
+                stats.idle--;
+                stats.reused++;
+                stats.leased++;
+            }
+        }
+        bool reused = lease.decoder != nullptr;
+        if (!reused)
+        {
+            // Outside the lock: creating a decoder may take a while.
+            lease.decoder = factory(signature);
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.createSeconds += seconds;
+            if (lease.decoder != nullptr)
+            {
+                stats.created++;
+                stats.leased++;
+            }
+        }
+        if (lease.decoder != nullptr)
+        {
+            lease.pool = this;
+        }
+        if (setup != nullptr)
+        {
+            setup->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            setup->cached = reused;
+            setup->negotiateSeconds = 0;
+        }
+        return lease;
+    }
+
+    // Creates decoders up front so the first files do not pay for them.
+    void Prewarm(const StreamSignature& signature, size_t count)
+    {
+        std::vector<Lease> leases;
+        for (size_t i = 0; i < count; i++)
+        {
+            leases.push_back(Acquire(signature));
+        }
+    }
+
+    // Destroys the idle decoders.
+    void Clear()
+    {
+        std::unordered_map<uint64_t, std::vector<std::unique_ptr<DecoderTransform>>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(idle);
+            for (const auto& entry : dropped)
+            {
+                stats.destroyed += entry.second.size();
+            }
+            stats.idle = 0;
+        }
+    }
+
+    DecoderPoolStats Stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    void Give(const StreamSignature& signature, std::unique_ptr<DecoderTransform> decoder, bool discard)
+    {
+        // Reset outside the lock; it may wait for the decoder's threads.
+        bool reset = !discard && decoder->Reset() == DecodeResult::Ok;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.leased--;
+            if (discard)
+            {
+                stats.discarded++;
+            }
+            else if (!reset)
+            {
+                stats.resetFailures++;
+            }
+            auto& list = idle[signature.Key()];
+            if (reset && list.size() < maxIdle)
+            {
+                list.push_back(std::move(decoder));
+                stats.idle++;
+                return;
+            }
+            stats.destroyed++;
+        }
+        // decoder is destroyed here, outside the lock.
+    }
+
+    Factory factory;
+    size_t maxIdle;
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::vector<std::unique_ptr<DecoderTransform>>> idle;
+    DecoderPoolStats stats;
+};
@@ -0,0 +1,71 @@
+#pragma once
+// Portable decoder interface mirroring the parts of IMFTransform the decode
+// loop relies on: ProcessInput may refuse input (MF_E_NOTACCEPTING),
+// ProcessOutput fills a caller-provided buffer until it needs more input
+// (MF_E_TRANSFORM_NEED_MORE_INPUT), and Drain/Flush map to the
+// MFT_MESSAGE_COMMAND_DRAIN / MFT_MESSAGE_COMMAND_FLUSH messages; Reset
+// adds MFT_MESSAGE_NOTIFY_END_STREAMING.
+//
+// Implementations: MFDecoderTransform (DDP_MFT, wraps the Media Foundation
+// decoder) and StandInDecoder (portable, deterministic, for Linux testing).
+#include "BitstreamSource.h"
+#include "PcmFormat.h"
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+enum class DecodeResult
+{
+    Ok,
+    NotAccepting,       // input refused; offer the same input again after pulling output
+    NeedMoreInput,      // no output available
+    Error,
+};
+
+struct DecoderInput
+{
+    BitstreamSlice slice;           // one access unit
+    int64_t sampleTime = -1;        // position in samples, -1 if unknown
+    uint32_t sampleCount = 0;       // samples the unit decodes to
+    std::shared_ptr<const void> owner;  // keeps slice memory alive while the decoder holds it
+};
+
+struct DecoderOutput
+{
+    // Supplied by the caller.
+    uint8_t* buffer = nullptr;
+    size_t capacity = 0;
+    // Filled by ProcessOutput.
+    size_t size = 0;
+    int64_t sampleTime = -1;
+    uint32_t sampleCount = 0;
+};
+
+class DecoderTransform
+{
+public:
+    virtual ~DecoderTransform() = default;
+
+    virtual PcmFormat OutputFormat() const = 0;
+
+    // Smallest output buffer ProcessOutput is guaranteed to fit one call into.
+    virtual size_t MaxOutputBytes() const = 0;
+
+    virtual DecodeResult BeginStreaming() = 0;
+    virtual DecodeResult ProcessInput(const DecoderInput& input) = 0;
+    virtual DecodeResult ProcessOutput(DecoderOutput& output) = 0;
+
+    // No more input follows; ProcessOutput returns what is left, then NeedMoreInput.
+    virtual DecodeResult Drain() = 0;
+
+    // Drops all buffered input and output and resets decoding state.
+    virtual DecodeResult Flush() = 0;
+
+    // Readies a decoder that finished a stream for another one of the same
+    // format (see DecoderPool); the next BeginStreaming starts it again.
+    virtual DecodeResult Reset() { return Flush(); }
+};
+
+// Creates a configured decoder, for callers that run one per thread.
+using DecoderFactory = std::function<std::unique_ptr<DecoderTransform>()>;
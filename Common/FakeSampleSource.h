@@ -0,0 +1,310 @@
+#pragma once
+// AsyncSampleSource that stands in for a Media Foundation source reader in
+// the portable benchmarks: it completes reads on its own thread after a
+// simulated per-read latency, with deterministic float PCM whose value says
+// which frame and channel it is, so a consumer can check that nothing was
+// lost, duplicated or reordered.
+//
+// Reads overlap the way they do in a real source: each one completes its
+// latency after it was requested, but never before the read ahead of it,
+// so N reads in flight hide up to N latencies.
+//
+// Several streams can be configured to stand in for a container with more
+// than one audio track read with MF_SOURCE_READER_ANY_STREAM: reads are
+// served from the stream with the earliest next timestamp, the way a
+// demuxer interleaves them, and each stream reports its own end.
+#include "AsyncSampleReader.h"
+#include "PcmFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define FAKE_SOURCE_READ_FAILED ((int32_t)0x80004005)    // E_FAIL
+
+struct FakeStreamOptions
+{
+    uint32_t streamIndex = 0;
+    uint16_t channels = 2;
+    uint64_t frames = 48000;
+};
+
+struct FakeSourceOptions
+{
+    uint32_t sampleRate = 48000;
+    uint16_t channels = 6;
+    uint64_t frames = 48000 * 10;       // stream length
+    uint32_t framesPerSample = 1536;    // one E-AC-3 frame per read
+    double latencySeconds = 0.001;      // from request to completion
+    double jitterSeconds = 0;           // added to the latency, pseudo-random per read
+    int64_t failAtRead = -1;            // this read completes with FAKE_SOURCE_READ_FAILED
+    int64_t typeChangeAtRead = -1;      // this read reports a media type change
+
+    // Buffers each sample is split into, at byte offsets that need not fall
+    // on frame boundaries. Above SourceSample::MaxBuffers the source takes
+    // the contiguous-copy fallback, as the Media Foundation one does.
+    uint32_t buffersPerSample = 1;
+
+    // Streams of a multi-track source. Empty means a single stream, index
+    // 0, with the channels and frames above.
+    std::vector<FakeStreamOptions> streams;
+
+    std::vector<FakeStreamOptions> Streams() const
+    {
+        if (!streams.empty())
+        {
+            return streams;
+        }
+        FakeStreamOptions stream;
+        stream.channels = channels;
+        stream.frames = frames;
+        return { stream };
+    }
+
+    PcmFormat Format(uint16_t streamChannels = 0) const
+    {
+        PcmFormat format;
+        format.sampleRate = sampleRate;
+        format.channels = streamChannels != 0 ? streamChannels : channels;
+        format.sampleType = PcmSampleType::Float32;
+        return format;
+    }
+};
+
+struct FakeSourceStats
+{
+    uint64_t requests = 0;
+    uint64_t completions = 0;
+    uint64_t samples = 0;               // completions carrying PCM, from any stream
+    uint64_t cancelled = 0;             // pending when CancelPending was called
+    uint32_t maxPending = 0;
+};
+
+class FakeSampleSource : public AsyncSampleSource
+{
+public:
+    explicit FakeSampleSource(const FakeSourceOptions& options) : options(options)
+    {
+        for (const auto& stream : options.Streams())
+        {
+            cursors.push_back({ stream, 0, false });
+        }
+        worker = std::thread([this] { Run(); });
+    }
+
+    ~FakeSampleSource() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shutdown = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    // The value of one PCM sample, for consumers to check against.
+    static float Value(uint64_t frame, uint16_t channel, uint32_t stream = 0)
+    {
+        return (float)((frame * 7 + channel * 1009 + stream * 331) % 4096) / 2048.0f - 1.0f;
+    }
+
+    void SetCompletion(Completion completion) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->completion = std::move(completion);
+    }
+
+    int32_t RequestSample() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto latency = options.latencySeconds + options.jitterSeconds * Jitter(nextRead);
+            auto due = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(latency));
+            // In order: never before the read ahead of it.
+            if (!pending.empty() && due < pending.back().due)
+            {
+                due = pending.back().due;
+            }
+            pending.push_back({ nextRead++, due });
+            stats.requests++;
+            stats.maxPending = std::max(stats.maxPending, (uint32_t)pending.size());
+        }
+        changed.notify_all();
+        return 0;
+    }
+
+    void CancelPending() override
+    {
+        // A completion still running may request another read, so the
+        // list is cleared only once it has returned.
+        std::unique_lock<std::mutex> lock(mutex);
+        cancelling = true;
+        changed.wait(lock, [&] { return !completing; });
+        stats.cancelled += pending.size();
+        pending.clear();
+        cancelling = false;
+    }
+
+    FakeSourceStats Stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Request
+    {
+        uint64_t index;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    // Read position of one stream; only the worker thread touches these.
+    struct Cursor
+    {
+        FakeStreamOptions stream;
+        uint64_t next;
+        bool ended;
+    };
+
+    // 0..1, the same for a given read on every run.
+    static double Jitter(uint64_t read)
+    {
+        auto x = read * 0x9E3779B97F4A7C15ull;
+        x ^= x >> 29;
+        return (double)(x % 1000) / 1000.0;
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            if (shutdown)
+            {
+                return;
+            }
+            if (pending.empty() || cancelling)
+            {
+                changed.wait(lock);
+                continue;
+            }
+            auto due = pending.front().due;
+            if (std::chrono::steady_clock::now() < due)
+            {
+                changed.wait_until(lock, due);
+                continue;
+            }
+            auto index = pending.front().index;
+            pending.pop_front();
+            auto callback = completion;
+            completing = true;
+            lock.unlock();
+
+            SourceSample sample;
+            Produce(index, sample);
+            bool produced = sample.bufferCount != 0;
+            if (callback)
+            {
+                callback(sample);
+            }
+
+            lock.lock();
+            completing = false;
+            stats.completions++;
+            stats.samples += produced ? 1 : 0;
+            changed.notify_all();
+        }
+    }
+
+    int64_t Timestamp(uint64_t frame) const
+    {
+        return options.sampleRate != 0 ? (int64_t)(frame * 10000000 / options.sampleRate) : 0;
+    }
+
+    void Produce(uint64_t index, SourceSample& sample)
+    {
+        if ((int64_t)index == options.failAtRead)
+        {
+            sample.status = FAKE_SOURCE_READ_FAILED;
+            return;
+        }
+        if ((int64_t)index == options.typeChangeAtRead)
+        {
+            sample.flags = SourceSampleFlags::TypeChanged;
+            return;
+        }
+        // The stream with the earliest next timestamp; once all have
+        // ended, every read reports end of stream again.
+        Cursor* cursor = nullptr;
+        for (auto& candidate : cursors)
+        {
+            if (!candidate.ended && (cursor == nullptr || candidate.next < cursor->next))
+            {
+                cursor = &candidate;
+            }
+        }
+        if (cursor == nullptr)
+        {
+            sample.flags = SourceSampleFlags::EndOfStream;
+            sample.streamIndex = cursors.back().stream.streamIndex;
+            sample.timestamp = Timestamp(cursors.back().next);
+            return;
+        }
+        const auto& stream = cursor->stream;
+        auto first = cursor->next;
+        sample.streamIndex = stream.streamIndex;
+        sample.timestamp = Timestamp(first);
+        if (first >= stream.frames)
+        {
+            cursor->ended = true;
+            sample.flags = SourceSampleFlags::EndOfStream;
+            return;
+        }
+        auto frames = std::min<uint64_t>(options.framesPerSample, stream.frames - first);
+        cursor->next += frames;
+        auto pcm = std::make_shared<std::vector<float>>(frames * stream.channels);
+        auto out = pcm->data();
+        for (uint64_t frame = first; frame < first + frames; frame++)
+        {
+            for (uint16_t channel = 0; channel < stream.channels; channel++)
+            {
+                *out++ = Value(frame, channel, stream.streamIndex);
+            }
+        }
+        auto data = (const uint8_t*)pcm->data();
+        sample.size = pcm->size() * sizeof(float);
+        auto buffers = options.buffersPerSample != 0 ? options.buffersPerSample : 1;
+        if (buffers > SourceSample::MaxBuffers)
+        {
+            sample.copied = true;
+            buffers = 1;
+        }
+        for (uint32_t i = 0; i < buffers; i++)
+        {
+            auto begin = sample.size * i / buffers;
+            auto end = sample.size * (i + 1) / buffers;
+            sample.buffers[i].data = data + begin;
+            sample.buffers[i].size = end - begin;
+        }
+        sample.bufferCount = buffers;
+        sample.owner = std::move(pcm);
+    }
+
+    const FakeSourceOptions options;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Request> pending;
+    Completion completion;
+    std::vector<Cursor> cursors;
+    uint64_t nextRead = 0;
+    bool completing = false;
+    bool cancelling = false;
+    bool shutdown = false;
+    FakeSourceStats stats;
+    std::thread worker;
+};
@@ -0,0 +1,115 @@
+#pragma once
+// Small portable wrappers over stdio so the bitstream/PCM helpers can handle
+// files larger than 2 GB on both MSVC (where long is 32-bit) and POSIX.
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+inline FILE* OpenFile(const char* path, const char* mode)
+{
+    FILE* file = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&file, path, mode) != 0)
+    {
+        file = nullptr;
+    }
+#else
+    file = fopen(path, mode);
+#endif
+    return file;
+}
+
+#ifdef _WIN32
+inline FILE* OpenFile(const wchar_t* path, const wchar_t* mode)
+{
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, path, mode) != 0)
+    {
+        file = nullptr;
+    }
+    return file;
+}
+#endif
+
+inline bool SeekFile64(FILE* file, uint64_t offset)
+{
+#ifdef _MSC_VER
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+inline bool SeekFileEnd64(FILE* file)
+{
+#ifdef _MSC_VER
+    return _fseeki64(file, 0, SEEK_END) == 0;
+#else
+    return fseeko(file, 0, SEEK_END) == 0;
+#endif
+}
+
+inline uint64_t TellFile64(FILE* file)
+{
+#ifdef _MSC_VER
+    return (uint64_t)_ftelli64(file);
+#else
+    return (uint64_t)ftello(file);
+#endif
+}
+
+// Size and last-write time of a file, to tell whether data derived from it
+// (a frame index) is still current. modified is in 100 ns units on Windows
+// and nanoseconds elsewhere; only equality matters.
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t modified = 0;
+
+    bool operator==(const FileStamp& other) const { return size == other.size && modified == other.modified; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+inline bool GetFileStamp(const char* path, FileStamp& stamp)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+    {
+        return false;
+    }
+    stamp.size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    stamp.modified = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return false;
+    }
+    stamp.size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    stamp.modified = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp.modified = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+// Replaces the file's contents with text (reports, JSON exports).
+inline bool WriteTextFile(const char* path, const std::string& text)
+{
+    FILE* file = OpenFile(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,124 @@
+#pragma once
+// Access-unit index for seeking in a raw (E-)AC-3 bitstream.
+//
+// One entry per access unit: the byte offset of its independent frame's
+// sync word and the sample position it decodes to. Entries are sorted on
+// both, so finding the unit that holds a given sample is a binary search
+// and a decode can start on a sync frame instead of at byte zero. Building
+// the index only parses frame headers, never decodes.
+#include "DdpFrameParser.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct FrameIndexEntry
+{
+    uint64_t offset = 0;
+    int64_t sampleTime = 0;
+    uint32_t bytes = 0;             // access unit size, dependent frames included
+    uint8_t substreamId = 0;        // of the independent frame
+};
+
+// Byte and sample span to decode for a requested sample range.
+struct SeekPlan
+{
+    uint64_t beginOffset = 0;       // first access unit to feed (pre-roll included)
+    uint64_t endOffset = 0;         // end of the last access unit to feed
+    int64_t firstSample = 0;        // position of the first unit fed
+    int64_t startSample = 0;        // first sample to keep
+    int64_t endSample = 0;          // one past the last sample to keep
+    size_t units = 0;               // access units fed, pre-roll included
+};
+
+class FrameIndex
+{
+public:
+    // Scans the whole stream.
+    bool Build(const uint8_t* data, uint64_t size)
+    {
+        Clear();
+        DdpFrameSplitter splitter{ data, size };
+        DdpAccessUnit unit;
+        int64_t sampleTime = 0;
+        while (splitter.Next(unit))
+        {
+            Add(unit.offset, sampleTime, (uint32_t)unit.slice.size, unit.header.substreamid);
+            sampleTime += unit.header.samplesPerFrame;
+        }
+        SetEnd(size, sampleTime);
+        return !entries.empty();
+    }
+
+    // For loaders: entries must come in stream order.
+    void Add(uint64_t offset, int64_t sampleTime, uint32_t bytes, uint8_t substreamId = 0)
+    {
+        FrameIndexEntry entry;
+        entry.offset = offset;
+        entry.sampleTime = sampleTime;
+        entry.bytes = bytes;
+        entry.substreamId = substreamId;
+        entries.push_back(entry);
+    }
+
+    void Reserve(size_t count) { entries.reserve(count); }
+
+    void SetEnd(uint64_t bytes, int64_t samples)
+    {
+        streamBytes = bytes;
+        totalSamples = samples;
+    }
+
+    void Clear()
+    {
+        entries.clear();
+        streamBytes = 0;
+        totalSamples = 0;
+    }
+
+    size_t Size() const { return entries.size(); }
+    bool Empty() const { return entries.empty(); }
+    const FrameIndexEntry& operator[](size_t index) const { return entries[index]; }
+    const std::vector<FrameIndexEntry>& Entries() const { return entries; }
+    uint64_t StreamBytes() const { return streamBytes; }
+    int64_t TotalSamples() const { return totalSamples; }
+
+    // The access unit holding sample: the last one starting at or before it.
+    size_t Find(int64_t sample) const
+    {
+        auto next = std::upper_bound(entries.begin(), entries.end(), sample,
+            [](int64_t value, const FrameIndexEntry& entry) { return value < entry.sampleTime; });
+        return next == entries.begin() ? 0 : (size_t)(next - entries.begin()) - 1;
+    }
+
+    // Units to decode for [startSample, endSample), with prerollUnits extra
+    // units in front to warm the decoder up. endSample <= 0 means the end
+    // of the stream. False if the range is empty.
+    bool Plan(int64_t startSample, int64_t endSample, uint32_t prerollUnits, SeekPlan& plan) const
+    {
+        if (entries.empty())
+        {
+            return false;
+        }
+        startSample = startSample > 0 ? startSample : 0;
+        endSample = endSample > 0 && endSample < totalSamples ? endSample : totalSamples;
+        if (startSample >= endSample)
+        {
+            return false;
+        }
+        auto first = Find(startSample);
+        auto last = Find(endSample - 1);
+        first = first > prerollUnits ? first - prerollUnits : 0;
+        plan.beginOffset = entries[first].offset;
+        plan.endOffset = last + 1 < entries.size() ? entries[last + 1].offset : streamBytes;
+        plan.firstSample = entries[first].sampleTime;
+        plan.startSample = startSample;
+        plan.endSample = endSample;
+        plan.units = last + 1 - first;
+        return true;
+    }
+
+private:
+    std::vector<FrameIndexEntry> entries;
+    uint64_t streamBytes = 0;
+    int64_t totalSamples = 0;
+};
@@ -0,0 +1,247 @@
+#pragma once
+// Frame index sidecar: a FrameIndex saved next to its source ("in.wav" ->
+// "in.wav.ddpidx") so later runs can seek without rescanning the stream.
+//
+// Layout, little-endian: a fixed header carrying the source file's size
+// and last-write time (the index is only used while both still match), the
+// stream totals, the entry count and a checksum of the payload; then one
+// record per access unit, each field a LEB128 varint relative to the
+// previous unit:
+//
+//     offset - (previous offset + previous bytes)   0 unless bytes were skipped
+//     bytes
+//     sampleTime - previous sampleTime
+//     substreamId
+//
+// which is 4-6 bytes per unit instead of the 24 in memory. The file is
+// mapped and decoded into a FrameIndex in one pass.
+#include "FileIO.h"
+#include "FrameIndex.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define DDP_INDEX_MAGIC 0x49504444u     // "DDPI"
+#define DDP_INDEX_VERSION 1u
+
+namespace FrameIndexFileDetail
+{
+    const size_t HeaderBytes = 64;
+
+    inline void PutU32(uint8_t* out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out[i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+
+    inline void PutU64(uint8_t* out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            out[i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+
+    inline uint32_t GetU32(const uint8_t* in)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            value |= (uint32_t)in[i] << (8 * i);
+        }
+        return value;
+    }
+
+    inline uint64_t GetU64(const uint8_t* in)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            value |= (uint64_t)in[i] << (8 * i);
+        }
+        return value;
+    }
+
+    inline void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    // False on a truncated or over-long varint.
+    inline bool GetVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && in < end; shift += 7)
+        {
+            auto byte = *in++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline uint64_t Checksum(const uint8_t* data, size_t size)
+    {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+}
+
+inline std::string FrameIndexPath(const char* sourceFile)
+{
+    return std::string(sourceFile) + ".ddpidx";
+}
+
+// Writes to a temporary file and renames it into place, so a reader never
+// sees a partial index.
+inline bool SaveFrameIndex(const FrameIndex& index, const char* path, const FileStamp& source)
+{
+    using namespace FrameIndexFileDetail;
+    std::vector<uint8_t> payload;
+    payload.reserve(index.Size() * 6);
+    uint64_t previousEnd = 0;
+    int64_t previousSample = 0;
+    for (const auto& entry : index.Entries())
+    {
+        if (entry.offset < previousEnd || entry.sampleTime < previousSample)
+        {
+            return false;
+        }
+        PutVarint(payload, entry.offset - previousEnd);
+        PutVarint(payload, entry.bytes);
+        PutVarint(payload, (uint64_t)(entry.sampleTime - previousSample));
+        PutVarint(payload, entry.substreamId);
+        previousEnd = entry.offset + entry.bytes;
+        previousSample = entry.sampleTime;
+    }
+
+    uint8_t header[HeaderBytes] = {};
+    PutU32(header, DDP_INDEX_MAGIC);
+    PutU32(header + 4, DDP_INDEX_VERSION);
+    PutU64(header + 8, source.size);
+    PutU64(header + 16, (uint64_t)source.modified);
+    PutU64(header + 24, index.StreamBytes());
+    PutU64(header + 32, (uint64_t)index.TotalSamples());
+    PutU64(header + 40, index.Size());
+    PutU64(header + 48, payload.size());
+    PutU64(header + 56, Checksum(payload.data(), payload.size()));
+
+    auto temporary = std::string(path) + ".tmp";
+    FILE* file = OpenFile(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(header, 1, HeaderBytes, file) == HeaderBytes
+        && fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+    {
+        // rename does not replace an existing file on Windows.
+        remove(path);
+        ok = rename(temporary.c_str(), path) == 0;
+    }
+    if (!ok)
+    {
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+// False, leaving index empty, if the file is missing, damaged, from another
+// version, or was made for a different state of the source.
+inline bool LoadFrameIndex(FrameIndex& index, const char* path, const FileStamp& source)
+{
+    using namespace FrameIndexFileDetail;
+    index.Clear();
+    MappedFile file;
+    if (!file.Open(path) || file.Size() < HeaderBytes)
+    {
+        return false;
+    }
+    const uint8_t* header = file.Data();
+    auto count = GetU64(header + 40);
+    auto payloadBytes = GetU64(header + 48);
+    if (GetU32(header) != DDP_INDEX_MAGIC || GetU32(header + 4) != DDP_INDEX_VERSION
+        || GetU64(header + 8) != source.size || (int64_t)GetU64(header + 16) != source.modified
+        || payloadBytes != file.Size() - HeaderBytes || count > payloadBytes / 4)
+    {
+        return false;
+    }
+    const uint8_t* in = header + HeaderBytes;
+    const uint8_t* end = in + payloadBytes;
+    if (GetU64(header + 56) != Checksum(in, (size_t)payloadBytes))
+    {
+        return false;
+    }
+
+    auto streamBytes = GetU64(header + 24);
+    auto totalSamples = (int64_t)GetU64(header + 32);
+    index.Reserve((size_t)count);
+    uint64_t previousEnd = 0;
+    int64_t previousSample = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t gap, bytes, samples, substreamId;
+        if (!GetVarint(in, end, gap) || !GetVarint(in, end, bytes) || !GetVarint(in, end, samples) || !GetVarint(in, end, substreamId)
+            || bytes > UINT32_MAX || substreamId > 0xFF || previousEnd + gap + bytes > streamBytes)
+        {
+            index.Clear();
+            return false;
+        }
+        auto offset = previousEnd + gap;
+        auto sampleTime = previousSample + (int64_t)samples;
+        index.Add(offset, sampleTime, (uint32_t)bytes, (uint8_t)substreamId);
+        previousEnd = offset + bytes;
+        previousSample = sampleTime;
+    }
+    if (in != end || previousSample > totalSamples)
+    {
+        index.Clear();
+        return false;
+    }
+    index.SetEnd(streamBytes, totalSamples);
+    return true;
+}
+
+// Loads the sidecar of sourceFile if it is current, otherwise scans the
+// stream (data, size: the bitstream inside sourceFile) and saves a new one.
+// loaded tells which happened; a failed save only costs the next run a scan.
+inline bool LoadOrBuildFrameIndex(FrameIndex& index, const char* sourceFile, const uint8_t* data, uint64_t size, bool& loaded)
+{
+    loaded = false;
+    FileStamp stamp;
+    bool stamped = GetFileStamp(sourceFile, stamp);
+    auto path = FrameIndexPath(sourceFile);
+    if (stamped && LoadFrameIndex(index, path.c_str(), stamp) && index.StreamBytes() == size)
+    {
+        loaded = true;
+        return true;
+    }
+    if (!index.Build(data, size))
+    {
+        return false;
+    }
+    if (stamped)
+    {
+        SaveFrameIndex(index, path.c_str(), stamp);
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+// Open-addressing hash table from 16-byte GUIDs to constant names.
+//
+// Templated on the GUID and character types so the same code serves the
+// Windows GUID/WCHAR helpers and portable benchmarks. Lookups hash the 16
+// bytes once and usually hit on the first probe, including misses, which a
+// chain of GUID compares can only answer after trying every entry.
+// Add() may be called at any time to register vendor GUIDs, but not
+// concurrently with Find().
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+template <class Guid, class Char>
+class GuidNameTable
+{
+    static_assert(sizeof(Guid) == 16, "GUIDs are 16 bytes");
+
+public:
+    GuidNameTable()
+    {
+        slots.resize(256);
+    }
+
+    // Registers (or renames) a GUID. name must outlive the table.
+    void Add(const Guid& guid, const Char* name)
+    {
+        if ((count + 1) * 2 > slots.size())
+        {
+            Grow();
+        }
+        Insert(guid, name);
+    }
+
+    const Char* Find(const Guid& guid) const
+    {
+        auto mask = slots.size() - 1;
+        for (auto index = Hash(guid) & mask; ; index = (index + 1) & mask)
+        {
+            const auto& slot = slots[index];
+            if (slot.name == nullptr)
+            {
+                return nullptr;
+            }
+            if (memcmp(&slot.guid, &guid, sizeof(Guid)) == 0)
+            {
+                return slot.name;
+            }
+        }
+    }
+
+    size_t Size() const { return count; }
+
+private:
+    struct Slot
+    {
+        Guid guid;
+        const Char* name = nullptr;
+    };
+
+    static uint64_t Hash(const Guid& guid)
+    {
+        uint64_t words[2];
+        memcpy(words, &guid, sizeof(words));
+        // murmur3 fmix64 over the folded halves.
+        uint64_t h = words[0] ^ (words[1] * 0x9E3779B97F4A7C15ull);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void Insert(const Guid& guid, const Char* name)
+    {
+        auto mask = slots.size() - 1;
+        for (auto index = Hash(guid) & mask; ; index = (index + 1) & mask)
+        {
+            auto& slot = slots[index];
+            if (slot.name == nullptr)
+            {
+                slot.guid = guid;
+                slot.name = name;
+                count++;
+                return;
+            }
+            if (memcmp(&slot.guid, &guid, sizeof(Guid)) == 0)
+            {
+                slot.name = name;
+                return;
+            }
+        }
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        count = 0;
+        for (const auto& slot : old)
+        {
+            if (slot.name != nullptr)
+            {
+                Insert(slot.guid, slot.name);
+            }
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
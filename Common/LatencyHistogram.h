@@ -0,0 +1,153 @@
+#pragma once
+// Fixed-size latency histogram with log-linear buckets: eight buckets per
+// power of two of nanoseconds, so any percentile is within 12.5% of the
+// true value, from 1 ns to beyond an hour, in 2.5 KB and without
+// allocating. Recording is a couple of shifts and an increment, cheap
+// enough to do per access unit.
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class LatencyHistogram
+{
+public:
+    static const int SubBuckets = 8;            // per power of two
+    static const int SubBucketBits = 3;
+    static const int Buckets = SubBuckets + (42 - SubBucketBits) * SubBuckets;
+
+    void Record(double seconds)
+    {
+        RecordNanoseconds(seconds > 0 ? (uint64_t)(seconds * 1e9) : 0);
+    }
+
+    void RecordNanoseconds(uint64_t nanoseconds)
+    {
+        counts[BucketOf(nanoseconds)]++;
+        if (count == 0 || nanoseconds < min)
+        {
+            min = nanoseconds;
+        }
+        if (nanoseconds > max)
+        {
+            max = nanoseconds;
+        }
+        count++;
+        sum += nanoseconds;
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        if (other.count == 0)
+        {
+            return;
+        }
+        for (int i = 0; i < Buckets; i++)
+        {
+            counts[i] += other.counts[i];
+        }
+        min = count == 0 || other.min < min ? other.min : min;
+        max = other.max > max ? other.max : max;
+        count += other.count;
+        sum += other.sum;
+    }
+
+    void Clear()
+    {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t Count() const { return count; }
+    double MinSeconds() const { return min * 1e-9; }
+    double MaxSeconds() const { return max * 1e-9; }
+    double MeanSeconds() const { return count != 0 ? sum * 1e-9 / count : 0; }
+
+    // Upper bound of the bucket holding the p-th fraction (0..1) of values,
+    // clamped to the largest value seen.
+    double PercentileSeconds(double p) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        auto rank = (uint64_t)(p * count + 0.5);
+        rank = rank < 1 ? 1 : rank > count ? count : rank;
+        uint64_t seen = 0;
+        for (int i = 0; i < Buckets; i++)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+            {
+                auto upper = BucketUpper(i);
+                return (upper < max ? upper : max) * 1e-9;
+            }
+        }
+        return max * 1e-9;
+    }
+
+    // {"count":..,"min_us":..,"mean_us":..,"p50_us":..,"p90_us":..,"p99_us":..,
+    //  "p999_us":..,"max_us":..,"buckets":[[upper_us,count],...]} with the
+    // empty buckets left out, for dashboards to load as is.
+    std::string ToJson() const
+    {
+        std::string json;
+        char text[96];
+        snprintf(text, sizeof(text), "{\"count\":%llu", (unsigned long long)count);
+        json += text;
+        const struct { const char* name; double seconds; } fields[] = {
+            { "min_us", MinSeconds() }, { "mean_us", MeanSeconds() }, { "p50_us", PercentileSeconds(0.5) },
+            { "p90_us", PercentileSeconds(0.9) }, { "p99_us", PercentileSeconds(0.99) },
+            { "p999_us", PercentileSeconds(0.999) }, { "max_us", MaxSeconds() } };
+        for (const auto& field : fields)
+        {
+            snprintf(text, sizeof(text), ",\"%s\":%.3f", field.name, field.seconds * 1e6);
+            json += text;
+        }
+        json += ",\"buckets\":[";
+        bool first = true;
+        for (int i = 0; i < Buckets; i++)
+        {
+            if (counts[i] != 0)
+            {
+                snprintf(text, sizeof(text), "%s[%.3f,%llu]", first ? "" : ",", BucketUpper(i) * 1e-3, (unsigned long long)counts[i]);
+                json += text;
+                first = false;
+            }
+        }
+        json += "]}";
+        return json;
+    }
+
+private:
+    static int BucketOf(uint64_t value)
+    {
+        if (value < SubBuckets)
+        {
+            return (int)value;
+        }
+        int exponent = 63;
+        while ((value >> exponent) == 0)
+        {
+            exponent--;
+        }
+        int bucket = SubBuckets + (exponent - SubBucketBits) * SubBuckets + (int)((value >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+        return bucket < Buckets ? bucket : Buckets - 1;
+    }
+
+    // Largest value that falls into bucket.
+    static uint64_t BucketUpper(int bucket)
+    {
+        if (bucket < SubBuckets)
+        {
+            return (uint64_t)bucket;
+        }
+        int exponent = (bucket - SubBuckets) / SubBuckets + SubBucketBits;
+        uint64_t sub = (uint64_t)((bucket - SubBuckets) % SubBuckets) + SubBuckets;
+        return ((sub + 1) << (exponent - SubBucketBits)) - 1;
+    }
+
+    uint64_t counts[Buckets] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+};
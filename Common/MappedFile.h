@@ -0,0 +1,165 @@
+#pragma once
+// Read-only memory mapping of a whole file. Used to hand the decoder views
+// into the bitstream instead of copying it through intermediate buffers.
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    // sequential: hint the OS that the mapping is consumed front to back so it
+    // reads ahead aggressively and may drop pages behind the cursor.
+    bool Open(const char* path, bool sequential = true)
+    {
+        Close();
+#ifdef _WIN32
+        DWORD flags = sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+        fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize))
+        {
+            Close();
+            return false;
+        }
+        size = (uint64_t)fileSize.QuadPart;
+        if (size == 0)
+        {
+            return true;
+        }
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL)
+        {
+            Close();
+            return false;
+        }
+        data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr)
+        {
+            Close();
+            return false;
+        }
+#else
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            Close();
+            return false;
+        }
+        size = (uint64_t)st.st_size;
+        if (size == 0)
+        {
+            return true;
+        }
+        auto address = mmap(nullptr, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+        data = (const uint8_t*)address;
+        if (sequential)
+        {
+            madvise(address, (size_t)size, MADV_SEQUENTIAL);
+        }
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data != nullptr)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle != NULL)
+        {
+            CloseHandle(mappingHandle);
+            mappingHandle = NULL;
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(fileHandle);
+            fileHandle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (data != nullptr)
+        {
+            munmap((void*)data, (size_t)size);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    // Tells the OS the range [offset, offset + length) will not be read again.
+    void Release(uint64_t offset, uint64_t length)
+    {
+        if (data == nullptr || length == 0)
+        {
+            return;
+        }
+#ifndef _WIN32
+        auto pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+        auto begin = (offset + pageSize - 1) / pageSize * pageSize;
+        auto end = (offset + length) / pageSize * pageSize;
+        if (end > begin)
+        {
+            madvise((void*)(data + begin), (size_t)(end - begin), MADV_DONTNEED);
+        }
+#endif
+    }
+
+    bool IsOpen() const
+    {
+#ifdef _WIN32
+        return fileHandle != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    const uint8_t* Data() const { return data; }
+    uint64_t Size() const { return size; }
+
+private:
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#else
+    int fd = -1;
+#endif
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+};
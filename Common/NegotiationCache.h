@@ -0,0 +1,130 @@
+#pragma once
+// Memo of decoder format negotiation, keyed by the source stream's format.
+//
+// Setting up a decoder MFT means enumerating decoders and walking their
+// available input and output types, converting each one to a WAVEFORMATEX
+// on the way; on a batch of short clips that costs more than the decode.
+// The outcome only depends on the source format (codec, sample rate,
+// channel layout), so it is negotiated once per format and replayed for
+// every later decoder. A miss holds the cache lock while negotiating, so
+// workers starting together wait for the first negotiation instead of
+// repeating it.
+#include "DdpFrameParser.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// What decoder setup depends on, read from the first access unit.
+struct StreamSignature
+{
+    bool isEac3 = true;
+    uint32_t sampleRate = 48000;
+    uint8_t acmod = 7;              // 3/2
+    uint8_t lfeon = 1;
+    bool dependentFrames = false;   // extra channels in dependent substreams (7.1)
+
+    uint64_t Key() const
+    {
+        return (uint64_t)sampleRate << 16 | (uint64_t)acmod << 8 | (uint64_t)lfeon << 2 | (uint64_t)dependentFrames << 1 | (isEac3 ? 1 : 0);
+    }
+
+    uint16_t Channels() const { return DdpChannelCount(acmod, lfeon); }
+};
+
+inline bool ReadStreamSignature(const uint8_t* data, uint64_t size, StreamSignature& signature)
+{
+    DdpFrameSplitter splitter{ data, size };
+    DdpAccessUnit unit;
+    if (!splitter.Next(unit))
+    {
+        return false;
+    }
+    signature.isEac3 = unit.header.isEac3;
+    signature.sampleRate = unit.header.sampleRate;
+    signature.acmod = unit.header.acmod;
+    signature.lfeon = unit.header.lfeon;
+    signature.dependentFrames = unit.frameCount > 1;
+    return true;
+}
+
+// Per-decoder setup timing.
+struct DecoderSetupStats
+{
+    double seconds = 0;             // whole decoder creation
+    double negotiateSeconds = 0;    // enumeration and type negotiation; 0 when cached
+    bool cached = false;
+};
+
+template <class Entry>
+class NegotiationCache
+{
+public:
+    // Copies the entry for signature into entry, calling
+    // negotiate(signature, entry) -> bool first if there is none yet.
+    // Failed negotiations are not remembered.
+    template <class Negotiate>
+    bool Get(const StreamSignature& signature, Entry& entry, Negotiate negotiate, DecoderSetupStats* stats = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(signature.Key());
+        if (found != entries.end())
+        {
+            hits++;
+            entry = found->second;
+            if (stats != nullptr)
+            {
+                stats->cached = true;
+                stats->negotiateSeconds = 0;
+            }
+            return true;
+        }
+        misses++;
+        auto start = std::chrono::steady_clock::now();
+        Entry negotiated;
+        bool ok = negotiate(signature, negotiated);
+        if (stats != nullptr)
+        {
+            stats->cached = false;
+            stats->negotiateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (!ok)
+        {
+            return false;
+        }
+        entry = negotiated;
+        entries.emplace(signature.Key(), std::move(negotiated));
+        return true;
+    }
+
+    // Drops an entry that stopped working, so the next Get renegotiates.
+    void Forget(const StreamSignature& signature)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(signature.Key());
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    uint64_t Hits() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    uint64_t Misses() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
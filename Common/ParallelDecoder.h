@@ -0,0 +1,248 @@
+#pragma once
+// Parallel decode of a single long stream.
+//
+// The stream is cut at access-unit boundaries (found in a FrameIndex) into
+// chunks of chunkUnits units, and each chunk is decoded on a pool worker
+// by that worker's own decoder instance. A chunk's decode starts
+// prerollUnits units early so the decoder is warm when the chunk begins;
+// the pre-roll output is cut off (RangeSink), so chunks join
+// sample-accurately and, for a decoder whose state reaches back no further
+// than the pre-roll, bit-exactly with a serial decode.
+//
+// The calling thread writes finished chunks to the sink in stream order,
+// replaying every decoded buffer with its position, so sinks downstream
+// (timeline checks, mixing, conversion) see what a serial decode would
+// give them. At most `window` chunks are in flight, which bounds memory to
+// a few chunks of PCM however long the stream is.
+#include "DecodeMetrics.h"
+#include "DecodePipeline.h"
+#include "DecoderTransform.h"
+#include "FrameIndex.h"
+#include "SampleClock.h"
+#include "WorkStealingPool.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct ParallelDecodeOptions
+{
+    // Workers to decode on; the calling thread must not be one of them.
+    WorkStealingPool* pool = nullptr;
+    DecoderFactory createDecoder;   // called once per worker that takes a chunk
+    uint32_t chunkUnits = 512;      // about 16 s of 1536-sample units at 48 kHz
+    // Units decoded ahead of each chunk and dropped. One covers the
+    // transform overlap; the second leaves a margin for decoder state that
+    // is smoothed over more than one frame.
+    uint32_t prerollUnits = 2;
+    unsigned window = 0;            // chunks decoded or waiting; 0 means twice the pool size
+};
+
+struct ParallelDecodeStats
+{
+    uint64_t chunks = 0;
+    uint64_t prerollUnits = 0;      // units decoded twice, at chunk seams
+    unsigned workers = 0;
+    double writerWaitSeconds = 0;   // calling thread waiting for the next chunk
+};
+
+namespace ParallelDecodeDetail
+{
+    // Decoded output of one chunk, kept with each buffer's position. The
+    // storage is reused from chunk to chunk.
+    struct Chunk
+    {
+        struct Piece
+        {
+            size_t offset = 0;
+            size_t size = 0;
+            int64_t sampleTime = -1;
+            uint32_t sampleCount = 0;
+        };
+
+        std::vector<uint8_t> data;
+        size_t used = 0;
+        std::vector<Piece> pieces;
+        int64_t startSample = 0;        // samples to keep, pre-roll excluded
+        int64_t endSample = 0;
+        DecodeStats stats;
+        uint64_t prerollUnits = 0;
+        bool ok = false;
+        bool done = false;
+    };
+
+    // RunDecodeLoop output adapter: the decoder writes straight into the
+    // chunk, so nothing is copied until the chunk is written out.
+    class ChunkOutput
+    {
+    public:
+        ChunkOutput(Chunk& chunk, size_t bufferBytes) : chunk(chunk), bufferBytes(bufferBytes) {}
+
+        uint8_t* Acquire(size_t& capacity)
+        {
+            if (chunk.data.size() < chunk.used + bufferBytes)
+            {
+                chunk.data.resize(chunk.used + bufferBytes);
+            }
+            capacity = bufferBytes;
+            return chunk.data.data() + chunk.used;
+        }
+
+        bool Commit(const DecoderOutput& output)
+        {
+            Chunk::Piece piece;
+            piece.offset = chunk.used;
+            piece.size = output.size;
+            piece.sampleTime = output.sampleTime;
+            piece.sampleCount = output.sampleCount;
+            chunk.pieces.push_back(piece);
+            chunk.used += output.size;
+            return true;
+        }
+
+        void Finish() {}
+
+    private:
+        Chunk& chunk;
+        size_t bufferBytes;
+    };
+}
+
+// Decodes [startSample, endSample) of the stream at data (endSample past
+// the end means to the end) into sink. frameBytes is the decoder output's
+// block alignment. stats sums the chunk decodes, pre-roll included, with
+// seconds the wall time of the whole call.
+template <class Sink>
+bool ParallelDecodeStream(const uint8_t* data, const FrameIndex& index, int64_t startSample, int64_t endSample, size_t frameBytes,
+    Sink& sink, DecodeStats& stats, const ParallelDecodeOptions& options, ParallelDecodeStats* parallelStats = nullptr,
+    std::shared_ptr<const void> owner = nullptr)
+{
+    using ParallelDecodeDetail::Chunk;
+    auto start = std::chrono::steady_clock::now();
+    SeekPlan whole;
+    if (options.pool == nullptr || !options.createDecoder || !index.Plan(startSample, endSample, 0, whole))
+    {
+        return false;
+    }
+
+    // Chunk seams fall on every chunkUnits-th unit inside the range.
+    std::vector<int64_t> seams;
+    seams.push_back(whole.startSample);
+    size_t chunkUnits = options.chunkUnits != 0 ? options.chunkUnits : 1;
+    for (auto unit = index.Find(whole.startSample) + chunkUnits; unit <= index.Find(whole.endSample - 1); unit += chunkUnits)
+    {
+        seams.push_back(index[unit].sampleTime);
+    }
+    seams.push_back(whole.endSample);
+    size_t chunks = seams.size() - 1;
+
+    std::vector<std::unique_ptr<DecoderTransform>> decoders(options.pool->Size());
+    auto decodeChunk = [&](size_t chunkIndex, Chunk& chunk, unsigned workerIndex)
+    {
+        auto& decoder = decoders[workerIndex];
+        if (decoder == nullptr)
+        {
+            decoder = options.createDecoder();
+            if (decoder == nullptr)
+            {
+                return;
+            }
+        }
+        else
+        {
+            decoder->Flush();
+        }
+        SeekPlan plan;
+        if (!index.Plan(seams[chunkIndex], seams[chunkIndex + 1], options.prerollUnits, plan))
+        {
+            return;
+        }
+        chunk.startSample = plan.startSample;
+        chunk.endSample = plan.endSample;
+        chunk.prerollUnits = index.Find(plan.startSample) - index.Find(plan.firstSample);
+        chunk.data.reserve(plan.units * decoder->MaxOutputBytes());
+        DdpFrameSplitter splitter{ data, plan.endOffset };
+        splitter.Seek(plan.beginOffset);
+        SplitterInput<> input{ splitter, chunk.stats, owner, NoInputHook(), plan.firstSample };
+        ParallelDecodeDetail::ChunkOutput output{ chunk, decoder->MaxOutputBytes() };
+        chunk.ok = RunDecodeLoop(input, *decoder, output, chunk.stats);
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t window = options.window != 0 ? options.window : 2 * options.pool->Size();
+    std::vector<Chunk> slots(window < chunks ? window : chunks);
+    size_t submitted = 0;
+    auto submit = [&]()
+    {
+        // The slot's previous chunk has been written; no worker holds it.
+        auto chunkIndex = submitted++;
+        auto& chunk = slots[chunkIndex % slots.size()];
+        chunk.used = 0;
+        chunk.pieces.clear();
+        chunk.stats = DecodeStats();
+        chunk.prerollUnits = 0;
+        chunk.ok = false;
+        chunk.done = false;
+        options.pool->Submit([&, chunkIndex](unsigned workerIndex)
+        {
+            auto& chunk = slots[chunkIndex % slots.size()];
+            decodeChunk(chunkIndex, chunk, workerIndex);
+            // Notify under the lock: once the last chunk is done the caller
+            // may return and take mutex and finished with it.
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk.done = true;
+            finished.notify_all();
+        });
+    };
+    while (submitted < slots.size())
+    {
+        submit();
+    }
+
+    // Write in order; after a failure, only wait for what is in flight.
+    ParallelDecodeStats local;
+    local.chunks = chunks;
+    local.workers = options.pool->Size();
+    bool ok = true;
+    for (size_t chunkIndex = 0; chunkIndex < submitted; chunkIndex++)
+    {
+        auto& chunk = slots[chunkIndex % slots.size()];
+        {
+            auto waitStart = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return chunk.done; });
+            local.writerWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+        }
+        ok = ok && chunk.ok;
+        if (ok)
+        {
+            // Pre-roll output is dropped here, on the way out.
+            RangeSink<Sink> range{ sink, frameBytes, chunk.startSample, chunk.endSample };
+            for (const auto& piece : chunk.pieces)
+            {
+                DDP_TIMED(DecodeStage::Write, range.WriteAt(chunk.data.data() + piece.offset, piece.size, piece.sampleTime, piece.sampleCount));
+            }
+        }
+        stats.inputUnits += chunk.stats.inputUnits;
+        stats.inputFrames += chunk.stats.inputFrames;
+        stats.inputBytes += chunk.stats.inputBytes;
+        stats.notAccepting += chunk.stats.notAccepting;
+        stats.outputBuffers += chunk.stats.outputBuffers;
+        stats.outputSamples += chunk.stats.outputSamples;
+        stats.outputBytes += chunk.stats.outputBytes;
+        local.prerollUnits += chunk.prerollUnits;
+        if (ok && submitted < chunks)
+        {
+            submit();
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (parallelStats != nullptr)
+    {
+        *parallelStats = local;
+    }
+    return ok;
+}
@@ -0,0 +1,312 @@
+#pragma once
+// Interleaved float -> 16-bit, packed 24-bit or 32-bit integer PCM, with
+// clipping and optional TPDF dither.
+//
+// Samples are scaled by 2^(bits-1), dithered, clamped to the integer range
+// (NaN becomes the negative limit) and rounded to nearest-even. The dither
+// comes from eight interleaved xorshift32 generators, sample i drawing from
+// generator i % 8, so the AVX2 (one 8-lane step) and SSE2 (two 4-lane
+// steps) kernels produce exactly the same bytes as the scalar reference;
+// the kernel is picked at runtime from what the CPU supports.
+#include "CpuFeatures.h"
+#include "PcmFormat.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class PcmConverter
+{
+public:
+    static const uint32_t DefaultSeed = 0x2545F491;
+
+    // level is clamped to what the CPU supports.
+    PcmConverter(PcmSampleType target, bool dither, uint32_t seed = DefaultSeed, SimdLevel level = SimdLevel::Avx2)
+        : target(target), dither(dither && target != PcmSampleType::Float32)
+    {
+        this->level = ClampSimdLevel(level);
+        Reset(seed);
+        switch (target)
+        {
+        case PcmSampleType::Int16:
+            scale = 32768.0f;
+            upper = 32767.0f;
+            break;
+        case PcmSampleType::Int24:
+            scale = 8388608.0f;
+            upper = 8388607.0f;
+            break;
+        default:
+            scale = 2147483648.0f;
+            upper = 2147483520.0f;  // largest float below 2^31
+            break;
+        }
+        lower = -scale;
+    }
+
+    void Reset(uint32_t seed)
+    {
+        for (uint32_t lane = 0; lane < Lanes; lane++)
+        {
+            // Distinct, non-zero lane seeds.
+            uint32_t x = seed + 0x9E3779B9u * (lane + 1);
+            x ^= x >> 16;
+            x *= 0x85EBCA6Bu;
+            x ^= x >> 13;
+            state[lane] = x != 0 ? x : 1;
+        }
+        phase = 0;
+    }
+
+    PcmSampleType Target() const { return target; }
+    SimdLevel Level() const { return level; }
+    size_t BytesPerSample() const { return target == PcmSampleType::Int16 ? 2 : target == PcmSampleType::Int24 ? 3 : 4; }
+    size_t OutputBytes(size_t samples) const { return samples * BytesPerSample(); }
+
+    // Converts count samples (not frames) into out, which must hold
+    // OutputBytes(count). Dither continues across calls.
+    void Convert(const float* in, size_t count, uint8_t* out)
+    {
+        if (target == PcmSampleType::Float32)
+        {
+            memcpy(out, in, count * sizeof(float));
+            return;
+        }
+        // Line up with generator 0 so vector blocks start on a full step.
+        size_t i = 0;
+        while (dither && phase != 0 && i < count)
+        {
+            ConvertScalar(in[i], out + i * BytesPerSample());
+            i++;
+        }
+#ifdef SIMD_X86
+        if (level == SimdLevel::Avx2)
+        {
+            i = ConvertAvx2(in, count, out, i);
+        }
+        else if (level == SimdLevel::Sse2)
+        {
+            i = ConvertSse2(in, count, out, i);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            ConvertScalar(in[i], out + i * BytesPerSample());
+        }
+    }
+
+private:
+    static const uint32_t Lanes = 8;
+
+    float NextDither()
+    {
+        uint32_t x = state[phase];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state[phase] = x;
+        phase = (phase + 1) & (Lanes - 1);
+        // Difference of two 16-bit uniforms: triangular over (-1, 1) LSB.
+        return (float)((int32_t)(x & 0xFFFF) - (int32_t)(x >> 16)) * (1.0f / 65536.0f);
+    }
+
+    void ConvertScalar(float sample, uint8_t* out)
+    {
+        float value = sample * scale;
+        if (dither)
+        {
+            value = value + NextDither();
+        }
+        value = value > lower ? value : lower;
+        value = value < upper ? value : upper;
+        auto integer = (int32_t)std::lrint(value);
+        switch (target)
+        {
+        case PcmSampleType::Int16:
+        {
+            auto s16 = (int16_t)integer;
+            memcpy(out, &s16, 2);
+            break;
+        }
+        case PcmSampleType::Int24:
+            out[0] = (uint8_t)integer;
+            out[1] = (uint8_t)(integer >> 8);
+            out[2] = (uint8_t)(integer >> 16);
+            break;
+        default:
+            memcpy(out, &integer, 4);
+            break;
+        }
+    }
+
+#ifdef SIMD_X86
+    SIMD_TARGET_SSE2 static __m128i Xorshift(__m128i x)
+    {
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+        return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    }
+
+    SIMD_TARGET_SSE2 static __m128 Triangular(__m128i x)
+    {
+        auto low = _mm_and_si128(x, _mm_set1_epi32(0xFFFF));
+        auto high = _mm_srli_epi32(x, 16);
+        return _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(low, high)), _mm_set1_ps(1.0f / 65536.0f));
+    }
+
+    SIMD_TARGET_SSE2 size_t ConvertSse2(const float* in, size_t count, uint8_t* out, size_t i)
+    {
+        auto vscale = _mm_set1_ps(scale);
+        auto vlower = _mm_set1_ps(lower);
+        auto vupper = _mm_set1_ps(upper);
+        auto lanes0 = _mm_loadu_si128((const __m128i*)&state[0]);
+        auto lanes1 = _mm_loadu_si128((const __m128i*)&state[4]);
+        for (; i + 8 <= count; i += 8)
+        {
+            auto v0 = _mm_mul_ps(_mm_loadu_ps(in + i), vscale);
+            auto v1 = _mm_mul_ps(_mm_loadu_ps(in + i + 4), vscale);
+            if (dither)
+            {
+                lanes0 = Xorshift(lanes0);
+                lanes1 = Xorshift(lanes1);
+                v0 = _mm_add_ps(v0, Triangular(lanes0));
+                v1 = _mm_add_ps(v1, Triangular(lanes1));
+            }
+            v0 = _mm_min_ps(_mm_max_ps(v0, vlower), vupper);
+            v1 = _mm_min_ps(_mm_max_ps(v1, vlower), vupper);
+            auto i0 = _mm_cvtps_epi32(v0);
+            auto i1 = _mm_cvtps_epi32(v1);
+            switch (target)
+            {
+            case PcmSampleType::Int16:
+                _mm_storeu_si128((__m128i*)(out + i * 2), _mm_packs_epi32(i0, i1));
+                break;
+            case PcmSampleType::Int24:
+            {
+                // No byte shuffle in SSE2; pack from a spill.
+                alignas(16) int32_t values[8];
+                _mm_store_si128((__m128i*)values, i0);
+                _mm_store_si128((__m128i*)(values + 4), i1);
+                auto p = out + i * 3;
+                for (int k = 0; k < 8; k++)
+                {
+                    p[k * 3] = (uint8_t)values[k];
+                    p[k * 3 + 1] = (uint8_t)(values[k] >> 8);
+                    p[k * 3 + 2] = (uint8_t)(values[k] >> 16);
+                }
+                break;
+            }
+            default:
+                _mm_storeu_si128((__m128i*)(out + i * 4), i0);
+                _mm_storeu_si128((__m128i*)(out + i * 4 + 16), i1);
+                break;
+            }
+        }
+        _mm_storeu_si128((__m128i*)&state[0], lanes0);
+        _mm_storeu_si128((__m128i*)&state[4], lanes1);
+        return i;
+    }
+
+    SIMD_TARGET_AVX2 size_t ConvertAvx2(const float* in, size_t count, uint8_t* out, size_t i)
+    {
+        auto vscale = _mm256_set1_ps(scale);
+        auto vlower = _mm256_set1_ps(lower);
+        auto vupper = _mm256_set1_ps(upper);
+        auto mask16 = _mm256_set1_epi32(0xFFFF);
+        auto lsb = _mm256_set1_ps(1.0f / 65536.0f);
+        auto lanes = _mm256_loadu_si256((const __m256i*)state);
+        // Low three bytes of each 32-bit value, per 128-bit half.
+        auto pack24 = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        for (; i + 8 <= count; i += 8)
+        {
+            auto v = _mm256_mul_ps(_mm256_loadu_ps(in + i), vscale);
+            if (dither)
+            {
+                lanes = _mm256_xor_si256(lanes, _mm256_slli_epi32(lanes, 13));
+                lanes = _mm256_xor_si256(lanes, _mm256_srli_epi32(lanes, 17));
+                lanes = _mm256_xor_si256(lanes, _mm256_slli_epi32(lanes, 5));
+                auto tpdf = _mm256_sub_epi32(_mm256_and_si256(lanes, mask16), _mm256_srli_epi32(lanes, 16));
+                v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_cvtepi32_ps(tpdf), lsb));
+            }
+            v = _mm256_min_ps(_mm256_max_ps(v, vlower), vupper);
+            auto values = _mm256_cvtps_epi32(v);
+            switch (target)
+            {
+            case PcmSampleType::Int16:
+            {
+                // packs works per 128-bit half; gather both results into the low half.
+                auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(values, values), 0x08);
+                _mm_storeu_si128((__m128i*)(out + i * 2), _mm256_castsi256_si128(packed));
+                break;
+            }
+            case PcmSampleType::Int24:
+            {
+                auto packed = _mm256_shuffle_epi8(values, pack24);
+                auto p = out + i * 3;
+                if (i + 16 <= count)
+                {
+                    // 16-byte stores; the 4 spare bytes land where the next block writes.
+                    _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(packed));
+                    _mm_storeu_si128((__m128i*)(p + 12), _mm256_extracti128_si256(packed, 1));
+                }
+                else
+                {
+                    alignas(32) uint8_t bytes[32];
+                    _mm256_store_si256((__m256i*)bytes, packed);
+                    memcpy(p, bytes, 12);
+                    memcpy(p + 12, bytes + 16, 12);
+                }
+                break;
+            }
+            default:
+                _mm256_storeu_si256((__m256i*)(out + i * 4), values);
+                break;
+            }
+        }
+        _mm256_storeu_si256((__m256i*)state, lanes);
+        return i;
+    }
+#endif
+
+    PcmSampleType target;
+    bool dither;
+    SimdLevel level = SimdLevel::Scalar;
+    float scale = 1;
+    float lower = -1;
+    float upper = 1;
+    alignas(32) uint32_t state[Lanes];
+    uint32_t phase = 0;
+};
+
+// Sink adapter: converts each float buffer and writes the result to the
+// wrapped sink (BufferedPcmWriter, WaveFileWriter, ...).
+template <class Sink>
+class ConvertingSink
+{
+public:
+    ConvertingSink(Sink& sink, PcmConverter& converter) : sink(sink), converter(converter) {}
+
+    void Write(const void* buffer, size_t size)
+    {
+        if (converter.Target() == PcmSampleType::Float32)
+        {
+            sink.Write(buffer, size);
+            return;
+        }
+        auto samples = size / sizeof(float);
+        auto bytes = converter.OutputBytes(samples);
+        if (scratch.size() < bytes)
+        {
+            scratch.resize(bytes);
+        }
+        converter.Convert((const float*)buffer, samples, scratch.data());
+        sink.Write(scratch.data(), bytes);
+    }
+
+private:
+    Sink& sink;
+    PcmConverter& converter;
+    std::vector<uint8_t> scratch;
+};
@@ -0,0 +1,185 @@
+#pragma once
+// Portable description of an interleaved PCM stream plus conversion to and
+// from the WAVEFORMATEX / WAVEFORMATEXTENSIBLE bytes used by "fmt " chunks
+// and by MFCreateWaveFormatExFromMFMediaType.
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+enum class PcmSampleType
+{
+    Float32,
+    Int16,
+    Int24,      // packed, 3 bytes per sample
+    Int32,
+};
+
+#define WAVE_FORMAT_TAG_PCM 0x0001
+#define WAVE_FORMAT_TAG_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_TAG_EXTENSIBLE 0xFFFE
+
+struct PcmFormat
+{
+    uint32_t sampleRate = 48000;
+    uint16_t channels = 2;
+    PcmSampleType sampleType = PcmSampleType::Float32;
+    uint32_t channelMask = 0;   // SPEAKER_* bits; 0 means "use the default for channels"
+
+    uint16_t BytesPerSample() const
+    {
+        switch (sampleType)
+        {
+        case PcmSampleType::Int16:
+            return 2;
+        case PcmSampleType::Int24:
+            return 3;
+        default:
+            return 4;
+        }
+    }
+
+    uint16_t BitsPerSample() const { return (uint16_t)(BytesPerSample() * 8); }
+    uint16_t BlockAlign() const { return (uint16_t)(BytesPerSample() * channels); }
+};
+
+// Command-line names: f32, s16, s24, s32.
+inline bool ParsePcmSampleType(const char* name, PcmSampleType& type)
+{
+    static const struct
+    {
+        const char* name;
+        PcmSampleType type;
+    } names[] = {
+        { "f32", PcmSampleType::Float32 },
+        { "s16", PcmSampleType::Int16 },
+        { "s24", PcmSampleType::Int24 },
+        { "s32", PcmSampleType::Int32 },
+    };
+    for (const auto& entry : names)
+    {
+        if (strcmp(name, entry.name) == 0)
+        {
+            type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Default WAVEFORMATEXTENSIBLE channel masks (ksmedia.h KSAUDIO_SPEAKER_*).
+inline uint32_t DefaultChannelMask(uint16_t channels)
+{
+    switch (channels)
+    {
+    case 1:
+        return 0x4;         // FC
+    case 2:
+        return 0x3;         // FL FR
+    case 3:
+        return 0x7;         // FL FR FC
+    case 4:
+        return 0x33;        // FL FR BL BR
+    case 5:
+        return 0x37;        // FL FR FC BL BR
+    case 6:
+        return 0x3F;        // 5.1: FL FR FC LFE BL BR
+    case 7:
+        return 0x13F;       // 6.1: 5.1 + BC
+    case 8:
+        return 0x63F;       // 7.1: 5.1 + SL SR
+    default:
+        return 0;
+    }
+}
+
+inline uint16_t ReadFmtLE16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t ReadFmtLE32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Parses a WAVEFORMATEX/WAVEFORMATEXTENSIBLE. Only integer PCM and IEEE float
+// are understood; anything else returns false.
+inline bool ParsePcmFormat(const uint8_t* fmt, size_t size, PcmFormat& format)
+{
+    if (size < 16)
+    {
+        return false;
+    }
+    auto tag = ReadFmtLE16(fmt);
+    format.channels = ReadFmtLE16(fmt + 2);
+    format.sampleRate = ReadFmtLE32(fmt + 4);
+    auto bits = ReadFmtLE16(fmt + 14);
+    format.channelMask = 0;
+    if (tag == WAVE_FORMAT_TAG_EXTENSIBLE)
+    {
+        if (size < 40)
+        {
+            return false;
+        }
+        format.channelMask = ReadFmtLE32(fmt + 20);
+        // The SubFormat GUID starts with the equivalent format tag.
+        tag = ReadFmtLE16(fmt + 24);
+    }
+    if (tag == WAVE_FORMAT_TAG_IEEE_FLOAT && bits == 32)
+    {
+        format.sampleType = PcmSampleType::Float32;
+    }
+    else if (tag == WAVE_FORMAT_TAG_PCM && bits == 16)
+    {
+        format.sampleType = PcmSampleType::Int16;
+    }
+    else if (tag == WAVE_FORMAT_TAG_PCM && bits == 24)
+    {
+        format.sampleType = PcmSampleType::Int24;
+    }
+    else if (tag == WAVE_FORMAT_TAG_PCM && bits == 32)
+    {
+        format.sampleType = PcmSampleType::Int32;
+    }
+    else
+    {
+        return false;
+    }
+    return format.channels != 0;
+}
+
+// Builds a 40-byte WAVEFORMATEXTENSIBLE for the format.
+inline std::vector<uint8_t> BuildFmtChunk(const PcmFormat& format)
+{
+    std::vector<uint8_t> fmt;
+    auto put16 = [&](uint16_t value)
+    {
+        fmt.push_back((uint8_t)value);
+        fmt.push_back((uint8_t)(value >> 8));
+    };
+    auto put32 = [&](uint32_t value)
+    {
+        put16((uint16_t)value);
+        put16((uint16_t)(value >> 16));
+    };
+    auto channelMask = format.channelMask != 0 ? format.channelMask : DefaultChannelMask(format.channels);
+    auto subFormatTag = format.sampleType == PcmSampleType::Float32 ? WAVE_FORMAT_TAG_IEEE_FLOAT : WAVE_FORMAT_TAG_PCM;
+
+    put16(WAVE_FORMAT_TAG_EXTENSIBLE);
+    put16(format.channels);
+    put32(format.sampleRate);
+    put32(format.sampleRate * format.BlockAlign());
+    put16(format.BlockAlign());
+    put16(format.BitsPerSample());
+    put16(22);                      // cbSize
+    put16(format.BitsPerSample());  // wValidBitsPerSample
+    put32(channelMask);
+    // SubFormat: {0000xxxx-0000-0010-8000-00AA00389B71}
+    put32(subFormatTag);
+    put16(0x0000);
+    put16(0x0010);
+    static const uint8_t guidTail[8] = { 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+    fmt.insert(fmt.end(), guidTail, guidTail + sizeof(guidTail));
+    return fmt;
+}
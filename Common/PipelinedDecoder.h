@@ -0,0 +1,210 @@
+#pragma once
+// Three-stage decode of a single stream:
+//
+//   read   (own thread)      splitter -> prefault input pages -> input ring
+//   decode (calling thread)  input ring -> DecoderTransform -> output ring
+//   write  (own thread)      output ring -> sink -> buffers back to the pool
+//
+// The stages are joined by SpscRings, so page faults on the mapped input
+// and blocking writes on the output overlap with decoding instead of
+// stalling it; with enough ring depth throughput approaches that of the
+// decoder alone. Ring stall counters say which stage is the bottleneck: a
+// decode stage that waits on an empty input ring is I/O bound on the read
+// side, one that waits on a full output ring is bound by the writer.
+#include "DecodeMetrics.h"
+#include "DecodePipeline.h"
+#include "SpscRing.h"
+#include <chrono>
+#include <thread>
+
+struct PipelineOptions
+{
+    size_t inputDepth = 32;     // access units read ahead of the decoder
+    size_t outputDepth = 8;     // decoded buffers waiting for the writer
+    bool prefaultInput = true;  // touch input pages on the read thread
+
+    // Output buffers needed to keep every stage busy: a full ring, one being
+    // decoded into, and one being written.
+    uint32_t OutputBuffers() const { return (uint32_t)outputDepth + 2; }
+};
+
+struct PipelineStats
+{
+    SpscRingStats inputRing;
+    SpscRingStats outputRing;
+    uint64_t poolStalls = 0;        // decode stage waiting for a free output buffer
+    double readSeconds = 0;
+    double writeSeconds = 0;
+};
+
+struct PcmBlock
+{
+    uint8_t* buffer = nullptr;
+    size_t size = 0;
+    int64_t sampleTime = -1;
+    uint32_t sampleCount = 0;
+};
+
+namespace PipelineDetail
+{
+    class RingInput
+    {
+    public:
+        explicit RingInput(SpscRing<DecoderInput>& ring) : ring(ring) {}
+        bool Next(DecoderInput& input) { return ring.Pop(input); }
+        void Accepted() {}
+
+    private:
+        SpscRing<DecoderInput>& ring;
+    };
+
+    class RingOutput
+    {
+    public:
+        RingOutput(BufferPool& pool, SpscRing<PcmBlock>& ring, uint64_t& poolStalls) : pool(pool), ring(ring), poolStalls(poolStalls) {}
+
+        uint8_t* Acquire(size_t& capacity)
+        {
+            capacity = pool.BufferSize();
+            if (buffer != nullptr)
+            {
+                return buffer;
+            }
+            buffer = pool.Acquire();
+            if (buffer == nullptr)
+            {
+                // Every buffer is queued or being written.
+                poolStalls++;
+                while ((buffer = pool.Acquire()) == nullptr && !ring.Cancelled())
+                {
+                    std::this_thread::yield();
+                }
+            }
+            return buffer;
+        }
+
+        bool Commit(const DecoderOutput& output)
+        {
+            PcmBlock block;
+            block.buffer = output.buffer;
+            block.size = output.size;
+            block.sampleTime = output.sampleTime;
+            block.sampleCount = output.sampleCount;
+            if (!ring.Push(block))
+            {
+                return false;
+            }
+            buffer = nullptr;
+            return true;
+        }
+
+        void Finish()
+        {
+            if (buffer != nullptr)
+            {
+                pool.Release(buffer);
+                buffer = nullptr;
+            }
+        }
+
+    private:
+        BufferPool& pool;
+        SpscRing<PcmBlock>& ring;
+        uint64_t& poolStalls;
+        uint8_t* buffer = nullptr;
+    };
+
+    // Reads one byte per page so the fault is taken here, not in the decoder.
+    inline uint64_t Prefault(const BitstreamSlice& slice)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < slice.size; i += 4096)
+        {
+            sum += slice.data[i];
+        }
+        if (slice.size != 0)
+        {
+            sum += slice.data[slice.size - 1];
+        }
+        return sum;
+    }
+}
+
+// Same contract as DecodeStream. The sink is only called from the write
+// thread, the input hook only from the read thread. outputPool should hold
+// options.OutputBuffers() buffers; fewer still works but serializes stages.
+template <class Sink, class InputHook = NoInputHook>
+bool PipelinedDecodeStream(DdpFrameSplitter& splitter, DecoderTransform& decoder, BufferPool& outputPool, Sink& sink,
+    DecodeStats& stats, std::shared_ptr<const void> owner = nullptr, InputHook inputHook = InputHook(),
+    const PipelineOptions& options = PipelineOptions(), PipelineStats* pipelineStats = nullptr, int64_t startSample = 0)
+{
+    SpscRing<DecoderInput> inputRing{ options.inputDepth };
+    SpscRing<PcmBlock> outputRing{ options.outputDepth };
+    PipelineStats local;
+
+    std::thread reader([&]
+    {
+        auto start = std::chrono::steady_clock::now();
+        SplitterInput<InputHook> input{ splitter, stats, std::move(owner), inputHook, startSample };
+        DecoderInput unit;
+        volatile uint64_t touched = 0;
+        while (input.Next(unit))
+        {
+            if (options.prefaultInput)
+            {
+                touched = touched + PipelineDetail::Prefault(unit.slice);
+            }
+            if (!inputRing.Push(unit))
+            {
+                break;
+            }
+            // The release window trails far behind the ring depth, so pages
+            // released here are long done with by the decoder.
+            input.Accepted();
+        }
+        inputRing.Close();
+        local.readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    std::thread writer([&]
+    {
+        auto start = std::chrono::steady_clock::now();
+        PcmBlock block;
+        while (outputRing.Pop(block))
+        {
+            DDP_TIMED(DecodeStage::Write, WriteDecoded(sink, block.buffer, block.size, block.sampleTime, block.sampleCount));
+            outputPool.Release(block.buffer);
+        }
+        local.writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    PipelineDetail::RingInput input{ inputRing };
+    PipelineDetail::RingOutput output{ outputPool, outputRing, local.poolStalls };
+    bool ok = RunDecodeLoop(input, decoder, output, stats);
+    if (ok)
+    {
+        outputRing.Close();
+    }
+    else
+    {
+        inputRing.Cancel();
+        outputRing.Cancel();
+    }
+    reader.join();
+    writer.join();
+
+    // Buffers left in a cancelled ring go back to the pool.
+    PcmBlock block;
+    while (outputRing.TryPop(block))
+    {
+        outputPool.Release(block.buffer);
+    }
+
+    if (pipelineStats != nullptr)
+    {
+        local.inputRing = inputRing.GetStats();
+        local.outputRing = outputRing.GetStats();
+        *pipelineStats = local;
+    }
+    return ok;
+}
@@ -0,0 +1,269 @@
+#pragma once
+// Planar (one buffer per channel) output for analysis tooling.
+//
+// Deinterleaver splits interleaved float frames into per-channel planes. A
+// plain frame-by-frame loop writes to every plane on each frame and a
+// channel-by-channel loop rereads the whole input once per channel; both
+// fall apart at 6-16 channels. Here the input is walked in blocks of
+// BlockFrames that stay in L1, and inside a block groups of 4 channels are
+// transposed in registers, 8 frames at a time with AVX2 and 4 with SSE2,
+// so every store is a full vector. Left-over channels and frames are
+// copied one at a time.
+//
+// PlanarWaveWriter uses it to write one mono WAVE file per channel.
+#include "BufferedPcmWriter.h"
+#include "ChannelMixer.h"
+#include "CpuFeatures.h"
+#include "PcmConverter.h"
+#include "PcmFormat.h"
+#include "WaveFileWriter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Deinterleaver
+{
+public:
+    static const size_t BlockFrames = 256;
+
+    // level is clamped to what the CPU supports.
+    explicit Deinterleaver(SimdLevel level = SimdLevel::Avx2) : level(ClampSimdLevel(level)) {}
+
+    SimdLevel Level() const { return level; }
+
+    // in holds frames x channels floats; planes[c] receives frames floats.
+    void Deinterleave(const float* in, size_t frames, uint16_t channels, float* const* planes) const
+    {
+        for (size_t first = 0; first < frames; first += BlockFrames)
+        {
+            size_t count = frames - first < BlockFrames ? frames - first : BlockFrames;
+            const float* block = in + first * channels;
+            uint16_t channel = 0;
+#ifdef SIMD_X86
+            if (level == SimdLevel::Avx2)
+            {
+                channel = TransposeAvx2(block, count, channels, planes, first);
+            }
+            if (level != SimdLevel::Scalar)
+            {
+                channel = TransposeSse2(block, count, channels, planes, first, channel);
+            }
+#endif
+            for (; channel < channels; channel++)
+            {
+                CopyChannel(block, 0, count, channels, planes[channel] + first, channel);
+            }
+        }
+    }
+
+private:
+    static void CopyChannel(const float* block, size_t frame, size_t count, uint16_t channels, float* plane, uint16_t channel)
+    {
+        for (; frame < count; frame++)
+        {
+            plane[frame] = block[frame * channels + channel];
+        }
+    }
+
+#ifdef SIMD_X86
+    // Groups of 4 channels from channel on; returns the first channel left.
+    SIMD_TARGET_SSE2 static uint16_t TransposeSse2(const float* block, size_t count, uint16_t channels, float* const* planes, size_t first, uint16_t channel)
+    {
+        for (; channel + 4 <= channels; channel += 4)
+        {
+            float* out0 = planes[channel] + first;
+            float* out1 = planes[channel + 1] + first;
+            float* out2 = planes[channel + 2] + first;
+            float* out3 = planes[channel + 3] + first;
+            size_t frame = 0;
+            for (; frame + 4 <= count; frame += 4)
+            {
+                const float* p = block + frame * channels + channel;
+                auto r0 = _mm_loadu_ps(p);
+                auto r1 = _mm_loadu_ps(p + channels);
+                auto r2 = _mm_loadu_ps(p + 2 * channels);
+                auto r3 = _mm_loadu_ps(p + 3 * channels);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(out0 + frame, r0);
+                _mm_storeu_ps(out1 + frame, r1);
+                _mm_storeu_ps(out2 + frame, r2);
+                _mm_storeu_ps(out3 + frame, r3);
+            }
+            for (uint16_t lane = 0; lane < 4; lane++)
+            {
+                CopyChannel(block, frame, count, channels, planes[channel + lane] + first, channel + lane);
+            }
+        }
+        return channel;
+    }
+
+    // Groups of 4 channels, 8 frames per step: frames k and k + 4 share a
+    // register (one per 128-bit half), so the in-lane 4x4 transpose leaves
+    // each channel's 8 frames in order in one register.
+    SIMD_TARGET_AVX2 static uint16_t TransposeAvx2(const float* block, size_t count, uint16_t channels, float* const* planes, size_t first)
+    {
+        uint16_t channel = 0;
+        for (; channel + 4 <= channels; channel += 4)
+        {
+            float* out0 = planes[channel] + first;
+            float* out1 = planes[channel + 1] + first;
+            float* out2 = planes[channel + 2] + first;
+            float* out3 = planes[channel + 3] + first;
+            size_t frame = 0;
+            for (; frame + 8 <= count; frame += 8)
+            {
+                const float* p = block + frame * channels + channel;
+                const float* q = p + 4 * channels;
+                auto r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(q), 1);
+                auto r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + channels)), _mm_loadu_ps(q + channels), 1);
+                auto r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 2 * channels)), _mm_loadu_ps(q + 2 * channels), 1);
+                auto r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 3 * channels)), _mm_loadu_ps(q + 3 * channels), 1);
+                auto t0 = _mm256_unpacklo_ps(r0, r1);
+                auto t1 = _mm256_unpackhi_ps(r0, r1);
+                auto t2 = _mm256_unpacklo_ps(r2, r3);
+                auto t3 = _mm256_unpackhi_ps(r2, r3);
+                _mm256_storeu_ps(out0 + frame, _mm256_shuffle_ps(t0, t2, 0x44));
+                _mm256_storeu_ps(out1 + frame, _mm256_shuffle_ps(t0, t2, 0xEE));
+                _mm256_storeu_ps(out2 + frame, _mm256_shuffle_ps(t1, t3, 0x44));
+                _mm256_storeu_ps(out3 + frame, _mm256_shuffle_ps(t1, t3, 0xEE));
+            }
+            for (uint16_t lane = 0; lane < 4; lane++)
+            {
+                CopyChannel(block, frame, count, channels, planes[channel + lane] + first, channel + lane);
+            }
+        }
+        return channel;
+    }
+#endif
+
+    SimdLevel level;
+};
+
+// "out.wav", speaker FC -> "out.FC.wav"; channels without a speaker name
+// get their index ("out.ch9.wav").
+template <class Char>
+std::basic_string<Char> PlanarFileName(const Char* basePath, uint32_t speaker, uint16_t index)
+{
+    auto name = SpeakerName(speaker);
+    return SuffixedWaveFileName(basePath, "." + (name != nullptr ? std::string(name) : "ch" + std::to_string(index)));
+}
+
+// Writes interleaved float PCM as one mono WAVE file per channel, each in
+// its own converter (and dither generator) when writing integers.
+class PlanarWaveWriter
+{
+public:
+    PlanarWaveWriter() = default;
+    PlanarWaveWriter(const PlanarWaveWriter&) = delete;
+    PlanarWaveWriter& operator=(const PlanarWaveWriter&) = delete;
+    ~PlanarWaveWriter()
+    {
+        Close();
+    }
+
+    // format describes the interleaved input; its sampleType is what the
+    // files are written as.
+    template <class Char>
+    bool Open(const Char* basePath, const PcmFormat& newFormat, bool dither)
+    {
+        Close();
+        format = newFormat;
+        stats = PcmWriterStats();
+        dataBytes = 0;
+        failed = false;
+        auto mask = format.channelMask != 0 ? format.channelMask : DefaultChannelMask(format.channels);
+        // Many files are open at once: smaller blocks, no write-behind
+        // thread per file.
+        PcmWriterOptions writerOptions;
+        writerOptions.blockSize = 1 << 20;
+        writerOptions.writeBehind = false;
+        uint32_t bit = 1;
+        for (uint16_t channel = 0; channel < format.channels; channel++)
+        {
+            // The channel's speaker is the mask's next set bit, if any.
+            while (bit != 0 && (mask & bit) == 0)
+            {
+                bit <<= 1;
+            }
+            auto mono = format;
+            mono.channels = 1;
+            mono.channelMask = bit != 0 ? bit : SPEAKER_BIT_FC;
+            auto path = PlanarFileName(basePath, bit, channel);
+            auto writer = std::make_unique<WaveFileWriter>();
+            if (!writer->Open(path.c_str(), mono, writerOptions))
+            {
+                Close();
+                return false;
+            }
+            auto converter = std::make_unique<PcmConverter>(format.sampleType, dither, PcmConverter::DefaultSeed + channel);
+            sinks.push_back(std::make_unique<ConvertingSink<WaveFileWriter>>(*writer, *converter));
+            writers.push_back(std::move(writer));
+            converters.push_back(std::move(converter));
+            bit <<= 1;
+        }
+        return true;
+    }
+
+    void Write(const void* buffer, size_t size)
+    {
+        auto channels = (uint16_t)sinks.size();
+        if (channels == 0)
+        {
+            return;
+        }
+        auto frames = size / (sizeof(float) * channels);
+        if (scratch.size() < frames * channels)
+        {
+            scratch.resize(frames * channels);
+        }
+        planes.resize(channels);
+        for (uint16_t channel = 0; channel < channels; channel++)
+        {
+            planes[channel] = scratch.data() + channel * frames;
+        }
+        deinterleaver.Deinterleave((const float*)buffer, frames, channels, planes.data());
+        for (uint16_t channel = 0; channel < channels; channel++)
+        {
+            sinks[channel]->Write(planes[channel], frames * sizeof(float));
+        }
+    }
+
+    void Close()
+    {
+        for (auto& writer : writers)
+        {
+            writer->Close();
+            auto writerStats = writer->GetStats();
+            stats.bytes += writerStats.bytes;
+            stats.syscalls += writerStats.syscalls;
+            stats.stalls += writerStats.stalls;
+            stats.seconds = writerStats.seconds > stats.seconds ? writerStats.seconds : stats.seconds;
+            dataBytes += writer->DataBytes();
+            failed = failed || writer->Failed();
+        }
+        sinks.clear();
+        converters.clear();
+        writers.clear();
+    }
+
+    size_t Files() const { return writers.size(); }
+    const PcmFormat& Format() const { return format; }
+    // Totals over all files, complete after Close().
+    uint64_t DataBytes() const { return dataBytes; }
+    PcmWriterStats GetStats() const { return stats; }
+    bool Failed() const { return failed; }
+
+private:
+    PcmFormat format;
+    Deinterleaver deinterleaver;
+    std::vector<std::unique_ptr<WaveFileWriter>> writers;
+    std::vector<std::unique_ptr<PcmConverter>> converters;
+    std::vector<std::unique_ptr<ConvertingSink<WaveFileWriter>>> sinks;
+    std::vector<float> scratch;
+    std::vector<float*> planes;
+    PcmWriterStats stats;
+    uint64_t dataBytes = 0;
+    bool failed = false;
+};
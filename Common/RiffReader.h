@@ -0,0 +1,197 @@
+#pragma once
+// Chunk-walking RIFF/RF64 reader.
+//
+// Instead of loading the whole WAV and scanning for the bytes "data", the
+// reader hops from chunk header to chunk header (honouring the even-size pad
+// byte), picks up the ds64 sizes for RF64 files and then serves the data
+// chunk through bounded Read() calls, so memory use does not depend on the
+// size of the input.
+#include "FileIO.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class RiffReader
+{
+public:
+    RiffReader() = default;
+    RiffReader(const RiffReader&) = delete;
+    RiffReader& operator=(const RiffReader&) = delete;
+    ~RiffReader()
+    {
+        Close();
+    }
+
+    bool Open(const char* path)
+    {
+        Close();
+        file = OpenFile(path, "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        if (!SeekFileEnd64(file))
+        {
+            Close();
+            return false;
+        }
+        fileSize = TellFile64(file);
+        if (!SeekFile64(file, 0) || !ParseChunks())
+        {
+            Close();
+            return false;
+        }
+        return SeekData(0);
+    }
+
+    void Close()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+        fileSize = 0;
+        dataOffset = 0;
+        dataSize = 0;
+        dataPosition = 0;
+        isRF64 = false;
+        format.clear();
+    }
+
+    // Reads at most maxSize bytes of the data chunk; returns 0 at the end.
+    size_t Read(uint8_t* buffer, size_t maxSize)
+    {
+        auto remaining = Remaining();
+        if (file == nullptr || remaining == 0)
+        {
+            return 0;
+        }
+        auto toRead = (size_t)(remaining < maxSize ? remaining : maxSize);
+        auto readed = fread(buffer, 1, toRead, file);
+        dataPosition += readed;
+        return readed;
+    }
+
+    // Positions the next Read() at the given byte offset inside the data chunk.
+    bool SeekData(uint64_t position)
+    {
+        if (file == nullptr || position > dataSize)
+        {
+            return false;
+        }
+        if (!SeekFile64(file, dataOffset + position))
+        {
+            return false;
+        }
+        dataPosition = position;
+        return true;
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+    bool IsRF64() const { return isRF64; }
+    uint64_t FileSize() const { return fileSize; }
+    uint64_t DataOffset() const { return dataOffset; }
+    uint64_t DataSize() const { return dataSize; }
+    uint64_t DataPosition() const { return dataPosition; }
+    uint64_t Remaining() const { return dataSize - dataPosition; }
+
+    // Raw contents of the "fmt " chunk (a WAVEFORMATEX/WAVEFORMATEXTENSIBLE).
+    const std::vector<uint8_t>& Format() const { return format; }
+
+private:
+    static uint32_t ReadLE32(const uint8_t* p)
+    {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static uint64_t ReadLE64(const uint8_t* p)
+    {
+        return (uint64_t)ReadLE32(p) | ((uint64_t)ReadLE32(p + 4) << 32);
+    }
+
+    bool ReadExact(void* buffer, size_t size)
+    {
+        return fread(buffer, 1, size, file) == size;
+    }
+
+    bool ParseChunks()
+    {
+        uint8_t header[12];
+        if (!ReadExact(header, sizeof(header)) || memcmp(header + 8, "WAVE", 4) != 0)
+        {
+            return false;
+        }
+        if (memcmp(header, "RF64", 4) == 0)
+        {
+            isRF64 = true;
+        }
+        else if (memcmp(header, "RIFF", 4) != 0)
+        {
+            return false;
+        }
+
+        uint64_t ds64DataSize = 0;
+        uint64_t offset = sizeof(header);
+        while (offset + 8 <= fileSize)
+        {
+            uint8_t chunkHeader[8];
+            if (!SeekFile64(file, offset) || !ReadExact(chunkHeader, sizeof(chunkHeader)))
+            {
+                return false;
+            }
+            uint64_t chunkSize = ReadLE32(chunkHeader + 4);
+            auto chunkBody = offset + sizeof(chunkHeader);
+
+            if (memcmp(chunkHeader, "ds64", 4) == 0)
+            {
+                // riffSize(8) dataSize(8) sampleCount(8) tableLength(4) ...
+                uint8_t ds64[24];
+                if (chunkSize < sizeof(ds64) || !ReadExact(ds64, sizeof(ds64)))
+                {
+                    return false;
+                }
+                ds64DataSize = ReadLE64(ds64 + 8);
+            }
+            else if (memcmp(chunkHeader, "fmt ", 4) == 0)
+            {
+                if (chunkSize > 0xFFFF)
+                {
+                    return false;
+                }
+                format.resize((size_t)chunkSize);
+                if (!ReadExact(format.data(), format.size()))
+                {
+                    return false;
+                }
+            }
+            else if (memcmp(chunkHeader, "data", 4) == 0)
+            {
+                if (isRF64 && chunkSize == 0xFFFFFFFF)
+                {
+                    chunkSize = ds64DataSize;
+                }
+                // Truncated captures and streamed RIFFs with a placeholder size:
+                // trust the file, not the header.
+                if (chunkBody + chunkSize > fileSize)
+                {
+                    chunkSize = fileSize - chunkBody;
+                }
+                dataOffset = chunkBody;
+                dataSize = chunkSize;
+                return true;
+            }
+
+            offset = chunkBody + chunkSize + (chunkSize & 1);
+        }
+        return false;
+    }
+
+    FILE* file = nullptr;
+    uint64_t fileSize = 0;
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    uint64_t dataPosition = 0;
+    bool isRF64 = false;
+    std::vector<uint8_t> format;
+};
@@ -0,0 +1,311 @@
+#pragma once
+// Sample-accurate timeline tracking for long-running decodes.
+//
+// Input access units are stamped from a running 64-bit sample clock that
+// advances by each frame's size (SplitterInput), and the decoder carries
+// the stamp through to its output. TimelineMonitor then checks every
+// output buffer against its own clock, advanced by the samples actually
+// delivered: a buffer that starts late is a gap (dropped or concealed-away
+// frames), one that starts early an overlap (duplicated frames). Either is
+// counted and logged, and optionally repaired (gaps filled with silence,
+// overlaps trimmed) so the output stays on the source timeline over
+// multi-hour content instead of drifting by a frame per dropout.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SampleClock
+{
+public:
+    explicit SampleClock(int64_t start = 0) : position(start) {}
+
+    int64_t Position() const { return position; }
+
+    // Returns the position of a block of samples and moves past it.
+    int64_t Stamp(uint32_t samples)
+    {
+        auto start = position;
+        position += samples;
+        return start;
+    }
+
+    void Reset(int64_t start) { position = start; }
+
+private:
+    int64_t position;
+};
+
+struct TimelineOptions
+{
+    bool fillGaps = false;          // write silence for missing samples
+    bool trimOverlaps = false;      // drop samples already delivered
+    // Larger gaps are logged but not filled: a corrupt or wrapped timestamp
+    // must not turn into gigabytes of silence. 5 s at 48 kHz.
+    uint64_t maxFillSamples = 48000 * 5;
+    // Timestamps that round-trip through 100 ns units (Media Foundation)
+    // may be off by one sample; smaller differences are not reported.
+    uint32_t toleranceSamples = 1;
+};
+
+enum class DiscontinuityKind
+{
+    Gap,
+    Overlap,
+};
+
+struct Discontinuity
+{
+    DiscontinuityKind kind = DiscontinuityKind::Gap;
+    int64_t expected = 0;           // where the buffer should have started
+    int64_t actual = 0;             // where it says it starts
+    uint64_t samples = 0;           // size of the gap or overlap
+};
+
+struct TimelineStats
+{
+    static const size_t MaxLogged = 32;
+
+    uint64_t buffers = 0;
+    uint64_t untimedBuffers = 0;    // buffers without a timestamp, assumed contiguous
+    uint64_t gaps = 0;
+    uint64_t overlaps = 0;
+    uint64_t gapSamples = 0;
+    uint64_t overlapSamples = 0;
+    uint64_t filledSamples = 0;
+    uint64_t trimmedSamples = 0;
+    uint64_t unfilledGaps = 0;      // gaps above maxFillSamples, left as they are
+    int64_t startSample = -1;       // timeline origin: the first buffer's position
+    int64_t endSample = -1;         // where the next buffer is expected
+    std::vector<Discontinuity> log; // the first MaxLogged discontinuities
+
+    uint64_t Discontinuities() const { return gaps + overlaps; }
+};
+
+// What to do with one output buffer.
+struct TimelineAction
+{
+    uint64_t fillSamples = 0;       // silence to write before the buffer
+    uint32_t skipSamples = 0;       // leading samples of the buffer to drop
+};
+
+class TimelineMonitor
+{
+public:
+    explicit TimelineMonitor(const TimelineOptions& options = TimelineOptions()) : options(options) {}
+
+    // sampleTime -1 means the buffer has no timestamp.
+    TimelineAction Check(int64_t sampleTime, uint32_t sampleCount)
+    {
+        TimelineAction action;
+        stats.buffers++;
+        if (stats.startSample < 0)
+        {
+            // The first buffer defines the origin; a stream that starts
+            // late (after a seek) is not a gap.
+            stats.startSample = sampleTime >= 0 ? sampleTime : 0;
+            stats.endSample = stats.startSample;
+        }
+        if (sampleTime < 0)
+        {
+            stats.untimedBuffers++;
+            sampleTime = stats.endSample;
+        }
+
+        auto delta = sampleTime - stats.endSample;
+        if (delta > (int64_t)options.toleranceSamples)
+        {
+            Record(DiscontinuityKind::Gap, sampleTime, (uint64_t)delta);
+            stats.gaps++;
+            stats.gapSamples += (uint64_t)delta;
+            if (options.fillGaps && (uint64_t)delta <= options.maxFillSamples)
+            {
+                action.fillSamples = (uint64_t)delta;
+                stats.filledSamples += (uint64_t)delta;
+            }
+            else if (options.fillGaps)
+            {
+                stats.unfilledGaps++;
+            }
+        }
+        else if (delta < -(int64_t)options.toleranceSamples)
+        {
+            auto overlap = (uint64_t)-delta;
+            Record(DiscontinuityKind::Overlap, sampleTime, overlap);
+            stats.overlaps++;
+            stats.overlapSamples += overlap;
+            if (options.trimOverlaps)
+            {
+                action.skipSamples = overlap < sampleCount ? (uint32_t)overlap : sampleCount;
+                stats.trimmedSamples += action.skipSamples;
+            }
+        }
+        else
+        {
+            // Within tolerance: keep counting from our own clock so rounded
+            // timestamps cannot accumulate into drift.
+            sampleTime = stats.endSample;
+        }
+
+        // A trimmed overlap leaves the output where it was if the whole
+        // buffer had already been delivered.
+        auto end = sampleTime + sampleCount;
+        stats.endSample = options.trimOverlaps && end < stats.endSample ? stats.endSample : end;
+        return action;
+    }
+
+    const TimelineStats& Stats() const { return stats; }
+
+private:
+    void Record(DiscontinuityKind kind, int64_t actual, uint64_t samples)
+    {
+        if (stats.log.size() < TimelineStats::MaxLogged)
+        {
+            Discontinuity event;
+            event.kind = kind;
+            event.expected = stats.endSample;
+            event.actual = actual;
+            event.samples = samples;
+            stats.log.push_back(event);
+        }
+    }
+
+    TimelineOptions options;
+    TimelineStats stats;
+};
+
+// Sinks with a WriteAt(buffer, size, sampleTime, sampleCount) method
+// (TimelineSink) are handed each buffer's position; others just get Write.
+namespace SinkDetail
+{
+    template <class Sink>
+    auto WriteDecoded(Sink& sink, const void* buffer, size_t size, int64_t sampleTime, uint32_t sampleCount, int)
+        -> decltype(sink.WriteAt(buffer, size, sampleTime, sampleCount), void())
+    {
+        sink.WriteAt(buffer, size, sampleTime, sampleCount);
+    }
+
+    template <class Sink>
+    void WriteDecoded(Sink& sink, const void* buffer, size_t size, int64_t, uint32_t, long)
+    {
+        sink.Write(buffer, size);
+    }
+}
+
+template <class Sink>
+void WriteDecoded(Sink& sink, const void* buffer, size_t size, int64_t sampleTime, uint32_t sampleCount)
+{
+    SinkDetail::WriteDecoded(sink, buffer, size, sampleTime, sampleCount, 0);
+}
+
+// Sink adapter that checks each decoded buffer's position and applies the
+// monitor's repairs before passing it on. Buffers arrive through WriteAt
+// (see WriteDecoded); plain Write is treated as an untimed buffer.
+template <class Sink>
+class TimelineSink
+{
+public:
+    TimelineSink(Sink& sink, size_t frameBytes, const TimelineOptions& options = TimelineOptions())
+        : sink(sink), frameBytes(frameBytes), monitor(options)
+    {
+    }
+
+    void Write(const void* buffer, size_t size)
+    {
+        WriteAt(buffer, size, -1, (uint32_t)(size / frameBytes));
+    }
+
+    void WriteAt(const void* buffer, size_t size, int64_t sampleTime, uint32_t sampleCount)
+    {
+        if (sampleCount == 0)
+        {
+            sampleCount = (uint32_t)(size / frameBytes);
+        }
+        auto action = monitor.Check(sampleTime, sampleCount);
+        if (action.fillSamples != 0)
+        {
+            WriteSilence(action.fillSamples * frameBytes);
+        }
+        auto skip = (size_t)action.skipSamples * frameBytes;
+        if (skip < size)
+        {
+            sink.Write((const uint8_t*)buffer + skip, size - skip);
+        }
+    }
+
+    const TimelineStats& Stats() const { return monitor.Stats(); }
+
+private:
+    void WriteSilence(uint64_t bytes)
+    {
+        // Whole frames per chunk, so downstream mixers see complete frames.
+        const size_t chunk = (65536 / frameBytes + 1) * frameBytes;
+        if (silence.size() < chunk)
+        {
+            silence.assign(chunk, 0);
+        }
+        while (bytes != 0)
+        {
+            auto size = bytes < chunk ? (size_t)bytes : chunk;
+            sink.Write(silence.data(), size);
+            bytes -= size;
+        }
+    }
+
+    Sink& sink;
+    size_t frameBytes;
+    TimelineMonitor monitor;
+    std::vector<uint8_t> silence;
+};
+
+// Sink adapter that keeps only the samples in [startSample, endSample) of
+// positioned buffers: cuts the pre-roll and tail of a range decode to the
+// exact sample. Untimed buffers are taken to follow the previous one.
+template <class Sink>
+class RangeSink
+{
+public:
+    RangeSink(Sink& sink, size_t frameBytes, int64_t startSample = 0, int64_t endSample = INT64_MAX)
+        : sink(sink), frameBytes(frameBytes), startSample(startSample), endSample(endSample)
+    {
+    }
+
+    void Write(const void* buffer, size_t size)
+    {
+        WriteAt(buffer, size, -1, 0);
+    }
+
+    void WriteAt(const void* buffer, size_t size, int64_t sampleTime, uint32_t sampleCount)
+    {
+        if (sampleCount == 0)
+        {
+            sampleCount = (uint32_t)(size / frameBytes);
+        }
+        if (sampleTime < 0)
+        {
+            sampleTime = next;
+        }
+        next = sampleTime + sampleCount;
+        auto begin = sampleTime > startSample ? sampleTime : startSample;
+        auto end = next < endSample ? next : endSample;
+        if (begin >= end)
+        {
+            droppedSamples += sampleCount;
+            return;
+        }
+        auto keep = (uint32_t)(end - begin);
+        droppedSamples += sampleCount - keep;
+        WriteDecoded(sink, (const uint8_t*)buffer + (size_t)(begin - sampleTime) * frameBytes, (size_t)keep * frameBytes, begin, keep);
+    }
+
+    // True once a buffer reached the end of the range.
+    bool Done() const { return next >= endSample; }
+    uint64_t DroppedSamples() const { return droppedSamples; }
+
+private:
+    Sink& sink;
+    size_t frameBytes;
+    int64_t startSample;
+    int64_t endSample;
+    int64_t next = 0;
+    uint64_t droppedSamples = 0;
+};
@@ -0,0 +1,196 @@
+#pragma once
+// Bounded single-producer/single-consumer ring buffer.
+//
+// TryPush/TryPop never block or lock: the producer only writes tail, the
+// consumer only writes head, and each side caches the other's index so it
+// touches the shared cache line only when the ring looks full or empty.
+// Push/Pop add a spin-then-yield-then-sleep wait on top and count how often
+// and how long each side had to wait, which is what tells a pipeline which
+// stage is the bottleneck. Close() marks the end of the stream and Cancel()
+// makes both sides give up, e.g. when a stage fails.
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+struct SpscRingStats
+{
+    size_t capacity = 0;
+    uint64_t pushes = 0;
+    uint64_t fullStalls = 0;        // Push calls that found the ring full
+    uint64_t emptyStalls = 0;       // Pop calls that found the ring empty
+    double fullStallSeconds = 0;
+    double emptyStallSeconds = 0;
+    uint64_t occupancySum = 0;      // ring size seen by each push, before it
+    size_t maxOccupancy = 0;
+
+    double MeanOccupancy() const { return pushes != 0 ? occupancySum / (double)pushes : 0; }
+};
+
+template <class T>
+class SpscRing
+{
+public:
+    // depth is rounded up to a power of two.
+    explicit SpscRing(size_t depth)
+    {
+        size_t capacity = 1;
+        while (capacity < depth)
+        {
+            capacity <<= 1;
+        }
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t Capacity() const { return slots.size(); }
+
+    size_t Size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    // Producer side.
+    bool TryPush(T& item)
+    {
+        auto position = tail.load(std::memory_order_relaxed);
+        if (position - producerHead >= slots.size())
+        {
+            producerHead = head.load(std::memory_order_acquire);
+            if (position - producerHead >= slots.size())
+            {
+                return false;
+            }
+        }
+        auto occupancy = position - producerHead;
+        producer.occupancySum += occupancy;
+        if (occupancy > producer.maxOccupancy)
+        {
+            producer.maxOccupancy = occupancy;
+        }
+        producer.pushes++;
+        slots[position & mask] = std::move(item);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool TryPop(T& item)
+    {
+        auto position = head.load(std::memory_order_relaxed);
+        if (position == consumerTail)
+        {
+            consumerTail = tail.load(std::memory_order_acquire);
+            if (position == consumerTail)
+            {
+                return false;
+            }
+        }
+        item = std::move(slots[position & mask]);
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocks while the ring is full; false if the ring was cancelled.
+    bool Push(T& item)
+    {
+        if (TryPush(item))
+        {
+            return true;
+        }
+        producer.fullStalls++;
+        auto start = std::chrono::steady_clock::now();
+        bool pushed = Wait([&] { return TryPush(item); });
+        producer.fullStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return pushed;
+    }
+
+    // Blocks while the ring is empty; false once it is closed and drained,
+    // or cancelled.
+    bool Pop(T& item)
+    {
+        if (TryPop(item))
+        {
+            return true;
+        }
+        consumer.emptyStalls++;
+        auto start = std::chrono::steady_clock::now();
+        bool popped = Wait([&]
+        {
+            if (TryPop(item))
+            {
+                return true;
+            }
+            // Re-check after seeing closed: the last push may have landed in between.
+            return closed.load(std::memory_order_acquire) && TryPop(item);
+        }, true);
+        consumer.emptyStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return popped;
+    }
+
+    // Producer: no more items will be pushed.
+    void Close() { closed.store(true, std::memory_order_release); }
+
+    // Either side: make pending and future Push/Pop calls fail.
+    void Cancel() { cancelled.store(true, std::memory_order_release); }
+    bool Cancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    // Only meaningful once both sides have stopped.
+    SpscRingStats GetStats() const
+    {
+        SpscRingStats stats = producer;
+        stats.capacity = slots.size();
+        stats.emptyStalls = consumer.emptyStalls;
+        stats.emptyStallSeconds = consumer.emptyStallSeconds;
+        return stats;
+    }
+
+private:
+    template <class Ready>
+    bool Wait(Ready ready, bool stopWhenClosed = false)
+    {
+        for (uint32_t attempt = 0; ; attempt++)
+        {
+            if (ready())
+            {
+                return true;
+            }
+            if (cancelled.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            if (stopWhenClosed && closed.load(std::memory_order_acquire) && head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            if (attempt < 64)
+            {
+                continue;
+            }
+            if (attempt < 256)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    alignas(64) std::atomic<size_t> head{ 0 };  // next slot to pop; written by the consumer
+    alignas(64) std::atomic<size_t> tail{ 0 };  // next slot to push; written by the producer
+    alignas(64) size_t producerHead = 0;        // producer's cached head
+    SpscRingStats producer;
+    alignas(64) size_t consumerTail = 0;        // consumer's cached tail
+    SpscRingStats consumer;
+    alignas(64) std::atomic<bool> closed{ false };
+    std::atomic<bool> cancelled{ false };
+    std::vector<T> slots;
+    size_t mask = 0;
+};
@@ -0,0 +1,174 @@
+#pragma once
+// Deterministic stand-in for the Dolby Digital Plus decoder MFT.
+//
+// Accepts AC-3/E-AC-3 access units and produces float PCM whose samples
+// are a pure function of the current and previous access unit's bytes, so
+// (like a real decoder) it needs one frame of pre-roll after a Flush, and
+// two runs over the same frames are bit-identical. Its input queue is
+// bounded and it can refuse input periodically to exercise the
+// MF_E_NOTACCEPTING path.
+#include "DdpFrameParser.h"
+#include "DecoderTransform.h"
+#include <cstring>
+#include <deque>
+
+struct StandInDecoderOptions
+{
+    uint16_t channels = 6;
+    uint32_t sampleRate = 48000;
+    uint32_t inputQueueCapacity = 2;    // access units held before NotAccepting
+    uint32_t refuseEvery = 0;           // if > 0, refuse every Nth input once
+};
+
+class StandInDecoder : public DecoderTransform
+{
+public:
+    explicit StandInDecoder(const StandInDecoderOptions& options = StandInDecoderOptions()) : options(options) {}
+
+    PcmFormat OutputFormat() const override
+    {
+        PcmFormat format;
+        format.sampleRate = options.sampleRate;
+        format.channels = options.channels;
+        format.sampleType = PcmSampleType::Float32;
+        format.channelMask = DefaultChannelMask(options.channels);
+        return format;
+    }
+
+    size_t MaxOutputBytes() const override
+    {
+        return (size_t)MaxSamplesPerFrame * options.channels * sizeof(float);
+    }
+
+    DecodeResult BeginStreaming() override
+    {
+        draining = false;
+        return DecodeResult::Ok;
+    }
+
+    DecodeResult ProcessInput(const DecoderInput& input) override
+    {
+        if (draining)
+        {
+            return DecodeResult::Error;
+        }
+        if (queue.size() >= options.inputQueueCapacity)
+        {
+            return DecodeResult::NotAccepting;
+        }
+        if (options.refuseEvery != 0 && ++inputCalls % options.refuseEvery == 0 && !refusedLast)
+        {
+            refusedLast = true;
+            inputCalls--;
+            return DecodeResult::NotAccepting;
+        }
+        refusedLast = false;
+        queue.push_back(input);
+        return DecodeResult::Ok;
+    }
+
+    DecodeResult ProcessOutput(DecoderOutput& output) override
+    {
+        output.size = 0;
+        if (queue.empty())
+        {
+            return DecodeResult::NeedMoreInput;
+        }
+        const auto& input = queue.front();
+
+        DdpFrameHeader header;
+        uint32_t samples = input.sampleCount;
+        bool valid = ParseDdpFrameHeader(input.slice.data, input.slice.size, header);
+        if (valid)
+        {
+            samples = header.samplesPerFrame;
+        }
+        else
+        {
+            corruptFrames++;
+        }
+        if (samples == 0)
+        {
+            samples = 1536;
+        }
+        auto bytes = (size_t)samples * options.channels * sizeof(float);
+        if (output.buffer == nullptr || output.capacity < bytes)
+        {
+            return DecodeResult::Error;
+        }
+
+        auto pcm = (float*)output.buffer;
+        if (valid)
+        {
+            auto hash = Fnv1a(input.slice.data, input.slice.size);
+            Synthesize(pcm, samples, hash ^ (previousHash * 0x9E3779B97F4A7C15ull));
+            previousHash = hash;
+        }
+        else
+        {
+            // Concealment: silence, and the next frame starts cold.
+            memset(pcm, 0, bytes);
+            previousHash = 0;
+        }
+
+        output.size = bytes;
+        output.sampleCount = samples;
+        output.sampleTime = input.sampleTime >= 0 ? input.sampleTime : nextSampleTime;
+        nextSampleTime = output.sampleTime + samples;
+        queue.pop_front();
+        return DecodeResult::Ok;
+    }
+
+    DecodeResult Drain() override
+    {
+        draining = true;
+        return DecodeResult::Ok;
+    }
+
+    DecodeResult Flush() override
+    {
+        queue.clear();
+        previousHash = 0;
+        nextSampleTime = 0;
+        draining = false;
+        return DecodeResult::Ok;
+    }
+
+    uint64_t CorruptFrames() const { return corruptFrames; }
+
+private:
+    static const uint32_t MaxSamplesPerFrame = 1536;
+
+    static uint64_t Fnv1a(const uint8_t* data, size_t size)
+    {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    void Synthesize(float* pcm, uint32_t samples, uint64_t seed) const
+    {
+        auto state = (uint32_t)(seed ^ (seed >> 32)) | 1;
+        auto count = (size_t)samples * options.channels;
+        for (size_t i = 0; i < count; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            // [-0.5, 0.5) in exact 2^-24 steps, so results do not depend on FP mode.
+            pcm[i] = (float)((int32_t)(state >> 8) - (1 << 23)) * (1.0f / (1 << 24));
+        }
+    }
+
+    StandInDecoderOptions options;
+    std::deque<DecoderInput> queue;
+    uint64_t previousHash = 0;
+    int64_t nextSampleTime = 0;
+    uint64_t inputCalls = 0;
+    uint64_t corruptFrames = 0;
+    bool refusedLast = false;
+    bool draining = false;
+};
@@ -0,0 +1,160 @@
+#pragma once
+// BufferedPcmWriter that produces a self-describing WAVE file.
+//
+// The header is written up front with placeholder sizes and a 28-byte JUNK
+// chunk reserved in front of "fmt ". Close() seeks back and patches the sizes
+// in place; if the file ended up larger than 4 GB the JUNK chunk becomes
+// the ds64 chunk and the file is relabelled RF64 (EBU Tech 3306), so the
+// output never needs buffering or a second pass.
+#include "BufferedPcmWriter.h"
+#include "PcmFormat.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// "out.wav", ".FC" -> "out.FC.wav": a sibling file named after the output
+// (a channel of planar output, or a track of a multi-track source).
+template <class Char>
+std::basic_string<Char> SuffixedWaveFileName(const Char* basePath, const std::string& suffix)
+{
+    std::basic_string<Char> path = basePath;
+    if (path.size() > 4)
+    {
+        auto extension = path.substr(path.size() - 4);
+        if (extension[0] == '.' && (extension[1] | 0x20) == 'w' && (extension[2] | 0x20) == 'a' && (extension[3] | 0x20) == 'v')
+        {
+            path.resize(path.size() - 4);
+        }
+    }
+    auto name = suffix + ".wav";
+    path.append(name.begin(), name.end());
+    return path;
+}
+
+class WaveFileWriter : public BufferedPcmWriter
+{
+public:
+    WaveFileWriter() = default;
+    template <class Char>
+    WaveFileWriter(const Char* path, const PcmFormat& format, const Options& options = Options())
+    {
+        Open(path, format, options);
+    }
+    ~WaveFileWriter()
+    {
+        Close();
+    }
+
+    template <class Char>
+    bool Open(const Char* path, const PcmFormat& newFormat, const Options& options = Options())
+    {
+        Close();
+        if (!BufferedPcmWriter::Open(path, options))
+        {
+            return false;
+        }
+        format = newFormat;
+        dataBytes = 0;
+        auto header = BuildHeader(0, false);
+        BufferedPcmWriter::Write(header.data(), header.size());
+        return true;
+    }
+
+    void Write(const void* buffer, size_t size)
+    {
+        dataBytes += size;
+        BufferedPcmWriter::Write(buffer, size);
+    }
+
+    void Close()
+    {
+        if (!IsOpen())
+        {
+            return;
+        }
+        if (dataBytes & 1)
+        {
+            // Chunks are word aligned; the pad byte is not counted in the size.
+            uint8_t pad = 0;
+            BufferedPcmWriter::Write(&pad, 1);
+        }
+        Flush();
+        auto header = BuildHeader(dataBytes, true);
+        auto file = File();
+        if (!SeekFile64(file, 0) || fwrite(header.data(), 1, header.size(), file) != header.size())
+        {
+            patchFailed = true;
+        }
+        BufferedPcmWriter::Close();
+    }
+
+    uint64_t DataBytes() const { return dataBytes; }
+    const PcmFormat& Format() const { return format; }
+    bool Failed() const { return patchFailed || BufferedPcmWriter::Failed(); }
+
+private:
+    // RIFF(12) + JUNK/ds64(8 + 28) + fmt(8 + 40) + data(8)
+    static const uint32_t Ds64Size = 28;
+    static const uint32_t HeaderSize = 12 + 8 + Ds64Size + 8 + 40 + 8;
+
+    std::vector<uint8_t> BuildHeader(uint64_t dataSize, bool final) const
+    {
+        std::vector<uint8_t> header;
+        header.reserve(HeaderSize);
+        auto putTag = [&](const char* tag)
+        {
+            header.insert(header.end(), tag, tag + 4);
+        };
+        auto put32 = [&](uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                header.push_back((uint8_t)(value >> (8 * i)));
+            }
+        };
+        auto put64 = [&](uint64_t value)
+        {
+            put32((uint32_t)value);
+            put32((uint32_t)(value >> 32));
+        };
+
+        auto fmt = BuildFmtChunk(format);
+        uint64_t riffSize = HeaderSize - 8 + dataSize + (dataSize & 1);
+        bool rf64 = final && riffSize > 0xFFFFFFFFull;
+        // While writing, the sizes say "unknown" so a crashed capture is
+        // still readable as far as it got.
+        uint32_t riffSize32 = !final || rf64 ? 0xFFFFFFFF : (uint32_t)riffSize;
+        uint32_t dataSize32 = !final || rf64 ? 0xFFFFFFFF : (uint32_t)dataSize;
+
+        putTag(rf64 ? "RF64" : "RIFF");
+        put32(riffSize32);
+        putTag("WAVE");
+
+        putTag(rf64 ? "ds64" : "JUNK");
+        put32(Ds64Size);
+        if (rf64)
+        {
+            auto blockAlign = format.BlockAlign();
+            put64(riffSize);
+            put64(dataSize);
+            put64(blockAlign != 0 ? dataSize / blockAlign : 0);
+            put32(0);   // no table entries
+        }
+        else
+        {
+            header.insert(header.end(), Ds64Size, 0);
+        }
+
+        putTag("fmt ");
+        put32((uint32_t)fmt.size());
+        header.insert(header.end(), fmt.begin(), fmt.end());
+
+        putTag("data");
+        put32(dataSize32);
+        return header;
+    }
+
+    PcmFormat format;
+    uint64_t dataBytes = 0;
+    bool patchFailed = false;
+};
@@ -0,0 +1,193 @@
+#pragma once
+// Fixed-size thread pool with one task deque per worker. A worker runs its
+// own deque in submission order and, when that is empty, steals from the
+// back of the others, so a batch of uneven jobs (a 3-hour film next to a
+// 10-second sting) keeps every core busy until the last job starts.
+//
+// Tasks receive the index of the worker running them, which lets callers keep
+// per-worker state (e.g. one decoder instance per worker) without locking.
+// Optional per-thread init/exit hooks run on each worker thread, e.g. for
+// CoInitializeEx/CoUninitialize.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(unsigned worker)>;
+    using ThreadHook = std::function<void(unsigned worker)>;
+
+    // threads == 0 sizes the pool to the number of hardware threads.
+    explicit WorkStealingPool(unsigned threads = 0, ThreadHook threadInit = nullptr, ThreadHook threadExit = nullptr)
+        : threadInit(std::move(threadInit)), threadExit(std::move(threadExit))
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; i++)
+        {
+            queues.emplace_back(new Queue());
+        }
+        for (unsigned i = 0; i < threads; i++)
+        {
+            workers.emplace_back(&WorkStealingPool::Run, this, i);
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        Wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned Size() const { return (unsigned)workers.size(); }
+
+    // Called from a worker, the task goes to that worker's own deque;
+    // otherwise the deques are filled round-robin.
+    void Submit(Task task)
+    {
+        auto& current = CurrentWorker();
+        unsigned index = current.pool == this ? current.index : (unsigned)(nextQueue++ % queues.size());
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued++;
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every submitted task has finished.
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return pending == 0; });
+    }
+
+    uint64_t Steals() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct WorkerIdentity
+    {
+        const WorkStealingPool* pool = nullptr;
+        unsigned index = 0;
+    };
+
+    static WorkerIdentity& CurrentWorker()
+    {
+        static thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+    bool TryTake(unsigned index, Task& task)
+    {
+        {
+            auto& own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            auto& victim = *queues[(index + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(unsigned index)
+    {
+        CurrentWorker() = { this, index };
+        if (threadInit)
+        {
+            threadInit(index);
+        }
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return queued != 0 || stopping; });
+                if (queued == 0)
+                {
+                    break;
+                }
+                // Claim one queued task. Tasks are pushed before they are
+                // counted, so there is always one left for every claim.
+                queued--;
+            }
+            Task task;
+            while (!TryTake(index, task))
+            {
+                // Lost a race for a deque to another claimant; the task we
+                // are owed is in a deque already scanned.
+                std::this_thread::yield();
+            }
+            task(index);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                {
+                    idle.notify_all();
+                }
+            }
+        }
+        if (threadExit)
+        {
+            threadExit(index);
+        }
+        CurrentWorker() = {};
+    }
+
+    ThreadHook threadInit;
+    ThreadHook threadExit;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    size_t queued = 0;      // tasks sitting in deques, not yet claimed
+    size_t pending = 0;     // tasks submitted and not yet finished
+    bool stopping = false;
+    std::atomic<uint64_t> nextQueue{ 0 };
+    std::atomic<uint64_t> steals{ 0 };
+};
@@ -0,0 +1,172 @@
+#pragma once
+// Counts heap allocations made through operator new, for the benchmark
+// suite's allocation column. Replaces the global operators, so it must be
+// included from exactly one translation unit (DDP_Bench has only one).
+// Every form is replaced, nothrow included, so each block is freed by the
+// allocator that made it.
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+inline std::atomic<uint64_t>& AllocationCount()
+{
+    static std::atomic<uint64_t> count{ 0 };
+    return count;
+}
+
+inline uint64_t Allocations()
+{
+    return AllocationCount().load(std::memory_order_relaxed);
+}
+
+namespace AllocationCounterDetail
+{
+    // Null on failure; the throwing operators turn that into bad_alloc.
+    inline void* TryAllocate(size_t size) noexcept
+    {
+        AllocationCount().fetch_add(1, std::memory_order_relaxed);
+        return malloc(size != 0 ? size : 1);
+    }
+
+    inline void* TryAllocateAligned(size_t size, std::align_val_t alignment) noexcept
+    {
+        AllocationCount().fetch_add(1, std::memory_order_relaxed);
+        auto align = (size_t)alignment;
+        size = (size + align - 1) / align * align;
+#ifdef _WIN32
+        return _aligned_malloc(size != 0 ? size : align, align);
+#else
+        return aligned_alloc(align, size != 0 ? size : align);
+#endif
+    }
+
+    inline void* Allocate(size_t size)
+    {
+        void* block = TryAllocate(size);
+        if (block == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+    inline void* AllocateAligned(size_t size, std::align_val_t alignment)
+    {
+        void* block = TryAllocateAligned(size, alignment);
+        if (block == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+    inline void FreeAligned(void* block)
+    {
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        free(block);
+#endif
+    }
+}
+
+void* operator new(size_t size)
+{
+    return AllocationCounterDetail::Allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return AllocationCounterDetail::Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return AllocationCounterDetail::AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return AllocationCounterDetail::AllocateAligned(size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocationCounterDetail::TryAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocationCounterDetail::TryAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return AllocationCounterDetail::TryAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return AllocationCounterDetail::TryAllocateAligned(size, alignment);
+}
+
+void operator delete(void* block) noexcept
+{
+    free(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+    free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+    free(block);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
+
+void operator delete(void* block, size_t, std::align_val_t) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
+
+void operator delete[](void* block, size_t, std::align_val_t) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept
+{
+    free(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept
+{
+    free(block);
+}
+
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
+
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    AllocationCounterDetail::FreeAligned(block);
+}
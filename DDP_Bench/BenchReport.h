@@ -0,0 +1,183 @@
+#pragma once
+// Results of the benchmark suite: JSON output and comparison against a
+// stored baseline.
+//
+// The JSON is written one result object per line, so the baseline reader
+// below only has to handle the format it writes itself:
+//
+//   {"suite":"ddp_bench","version":1,"results":[
+//   {"name":"parse/4MB","seconds":...,"bytes":...,"frames":...,"mb_per_s":...,"frames_per_s":...,"allocations":...,"peak_rss_mb":...},
+//   ...
+//   ]}
+#include "../Common/FileIO.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define DDP_BENCH_REPORT_VERSION 1
+
+struct BenchCaseResult
+{
+    std::string name;               // stage/size, e.g. "decode/16MB"
+    double seconds = 0;             // per run, best of the repeats
+    uint64_t bytes = 0;             // bytes the stage processed per run
+    uint64_t frames = 0;            // access units, or PCM frames for PCM stages
+    uint64_t allocations = 0;       // operator new calls per run, in the best repeat
+    uint64_t peakRssBytes = 0;      // process high-water mark after the case
+
+    double MBPerSecond() const { return seconds > 0 ? bytes / 1e6 / seconds : 0; }
+    double FramesPerSecond() const { return seconds > 0 ? frames / seconds : 0; }
+};
+
+inline std::string BenchResultsToJson(const std::vector<BenchCaseResult>& results)
+{
+    std::string json = "{\"suite\":\"ddp_bench\",\"version\":" + std::to_string(DDP_BENCH_REPORT_VERSION) + ",\"results\":[\n";
+    char line[512];
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        snprintf(line, sizeof(line),
+            "{\"name\":\"%s\",\"seconds\":%.9g,\"bytes\":%llu,\"frames\":%llu,\"mb_per_s\":%.3f,\"frames_per_s\":%.1f,"
+            "\"allocations\":%llu,\"peak_rss_mb\":%.1f}%s\n",
+            result.name.c_str(), result.seconds, (unsigned long long)result.bytes, (unsigned long long)result.frames,
+            result.MBPerSecond(), result.FramesPerSecond(), (unsigned long long)result.allocations,
+            result.peakRssBytes / 1e6, i + 1 < results.size() ? "," : "");
+        json += line;
+    }
+    json += "]}\n";
+    return json;
+}
+
+namespace BenchReportDetail
+{
+    inline bool FindString(const std::string& line, const char* key, std::string& value)
+    {
+        auto pattern = std::string("\"") + key + "\":\"";
+        auto start = line.find(pattern);
+        if (start == std::string::npos)
+        {
+            return false;
+        }
+        start += pattern.size();
+        auto end = line.find('"', start);
+        if (end == std::string::npos)
+        {
+            return false;
+        }
+        value = line.substr(start, end - start);
+        return true;
+    }
+
+    inline bool FindNumber(const std::string& line, const char* key, double& value)
+    {
+        auto pattern = std::string("\"") + key + "\":";
+        auto start = line.find(pattern);
+        if (start == std::string::npos)
+        {
+            return false;
+        }
+        char* end = nullptr;
+        value = strtod(line.c_str() + start + pattern.size(), &end);
+        return end != line.c_str() + start + pattern.size();
+    }
+}
+
+// Reads results written by BenchResultsToJson. False if the file is
+// missing or from another report version.
+inline bool LoadBenchResults(const char* path, std::vector<BenchCaseResult>& results)
+{
+    using namespace BenchReportDetail;
+    results.clear();
+    FILE* file = OpenFile(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string text;
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) != 0)
+    {
+        text.append(chunk, read);
+    }
+    fclose(file);
+
+    double version = 0;
+    if (!FindNumber(text.substr(0, text.find('\n')), "version", version) || version != DDP_BENCH_REPORT_VERSION)
+    {
+        return false;
+    }
+    size_t start = 0;
+    while (start < text.size())
+    {
+        auto end = text.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        auto line = text.substr(start, end - start);
+        start = end + 1;
+        BenchCaseResult result;
+        double seconds, bytes, frames, allocations, peakRssMB;
+        if (FindString(line, "name", result.name) && FindNumber(line, "seconds", seconds) && FindNumber(line, "bytes", bytes)
+            && FindNumber(line, "frames", frames) && FindNumber(line, "allocations", allocations)
+            && FindNumber(line, "peak_rss_mb", peakRssMB))
+        {
+            result.seconds = seconds;
+            result.bytes = (uint64_t)bytes;
+            result.frames = (uint64_t)frames;
+            result.allocations = (uint64_t)allocations;
+            result.peakRssBytes = (uint64_t)(peakRssMB * 1e6);
+            results.push_back(result);
+        }
+    }
+    return true;
+}
+
+struct BenchComparison
+{
+    std::string name;
+    double baselineMBPerSecond = 0;
+    double currentMBPerSecond = 0;
+    uint64_t baselineAllocations = 0;
+    uint64_t currentAllocations = 0;
+    bool slower = false;            // throughput dropped by more than the threshold
+    bool moreAllocations = false;   // allocations grew by more than the threshold
+
+    double Ratio() const { return baselineMBPerSecond > 0 ? currentMBPerSecond / baselineMBPerSecond : 0; }
+    bool Regressed() const { return slower || moreAllocations; }
+};
+
+// Compares the cases present in both. threshold is a fraction: 0.1 flags
+// cases more than 10% slower in MB/s, or with more than 10% (and at least
+// 8) more allocations.
+inline std::vector<BenchComparison> CompareBenchResults(const std::vector<BenchCaseResult>& baseline,
+    const std::vector<BenchCaseResult>& current, double threshold)
+{
+    std::vector<BenchComparison> comparisons;
+    for (const auto& result : current)
+    {
+        for (const auto& reference : baseline)
+        {
+            if (reference.name != result.name)
+            {
+                continue;
+            }
+            BenchComparison comparison;
+            comparison.name = result.name;
+            comparison.baselineMBPerSecond = reference.MBPerSecond();
+            comparison.currentMBPerSecond = result.MBPerSecond();
+            comparison.baselineAllocations = reference.allocations;
+            comparison.currentAllocations = result.allocations;
+            comparison.slower = comparison.currentMBPerSecond < comparison.baselineMBPerSecond * (1 - threshold);
+            comparison.moreAllocations = result.allocations > reference.allocations + 8
+                && result.allocations > reference.allocations * (1 + threshold);
+            comparisons.push_back(comparison);
+            break;
+        }
+    }
+    return comparisons;
+}
@@ -0,0 +1,116 @@
+#pragma once
+// Timing and memory helpers shared by the benchmark commands.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+class Stopwatch
+{
+public:
+    Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+    void Restart()
+    {
+        start = std::chrono::steady_clock::now();
+    }
+
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+inline uint64_t PeakRssBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+inline uint64_t CurrentRssBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    unsigned long long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+    {
+        return 0;
+    }
+    if (fscanf(statm, "%llu %llu", &pages, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(statm);
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+inline double ToMiB(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+// Pass/fail bookkeeping of the self-checking commands. Failed checks are
+// printed as they happen; the summary line is what scripts look for.
+class BenchChecks
+{
+public:
+    // Counts one check and returns its condition.
+    bool Expect(bool condition, const std::string& what)
+    {
+        checks++;
+        if (!condition)
+        {
+            failures++;
+            printf("failed: %s\n", what.c_str());
+            fflush(stdout);
+        }
+        return condition;
+    }
+
+    // "checks=N failures=M", then suffix, e.g. " best=avx2".
+    void PrintSummary(const std::string& suffix = std::string()) const
+    {
+        printf("checks=%d failures=%d%s\n", checks, failures, suffix.c_str());
+        fflush(stdout);
+    }
+
+    int Failures() const { return failures; }
+    int ExitCode() const { return failures == 0 ? 0 : 1; }
+
+private:
+    int checks = 0;
+    int failures = 0;
+};
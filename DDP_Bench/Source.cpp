@@ -0,0 +1,3015 @@
+// Portable benchmarks for the DDP decode pipeline pieces that do not depend
+// on Media Foundation. Builds with the solution on Windows, or on Linux with
+//   g++ -O2 -std=c++17 -pthread DDP_Bench/Source.cpp -o ddp_bench
+#include "AllocationCounter.h"
+#include "BenchReport.h"
+#include "BenchUtil.h"
+#include "SyntheticStream.h"
+#include "../Common/BatchDecoder.h"
+#include "../Common/BitstreamSource.h"
+#include "../Common/BufferPool.h"
+#include "../Common/BufferedPcmWriter.h"
+#include "../Common/ChannelMixer.h"
+#include "../Common/DdpFrameParser.h"
+#include "../Common/DecodeMetrics.h"
+#include "../Common/DecodePipeline.h"
+#include "../Common/DecoderPool.h"
+#include "../Common/FakeSampleSource.h"
+#include "../Common/FrameIndex.h"
+#include "../Common/FrameIndexFile.h"
+#include "../Common/GuidNameTable.h"
+#include "../Common/NegotiationCache.h"
+#include "../Common/ParallelDecoder.h"
+#include "../Common/PcmConverter.h"
+#include "../Common/PipelinedDecoder.h"
+#include "../Common/PlanarPcm.h"
+#include "../Common/RiffReader.h"
+#include "../Common/SampleClock.h"
+#include "../Common/StandInDecoder.h"
+#include "../Common/WorkStealingPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DDPIN_BUFFER_SIZE 1024
+
+static void WriteLE32(FILE* file, uint32_t value)
+{
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void WriteLE64(FILE* file, uint64_t value)
+{
+    WriteLE32(file, (uint32_t)value);
+    WriteLE32(file, (uint32_t)(value >> 32));
+}
+
+// Writes a WAV (RF64 past 4 GB) whose data chunk is filled by fill(buffer, size).
+template <class Fill>
+static bool WriteSyntheticWav(const char* path, uint64_t dataSize, Fill fill)
+{
+    FILE* file = OpenFile(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool rf64 = dataSize > 0xFFFFFFFFull - 64;
+    fwrite(rf64 ? "RF64" : "RIFF", 1, 4, file);
+    WriteLE32(file, rf64 ? 0xFFFFFFFF : (uint32_t)(4 + 8 + 16 + 8 + dataSize));
+    fwrite("WAVE", 1, 4, file);
+    if (rf64)
+    {
+        fwrite("ds64", 1, 4, file);
+        WriteLE32(file, 28);
+        WriteLE64(file, 4 + 36 + 8 + 16 + 8 + dataSize);
+        WriteLE64(file, dataSize);
+        WriteLE64(file, 0);
+        WriteLE32(file, 0);
+    }
+    // WAVE_FORMAT_DOLBY_AC3_SPDIF placeholder; only the data chunk matters here.
+    fwrite("fmt ", 1, 4, file);
+    WriteLE32(file, 16);
+    uint8_t fmt[16] = { 0x92, 0x00, 2, 0, 0x80, 0xBB, 0, 0, 0, 0xEE, 2, 0, 4, 0, 16, 0 };
+    fwrite(fmt, 1, sizeof(fmt), file);
+    fwrite("data", 1, 4, file);
+    WriteLE32(file, rf64 ? 0xFFFFFFFF : (uint32_t)dataSize);
+
+    std::vector<uint8_t> block(1 << 20);
+    uint64_t written = 0;
+    while (written < dataSize)
+    {
+        auto size = (size_t)(dataSize - written < block.size() ? dataSize - written : block.size());
+        size = fill(block.data(), size);
+        if (size == 0 || fwrite(block.data(), 1, size, file) != size)
+        {
+            fclose(file);
+            return false;
+        }
+        written += size;
+    }
+    fclose(file);
+    return true;
+}
+
+// Stand-in for the decoder touching its input so the mapped path is not
+// measured as "free" just because nothing reads the pages.
+static uint64_t Consume(const uint8_t* data, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// WAV-wrapped synthetic E-AC-3 stream, the input format DDP_MFT decodes.
+static bool WriteSyntheticStreamWav(const char* path, uint64_t dataSize, const SyntheticStreamOptions& options = SyntheticStreamOptions())
+{
+    SyntheticStreamWriter stream{ options };
+    std::vector<uint8_t> pending;
+    return WriteSyntheticWav(path, dataSize, [&](uint8_t* buffer, size_t size)
+    {
+        if (pending.size() < size)
+        {
+            stream.Append(pending, size);
+        }
+        memcpy(buffer, pending.data(), size);
+        pending.erase(pending.begin(), pending.begin() + size);
+        return size;
+    });
+}
+
+static int MakeWav(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "usage: make-wav <file> <sizeMB>" << std::endl;
+        return 1;
+    }
+    return WriteSyntheticStreamWav(argv[2], std::stoull(argv[3]) * 1024 * 1024) ? 0 : 1;
+}
+
+// Compares how the feed loop gets bytes from the file into decoder input
+// buffers:
+//   legacy - whole-file slurp + vector copy + memcpy per slice (old getRawBitStream)
+//   copy   - bounded file reads into a staging buffer + memcpy into a new buffer per slice
+//   mapped - slices are views into a read-only mapping
+static int BenchSource(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "usage: source <legacy|copy|mapped> <file>" << std::endl;
+        return 1;
+    }
+    std::string mode = argv[2];
+    const char* path = argv[3];
+    uint64_t bytesCopied = 0;
+    uint64_t bytesFed = 0;
+    uint64_t checksum = 0;
+    uint64_t allocations = 0;
+    Stopwatch timer;
+
+    if (mode == "legacy")
+    {
+        RiffReader riff;
+        if (!riff.Open(path))
+        {
+            return 1;
+        }
+        FILE* file = OpenFile(path, "rb");
+        std::vector<uint8_t> wavBuffer((size_t)riff.FileSize());
+        bytesCopied += fread(wavBuffer.data(), 1, wavBuffer.size(), file);
+        fclose(file);
+        std::vector<uint8_t> data(wavBuffer.begin() + (size_t)riff.DataOffset(), wavBuffer.begin() + (size_t)(riff.DataOffset() + riff.DataSize()));
+        bytesCopied += data.size();
+        allocations += 2;
+        for (size_t index = 0; index < data.size(); index += DDPIN_BUFFER_SIZE)
+        {
+            auto size = data.size() - index < DDPIN_BUFFER_SIZE ? data.size() - index : DDPIN_BUFFER_SIZE;
+            std::unique_ptr<uint8_t[]> mediaBuffer(new uint8_t[DDPIN_BUFFER_SIZE]);
+            memcpy(mediaBuffer.get(), data.data() + index, size);
+            checksum += Consume(mediaBuffer.get(), size);
+            bytesCopied += size;
+            bytesFed += size;
+            allocations++;
+        }
+    }
+    else if (mode == "copy")
+    {
+        RiffReader riff;
+        if (!riff.Open(path))
+        {
+            return 1;
+        }
+        std::vector<uint8_t> staging(DDPIN_BUFFER_SIZE);
+        allocations++;
+        size_t size;
+        while ((size = riff.Read(staging.data(), staging.size())) != 0)
+        {
+            std::unique_ptr<uint8_t[]> mediaBuffer(new uint8_t[DDPIN_BUFFER_SIZE]);
+            memcpy(mediaBuffer.get(), staging.data(), size);
+            checksum += Consume(mediaBuffer.get(), size);
+            bytesCopied += 2 * size;
+            bytesFed += size;
+            allocations++;
+        }
+    }
+    else if (mode == "mapped")
+    {
+        MappedBitstreamSource source;
+        if (!source.Open(path))
+        {
+            return 1;
+        }
+        const uint64_t releaseWindow = DDPIN_RELEASE_WINDOW;
+        while (true)
+        {
+            auto slice = source.Next(DDPIN_BUFFER_SIZE);
+            if (slice.size == 0)
+            {
+                break;
+            }
+            checksum += Consume(slice.data, slice.size);
+            bytesFed += slice.size;
+            if (source.Position() > releaseWindow)
+            {
+                source.ReleaseConsumed(source.Position() - releaseWindow);
+            }
+        }
+    }
+    else
+    {
+        std::cout << "unknown source mode " << mode << std::endl;
+        return 1;
+    }
+
+    auto seconds = timer.Seconds();
+    std::cout << "mode=" << mode
+        << " fed_mib=" << ToMiB(bytesFed)
+        << " copied_mib=" << ToMiB(bytesCopied)
+        << " allocations=" << allocations
+        << " seconds=" << seconds
+        << " mib_per_s=" << ToMiB(bytesFed) / seconds
+        << " peak_rss_mib=" << ToMiB(PeakRssBytes())
+        << " checksum=" << checksum << std::endl;
+    if (mode == "mapped")
+    {
+        // Not an RSS saving: mapped pages stay resident until released, so
+        // the peak is the release window plus read-ahead, above the copy
+        // path's small buffers. What mapping saves is the copies.
+        std::cout << "note: mapping trades resident pages (release window " << ToMiB(DDPIN_RELEASE_WINDOW)
+            << " MiB plus read-ahead) for zero copies" << std::endl;
+    }
+    return 0;
+}
+
+// Splits a synthetic E-AC-3 stream held in memory into access units.
+static int BenchFrames(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 256;
+    SyntheticStreamOptions options;
+    options.dependentSubstream = argc > 3 && std::string(argv[3]) == "dependent";
+    std::vector<uint8_t> stream;
+    stream.reserve((size_t)(sizeMB << 20) + options.maxFrameBytes * 2);
+    SyntheticStreamWriter writer{ options };
+    writer.Append(stream, sizeMB << 20);
+
+    Stopwatch timer;
+    DdpFrameSplitter splitter{ stream.data(), stream.size() };
+    DdpAccessUnit unit;
+    uint64_t accessUnits = 0;
+    uint64_t samples = 0;
+    while (splitter.Next(unit))
+    {
+        accessUnits++;
+        samples += unit.header.samplesPerFrame;
+    }
+    auto seconds = timer.Seconds();
+
+    std::cout << "stream_mib=" << ToMiB(stream.size())
+        << " access_units=" << accessUnits
+        << " frames=" << splitter.FrameCount()
+        << " skipped_bytes=" << splitter.SkippedBytes()
+        << " audio_seconds=" << samples / 48000.0
+        << " seconds=" << seconds
+        << " frames_per_s=" << splitter.FrameCount() / seconds
+        << " mib_per_s=" << ToMiB(stream.size()) / seconds << std::endl;
+    return splitter.SkippedBytes() == 0 ? 0 : 1;
+}
+
+// Acquire/release churn through BufferPool from several threads, compared
+// with an aligned new/delete per buffer. Fails if the pool touches the heap
+// once warmed up.
+static int BenchPool(int argc, char** argv)
+{
+    uint32_t threadCount = argc > 2 ? (uint32_t)std::stoul(argv[2]) : 4;
+    const uint64_t iterations = 2000000;
+    const size_t bufferSize = 6 * 1536 * sizeof(float);
+    const uint32_t perThread = 4;
+    BufferPool pool{ bufferSize, threadCount * perThread };
+
+    auto churn = [&](uint64_t count)
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, count]()
+            {
+                uint8_t* held[perThread];
+                for (uint64_t i = 0; i < count; i++)
+                {
+                    for (auto& buffer : held)
+                    {
+                        buffer = pool.Acquire();
+                        buffer[0] = (uint8_t)i;
+                    }
+                    for (auto buffer : held)
+                    {
+                        pool.Release(buffer);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    };
+
+    pool.Reserve(pool.Capacity());
+    churn(16);
+    auto warm = pool.GetCounters();
+    Stopwatch timer;
+    churn(iterations);
+    auto poolSeconds = timer.Seconds();
+    auto steady = pool.GetCounters();
+
+    timer.Restart();
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&]()
+            {
+                for (uint64_t i = 0; i < iterations; i++)
+                {
+                    for (uint32_t b = 0; b < perThread; b++)
+                    {
+                        auto buffer = (uint8_t*)::operator new(bufferSize, std::align_val_t(64));
+                        buffer[0] = (uint8_t)i;
+                        ::operator delete(buffer, std::align_val_t(64));
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+    auto heapSeconds = timer.Seconds();
+
+    auto operations = (double)iterations * threadCount * perThread;
+    auto steadyAllocations = steady.heapAllocations - warm.heapAllocations;
+    std::cout << "threads=" << threadCount
+        << " pool_ns_per_buffer=" << poolSeconds * 1e9 / operations
+        << " heap_ns_per_buffer=" << heapSeconds * 1e9 / operations
+        << " warmup_allocations=" << warm.heapAllocations
+        << " steady_allocations=" << steadyAllocations
+        << " exhausted=" << steady.exhausted << std::endl;
+    if (steadyAllocations != 0 || steady.exhausted != 0 || steady.acquires != steady.releases)
+    {
+        std::cout << "FAIL: pool allocated or ran dry in steady state" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Writes sizeMB of PCM in decoder-sized chunks:
+//   stdio        - one buffered fwrite per chunk, like the old PCMWriter
+//   buffered     - BufferedPcmWriter, blocks flushed on the calling thread
+//   write-behind - BufferedPcmWriter with the background flush thread
+static int BenchWriter(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "usage: writer <stdio|buffered|write-behind> <file> [sizeMB] [chunkBytes]" << std::endl;
+        return 1;
+    }
+    std::string mode = argv[2];
+    const char* path = argv[3];
+    uint64_t total = (argc > 4 ? std::stoull(argv[4]) : 1024) << 20;
+    size_t chunkSize = argc > 5 ? (size_t)std::stoull(argv[5]) : 6 * 1536 * sizeof(float);
+    std::vector<uint8_t> chunk(chunkSize);
+    for (size_t i = 0; i < chunk.size(); i++)
+    {
+        chunk[i] = (uint8_t)(i * 31);
+    }
+
+    uint64_t calls = 0;
+    uint64_t syscalls = 0;
+    uint64_t stalls = 0;
+    Stopwatch timer;
+    if (mode == "stdio")
+    {
+        FILE* file = OpenFile(path, "wb");
+        if (file == nullptr)
+        {
+            return 1;
+        }
+        for (uint64_t written = 0; written < total; written += chunk.size())
+        {
+            fwrite(chunk.data(), 1, chunk.size(), file);
+            calls++;
+        }
+        fclose(file);
+        // stdio flushes every BUFSIZ bytes, or per call for chunks larger than that.
+        syscalls = chunk.size() >= BUFSIZ ? calls : total / BUFSIZ;
+    }
+    else if (mode == "buffered" || mode == "write-behind")
+    {
+        BufferedPcmWriter::Options options;
+        options.writeBehind = mode == "write-behind";
+        BufferedPcmWriter writer;
+        if (!writer.Open(path, options))
+        {
+            return 1;
+        }
+        for (uint64_t written = 0; written < total; written += chunk.size())
+        {
+            writer.Write(chunk.data(), chunk.size());
+            calls++;
+        }
+        writer.Close();
+        auto stats = writer.GetStats();
+        syscalls = stats.syscalls;
+        stalls = stats.stalls;
+    }
+    else
+    {
+        std::cout << "unknown writer mode " << mode << std::endl;
+        return 1;
+    }
+
+    auto seconds = timer.Seconds();
+    std::cout << "mode=" << mode
+        << " mib=" << ToMiB(total)
+        << " write_calls=" << calls
+        << " syscalls=" << syscalls
+        << " stalls=" << stalls
+        << " seconds=" << seconds
+        << " mib_per_s=" << ToMiB(total) / seconds
+        << " syscalls_per_s=" << syscalls / seconds << std::endl;
+    return 0;
+}
+
+struct BenchGuid
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+
+    bool operator==(const BenchGuid& other) const
+    {
+        return memcmp(this, &other, sizeof(BenchGuid)) == 0;
+    }
+};
+
+// GetGUIDNameConst lookups: the old chain of GUID compares versus
+// GuidNameTable, for hits spread over the list and for misses.
+static int BenchGuids(int, char**)
+{
+    const size_t entryCount = 130;
+    const uint64_t lookups = 20000000;
+    std::vector<BenchGuid> guids(entryCount);
+    std::vector<std::string> names(entryCount);
+    uint32_t seed = 1;
+    auto random = [&]()
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    };
+    GuidNameTable<BenchGuid, char> table;
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        // MF attribute GUIDs share Data2..Data4 tails in families; mimic that.
+        guids[i] = { random(), (uint16_t)(0x1000 + i % 4), 0x4BD4, { 0x88, 0x6D, 0xEC, 0x12, 0x34, 0x56, 0x78, (uint8_t)(i % 3) } };
+        names[i] = "GUID_" + std::to_string(i);
+        table.Add(guids[i], names[i].c_str());
+    }
+    BenchGuid missing = { 0xDEADBEEF, 1, 2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+
+    auto chain = [&](const BenchGuid& guid) -> const char*
+    {
+        for (size_t i = 0; i < entryCount; i++)
+        {
+            if (guids[i] == guid)
+            {
+                return names[i].c_str();
+            }
+        }
+        return nullptr;
+    };
+
+    uint64_t found = 0;
+    auto measure = [&](const char* label, bool hit, bool useTable)
+    {
+        Stopwatch timer;
+        for (uint64_t i = 0; i < lookups; i++)
+        {
+            const auto& guid = hit ? guids[i % entryCount] : missing;
+            auto name = useTable ? table.Find(guid) : chain(guid);
+            found += name != nullptr;
+        }
+        std::cout << label << "_ns=" << timer.Seconds() * 1e9 / lookups << " ";
+    };
+    measure("chain_hit", true, false);
+    measure("table_hit", true, true);
+    measure("chain_miss", false, false);
+    measure("table_miss", false, true);
+    std::cout << "found=" << found << std::endl;
+    return found == 2 * lookups ? 0 : 1;
+}
+
+// Folds decoder output into a checksum instead of writing it anywhere.
+struct ChecksumSink
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    uint64_t bytes = 0;
+
+    void Write(const void* buffer, size_t size)
+    {
+        auto data = (const uint8_t*)buffer;
+        for (size_t i = 0; i < size; i += 8)
+        {
+            uint64_t word = 0;
+            memcpy(&word, data + i, size - i < 8 ? size - i : 8);
+            hash = (hash ^ word) * 0x100000001B3ull;
+        }
+        bytes += size;
+    }
+};
+
+static int BenchDecode(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 64;
+    StandInDecoderOptions decoderOptions;
+    decoderOptions.inputQueueCapacity = argc > 3 ? (uint32_t)std::stoul(argv[3]) : 2;
+    decoderOptions.refuseEvery = argc > 4 ? (uint32_t)std::stoul(argv[4]) : 0;
+
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+
+    auto run = [&](const StandInDecoderOptions& options, ChecksumSink& sink, DecodeStats& stats)
+    {
+        StandInDecoder decoder{ options };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        return DecodeStream(splitter, decoder, pool, sink, stats);
+    };
+
+    ChecksumSink sink;
+    DecodeStats stats;
+    bool ok = run(decoderOptions, sink, stats);
+
+    // The output must not depend on how often the decoder pushed back.
+    StandInDecoderOptions reference;
+    reference.inputQueueCapacity = 1;
+    reference.refuseEvery = 3;
+    ChecksumSink referenceSink;
+    DecodeStats referenceStats;
+    ok = run(reference, referenceSink, referenceStats) && ok;
+    bool identical = sink.hash == referenceSink.hash && sink.bytes == referenceSink.bytes;
+    bool complete = stats.outputSamples == stats.inputUnits * 1536;
+
+    std::cout << "stream_mib=" << ToMiB(stream.size())
+        << " access_units=" << stats.inputUnits
+        << " refused=" << stats.notAccepting
+        << " output_mib=" << ToMiB(stats.outputBytes)
+        << " seconds=" << stats.seconds
+        << " realtime_x=" << stats.RealtimeFactor(48000)
+        << " us_per_unit=" << (stats.inputUnits != 0 ? stats.seconds * 1e6 / stats.inputUnits : 0)
+        << " complete=" << (complete ? "yes" : "no")
+        << " matches_backpressure_run=" << (identical ? "yes" : "no") << std::endl;
+    return ok && complete && identical ? 0 : 1;
+}
+
+static uint64_t ChecksumFile(const char* path)
+{
+    ChecksumSink sink;
+    FILE* file = OpenFile(path, "rb");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+    std::vector<uint8_t> block(1 << 20);
+    size_t read;
+    while ((read = fread(block.data(), 1, block.size(), file)) != 0)
+    {
+        sink.Write(block.data(), read);
+    }
+    fclose(file);
+    return sink.hash;
+}
+
+static int BenchBatch(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "usage: batch <dir> [files] [sizeMB] [threads]" << std::endl;
+        return 1;
+    }
+    std::string dir = argv[2];
+    unsigned files = argc > 3 ? (unsigned)std::stoul(argv[3]) : 16;
+    uint64_t sizeMB = argc > 4 ? std::stoull(argv[4]) : 8;
+    unsigned threads = argc > 5 ? (unsigned)std::stoul(argv[5]) : 0;
+
+    // Uneven sizes (1x..4x, shuffled) so stealing and largest-first ordering matter.
+    std::vector<BatchJob> jobs;
+    for (unsigned i = 0; i < files; i++)
+    {
+        BatchJob job;
+        job.input = dir + "/batch_in_" + std::to_string(i) + ".wav";
+        job.output = dir + "/batch_out_" + std::to_string(i) + ".wav";
+        SyntheticStreamOptions options;
+        options.seed = 0x0B77 + i;
+        if (!WriteSyntheticStreamWav(job.input.c_str(), (sizeMB << 20) * (1 + (i * 7) % 4) / 2, options))
+        {
+            std::cout << "failed to write " << job.input << std::endl;
+            return 1;
+        }
+        jobs.push_back(job);
+    }
+    auto manifest = dir + "/batch_manifest.tsv";
+    FILE* file = OpenFile(manifest.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return 1;
+    }
+    fprintf(file, "# input<TAB>output\n");
+    for (const auto& job : jobs)
+    {
+        fprintf(file, "%s\t%s\n", job.input.c_str(), job.output.c_str());
+    }
+    fclose(file);
+    jobs.clear();
+    if (!LoadBatchManifest(manifest.c_str(), jobs) || jobs.size() != files)
+    {
+        std::cout << "manifest round trip failed" << std::endl;
+        return 1;
+    }
+
+    auto createDecoder = []() -> std::unique_ptr<DecoderTransform> { return std::unique_ptr<DecoderTransform>(new StandInDecoder()); };
+    auto run = [&](unsigned workers, std::vector<uint64_t>& checksums)
+    {
+        WorkStealingPool pool{ workers };
+        auto result = DecodeBatch(jobs, pool, createDecoder);
+        checksums.clear();
+        for (const auto& file : result.files)
+        {
+            checksums.push_back(ChecksumFile(file.job.output.c_str()));
+        }
+        return result;
+    };
+
+    std::vector<uint64_t> serialChecksums, parallelChecksums;
+    auto serial = run(1, serialChecksums);
+    auto parallel = run(threads, parallelChecksums);
+
+    // Workers reuse flushed decoders, so a file's output must not depend on
+    // which worker decoded it or what that worker decoded before.
+    bool identical = serialChecksums == parallelChecksums;
+    bool ok = serial.Failures() == 0 && parallel.Failures() == 0 && identical;
+    for (const auto& file : parallel.files)
+    {
+        RiffReader output;
+        ok = ok && output.Open(file.job.output.c_str()) && output.DataSize() == file.stats.outputBytes;
+        std::cout << "file=" << file.job.input
+            << " worker=" << file.worker
+            << " audio_seconds=" << file.AudioSeconds()
+            << " realtime_x=" << file.RealtimeFactor() << std::endl;
+    }
+    std::cout << "files=" << files
+        << " workers=" << parallel.workers
+        << " audio_seconds=" << parallel.AudioSeconds()
+        << " serial_seconds=" << serial.seconds
+        << " parallel_seconds=" << parallel.seconds
+        << " serial_realtime_x=" << serial.RealtimeFactor()
+        << " parallel_realtime_x=" << parallel.RealtimeFactor()
+        << " speedup=" << (parallel.seconds > 0 ? serial.seconds / parallel.seconds : 0)
+        << " steals=" << parallel.steals
+        << " outputs_match=" << (identical ? "yes" : "no") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Checksum sink that also sleeps per write, standing in for a slow disk.
+struct SlowSink : ChecksumSink
+{
+    uint32_t delayMicroseconds = 0;
+
+    void Write(const void* buffer, size_t size)
+    {
+        ChecksumSink::Write(buffer, size);
+        if (delayMicroseconds != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(delayMicroseconds));
+        }
+    }
+};
+
+static int BenchPipeline(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "usage: pipeline <dir> [sizeMB] [sinkDelayUs] [inputDepth] [outputDepth]" << std::endl;
+        return 1;
+    }
+    std::string dir = argv[2];
+    uint64_t sizeMB = argc > 3 ? std::stoull(argv[3]) : 32;
+    uint32_t delay = argc > 4 ? (uint32_t)std::stoul(argv[4]) : 30;
+    PipelineOptions options;
+    options.inputDepth = argc > 5 ? std::stoull(argv[5]) : options.inputDepth;
+    options.outputDepth = argc > 6 ? std::stoull(argv[6]) : options.outputDepth;
+
+    auto input = dir + "/pipeline_in.wav";
+    if (!WriteSyntheticStreamWav(input.c_str(), sizeMB << 20))
+    {
+        std::cout << "failed to write " << input << std::endl;
+        return 1;
+    }
+    MappedBitstreamSource bitStream;
+    if (!bitStream.Open(input.c_str()))
+    {
+        return 1;
+    }
+
+    auto run = [&](bool pipelined, SlowSink& sink, DecodeStats& stats, PipelineStats& pipelineStats)
+    {
+        StandInDecoder decoder;
+        BufferPool pool{ decoder.MaxOutputBytes(), options.OutputBuffers() };
+        pool.Reserve(options.OutputBuffers());
+        DdpFrameSplitter splitter{ bitStream.Data(), bitStream.Size() };
+        sink.delayMicroseconds = delay;
+        return pipelined
+            ? PipelinedDecodeStream(splitter, decoder, pool, sink, stats, bitStream.Owner(), NoInputHook(), options, &pipelineStats)
+            : DecodeStream(splitter, decoder, pool, sink, stats, bitStream.Owner());
+    };
+
+    SlowSink serialSink, pipelinedSink;
+    DecodeStats serial, pipelined;
+    PipelineStats unused, stages;
+    bool ok = run(false, serialSink, serial, unused);
+    ok = run(true, pipelinedSink, pipelined, stages) && ok;
+    bool identical = serialSink.hash == pipelinedSink.hash && serialSink.bytes == pipelinedSink.bytes;
+
+    // Same through DecodeFile into real WAVE files.
+    auto serialFile = dir + "/pipeline_serial.wav";
+    auto pipelinedFile = dir + "/pipeline_pipelined.wav";
+    {
+        StandInDecoder decoder;
+        BufferPool pool{ decoder.MaxOutputBytes(), options.OutputBuffers() };
+        DecodeFileStats fileStats;
+        DecodeFileOptions fileOptions;
+        ok = DecodeFile(input.c_str(), serialFile.c_str(), decoder, pool, fileStats, fileOptions) && ok;
+        decoder.Flush();
+        fileOptions.pipeline = &options;
+        ok = DecodeFile(input.c_str(), pipelinedFile.c_str(), decoder, pool, fileStats, fileOptions) && ok;
+    }
+    bool filesIdentical = ChecksumFile(serialFile.c_str()) == ChecksumFile(pipelinedFile.c_str());
+
+    std::cout << "stream_mib=" << ToMiB(bitStream.Size())
+        << " sink_delay_us=" << delay
+        << " serial_seconds=" << serial.seconds
+        << " pipelined_seconds=" << pipelined.seconds
+        << " serial_realtime_x=" << serial.RealtimeFactor(48000)
+        << " pipelined_realtime_x=" << pipelined.RealtimeFactor(48000)
+        << " speedup=" << (pipelined.seconds > 0 ? serial.seconds / pipelined.seconds : 0) << std::endl;
+    std::cout << "input_ring depth=" << stages.inputRing.capacity
+        << " mean_occupancy=" << stages.inputRing.MeanOccupancy()
+        << " max_occupancy=" << stages.inputRing.maxOccupancy
+        << " reader_full_stalls=" << stages.inputRing.fullStalls
+        << " decoder_empty_stalls=" << stages.inputRing.emptyStalls
+        << " decoder_empty_seconds=" << stages.inputRing.emptyStallSeconds
+        << " read_seconds=" << stages.readSeconds << std::endl;
+    std::cout << "output_ring depth=" << stages.outputRing.capacity
+        << " mean_occupancy=" << stages.outputRing.MeanOccupancy()
+        << " max_occupancy=" << stages.outputRing.maxOccupancy
+        << " decoder_full_stalls=" << stages.outputRing.fullStalls
+        << " decoder_full_seconds=" << stages.outputRing.fullStallSeconds
+        << " writer_empty_stalls=" << stages.outputRing.emptyStalls
+        << " pool_stalls=" << stages.poolStalls
+        << " write_seconds=" << stages.writeSeconds << std::endl;
+    std::cout << "outputs_match=" << (identical ? "yes" : "no")
+        << " files_match=" << (filesIdentical ? "yes" : "no") << std::endl;
+    return ok && identical && filesIdentical ? 0 : 1;
+}
+
+static int BenchConvert(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 64;
+    const PcmSampleType types[] = { PcmSampleType::Int16, PcmSampleType::Int24, PcmSampleType::Int32 };
+    const char* typeNames[] = { "s16", "s24", "s32" };
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 };
+    auto supported = DetectSimdLevel();
+
+    // Correctness: every SIMD kernel must match the scalar reference byte for
+    // byte, across odd lengths, split calls and out-of-range input.
+    std::vector<float> input(4099);
+    uint32_t seed = 1;
+    for (auto& sample : input)
+    {
+        seed = seed * 1664525 + 1013904223;
+        sample = ((int32_t)seed / 2147483648.0f) * 1.25f;  // about 20% clipped
+    }
+    const float specials[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.99999994f, -0.99999994f, 1e-9f, -1e-9f,
+        1e30f, -1e30f, INFINITY, -INFINITY, NAN, 0.5f / 32768, 1.5f / 32768, -0.5f / 8388608 };
+    for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); i++)
+    {
+        input[i * 7] = specials[i];
+    }
+
+    BenchChecks checks;
+    for (int t = 0; t < 3; t++)
+    {
+        for (int dither = 0; dither < 2; dither++)
+        {
+            for (auto level : levels)
+            {
+                if ((int)level > (int)supported)
+                {
+                    continue;
+                }
+                for (size_t split : { (size_t)0, (size_t)1, (size_t)5, (size_t)13, (size_t)2048 })
+                {
+                    PcmConverter reference{ types[t], dither != 0, 7, SimdLevel::Scalar };
+                    PcmConverter candidate{ types[t], dither != 0, 7, level };
+                    std::vector<uint8_t> expected(reference.OutputBytes(input.size()) + 32, 0xCD);
+                    std::vector<uint8_t> actual(expected.size(), 0xCD);
+                    reference.Convert(input.data(), input.size(), expected.data());
+                    // Two calls, so dither state has to carry across a split.
+                    candidate.Convert(input.data(), split, actual.data());
+                    candidate.Convert(input.data() + split, input.size() - split, actual.data() + candidate.OutputBytes(split));
+                    checks.Expect(expected == actual, std::string("mismatch: ") + typeNames[t] + " dither=" + std::to_string(dither)
+                        + " " + SimdLevelName(level) + " split=" + std::to_string(split));
+                }
+            }
+        }
+
+        // Clipping and rounding of the reference itself.
+        PcmConverter scalar{ types[t], false, 7, SimdLevel::Scalar };
+        const float edges[] = { 1.0f, -1.0f, 2.0f, -2.0f, NAN, 0.0f };
+        uint8_t out[6 * 4];
+        scalar.Convert(edges, 6, out);
+        auto read = [&](int index) -> int64_t
+        {
+            auto bytes = scalar.BytesPerSample();
+            auto p = out + index * bytes;
+            uint32_t value = 0;
+            memcpy(&value, p, bytes);
+            int shift = 32 - (int)bytes * 8;
+            return (int64_t)((int32_t)(value << shift) >> shift);
+        };
+        int64_t max = types[t] == PcmSampleType::Int16 ? 32767 : types[t] == PcmSampleType::Int24 ? 8388607 : 2147483520;
+        int64_t min = types[t] == PcmSampleType::Int16 ? -32768 : types[t] == PcmSampleType::Int24 ? -8388608 : -2147483647 - 1;
+        checks.Expect(read(0) == max && read(1) == min && read(2) == max && read(3) == min && read(4) == min && read(5) == 0,
+            std::string("clipping: ") + typeNames[t]);
+    }
+
+    // Dither is zero-mean and within one LSB.
+    {
+        std::vector<float> silence(1 << 16, 0.0f);
+        std::vector<int16_t> out(silence.size());
+        PcmConverter converter{ PcmSampleType::Int16, true };
+        converter.Convert(silence.data(), silence.size(), (uint8_t*)out.data());
+        int64_t sum = 0;
+        int minValue = 0, maxValue = 0;
+        for (auto value : out)
+        {
+            sum += value;
+            minValue = value < minValue ? value : minValue;
+            maxValue = value > maxValue ? value : maxValue;
+        }
+        checks.Expect(minValue >= -1 && maxValue <= 1 && std::abs((double)sum / out.size()) <= 0.02,
+            "dither statistics: min=" + std::to_string(minValue) + " max=" + std::to_string(maxValue)
+            + " mean=" + std::to_string((double)sum / out.size()));
+    }
+    checks.PrintSummary(std::string(" best=") + SimdLevelName(supported));
+
+    // Throughput, in GB/s of float input.
+    std::vector<float> samples((size_t)(sizeMB << 20) / sizeof(float));
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = input[i % input.size()];
+    }
+    std::vector<uint8_t> out(samples.size() * 4);
+    for (int t = 0; t < 3; t++)
+    {
+        for (int dither = 0; dither < 2; dither++)
+        {
+            for (auto level : levels)
+            {
+                if ((int)level > (int)supported)
+                {
+                    continue;
+                }
+                PcmConverter converter{ types[t], dither != 0, 7, level };
+                converter.Convert(samples.data(), samples.size(), out.data());
+                Stopwatch timer;
+                const int passes = 4;
+                for (int pass = 0; pass < passes; pass++)
+                {
+                    converter.Convert(samples.data(), samples.size(), out.data());
+                }
+                auto seconds = timer.Seconds();
+                std::cout << "type=" << typeNames[t]
+                    << " dither=" << (dither ? "tpdf" : "none")
+                    << " kernel=" << SimdLevelName(level)
+                    << " gb_per_s=" << passes * samples.size() * sizeof(float) / seconds / 1e9
+                    << " msamples_per_s=" << passes * samples.size() / seconds / 1e6 << std::endl;
+            }
+        }
+    }
+    return checks.ExitCode();
+}
+
+static int BenchMix(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 64;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 };
+    auto supported = DetectSimdLevel();
+    const uint32_t mask51 = SPEAKER_BIT_FL | SPEAKER_BIT_FR | SPEAKER_BIT_FC | SPEAKER_BIT_LFE | SPEAKER_BIT_BL | SPEAKER_BIT_BR;
+    const uint32_t mask71 = mask51 | SPEAKER_BIT_SL | SPEAKER_BIT_SR;
+
+    struct Case
+    {
+        const char* name;
+        MixMatrix matrix;
+    };
+    std::vector<Case> cases;
+    auto add = [&](const char* name, uint32_t mask, uint16_t channels, MixPreset preset, const char* order = nullptr)
+    {
+        MixOptions options;
+        options.preset = preset;
+        options.lfeGain = 0.5f;
+        if (order != nullptr)
+        {
+            ParseSpeakerOrder(order, options.order);
+        }
+        cases.push_back({ name, BuildMixMatrix(mask, channels, options) });
+    };
+    add("5.1-loro", mask51, 6, MixPreset::LoRo);
+    add("5.1-ltrt", mask51, 6, MixPreset::LtRt);
+    add("7.1-loro", mask71, 8, MixPreset::LoRo);
+    add("7.1-ltrt", mask71, 8, MixPreset::LtRt);
+    add("3.0-loro", 0x7, 3, MixPreset::LoRo);
+    add("5.1-film", mask51, 6, MixPreset::Reorder, "FL,FC,FR,BL,BR,LFE");
+    add("7.1-to-5.1", mask71, 8, MixPreset::Reorder, "FL,FR,FC,LFE,SL,SR");
+    add("5.1-front", mask51, 6, MixPreset::Reorder, "FC,FL,FR");
+    {
+        // 6 -> 6 with gains: trims surrounds, keeps the layout.
+        MixOptions identity;
+        auto matrix = BuildMixMatrix(mask51, 6, identity);
+        matrix.At(4, 4) = 0.5f;
+        matrix.At(5, 5) = 0.5f;
+        matrix.At(2, 3) = 0.25f;
+        cases.push_back({ "5.1-trim", matrix });
+    }
+
+    // Correctness: every kernel must match the scalar reference bit for bit,
+    // including the scalar tails of odd frame counts.
+    std::vector<float> input(1029 * 8);
+    uint32_t seed = 1;
+    for (auto& sample : input)
+    {
+        seed = seed * 1664525 + 1013904223;
+        sample = (int32_t)seed / 2147483648.0f;
+    }
+    input[3] = INFINITY;
+    input[10] = -0.0f;
+    input[17] = 1e-40f;
+
+    BenchChecks checks;
+    for (const auto& test : cases)
+    {
+        ChannelMixer reference{ test.matrix, SimdLevel::Scalar };
+        for (size_t frames : { (size_t)1, (size_t)3, (size_t)7, (size_t)1029 })
+        {
+            size_t samples = frames * test.matrix.outputs;
+            std::vector<float> expected(samples + 8, 7.0f);
+            reference.Mix(input.data(), frames, expected.data());
+            for (auto level : levels)
+            {
+                if ((int)level > (int)supported)
+                {
+                    continue;
+                }
+                ChannelMixer candidate{ test.matrix, level };
+                std::vector<float> actual(samples + 8, 7.0f);
+                candidate.Mix(input.data(), frames, actual.data());
+                // Compared as bytes: NaN and signed zero must match too, and
+                // nothing may be written past the last frame.
+                checks.Expect(memcmp(expected.data(), actual.data(), actual.size() * sizeof(float)) == 0,
+                    std::string("mismatch: ") + test.name + " " + candidate.KernelName() + " frames=" + std::to_string(frames));
+            }
+        }
+    }
+
+    // Known coefficients, one impulse per input channel.
+    auto impulse = [&](const MixMatrix& matrix, uint16_t channel, std::vector<float>& out)
+    {
+        std::vector<float> frame(matrix.inputs, 0.0f);
+        frame[channel] = 1.0f;
+        out.assign(matrix.outputs, 0.0f);
+        ChannelMixer{ matrix }.Mix(frame.data(), 1, out.data());
+    };
+    std::vector<float> fl, fc, lfe, bl, br;
+    const auto& loro = cases[0].matrix;
+    impulse(loro, 0, fl);
+    impulse(loro, 2, fc);
+    impulse(loro, 3, lfe);
+    impulse(loro, 4, bl);
+    checks.Expect(fl[1] == 0 && std::fabs(fc[0] / fl[0] - 0.70710678f) < 1e-6f && fc[0] == fc[1], "loro centre at -3 dB");
+    checks.Expect(std::fabs(lfe[0] / fl[0] - 0.5f) < 1e-6f, "loro lfe gain");
+    checks.Expect(bl[1] == 0 && std::fabs(bl[0] / fl[0] - 0.70710678f) < 1e-6f, "loro surround on its own side");
+    checks.Expect(std::fabs(fl[0] + fc[0] + lfe[0] + bl[0] - 1.0f) < 1e-6f, "loro normalized to full scale");
+    const auto& ltrt = cases[1].matrix;
+    impulse(ltrt, 4, bl);
+    impulse(ltrt, 5, br);
+    checks.Expect(bl[0] < 0 && bl[1] > 0 && bl[0] == br[0] && bl[1] == br[1] && bl[0] == -bl[1], "ltrt surround sum in antiphase");
+    std::vector<float> out;
+    const auto& film = cases[5].matrix;
+    impulse(film, 3, out);
+    checks.Expect(out[5] == 1.0f && out[0] == 0 && film.outputMask == 0, "reorder moves lfe last, no wave mask");
+    const auto& to51 = cases[6].matrix;
+    impulse(to51, 6, out);
+    checks.Expect(out[4] == 1.0f && to51.outputMask == 0x63F - 0x30, "7.1 side pair to 5.1 surrounds");
+    checks.PrintSummary(std::string(" best=") + SimdLevelName(supported));
+
+    // Throughput, in input frames per second.
+    std::vector<float> samples((size_t)(sizeMB << 20) / sizeof(float));
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = input[i % input.size()];
+    }
+    std::vector<float> mixed(samples.size());
+    for (const auto& test : cases)
+    {
+        size_t frames = samples.size() / test.matrix.inputs;
+        for (auto level : levels)
+        {
+            if ((int)level > (int)supported)
+            {
+                continue;
+            }
+            ChannelMixer mixer{ test.matrix, level };
+            mixer.Mix(samples.data(), frames, mixed.data());
+            Stopwatch timer;
+            const int passes = 4;
+            for (int pass = 0; pass < passes; pass++)
+            {
+                mixer.Mix(samples.data(), frames, mixed.data());
+            }
+            auto seconds = timer.Seconds();
+            std::cout << "matrix=" << test.name
+                << " kernel=" << mixer.KernelName()
+                << " mframes_per_s=" << passes * frames / seconds / 1e6
+                << " gb_per_s=" << passes * frames * test.matrix.inputs * sizeof(float) / seconds / 1e9 << std::endl;
+        }
+    }
+    return checks.ExitCode();
+}
+
+// The separate deinterleave pass the analysis tools used to run: one sweep
+// over the whole buffer per channel.
+static void DeinterleaveByChannel(const float* in, size_t frames, uint16_t channels, float* const* planes)
+{
+    for (uint16_t channel = 0; channel < channels; channel++)
+    {
+        for (size_t frame = 0; frame < frames; frame++)
+        {
+            planes[channel][frame] = in[frame * channels + channel];
+        }
+    }
+}
+
+static void DeinterleaveByFrame(const float* in, size_t frames, uint16_t channels, float* const* planes)
+{
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        for (uint16_t channel = 0; channel < channels; channel++)
+        {
+            planes[channel][frame] = in[frame * channels + channel];
+        }
+    }
+}
+
+static int BenchPlanar(int argc, char** argv)
+{
+    std::string dir = argc > 2 ? argv[2] : ".";
+    uint64_t sizeMB = argc > 3 ? std::stoull(argv[3]) : 64;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 };
+    auto supported = DetectSimdLevel();
+
+    std::vector<float> input(1031 * 16);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = (float)i;
+    }
+    auto makePlanes = [](std::vector<float>& storage, uint16_t channels, size_t frames, std::vector<float*>& planes)
+    {
+        storage.assign(channels * frames + 8, -1.0f);
+        planes.resize(channels);
+        for (uint16_t channel = 0; channel < channels; channel++)
+        {
+            planes[channel] = storage.data() + channel * frames;
+        }
+    };
+
+    // Correctness: every kernel must match the naive loop, across channel
+    // counts that do and do not fill a vector and frame counts that do and
+    // do not fill a block.
+    BenchChecks checks;
+    for (uint16_t channels : { 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 16 })
+    {
+        for (size_t frames : { (size_t)1, (size_t)7, (size_t)255, (size_t)256, (size_t)257, (size_t)1031 })
+        {
+            std::vector<float> expectedStorage, actualStorage;
+            std::vector<float*> expected, actual;
+            makePlanes(expectedStorage, channels, frames, expected);
+            DeinterleaveByFrame(input.data(), frames, channels, expected.data());
+            for (auto level : levels)
+            {
+                if ((int)level > (int)supported)
+                {
+                    continue;
+                }
+                makePlanes(actualStorage, channels, frames, actual);
+                Deinterleaver{ level }.Deinterleave(input.data(), frames, channels, actual.data());
+                checks.Expect(expectedStorage == actualStorage, "mismatch: channels=" + std::to_string(channels)
+                    + " frames=" + std::to_string(frames) + " " + SimdLevelName(level));
+            }
+        }
+    }
+
+    // One file per channel, named after the speaker, holding that channel.
+    {
+        PcmFormat format;
+        format.channels = 6;
+        format.channelMask = 0x3F;
+        std::string base = dir + "/planar_check.wav";
+        PlanarWaveWriter writer;
+        if (checks.Expect(writer.Open(base.c_str(), format, false), "cannot create " + base))
+        {
+            const size_t frames = 1031;
+            writer.Write(input.data(), 600 * 6 * sizeof(float));
+            writer.Write(input.data() + 600 * 6, (frames - 600) * 6 * sizeof(float));
+            writer.Close();
+            const char* names[] = { "FL", "FR", "FC", "LFE", "BL", "BR" };
+            for (uint16_t channel = 0; channel < 6; channel++)
+            {
+                auto path = PlanarFileName(base.c_str(), 1u << channel, channel);
+                RiffReader riff;
+                std::vector<float> plane(frames + 1);
+                bool match = path == dir + "/planar_check." + names[channel] + ".wav" && riff.Open(path.c_str())
+                    && riff.DataSize() == frames * sizeof(float) && riff.Read((uint8_t*)plane.data(), plane.size() * sizeof(float)) == frames * sizeof(float);
+                for (size_t frame = 0; match && frame < frames; frame++)
+                {
+                    match = plane[frame] == input[frame * 6 + channel];
+                }
+                riff.Close();
+                remove(path.c_str());
+                checks.Expect(match, "planar file: " + path);
+            }
+        }
+    }
+    checks.PrintSummary(std::string(" best=") + SimdLevelName(supported));
+
+    // Throughput against channel count, in GB/s of interleaved input.
+    for (uint16_t channels : { 2, 6, 8, 12, 16 })
+    {
+        size_t frames = (size_t)(sizeMB << 20) / sizeof(float) / channels;
+        std::vector<float> samples(frames * channels);
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            samples[i] = input[i % input.size()];
+        }
+        std::vector<float> storage;
+        std::vector<float*> planes;
+        makePlanes(storage, channels, frames, planes);
+        auto run = [&](const char* kernel, auto deinterleave)
+        {
+            deinterleave();
+            Stopwatch timer;
+            const int passes = 4;
+            for (int pass = 0; pass < passes; pass++)
+            {
+                deinterleave();
+            }
+            auto seconds = timer.Seconds();
+            std::cout << "channels=" << channels << " kernel=" << kernel
+                << " gb_per_s=" << passes * samples.size() * sizeof(float) / seconds / 1e9 << std::endl;
+        };
+        run("naive-by-channel", [&] { DeinterleaveByChannel(samples.data(), frames, channels, planes.data()); });
+        run("naive-by-frame", [&] { DeinterleaveByFrame(samples.data(), frames, channels, planes.data()); });
+        for (auto level : levels)
+        {
+            if ((int)level > (int)supported)
+            {
+                continue;
+            }
+            Deinterleaver deinterleaver{ level };
+            std::string kernel = std::string("blocked-") + SimdLevelName(level);
+            run(kernel.c_str(), [&] { deinterleaver.Deinterleave(samples.data(), frames, channels, planes.data()); });
+        }
+    }
+    return checks.ExitCode();
+}
+
+// Drops or repeats access units after they were stamped, like a lossy
+// transport, so the decoder output has holes or repeats in its timeline.
+class FaultyInput
+{
+public:
+    FaultyInput(SplitterInput<>& input, uint32_t dropEvery, uint32_t repeatEvery)
+        : input(input), dropEvery(dropEvery), repeatEvery(repeatEvery)
+    {
+    }
+
+    bool Next(DecoderInput& unit)
+    {
+        if (repeatPending)
+        {
+            unit = last;
+            repeatPending = false;
+            return true;
+        }
+        while (input.Next(unit))
+        {
+            index++;
+            if (dropEvery != 0 && index % dropEvery == 0)
+            {
+                dropped++;
+                continue;
+            }
+            if (repeatEvery != 0 && index % repeatEvery == 0)
+            {
+                last = unit;
+                repeatPending = true;
+                repeated++;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void Accepted() { input.Accepted(); }
+
+    uint64_t index = 0;
+    uint64_t dropped = 0;
+    uint64_t repeated = 0;
+
+private:
+    SplitterInput<>& input;
+    uint32_t dropEvery;
+    uint32_t repeatEvery;
+    DecoderInput last;
+    bool repeatPending = false;
+};
+
+static int BenchTimeline(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 16;
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+    StandInDecoderOptions decoderOptions;
+    const size_t frameBytes = decoderOptions.channels * sizeof(float);
+
+    struct Run
+    {
+        bool ok = false;
+        uint64_t units = 0;
+        uint64_t dropped = 0;
+        uint64_t repeated = 0;
+        uint64_t bytes = 0;
+        TimelineStats timeline;
+    };
+    auto run = [&](uint32_t dropEvery, uint32_t repeatEvery, const TimelineOptions& options)
+    {
+        Run result;
+        StandInDecoder decoder{ decoderOptions };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        DecodeStats stats;
+        SplitterInput<> splitterInput{ splitter, stats };
+        FaultyInput input{ splitterInput, dropEvery, repeatEvery };
+        ChecksumSink checksum;
+        TimelineSink<ChecksumSink> sink{ checksum, frameBytes, options };
+        SinkOutput<TimelineSink<ChecksumSink>> output{ pool, sink };
+        result.ok = RunDecodeLoop(input, decoder, output, stats);
+        result.units = input.index;
+        result.dropped = input.dropped;
+        result.repeated = input.repeated;
+        result.bytes = checksum.bytes;
+        result.timeline = sink.Stats();
+        return result;
+    };
+
+    BenchChecks checks;
+
+    TimelineOptions detectOnly;
+    TimelineOptions repair;
+    repair.fillGaps = true;
+    repair.trimOverlaps = true;
+    const uint64_t frame = 1536;
+
+    auto clean = run(0, 0, detectOnly);
+    auto total = clean.units * frame;
+    checks.Expect(clean.ok && clean.timeline.Discontinuities() == 0 && clean.timeline.untimedBuffers == 0
+        && clean.timeline.endSample == (int64_t)total && clean.bytes == total * frameBytes, "clean stream is continuous");
+
+    // The pipelined writer must pass positions on as well.
+    {
+        StandInDecoder decoder{ decoderOptions };
+        PipelineOptions pipeline;
+        BufferPool pool{ decoder.MaxOutputBytes(), pipeline.OutputBuffers() };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        DecodeStats stats;
+        ChecksumSink checksum;
+        TimelineSink<ChecksumSink> sink{ checksum, frameBytes };
+        bool ok = PipelinedDecodeStream(splitter, decoder, pool, sink, stats, nullptr, NoInputHook(), pipeline);
+        checks.Expect(ok && sink.Stats().Discontinuities() == 0 && sink.Stats().untimedBuffers == 0
+            && sink.Stats().endSample == (int64_t)total, "pipelined stream is continuous and timed");
+    }
+
+    const uint32_t dropEvery = 50;
+    auto dropped = run(dropEvery, 0, detectOnly);
+    checks.Expect(dropped.ok && dropped.timeline.gaps == dropped.dropped && dropped.timeline.gapSamples == dropped.dropped * frame
+        && dropped.timeline.overlaps == 0 && dropped.bytes == (dropped.units - dropped.dropped) * frame * frameBytes,
+        "dropped frames reported as gaps");
+    auto filled = run(dropEvery, 0, repair);
+    bool lastDropped = filled.units % dropEvery == 0;
+    checks.Expect(filled.ok && filled.timeline.filledSamples == filled.timeline.gapSamples
+        && (lastDropped || filled.bytes == clean.bytes), "gaps filled back to full length");
+    if (!filled.timeline.log.empty())
+    {
+        const auto& event = filled.timeline.log[0];
+        checks.Expect(event.kind == DiscontinuityKind::Gap && event.expected == (int64_t)((dropEvery - 1) * frame)
+            && event.actual == (int64_t)(dropEvery * frame) && event.samples == frame, "first gap logged where it happened");
+    }
+
+    const uint32_t repeatEvery = 40;
+    auto repeated = run(0, repeatEvery, detectOnly);
+    checks.Expect(repeated.ok && repeated.timeline.overlaps == repeated.repeated && repeated.timeline.overlapSamples == repeated.repeated * frame
+        && repeated.timeline.gaps == 0, "repeated frames reported as overlaps");
+    auto trimmed = run(0, repeatEvery, repair);
+    checks.Expect(trimmed.ok && trimmed.timeline.trimmedSamples == trimmed.timeline.overlapSamples && trimmed.bytes == clean.bytes
+        && trimmed.timeline.endSample == (int64_t)total, "overlaps trimmed back to the source timeline");
+
+    // A unit stamped far in the future (a corrupt or wrapped timestamp) is
+    // logged as a gap but not filled: the output stays bounded.
+    {
+        std::vector<float> unit(frame * decoderOptions.channels, 0.25f);
+        auto unitBytes = unit.size() * sizeof(float);
+        ChecksumSink checksum;
+        TimelineSink<ChecksumSink> sink{ checksum, frameBytes, repair };
+        const int64_t future = 1ll << 40;
+        WriteDecoded(sink, unit.data(), unitBytes, 0, (uint32_t)frame);
+        WriteDecoded(sink, unit.data(), unitBytes, (int64_t)frame * 2, (uint32_t)frame);
+        WriteDecoded(sink, unit.data(), unitBytes, future, (uint32_t)frame);
+        WriteDecoded(sink, unit.data(), unitBytes, future + (int64_t)frame, (uint32_t)frame);
+        const auto& stats = sink.Stats();
+        checks.Expect(stats.gaps == 2 && stats.unfilledGaps == 1 && stats.filledSamples == frame
+            && stats.gapSamples == frame + (uint64_t)(future - 3 * (int64_t)frame) && checksum.bytes == 5 * unitBytes
+            && stats.endSample == future + 2 * (int64_t)frame, "a gap past maxFillSamples is logged, not filled");
+    }
+
+    // Timestamps that went through 100 ns units (Media Foundation) over 30
+    // hours of 44.1 kHz, starting past 2^32 samples: rounding must neither
+    // be reported nor add up to drift.
+    {
+        const int64_t rate = 44100;
+        const int64_t start = (1ll << 32) - 12345;
+        const int64_t end = start + 30 * 3600 * rate;
+        TimelineMonitor monitor;
+        Stopwatch timer;
+        uint64_t buffers = 0;
+        for (int64_t position = start; position < end; position += frame, buffers++)
+        {
+            int64_t hns = position * 10000000 / rate;
+            monitor.Check((hns * rate + 5000000) / 10000000, (uint32_t)frame);
+        }
+        auto seconds = timer.Seconds();
+        const auto& stats = monitor.Stats();
+        checks.Expect(stats.Discontinuities() == 0 && stats.startSample == start && stats.endSample == start + (int64_t)(buffers * frame),
+            "100 ns rounding over 30 hours");
+        std::cout << "monitor_ns_per_buffer=" << seconds * 1e9 / buffers << std::endl;
+    }
+
+    std::cout << "access_units=" << clean.units
+        << " dropped=" << dropped.dropped << " gaps=" << dropped.timeline.gaps
+        << " repeated=" << repeated.repeated << " overlaps=" << repeated.timeline.overlaps
+        << " filled_samples=" << filled.timeline.filledSamples << " trimmed_samples=" << trimmed.timeline.trimmedSamples << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+// Keeps decoder output in memory so ranges can be compared to slices of it.
+struct CaptureSink
+{
+    std::vector<uint8_t> data;
+
+    void Write(const void* buffer, size_t size)
+    {
+        data.insert(data.end(), (const uint8_t*)buffer, (const uint8_t*)buffer + size);
+    }
+};
+
+static int BenchSeek(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 2;
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+    StandInDecoderOptions decoderOptions;
+    const size_t frameBytes = decoderOptions.channels * sizeof(float);
+
+    Stopwatch buildTimer;
+    FrameIndex index;
+    bool built = index.Build(stream.data(), stream.size());
+    auto buildSeconds = buildTimer.Seconds();
+
+    // Reference: the whole stream from the start.
+    CaptureSink full;
+    {
+        StandInDecoder decoder{ decoderOptions };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        DecodeStats stats;
+        DecodeStream(splitter, decoder, pool, full, stats);
+    }
+    auto total = index.TotalSamples();
+
+    struct Run
+    {
+        bool ok = false;
+        SeekPlan plan;
+        std::vector<uint8_t> data;
+        double seconds = 0;
+    };
+    auto decodeRange = [&](int64_t start, int64_t end, uint32_t preroll, bool pipelined)
+    {
+        Run result;
+        Stopwatch timer;
+        if (!index.Plan(start, end, preroll, result.plan))
+        {
+            return result;
+        }
+        StandInDecoder decoder{ decoderOptions };
+        PipelineOptions pipeline;
+        BufferPool pool{ decoder.MaxOutputBytes(), pipelined ? pipeline.OutputBuffers() : 1 };
+        DdpFrameSplitter splitter{ stream.data(), result.plan.endOffset };
+        splitter.Seek(result.plan.beginOffset);
+        DecodeStats stats;
+        CaptureSink capture;
+        RangeSink<CaptureSink> sink{ capture, frameBytes, result.plan.startSample, result.plan.endSample };
+        result.ok = pipelined
+            ? PipelinedDecodeStream(splitter, decoder, pool, sink, stats, nullptr, NoInputHook(), pipeline, nullptr, result.plan.firstSample)
+            : DecodeStream(splitter, decoder, pool, sink, stats, nullptr, NoInputHook(), result.plan.firstSample);
+        result.seconds = timer.Seconds();
+        result.data = std::move(capture.data);
+        return result;
+    };
+    auto slice = [&](int64_t start, int64_t end)
+    {
+        end = end > 0 && end < total ? end : total;
+        return std::vector<uint8_t>(full.data.begin() + (size_t)start * frameBytes, full.data.begin() + (size_t)end * frameBytes);
+    };
+
+    BenchChecks checks;
+
+    checks.Expect(built && index.Size() > 20 && full.data.size() == (size_t)total * frameBytes, "index covers the decoded stream");
+    const int64_t frame = index[1].sampleTime - index[0].sampleTime;
+    checks.Expect(index.Find(0) == 0 && index.Find(frame - 1) == 0 && index.Find(frame) == 1 && index.Find(total + 5) == index.Size() - 1,
+        "find picks the unit holding the sample");
+
+    // Start of stream, unit boundaries, mid-frame cuts, the tail, and one
+    // sample; end 0 means to the end of the stream.
+    const int64_t ranges[][2] = {
+        { 0, 1000 },
+        { 0, 0 },
+        { 10 * frame, 20 * frame },
+        { 12345, 54321 },
+        { frame - 1, frame + 1 },
+        { 7 * frame + 100, 7 * frame + 101 },
+        { total - 777, 0 },
+        { total / 2, total - 1 },
+    };
+    for (const auto& range : ranges)
+    {
+        for (bool pipelined : { false, true })
+        {
+            auto run = decodeRange(range[0], range[1], DDPIN_PREROLL_UNITS, pipelined);
+            checks.Expect(run.ok && run.data == slice(range[0], range[1]),
+                std::string(pipelined ? "pipelined" : "serial") + " range " + std::to_string(range[0]) + "-" + std::to_string(range[1])
+                + " matches the full decode");
+        }
+    }
+    // Past the end, or empty: nothing to plan.
+    SeekPlan plan;
+    checks.Expect(!index.Plan(total, 0, DDPIN_PREROLL_UNITS, plan) && !index.Plan(500, 500, DDPIN_PREROLL_UNITS, plan), "empty ranges are refused");
+    // Without pre-roll the first unit decodes cold and differs.
+    auto cold = decodeRange(10 * frame, 20 * frame, 0, false);
+    checks.Expect(cold.ok && cold.data.size() == slice(10 * frame, 20 * frame).size() && cold.data != slice(10 * frame, 20 * frame),
+        "no pre-roll gives a different first frame");
+
+    // A short range near the end costs a few units, not the whole stream.
+    Stopwatch fullTimer;
+    {
+        StandInDecoder decoder{ decoderOptions };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        DecodeStats stats;
+        ChecksumSink checksum;
+        DecodeStream(splitter, decoder, pool, checksum, stats);
+    }
+    auto fullSeconds = fullTimer.Seconds();
+    auto tail = decodeRange(total - 10 * frame, total - 5 * frame, DDPIN_PREROLL_UNITS, false);
+    checks.Expect(tail.ok && tail.plan.units == 6, "tail range feeds five units plus pre-roll");
+
+    const int lookups = 1000000;
+    uint64_t found = 0;
+    Stopwatch findTimer;
+    for (int i = 0; i < lookups; i++)
+    {
+        found += index.Find((int64_t)((uint64_t)i * 2654435761u % (uint64_t)total));
+    }
+    auto findSeconds = findTimer.Seconds();
+
+    std::cout << "access_units=" << index.Size() << " samples=" << total
+        << " index_build_ms=" << buildSeconds * 1000 << " find_ns=" << findSeconds * 1e9 / lookups << " (" << found % 2 << ")"
+        << " full_decode_ms=" << fullSeconds * 1000 << " tail_range_ms=" << tail.seconds * 1000 << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+static int BenchIndex(int argc, char** argv)
+{
+    std::string dir = argc > 2 ? argv[2] : ".";
+    uint64_t sizeMB = argc > 3 ? std::stoull(argv[3]) : 64;
+    auto input = dir + "/index_in.wav";
+    auto sidecar = FrameIndexPath(input.c_str());
+    remove(sidecar.c_str());
+    if (!WriteSyntheticStreamWav(input.c_str(), sizeMB << 20))
+    {
+        std::cout << "failed to write " << input << std::endl;
+        return 1;
+    }
+
+    BenchChecks checks;
+    auto sameEntries = [](const FrameIndex& a, const FrameIndex& b)
+    {
+        if (a.Size() != b.Size() || a.StreamBytes() != b.StreamBytes() || a.TotalSamples() != b.TotalSamples())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.Size(); i++)
+        {
+            if (a[i].offset != b[i].offset || a[i].sampleTime != b[i].sampleTime || a[i].bytes != b[i].bytes
+                || a[i].substreamId != b[i].substreamId)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto loadOrBuild = [&](FrameIndex& index, bool& loaded, double& seconds)
+    {
+        // Mapping included: that is what a repeat run pays either way.
+        Stopwatch timer;
+        MappedBitstreamSource source;
+        bool ok = source.Open(input.c_str()) && LoadOrBuildFrameIndex(index, input.c_str(), source.Data(), source.Size(), loaded);
+        seconds = timer.Seconds();
+        return ok;
+    };
+
+    FrameIndex built, loaded;
+    bool wasLoaded = true;
+    double buildSeconds = 0, loadSeconds = 0;
+    checks.Expect(loadOrBuild(built, wasLoaded, buildSeconds) && !wasLoaded && !built.Empty(), "first run scans and saves");
+    checks.Expect(loadOrBuild(loaded, wasLoaded, loadSeconds) && wasLoaded && sameEntries(built, loaded), "second run loads the same index");
+    FileStamp sidecarStamp;
+    GetFileStamp(sidecar.c_str(), sidecarStamp);
+
+    // A range decode through the sidecar writes the same file as one
+    // through a fresh scan.
+    {
+        StandInDecoder decoder;
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DecodeFileOptions options;
+        options.startSeconds = 1.234;
+        options.endSeconds = 5.678;
+        DecodeFileStats scanned, indexed;
+        auto scannedOutput = dir + "/index_out_scan.wav";
+        auto indexedOutput = dir + "/index_out_sidecar.wav";
+        bool ok = DecodeFile(input.c_str(), scannedOutput.c_str(), decoder, pool, scanned, options);
+        options.indexFile = true;
+        ok = DecodeFile(input.c_str(), indexedOutput.c_str(), decoder, pool, indexed, options) && ok;
+        checks.Expect(ok && indexed.indexLoaded && ChecksumFile(scannedOutput.c_str()) == ChecksumFile(indexedOutput.c_str()),
+            "range decode through the sidecar matches a scan");
+    }
+
+    // Damaged sidecars are rejected, not trusted.
+    FileStamp sourceStamp;
+    GetFileStamp(input.c_str(), sourceStamp);
+    std::vector<uint8_t> bytes;
+    {
+        MappedFile file;
+        if (file.Open(sidecar.c_str()))
+        {
+            bytes.assign(file.Data(), file.Data() + file.Size());
+        }
+    }
+    auto rewrite = [&](const std::vector<uint8_t>& content)
+    {
+        FILE* file = OpenFile(sidecar.c_str(), "wb");
+        if (file != nullptr)
+        {
+            fwrite(content.data(), 1, content.size(), file);
+            fclose(file);
+        }
+    };
+    FrameIndex rejected;
+    auto flipped = bytes;
+    flipped[flipped.size() / 2] ^= 0x40;
+    rewrite(flipped);
+    checks.Expect(!LoadFrameIndex(rejected, sidecar.c_str(), sourceStamp) && rejected.Empty(), "corrupt payload rejected");
+    rewrite(std::vector<uint8_t>(bytes.begin(), bytes.end() - 3));
+    checks.Expect(!LoadFrameIndex(rejected, sidecar.c_str(), sourceStamp), "truncated sidecar rejected");
+    rewrite(bytes);
+    auto otherStamp = sourceStamp;
+    otherStamp.modified++;
+    checks.Expect(LoadFrameIndex(rejected, sidecar.c_str(), sourceStamp) && !LoadFrameIndex(rejected, sidecar.c_str(), otherStamp),
+        "stamp mismatch rejected");
+
+    // A changed source makes the next run rescan and replace the sidecar.
+    SyntheticStreamOptions changed;
+    changed.seed = 0xC4A6;
+    WriteSyntheticStreamWav(input.c_str(), (sizeMB << 20) + 4096, changed);
+    FrameIndex rebuilt, reference;
+    checks.Expect(loadOrBuild(rebuilt, wasLoaded, buildSeconds) && !wasLoaded, "changed source rescanned");
+    {
+        MappedBitstreamSource source;
+        checks.Expect(source.Open(input.c_str()) && reference.Build(source.Data(), source.Size()) && sameEntries(rebuilt, reference)
+            && loadOrBuild(loaded, wasLoaded, loadSeconds) && wasLoaded && sameEntries(loaded, reference),
+            "replacement sidecar matches the new source");
+    }
+
+    std::cout << "access_units=" << built.Size() << " sidecar_bytes=" << sidecarStamp.size
+        << " bytes_per_unit=" << (double)sidecarStamp.size / built.Size()
+        << " in_memory_bytes_per_unit=" << sizeof(FrameIndexEntry)
+        << " scan_ms=" << buildSeconds * 1000 << " load_ms=" << loadSeconds * 1000 << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+static int BenchParallel(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 64;
+    unsigned threads = argc > 3 ? (unsigned)std::stoul(argv[3]) : 0;
+    uint32_t chunkUnits = argc > 4 ? (uint32_t)std::stoul(argv[4]) : 512;
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+    StandInDecoderOptions decoderOptions;
+    const size_t frameBytes = decoderOptions.channels * sizeof(float);
+    FrameIndex index;
+    index.Build(stream.data(), stream.size());
+
+    BenchChecks checks;
+
+    struct Run
+    {
+        bool ok = false;
+        uint64_t hash = 0;
+        uint64_t bytes = 0;
+        TimelineStats timeline;
+        DecodeStats stats;
+        ParallelDecodeStats parallel;
+    };
+    auto serial = [&](int64_t start, int64_t end)
+    {
+        Run result;
+        StandInDecoder decoder{ decoderOptions };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        SeekPlan plan;
+        index.Plan(start, end, DDPIN_PREROLL_UNITS, plan);
+        DdpFrameSplitter splitter{ stream.data(), plan.endOffset };
+        splitter.Seek(plan.beginOffset);
+        ChecksumSink checksum;
+        RangeSink<ChecksumSink> sink{ checksum, frameBytes, plan.startSample, plan.endSample };
+        result.ok = DecodeStream(splitter, decoder, pool, sink, result.stats, nullptr, NoInputHook(), plan.firstSample);
+        result.hash = checksum.hash;
+        result.bytes = checksum.bytes;
+        return result;
+    };
+    WorkStealingPool pool{ threads };
+    auto parallel = [&](int64_t start, int64_t end, uint32_t units, uint32_t preroll)
+    {
+        Run result;
+        ParallelDecodeOptions options;
+        options.pool = &pool;
+        options.createDecoder = [&]() -> std::unique_ptr<DecoderTransform> { return std::unique_ptr<DecoderTransform>(new StandInDecoder(decoderOptions)); };
+        options.chunkUnits = units;
+        options.prerollUnits = preroll;
+        ChecksumSink checksum;
+        TimelineSink<ChecksumSink> sink{ checksum, frameBytes };
+        result.ok = ParallelDecodeStream(stream.data(), index, start, end, frameBytes, sink, result.stats, options, &result.parallel);
+        result.hash = checksum.hash;
+        result.bytes = checksum.bytes;
+        result.timeline = sink.Stats();
+        return result;
+    };
+
+    // Whole stream: same bytes as the serial decode for any chunking, with
+    // every buffer on the timeline.
+    auto reference = serial(0, 0);
+    auto total = index.TotalSamples();
+    checks.Expect(reference.ok && reference.bytes == (uint64_t)total * frameBytes, "serial reference decodes the whole stream");
+    for (uint32_t units : { chunkUnits, 1u, 7u, (uint32_t)index.Size() + 1 })
+    {
+        auto run = parallel(0, 0, units, 2);
+        checks.Expect(run.ok && run.hash == reference.hash && run.bytes == reference.bytes && run.timeline.Discontinuities() == 0
+            && run.timeline.untimedBuffers == 0 && run.timeline.endSample == total,
+            "chunks of " + std::to_string(units) + " units match the serial decode");
+    }
+    auto seamless = parallel(0, 0, 64, 1);
+    checks.Expect(seamless.ok && seamless.hash == reference.hash, "one unit of pre-roll is enough for the stand-in");
+    auto cold = parallel(0, 0, 64, 0);
+    checks.Expect(cold.ok && cold.bytes == reference.bytes && cold.hash != reference.hash, "no pre-roll breaks the seams");
+
+    // A range with mid-unit ends.
+    const int64_t rangeStart = 100000 + 17, rangeEnd = total - 54321;
+    auto rangeReference = serial(rangeStart, rangeEnd);
+    auto ranged = parallel(rangeStart, rangeEnd, 37, 2);
+    checks.Expect(ranged.ok && ranged.hash == rangeReference.hash && ranged.bytes == rangeReference.bytes
+        && ranged.timeline.startSample == rangeStart && ranged.timeline.endSample == rangeEnd, "range matches the serial decode");
+
+    // End to end through DecodeFile, to a WAV file on disk.
+    if (argc > 5)
+    {
+        std::string dir = argv[5];
+        auto input = dir + "/parallel_in.wav";
+        WriteSyntheticStreamWav(input.c_str(), sizeMB << 20);
+        StandInDecoder decoder{ decoderOptions };
+        BufferPool outputPool{ decoder.MaxOutputBytes(), 1 };
+        DecodeFileOptions options;
+        options.outputType = PcmSampleType::Int24;
+        DecodeFileStats serialStats, parallelStats;
+        auto serialOutput = dir + "/parallel_out_serial.wav";
+        auto parallelOutput = dir + "/parallel_out_parallel.wav";
+        bool ok = DecodeFile(input.c_str(), serialOutput.c_str(), decoder, outputPool, serialStats, options);
+        ParallelDecodeOptions parallelOptions;
+        parallelOptions.pool = &pool;
+        parallelOptions.createDecoder = [&]() -> std::unique_ptr<DecoderTransform> { return std::unique_ptr<DecoderTransform>(new StandInDecoder(decoderOptions)); };
+        options.parallel = &parallelOptions;
+        ok = DecodeFile(input.c_str(), parallelOutput.c_str(), decoder, outputPool, parallelStats, options) && ok;
+        checks.Expect(ok && ChecksumFile(serialOutput.c_str()) == ChecksumFile(parallelOutput.c_str()), "DecodeFile writes the same WAV file");
+    }
+
+    // Throughput: the pool against one decoder.
+    Stopwatch serialTimer;
+    auto timedSerial = serial(0, 0);
+    auto serialSeconds = serialTimer.Seconds();
+    auto timed = parallel(0, 0, chunkUnits, 2);
+    checks.Expect(timedSerial.hash == timed.hash, "timed runs agree");
+    double audioSeconds = total / (double)decoderOptions.sampleRate;
+    std::cout << "access_units=" << index.Size() << " workers=" << timed.parallel.workers << " chunks=" << timed.parallel.chunks
+        << " preroll_units=" << timed.parallel.prerollUnits
+        << " serial_realtime_x=" << audioSeconds / serialSeconds << " parallel_realtime_x=" << audioSeconds / timed.stats.seconds
+        << " speedup=" << serialSeconds / timed.stats.seconds << " writer_wait_s=" << timed.parallel.writerWaitSeconds << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+static int BenchNegotiate(int argc, char** argv)
+{
+    unsigned files = argc > 2 ? (unsigned)std::stoul(argv[2]) : 64;
+    unsigned threads = argc > 3 ? (unsigned)std::stoul(argv[3]) : 4;
+    // Stand-in for MFTEnumEx plus the walk over available types: the cost
+    // is paid per negotiation, whatever the result.
+    const auto enumerateCost = std::chrono::milliseconds(2);
+
+    BenchChecks checks;
+
+    // Three source formats: 5.1, 7.1 (dependent substream) and stereo.
+    std::vector<std::vector<uint8_t>> streams(3);
+    std::vector<StreamSignature> signatures(3);
+    SyntheticStreamOptions formats[3];
+    formats[1].dependentSubstream = true;
+    formats[2].acmod = 2;
+    formats[2].lfeon = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        SyntheticStreamWriter writer{ formats[i] };
+        writer.Append(streams[i], 64 << 10);
+        ReadStreamSignature(streams[i].data(), streams[i].size(), signatures[i]);
+    }
+    checks.Expect(signatures[0].Channels() == 6 && !signatures[0].dependentFrames && signatures[1].dependentFrames
+        && signatures[2].Channels() == 2 && signatures[0].sampleRate == 48000
+        && signatures[0].Key() != signatures[1].Key() && signatures[0].Key() != signatures[2].Key(), "signatures tell the formats apart");
+    StreamSignature none;
+    uint8_t garbage[256] = {};
+    checks.Expect(!ReadStreamSignature(garbage, sizeof(garbage), none), "no signature without a sync frame");
+
+    struct Negotiated
+    {
+        uint64_t key = 0;
+        uint16_t channels = 0;
+    };
+    std::atomic<uint64_t> negotiations{ 0 };
+    auto negotiate = [&](const StreamSignature& signature, Negotiated& negotiated)
+    {
+        negotiations++;
+        std::this_thread::sleep_for(enumerateCost);
+        negotiated.key = signature.Key();
+        negotiated.channels = signature.Channels();
+        return true;
+    };
+
+    // A batch of short clips, formats interleaved, on a pool; each file
+    // reads its signature and sets up its decoder.
+    auto runBatch = [&](bool cached, std::vector<double>& setupSeconds)
+    {
+        NegotiationCache<Negotiated> cache;
+        setupSeconds.assign(files, 0);
+        std::atomic<unsigned> wrong{ 0 };
+        Stopwatch timer;
+        {
+            WorkStealingPool pool{ threads };
+            for (unsigned i = 0; i < files; i++)
+            {
+                pool.Submit([&, i](unsigned)
+                {
+                    Stopwatch setup;
+                    const auto& stream = streams[i % 3];
+                    StreamSignature signature;
+                    Negotiated negotiated;
+                    bool ok = ReadStreamSignature(stream.data(), stream.size(), signature)
+                        && (cached ? cache.Get(signature, negotiated, negotiate) : negotiate(signature, negotiated));
+                    setupSeconds[i] = setup.Seconds();
+                    if (!ok || negotiated.key != signatures[i % 3].Key() || negotiated.channels != signatures[i % 3].Channels())
+                    {
+                        wrong++;
+                    }
+                });
+            }
+            pool.Wait();
+        }
+        if (cached)
+        {
+            checks.Expect(cache.Misses() == 3 && cache.Hits() == files - 3 && cache.Size() == 3, "one negotiation per format, even concurrently");
+        }
+        checks.Expect(wrong == 0, "every file gets its own format's types");
+        return timer.Seconds();
+    };
+
+    std::vector<double> uncachedSetup, cachedSetup;
+    negotiations = 0;
+    auto uncachedSeconds = runBatch(false, uncachedSetup);
+    checks.Expect(negotiations == files, "uncached setup negotiates every file");
+    negotiations = 0;
+    auto cachedSeconds = runBatch(true, cachedSetup);
+    checks.Expect(negotiations == 3, "cached setup negotiates each format once");
+
+    // A failed negotiation is not remembered; Forget drops an entry.
+    {
+        NegotiationCache<Negotiated> cache;
+        Negotiated negotiated;
+        int attempts = 0;
+        auto failing = [&](const StreamSignature&, Negotiated&) { attempts++; return false; };
+        bool first = cache.Get(signatures[0], negotiated, failing);
+        bool second = cache.Get(signatures[0], negotiated, failing);
+        checks.Expect(!first && !second && attempts == 2 && cache.Size() == 0, "failures are retried");
+        DecoderSetupStats setup;
+        cache.Get(signatures[0], negotiated, negotiate, &setup);
+        bool negotiatedFirst = !setup.cached && setup.negotiateSeconds > 0;
+        cache.Get(signatures[0], negotiated, negotiate, &setup);
+        checks.Expect(negotiatedFirst && setup.cached && setup.negotiateSeconds == 0, "setup stats say where the types came from");
+        cache.Forget(signatures[0]);
+        cache.Get(signatures[0], negotiated, negotiate, &setup);
+        checks.Expect(!setup.cached && cache.Size() == 1, "forgotten entries are renegotiated");
+    }
+
+    auto mean = [](const std::vector<double>& values)
+    {
+        double total = 0;
+        for (auto value : values)
+        {
+            total += value;
+        }
+        return values.empty() ? 0 : total / values.size();
+    };
+    std::sort(cachedSetup.begin(), cachedSetup.end());
+    std::cout << "files=" << files << " threads=" << threads
+        << " uncached_setup_ms=" << mean(uncachedSetup) * 1000 << " cached_setup_ms=" << mean(cachedSetup) * 1000
+        << " cached_median_setup_us=" << cachedSetup[cachedSetup.size() / 2] * 1e6
+        << " uncached_batch_s=" << uncachedSeconds << " cached_batch_s=" << cachedSeconds << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+// Stand-in decoder that counts live instances and resets, and can be told
+// to fail its next Reset, for checking the pool's accounting.
+class CountedDecoder : public StandInDecoder
+{
+public:
+    static std::atomic<int64_t> live;
+    static std::atomic<uint64_t> resets;
+
+    explicit CountedDecoder(const StandInDecoderOptions& options) : StandInDecoder(options) { live++; }
+    ~CountedDecoder() override { live--; }
+
+    DecodeResult Reset() override
+    {
+        resets++;
+        if (failReset)
+        {
+            return DecodeResult::Error;
+        }
+        return StandInDecoder::Reset();
+    }
+
+    bool failReset = false;
+};
+
+std::atomic<int64_t> CountedDecoder::live{ 0 };
+std::atomic<uint64_t> CountedDecoder::resets{ 0 };
+
+static int BenchDecoderPool(int argc, char** argv)
+{
+    std::string dir = argc > 2 ? argv[2] : ".";
+    unsigned files = argc > 3 ? (unsigned)std::stoul(argv[3]) : 48;
+    unsigned threads = argc > 4 ? (unsigned)std::stoul(argv[4]) : 4;
+    // Stand-in for activating the MFT and setting its types, paid per
+    // decoder created.
+    const auto activateCost = std::chrono::milliseconds(2);
+
+    BenchChecks checks;
+
+    // Short clips (about a second each) in two formats, interleaved.
+    SyntheticStreamOptions formats[2];
+    formats[1].acmod = 2;
+    formats[1].lfeon = 0;
+    std::vector<BatchJob> jobs;
+    for (unsigned i = 0; i < files; i++)
+    {
+        BatchJob job;
+        job.input = dir + "/pool_in_" + std::to_string(i) + ".wav";
+        auto options = formats[i % 2];
+        options.seed = 0x0B77 + i;
+        if (!WriteSyntheticStreamWav(job.input.c_str(), 96 << 10, options))
+        {
+            std::cout << "failed to write " << job.input << std::endl;
+            return 1;
+        }
+        jobs.push_back(job);
+    }
+
+    auto factory = [&](const StreamSignature& signature) -> std::unique_ptr<DecoderTransform>
+    {
+        std::this_thread::sleep_for(activateCost);
+        StandInDecoderOptions options;
+        options.channels = signature.Channels();
+        options.sampleRate = signature.sampleRate;
+        return std::unique_ptr<DecoderTransform>(new CountedDecoder(options));
+    };
+
+    // Without pooling nothing is kept idle, so every file creates its
+    // decoder and destroys it afterwards.
+    auto run = [&](size_t maxIdle, const char* suffix, std::vector<uint64_t>& checksums, std::vector<double>& setupSeconds,
+        DecoderPoolStats& stats)
+    {
+        auto batch = jobs;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            batch[i].output = dir + "/pool_out_" + std::to_string(i) + suffix + ".wav";
+        }
+        BatchResult result;
+        {
+            DecoderPool decoders{ factory, maxIdle };
+            WorkStealingPool pool{ threads };
+            result = DecodeBatch(batch, pool, decoders);
+            stats = decoders.Stats();
+        }
+        checksums.clear();
+        setupSeconds.clear();
+        for (const auto& file : result.files)
+        {
+            checksums.push_back(ChecksumFile(file.job.output.c_str()));
+            setupSeconds.push_back(file.setupSeconds);
+        }
+        checks.Expect(result.Failures() == 0, "batch decodes");
+        return result;
+    };
+
+    std::vector<uint64_t> freshChecksums, pooledChecksums;
+    std::vector<double> freshSetup, pooledSetup;
+    DecoderPoolStats fresh, pooled;
+    auto freshResult = run(0, "_fresh", freshChecksums, freshSetup, fresh);
+    auto pooledResult = run(16, "_pooled", pooledChecksums, pooledSetup, pooled);
+
+    // A reset decoder must decode the next file exactly like a new one.
+    checks.Expect(freshChecksums == pooledChecksums, "pooled decoders give the same output as fresh ones");
+    checks.Expect(fresh.created == files && fresh.reused == 0 && fresh.destroyed == files, "unpooled: one decoder per file");
+    checks.Expect(pooled.created <= 2 * (uint64_t)threads && pooled.created + pooled.reused == files,
+        "pooled: at most one decoder per worker and format");
+    checks.Expect(fresh.leased == 0 && pooled.leased == 0 && pooled.idle == pooled.created && pooled.Unaccounted() == 0,
+        "every lease returned by the end of the batch");
+    checks.Expect(CountedDecoder::live == 0, "no decoder outlives its pool");
+
+    // Lease lifetime, discards and failed resets.
+    {
+        DecoderPool decoders{ factory, 2 };
+        StreamSignature surround, stereo;
+        stereo.acmod = 2;
+        stereo.lfeon = 0;
+        decoders.Prewarm(surround, 3);
+        auto stats = decoders.Stats();
+        checks.Expect(stats.created == 3 && stats.idle == 2 && stats.destroyed == 1 && CountedDecoder::live == 2,
+            "prewarm keeps at most maxIdle per format");
+
+        DecoderSetupStats setup;
+        auto lease = decoders.Acquire(stereo, &setup);
+        checks.Expect(lease && !setup.cached && lease->OutputFormat().channels == 2, "a new format gets a new decoder");
+        DecoderPool::Lease moved = std::move(lease);
+        checks.Expect(!lease && moved && decoders.Stats().leased == 1, "leases move");
+        moved.Return();
+        moved.Return();
+        stats = decoders.Stats();
+        checks.Expect(stats.leased == 0 && stats.idle == 3, "a lease returns once");
+
+        auto reusedLease = decoders.Acquire(stereo, &setup);
+        checks.Expect(setup.cached && decoders.Stats().reused == 1, "the returned decoder is handed out again");
+        reusedLease.Discard();
+        reusedLease = DecoderPool::Lease();
+        stats = decoders.Stats();
+        checks.Expect(stats.discarded == 1 && stats.idle == 2 && CountedDecoder::live == 2, "discarded decoders are destroyed");
+
+        auto broken = decoders.Acquire(surround);
+        static_cast<CountedDecoder*>(broken.Get())->failReset = true;
+        auto resetsBefore = CountedDecoder::resets.load();
+        broken.Return();
+        stats = decoders.Stats();
+        checks.Expect(CountedDecoder::resets == resetsBefore + 1 && stats.resetFailures == 1 && stats.idle == 1 && CountedDecoder::live == 1,
+            "decoders that fail to reset are not reused");
+
+        // A lease still out shows up in the accounting.
+        auto outstanding = decoders.Acquire(surround);
+        stats = decoders.Stats();
+        checks.Expect(stats.leased == 1 && stats.Live() == 1 && stats.Unaccounted() == 0, "outstanding leases are counted");
+        outstanding.Return();
+        decoders.Clear();
+        stats = decoders.Stats();
+        checks.Expect(stats.Live() == 0 && CountedDecoder::live == 0, "clear destroys idle decoders");
+    }
+
+    auto percentile = [](std::vector<double> values, double p)
+    {
+        std::sort(values.begin(), values.end());
+        return values.empty() ? 0 : values[(size_t)(p * (values.size() - 1))];
+    };
+    std::cout << "files=" << files << " threads=" << threads
+        << " fresh_setup_p50_us=" << percentile(freshSetup, 0.5) * 1e6
+        << " fresh_setup_p99_us=" << percentile(freshSetup, 0.99) * 1e6
+        << " pooled_setup_p50_us=" << percentile(pooledSetup, 0.5) * 1e6
+        << " pooled_setup_p99_us=" << percentile(pooledSetup, 0.99) * 1e6
+        << " fresh_batch_s=" << freshResult.seconds << " pooled_batch_s=" << pooledResult.seconds
+        << " created=" << pooled.created << " reused=" << pooled.reused << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+static int BenchLatency(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 16;
+    uint32_t queue = argc > 3 ? (uint32_t)std::stoul(argv[3]) : 16;
+    std::string jsonFile = argc > 4 ? argv[4] : "";
+
+    BenchChecks checks;
+
+    // The histogram itself: percentiles within a bucket of the truth.
+    {
+        LatencyHistogram histogram;
+        for (uint64_t i = 1; i <= 10000; i++)
+        {
+            histogram.RecordNanoseconds(i * 1000);
+        }
+        auto within = [](double value, double truth) { return value >= truth && value <= truth * 1.125; };
+        checks.Expect(histogram.Count() == 10000 && within(histogram.PercentileSeconds(0.5), 5e-3) && within(histogram.PercentileSeconds(0.99), 9.9e-3)
+            && histogram.PercentileSeconds(1) == histogram.MaxSeconds() && within(histogram.MaxSeconds(), 10e-3)
+            && within(histogram.MinSeconds(), 0.999e-6),
+            "histogram percentiles are within one bucket");
+        LatencyHistogram other;
+        other.RecordNanoseconds(0);
+        other.RecordNanoseconds(uint64_t(1) << 62);
+        histogram.Merge(other);
+        checks.Expect(histogram.Count() == 10002 && histogram.MinSeconds() == 0 && histogram.MaxSeconds() > 4e9, "merge keeps extremes");
+        auto json = histogram.ToJson();
+        checks.Expect(json.find("\"count\":10002") != std::string::npos && json.find("\"p99_us\":") != std::string::npos
+            && json.find("\"buckets\":[[0.000,1]") != std::string::npos, "histogram exports as JSON");
+    }
+
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+
+    struct Run
+    {
+        ChecksumSink sink;
+        DecodeStats stats;
+        DecodeLatencyStats latency;
+        bool ok = false;
+    };
+    auto run = [&](uint32_t unitsPerPull)
+    {
+        Run result;
+        StandInDecoderOptions options;
+        options.inputQueueCapacity = queue;
+        StandInDecoder decoder{ options };
+        BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+        DdpFrameSplitter splitter{ stream.data(), stream.size() };
+        DecodeLoopOptions loop;
+        loop.unitsPerPull = unitsPerPull;
+        result.ok = DecodeStream(splitter, decoder, pool, result.sink, result.stats, nullptr, NoInputHook(), 0, loop, &result.latency);
+        return result;
+    };
+
+    // Filling the decoder first, then per unit and in small groups.
+    const uint32_t modes[] = { 0, 1, 2, 4 };
+    std::vector<Run> runs;
+    for (auto unitsPerPull : modes)
+    {
+        runs.push_back(run(unitsPerPull));
+    }
+    const auto& batched = runs[0];
+    const auto& perUnit = runs[1];
+    bool identical = true;
+    bool allMeasured = true;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        identical = identical && runs[i].ok && runs[i].sink.hash == batched.sink.hash && runs[i].sink.bytes == batched.sink.bytes;
+        allMeasured = allMeasured && runs[i].latency.unitLatency.Count() == runs[i].stats.inputUnits && runs[i].latency.firstOutputSeconds >= 0;
+        std::cout << "units_per_pull=" << modes[i]
+            << " first_output_us=" << runs[i].latency.firstOutputSeconds * 1e6
+            << " p50_us=" << runs[i].latency.unitLatency.PercentileSeconds(0.5) * 1e6
+            << " p99_us=" << runs[i].latency.unitLatency.PercentileSeconds(0.99) * 1e6
+            << " max_us=" << runs[i].latency.unitLatency.MaxSeconds() * 1e6
+            << " in_flight=" << runs[i].latency.maxUnitsInFlight
+            << " realtime_x=" << runs[i].stats.RealtimeFactor(48000) << std::endl;
+    }
+    checks.Expect(identical, "input granularity does not change the output");
+    checks.Expect(allMeasured, "every unit gets a latency");
+    checks.Expect(batched.latency.maxUnitsInFlight == queue && perUnit.latency.maxUnitsInFlight == 1
+        && runs[2].latency.maxUnitsInFlight == 2 && runs[3].latency.maxUnitsInFlight == 4, "units in flight follow the granularity");
+    checks.Expect(queue <= 2 || perUnit.latency.unitLatency.PercentileSeconds(0.5) < batched.latency.unitLatency.PercentileSeconds(0.5),
+        "per-unit mode has the lower median latency");
+
+    if (!jsonFile.empty())
+    {
+        checks.Expect(WriteTextFile(jsonFile.c_str(), perUnit.latency.ToJson() + "\n"), "latency JSON written");
+    }
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+static int BenchMetrics(int argc, char** argv)
+{
+    uint64_t sizeMB = argc > 2 ? std::stoull(argv[2]) : 16;
+    unsigned threads = argc > 3 ? (unsigned)std::stoul(argv[3]) : 4;
+    std::string jsonFile = argc > 4 ? argv[4] : "";
+
+    BenchChecks checks;
+
+    std::vector<uint8_t> stream;
+    SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+    streamWriter.Append(stream, sizeMB << 20);
+
+    // One decode: the counters must agree with the loop's own stats.
+    ResetMetrics();
+    StandInDecoderOptions decoderOptions;
+    decoderOptions.refuseEvery = 5;
+    StandInDecoder decoder{ decoderOptions };
+    BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+    DdpFrameSplitter splitter{ stream.data(), stream.size() };
+    ChecksumSink sink;
+    DecodeStats stats;
+    bool ok = DecodeStream(splitter, decoder, pool, sink, stats);
+    auto decoded = TakeMetricsSnapshot();
+
+    // Counting from several threads at once.
+    ResetMetrics();
+    const uint64_t perThread = 1000000;
+    Stopwatch countTimer;
+    {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]()
+            {
+                for (uint64_t i = 0; i < perThread; i++)
+                {
+                    DDP_COUNT(DecodeCounter::InputBytes, 2);
+                }
+                // 20 distinct codes overflow the 16-entry table.
+                for (int32_t code = 0; code < 20; code++)
+                {
+                    DDP_COUNT_HRESULT((int32_t)(0x80070000u + code));
+                }
+                DDP_COUNT_HRESULT(0);
+                DDP_COUNT_HRESULT(1);
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+    auto countSeconds = countTimer.Seconds();
+    auto counted = TakeMetricsSnapshot();
+
+    // Cost of an empty timed stage.
+    ResetMetrics();
+    const uint64_t timings = 1000000;
+    Stopwatch timedTimer;
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < timings; i++)
+    {
+        sum = sum + DDP_TIMED(DecodeStage::Split, i);
+    }
+    auto timedSeconds = timedTimer.Seconds();
+    auto timed = TakeMetricsSnapshot();
+
+    if (!decoded.enabled)
+    {
+        // Built with DDP_NO_METRICS: nothing is counted, the dump says so.
+        checks.Expect(ok && decoded.Counter(DecodeCounter::InputUnits) == 0 && counted.Counter(DecodeCounter::InputBytes) == 0
+            && timed.StageCalls(DecodeStage::Split) == 0, "metrics compiled out");
+        checks.Expect(decoded.ToJson().find("\"enabled\":false") != std::string::npos, "the dump reports metrics as disabled");
+    }
+    else
+    {
+        checks.Expect(ok && decoded.Counter(DecodeCounter::InputUnits) == stats.inputUnits
+            && decoded.Counter(DecodeCounter::InputBytes) == stats.inputBytes
+            && decoded.Counter(DecodeCounter::InputFrames) == stats.inputFrames, "input counters match the decode");
+        checks.Expect(decoded.Counter(DecodeCounter::OutputBuffers) == stats.outputBuffers
+            && decoded.Counter(DecodeCounter::OutputSamples) == stats.outputSamples
+            && decoded.Counter(DecodeCounter::OutputBytes) == stats.outputBytes, "output counters match the decode");
+        checks.Expect(decoded.Counter(DecodeCounter::NotAccepting) == stats.notAccepting && stats.notAccepting != 0
+            && decoded.Counter(DecodeCounter::NeedMoreInput) != 0 && decoded.Counter(DecodeCounter::DecodeErrors) == 0,
+            "decoder status counters");
+        checks.Expect(decoded.StageCalls(DecodeStage::ProcessInput) == stats.inputUnits + stats.notAccepting
+            && decoded.StageCalls(DecodeStage::ProcessOutput) == stats.outputBuffers + decoded.Counter(DecodeCounter::NeedMoreInput)
+            && decoded.StageCalls(DecodeStage::Write) == stats.outputBuffers && decoded.StageCalls(DecodeStage::Drain) == 1
+            && decoded.StageCalls(DecodeStage::Split) == stats.inputUnits + 1, "every stage call is timed");
+        checks.Expect(decoded.StageSeconds(DecodeStage::ProcessOutput) > 0 && decoded.StageSeconds(DecodeStage::ProcessOutput) <= stats.seconds * 1.05,
+            "stage time fits inside the decode");
+        checks.Expect(counted.Counter(DecodeCounter::InputBytes) == 2 * perThread * threads && counted.threads == threads,
+            "per-thread counters sum without loss");
+        bool tallied = counted.hresults.size() == 16 && counted.otherHresults == 4 * (uint64_t)threads;
+        for (const auto& entry : counted.hresults)
+        {
+            tallied = tallied && entry.second == threads && entry.first < 0;
+        }
+        checks.Expect(tallied, "failed HRESULTs are tallied by code, successes ignored");
+        checks.Expect(timed.StageCalls(DecodeStage::Split) == timings, "timed stages count calls");
+        auto json = decoded.ToJson();
+        checks.Expect(json.find("\"enabled\":true") != std::string::npos && json.find("\"not_accepting\":") != std::string::npos
+            && json.find("\"process_output\":{\"calls\":") != std::string::npos, "the dump has counters and stages");
+    }
+    if (!jsonFile.empty())
+    {
+        checks.Expect(WriteTextFile(jsonFile.c_str(), decoded.ToJson() + "\n"), "metrics JSON written");
+    }
+
+    auto perCall = [&](DecodeStage stage)
+    {
+        auto calls = decoded.StageCalls(stage);
+        return calls != 0 ? decoded.StageSeconds(stage) * 1e9 / calls : 0;
+    };
+    std::cout << "enabled=" << (decoded.enabled ? "yes" : "no")
+        << " units=" << stats.inputUnits
+        << " process_input_ns=" << perCall(DecodeStage::ProcessInput)
+        << " process_output_ns=" << perCall(DecodeStage::ProcessOutput)
+        << " count_ns=" << countSeconds * 1e9 / (perThread * threads)
+        << " timed_ns=" << timedSeconds * 1e9 / timings
+        << " ticks_per_second=" << decoded.ticksPerSecond << std::endl;
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+// Counts what reaches it and nothing else, so the sink costs nothing.
+struct CountingSink
+{
+    uint64_t bytes = 0;
+
+    void Write(const void*, size_t size)
+    {
+        bytes += size;
+    }
+};
+
+// The whole pipeline stage by stage, then end to end, on synthetic inputs
+// of several sizes; best of a few repeats per case. Results go to JSON and
+// can be checked against a baseline written by an earlier run.
+static int BenchSuite(int argc, char** argv)
+{
+    std::string dir = ".";
+    std::string jsonFile;
+    std::string baselineFile;
+    double threshold = 0.10;
+    int repeats = 3;
+    std::vector<uint64_t> sizesMB = { 4, 16, 64 };
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+        {
+            sizesMB = { 1, 4 };
+            repeats = 2;
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            jsonFile = argv[++i];
+        }
+        else if (arg == "--baseline" && i + 1 < argc)
+        {
+            baselineFile = argv[++i];
+        }
+        else if (arg == "--threshold" && i + 1 < argc)
+        {
+            threshold = std::stod(argv[++i]);
+        }
+        else if (arg == "--repeats" && i + 1 < argc)
+        {
+            repeats = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg[0] != '-')
+        {
+            dir = arg;
+        }
+        else
+        {
+            std::cout << "usage: suite [dir] [--quick] [--json <file>] [--baseline <file>] [--threshold <fraction>] [--repeats <n>]" << std::endl;
+            return 1;
+        }
+    }
+
+    BenchChecks checks;
+
+    // Runs a case `repeats` times, each repeat running it as often as fits
+    // in MinRepeatSeconds so short cases are not timer noise. The case
+    // returns false on failure and fills in the bytes and frames it
+    // processed in one run.
+    const double MinRepeatSeconds = 0.05;
+    std::vector<BenchCaseResult> results;
+    auto measure = [&](const std::string& name, const std::function<bool(BenchCaseResult&)>& run)
+    {
+        BenchCaseResult best;
+        best.name = name;
+        bool ok = true;
+        for (int i = 0; i < repeats && ok; i++)
+        {
+            BenchCaseResult result;
+            uint64_t runs = 0;
+            auto allocationsBefore = Allocations();
+            Stopwatch timer;
+            do
+            {
+                result = BenchCaseResult();
+                ok = run(result);
+                runs++;
+            } while (ok && timer.Seconds() < MinRepeatSeconds);
+            result.seconds = timer.Seconds() / runs;
+            result.allocations = (Allocations() - allocationsBefore) / runs;
+            if (i == 0 || result.seconds < best.seconds)
+            {
+                best.seconds = result.seconds;
+                best.bytes = result.bytes;
+                best.frames = result.frames;
+                best.allocations = result.allocations;
+            }
+        }
+        best.peakRssBytes = PeakRssBytes();
+        checks.Expect(ok, name.c_str());
+        results.push_back(best);
+        std::cout << name << " mb_per_s=" << best.MBPerSecond() << " frames_per_s=" << best.FramesPerSecond()
+            << " allocations=" << best.allocations << " peak_rss_mib=" << ToMiB(best.peakRssBytes) << std::endl;
+    };
+
+    for (auto sizeMB : sizesMB)
+    {
+        auto suffix = "/" + std::to_string(sizeMB) + "MB";
+        std::vector<uint8_t> stream;
+        SyntheticStreamWriter streamWriter{ SyntheticStreamOptions() };
+        streamWriter.Append(stream, sizeMB << 20);
+        auto input = dir + "/suite_in_" + std::to_string(sizeMB) + ".wav";
+        auto output = dir + "/suite_out_" + std::to_string(sizeMB) + ".wav";
+        if (!WriteSyntheticStreamWav(input.c_str(), sizeMB << 20))
+        {
+            std::cout << "failed to write " << input << std::endl;
+            return 1;
+        }
+
+        // Access units found in memory.
+        measure("parse" + suffix, [&](BenchCaseResult& result)
+        {
+            DdpFrameSplitter splitter{ stream.data(), stream.size() };
+            DdpAccessUnit unit;
+            while (splitter.Next(unit))
+            {
+                result.frames++;
+            }
+            result.bytes = stream.size();
+            return result.frames != 0;
+        });
+
+        // The WAV data chunk mapped and fed in decoder-sized slices.
+        measure("feed" + suffix, [&](BenchCaseResult& result)
+        {
+            MappedBitstreamSource source;
+            if (!source.Open(input.c_str()))
+            {
+                return false;
+            }
+            volatile uint64_t sum = 0;
+            while (true)
+            {
+                auto slice = source.Next(DDPIN_BUFFER_SIZE);
+                if (slice.size == 0)
+                {
+                    break;
+                }
+                sum = sum + Consume(slice.data, slice.size);
+                result.bytes += slice.size;
+                result.frames++;
+            }
+            return result.bytes == source.Size();
+        });
+
+        // Splitting and decoding, output counted and dropped.
+        measure("decode" + suffix, [&](BenchCaseResult& result)
+        {
+            StandInDecoder decoder;
+            BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+            DdpFrameSplitter splitter{ stream.data(), stream.size() };
+            CountingSink sink;
+            DecodeStats stats;
+            bool ok = DecodeStream(splitter, decoder, pool, sink, stats);
+            result.bytes = stats.inputBytes;
+            result.frames = stats.inputUnits;
+            return ok && sink.bytes == stats.outputBytes;
+        });
+
+        // Float to 16-bit with dither, sizeMB of float samples.
+        std::vector<float> pcm((sizeMB << 20) / sizeof(float));
+        uint32_t seed = 1;
+        for (auto& sample : pcm)
+        {
+            seed = seed * 1664525 + 1013904223;
+            sample = (int32_t)seed / 2147483648.0f;
+        }
+        std::vector<uint8_t> converted(pcm.size() * 2);
+        measure("convert" + suffix, [&](BenchCaseResult& result)
+        {
+            PcmConverter converter{ PcmSampleType::Int16, true };
+            const size_t block = 1536 * 6;
+            for (size_t i = 0; i < pcm.size(); i += block)
+            {
+                auto count = std::min(block, pcm.size() - i);
+                converter.Convert(pcm.data() + i, count, converted.data() + i * 2);
+            }
+            result.bytes = pcm.size() * sizeof(float);
+            result.frames = pcm.size() / 6;
+            return true;
+        });
+
+        // 16-bit 5.1 PCM through the WAVE writer, in decoder-sized blocks.
+        measure("write" + suffix, [&](BenchCaseResult& result)
+        {
+            PcmFormat format;
+            format.channels = 6;
+            format.sampleType = PcmSampleType::Int16;
+            format.channelMask = DefaultChannelMask(format.channels);
+            WaveFileWriter writer;
+            if (!writer.Open(output.c_str(), format))
+            {
+                return false;
+            }
+            const size_t block = 1536 * format.BlockAlign();
+            for (size_t offset = 0; offset < converted.size(); offset += block)
+            {
+                writer.Write(converted.data() + offset, std::min(block, converted.size() - offset));
+            }
+            writer.Close();
+            result.bytes = converted.size();
+            result.frames = converted.size() / format.BlockAlign();
+            return !writer.Failed();
+        });
+
+        // File to file: map, split, decode, convert to 16-bit, write.
+        measure("end-to-end" + suffix, [&](BenchCaseResult& result)
+        {
+            StandInDecoder decoder;
+            BufferPool pool{ decoder.MaxOutputBytes(), 1 };
+            DecodeFileOptions options;
+            options.outputType = PcmSampleType::Int16;
+            DecodeFileStats stats;
+            bool ok = DecodeFile(input.c_str(), output.c_str(), decoder, pool, stats, options);
+            result.bytes = stats.decode.inputBytes;
+            result.frames = stats.decode.inputUnits;
+            return ok;
+        });
+        remove(input.c_str());
+        remove(output.c_str());
+    }
+
+    // The report must read back as written.
+    auto json = BenchResultsToJson(results);
+    auto roundTrip = dir + "/suite_roundtrip.json";
+    std::vector<BenchCaseResult> reread;
+    bool readBack = WriteTextFile(roundTrip.c_str(), json) && LoadBenchResults(roundTrip.c_str(), reread) && reread.size() == results.size();
+    for (size_t i = 0; readBack && i < results.size(); i++)
+    {
+        readBack = reread[i].name == results[i].name && reread[i].bytes == results[i].bytes && reread[i].allocations == results[i].allocations
+            && std::fabs(reread[i].seconds - results[i].seconds) <= results[i].seconds * 1e-6;
+    }
+    remove(roundTrip.c_str());
+    checks.Expect(readBack, "results read back from JSON");
+    auto halved = results;
+    for (auto& result : halved)
+    {
+        result.seconds *= 2;
+    }
+    auto selfComparison = CompareBenchResults(results, results, threshold);
+    auto slowComparison = CompareBenchResults(results, halved, threshold);
+    checks.Expect(selfComparison.size() == results.size()
+        && std::none_of(selfComparison.begin(), selfComparison.end(), [](const BenchComparison& c) { return c.Regressed(); })
+        && std::all_of(slowComparison.begin(), slowComparison.end(), [](const BenchComparison& c) { return c.slower; }),
+        "baseline comparison flags a slowdown past the threshold");
+
+    if (!jsonFile.empty())
+    {
+        checks.Expect(WriteTextFile(jsonFile.c_str(), json), "results written");
+    }
+
+    size_t regressions = 0;
+    if (!baselineFile.empty())
+    {
+        std::vector<BenchCaseResult> baseline;
+        if (!LoadBenchResults(baselineFile.c_str(), baseline))
+        {
+            std::cout << "cannot read baseline " << baselineFile << std::endl;
+            return 1;
+        }
+        for (const auto& comparison : CompareBenchResults(baseline, results, threshold))
+        {
+            regressions += comparison.Regressed() ? 1 : 0;
+            std::cout << "compare " << comparison.name << " ratio=" << comparison.Ratio()
+                << " allocations=" << comparison.baselineAllocations << "->" << comparison.currentAllocations
+                << (comparison.slower ? " SLOWER" : "") << (comparison.moreAllocations ? " MORE_ALLOCATIONS" : "") << std::endl;
+        }
+        std::cout << "baseline=" << baselineFile << " threshold=" << threshold << " regressions=" << regressions << std::endl;
+    }
+    checks.PrintSummary();
+    return checks.Failures() == 0 && regressions == 0 ? 0 : 1;
+}
+
+// Checks positioned float PCM from FakeSampleSource: every buffer must
+// start where the previous one ended and hold the values of its frames.
+struct FakePcmCheckSink
+{
+    uint32_t stream = 0;
+    uint16_t channels = 0;
+    uint64_t frames = 0;
+    uint64_t writes = 0;
+    bool inOrder = true;
+
+    void WriteAt(const void* buffer, size_t size, int64_t sampleTime, uint32_t sampleCount)
+    {
+        auto values = (const float*)buffer;
+        writes++;
+        inOrder = inOrder && sampleTime == (int64_t)frames && size == (size_t)sampleCount * channels * sizeof(float);
+        for (uint32_t frame = 0; frame < sampleCount && inOrder; frame++)
+        {
+            for (uint16_t channel = 0; channel < channels; channel++)
+            {
+                inOrder = inOrder && values[frame * channels + channel] == FakeSampleSource::Value(frames + frame, channel, stream);
+            }
+        }
+        frames += sampleCount;
+    }
+};
+
+// Async source reader driver over the fake source: reads in flight hide the
+// per-read latency, completions arrive in order and complete, and failures,
+// type changes and early stops end the read cleanly.
+static int BenchAsyncRead(int argc, char** argv)
+{
+    double audioSeconds = argc > 2 ? std::stod(argv[2]) : 4;
+    double latencyMs = argc > 3 ? std::stod(argv[3]) : 2;
+    uint32_t writeDelayUs = argc > 4 ? (uint32_t)std::stoul(argv[4]) : 200;
+
+    BenchChecks checks;
+
+    FakeSourceOptions sourceOptions;
+    sourceOptions.frames = (uint64_t)(audioSeconds * sourceOptions.sampleRate);
+    sourceOptions.latencySeconds = latencyMs * 1e-3;
+    sourceOptions.jitterSeconds = latencyMs * 0.5e-3;
+
+    struct Run
+    {
+        AsyncReaderStats reader;
+        FakeSourceStats source;
+        uint64_t frames = 0;
+        uint64_t writes = 0;
+        bool inOrder = true;
+    };
+    // The consumer checks every value against the frame its timestamp names
+    // and stands in for conversion and writing with writeDelayUs per sample.
+    auto run = [&](const FakeSourceOptions& options, const AsyncReaderOptions& readerOptions, uint64_t stopAfter)
+    {
+        Run result;
+        FakeSampleSource source{ options };
+        FakePcmCheckSink sink;
+        sink.channels = options.channels;
+        std::vector<uint8_t> staging;
+        uint64_t consumed = 0;
+        result.reader = ReadSamplesAsync(source, [&](const SourceSample& sample)
+        {
+            auto first = (sample.timestamp * options.sampleRate + 5000000) / 10000000;
+            WriteGathered(sink, sample.buffers, sample.bufferCount, options.Format().BlockAlign(), first, staging);
+            result.inOrder = sink.inOrder;
+            result.frames = sink.frames;
+            result.writes = sink.writes;
+            if (writeDelayUs != 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(writeDelayUs));
+            }
+            return ++consumed < stopAfter;
+        }, readerOptions);
+        result.source = source.Stats();
+        return result;
+    };
+
+    // Blocking-loop equivalent first, then more reads in flight.
+    const uint32_t depths[] = { 1, 2, 4, 8 };
+    std::vector<Run> runs;
+    for (auto depth : depths)
+    {
+        AsyncReaderOptions readerOptions;
+        readerOptions.readsInFlight = depth;
+        runs.push_back(run(sourceOptions, readerOptions, UINT64_MAX));
+        const auto& reader = runs.back().reader;
+        std::cout << "reads_in_flight=" << depth
+            << " seconds=" << reader.seconds
+            << " realtime_x=" << (reader.seconds > 0 ? audioSeconds / reader.seconds : 0)
+            << " max_in_flight=" << reader.maxInFlight
+            << " max_queued=" << reader.maxQueued
+            << " writer_waits=" << reader.consumerWaits
+            << " writer_wait_s=" << reader.consumerWaitSeconds
+            << " source_stalls=" << reader.sourceStalls << std::endl;
+    }
+    // Wall time depends on the machine, so the speedup is reported rather
+    // than checked; the checks cover what every run must deliver.
+    std::cout << "speedup_4_in_flight=" << (runs[2].reader.seconds > 0 ? runs[0].reader.seconds / runs[2].reader.seconds : 0) << std::endl;
+    auto expectedSamples = (sourceOptions.frames + sourceOptions.framesPerSample - 1) / sourceOptions.framesPerSample;
+    auto expectedBytes = sourceOptions.frames * sourceOptions.Format().BlockAlign();
+    bool complete = true;
+    bool totals = true;
+    bool bounded = true;
+    bool used = true;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        complete = complete && runs[i].inOrder && runs[i].frames == sourceOptions.frames && runs[i].reader.endOfStream && runs[i].reader.status == 0;
+        totals = totals && runs[i].reader.samples == expectedSamples && runs[i].reader.bytes == expectedBytes;
+        bounded = bounded && runs[i].reader.maxInFlight <= depths[i] && runs[i].source.maxPending <= depths[i];
+        used = used && runs[i].reader.maxInFlight == depths[i];
+    }
+    checks.Expect(complete, "every frame arrives once, in order, up to end of stream");
+    checks.Expect(totals, "sample and byte totals match the source");
+    checks.Expect(bounded, "reads in flight stay within the limit");
+    checks.Expect(used, "the requested number of reads is kept in flight");
+
+    // A consumer slower than the source: the read-ahead is capped and the
+    // source is held back instead of queueing without bound.
+    {
+        auto slow = sourceOptions;
+        slow.frames = 48000;
+        slow.latencySeconds = 0;
+        slow.jitterSeconds = 0;
+        AsyncReaderOptions readerOptions;
+        readerOptions.readsInFlight = 2;
+        readerOptions.queueDepth = 3;
+        auto saved = writeDelayUs;
+        writeDelayUs = 2000;
+        auto result = run(slow, readerOptions, UINT64_MAX);
+        writeDelayUs = saved;
+        checks.Expect(result.inOrder && result.frames == slow.frames, "slow consumer still gets every frame");
+        checks.Expect(result.reader.maxQueued <= readerOptions.MaxOutstanding() && result.reader.sourceStalls != 0,
+            "read-ahead is bounded when the writer is the bottleneck");
+    }
+
+    // Samples in several buffers, split mid-frame, are written in place;
+    // only more buffers than a sample can list take the copy fallback.
+    {
+        auto split = sourceOptions;
+        split.frames = 48000;
+        split.latencySeconds = 0;
+        split.jitterSeconds = 0;
+        split.buffersPerSample = 5;
+        auto saved = writeDelayUs;
+        writeDelayUs = 0;
+        auto gathered = run(split, AsyncReaderOptions(), UINT64_MAX);
+        split.buffersPerSample = SourceSample::MaxBuffers + 1;
+        auto copied = run(split, AsyncReaderOptions(), UINT64_MAX);
+        writeDelayUs = saved;
+        std::cout << "gathered_samples=" << gathered.reader.gatheredSamples << " writes=" << gathered.writes
+            << " contiguous_copies=" << gathered.reader.contiguousCopies
+            << " | fallback: contiguous_copies=" << copied.reader.contiguousCopies << " copied_bytes=" << copied.reader.copiedBytes << std::endl;
+        checks.Expect(gathered.inOrder && gathered.frames == split.frames && gathered.reader.gatheredSamples == gathered.reader.samples
+            && gathered.reader.contiguousCopies == 0, "split samples are written in place, frames reassembled across buffers");
+        checks.Expect(copied.inOrder && copied.frames == split.frames && copied.reader.contiguousCopies == copied.reader.samples
+            && copied.reader.copiedBytes == copied.reader.bytes, "too many buffers take the counted contiguous-copy fallback");
+    }
+
+    // Endings other than end of stream.
+    {
+        auto failing = sourceOptions;
+        failing.failAtRead = 10;
+        auto result = run(failing, AsyncReaderOptions(), UINT64_MAX);
+        checks.Expect(result.reader.status == FAKE_SOURCE_READ_FAILED && result.reader.samples == 10 && result.inOrder,
+            "a failed read ends the stream after the samples before it");
+    }
+    {
+        auto changing = sourceOptions;
+        changing.typeChangeAtRead = 5;
+        auto result = run(changing, AsyncReaderOptions(), UINT64_MAX);
+        checks.Expect(result.reader.typeChanged && result.reader.samples == 5 && result.reader.status == 0, "a type change ends the stream");
+    }
+    {
+        AsyncReaderOptions readerOptions;
+        readerOptions.readsInFlight = 8;
+        auto result = run(sourceOptions, readerOptions, 7);
+        checks.Expect(result.reader.stopped && result.reader.samples == 7 && result.inOrder
+            && result.source.completions + result.source.cancelled == result.source.requests,
+            "stopping early cancels the reads in flight");
+    }
+
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+// Every audio track of a container in one read pass: samples are routed by
+// stream index to one output per track, against one full pass per track.
+static int BenchDemux(int argc, char** argv)
+{
+    double audioSeconds = argc > 2 ? std::stod(argv[2]) : 2;
+    double latencyMs = argc > 3 ? std::stod(argv[3]) : 0.5;
+
+    BenchChecks checks;
+
+    // Main 5.1 mix, a stereo language track and a shorter commentary; the
+    // indices leave gaps, as a video stream would.
+    FakeSourceOptions sourceOptions;
+    sourceOptions.latencySeconds = latencyMs * 1e-3;
+    auto frames = (uint64_t)(audioSeconds * sourceOptions.sampleRate);
+    sourceOptions.streams = { { 1, 6, frames }, { 2, 2, frames }, { 4, 2, frames * 3 / 4 } };
+
+    struct Run
+    {
+        AsyncReaderStats reader;
+        std::vector<FakePcmCheckSink> sinks;
+        std::vector<uint64_t> samples;
+        uint64_t dropped = 0;       // samples of streams without an output
+        FakeSourceStats source;
+    };
+    // Outputs for the streams in `selected`; the others are read and dropped.
+    auto run = [&](const FakeSourceOptions& options, const std::vector<uint32_t>& selected)
+    {
+        Run result;
+        std::vector<int> route;
+        for (const auto& stream : options.Streams())
+        {
+            if (std::find(selected.begin(), selected.end(), stream.streamIndex) == selected.end())
+            {
+                continue;
+            }
+            if (route.size() <= stream.streamIndex)
+            {
+                route.resize(stream.streamIndex + 1, -1);
+            }
+            route[stream.streamIndex] = (int)result.sinks.size();
+            FakePcmCheckSink sink;
+            sink.stream = stream.streamIndex;
+            sink.channels = stream.channels;
+            result.sinks.push_back(sink);
+        }
+        result.samples.resize(result.sinks.size());
+        AsyncReaderOptions readerOptions;
+        readerOptions.readsInFlight = 4;
+        readerOptions.streams = (uint32_t)options.Streams().size();
+        FakeSampleSource source{ options };
+        std::vector<uint8_t> staging;
+        result.reader = ReadSamplesAsync(source, [&](const SourceSample& sample)
+        {
+            auto output = sample.streamIndex < route.size() ? route[sample.streamIndex] : -1;
+            if (output < 0)
+            {
+                result.dropped++;
+                return true;
+            }
+            auto& sink = result.sinks[output];
+            auto first = (sample.timestamp * options.sampleRate + 5000000) / 10000000;
+            WriteGathered(sink, sample.buffers, sample.bufferCount, options.Format(sink.channels).BlockAlign(), first, staging);
+            result.samples[output]++;
+            return true;
+        }, readerOptions);
+        result.source = source.Stats();
+        return result;
+    };
+
+    std::vector<uint32_t> all;
+    for (const auto& stream : sourceOptions.streams)
+    {
+        all.push_back(stream.streamIndex);
+    }
+    auto single = run(sourceOptions, all);
+    std::cout << "one_pass streams=" << single.sinks.size() << " seconds=" << single.reader.seconds
+        << " samples=" << single.reader.samples << " streams_ended=" << single.reader.streamsEnded << std::endl;
+
+    // One pass per track, each reading the whole container. Wall time
+    // depends on the machine, so the speedup is reported, not checked.
+    double perTrackSeconds = 0;
+    uint64_t perTrackSourceSamples = 0;
+    bool perTrackComplete = true;
+    for (size_t i = 0; i < sourceOptions.streams.size(); i++)
+    {
+        auto pass = run(sourceOptions, { sourceOptions.streams[i].streamIndex });
+        perTrackSeconds += pass.reader.seconds;
+        perTrackSourceSamples += pass.source.samples;
+        perTrackComplete = perTrackComplete && pass.sinks[0].inOrder && pass.sinks[0].frames == sourceOptions.streams[i].frames;
+    }
+    std::cout << "per_track passes=" << sourceOptions.streams.size() << " seconds=" << perTrackSeconds
+        << " source_samples=" << perTrackSourceSamples << " one_pass_source_samples=" << single.source.samples
+        << " speedup=" << (single.reader.seconds > 0 ? perTrackSeconds / single.reader.seconds : 0) << std::endl;
+
+    bool complete = single.reader.endOfStream && single.reader.status == 0 && single.dropped == 0;
+    uint64_t sourceSamples = 0;
+    for (size_t i = 0; i < single.sinks.size(); i++)
+    {
+        const auto& stream = sourceOptions.streams[i];
+        auto expected = (stream.frames + sourceOptions.framesPerSample - 1) / sourceOptions.framesPerSample;
+        sourceSamples += expected;
+        std::cout << "stream=" << stream.streamIndex << " channels=" << stream.channels << " frames=" << single.sinks[i].frames
+            << " samples=" << single.samples[i] << std::endl;
+        complete = complete && single.sinks[i].inOrder && single.sinks[i].frames == stream.frames && single.samples[i] == expected;
+    }
+    checks.Expect(complete, "every track arrives whole, in order, at its own output");
+    checks.Expect(single.reader.streamsEnded == 3, "the read ends once every track has ended");
+    checks.Expect(perTrackComplete, "single-track passes decode the same audio");
+    checks.Expect(single.source.samples == sourceSamples && perTrackSourceSamples == sourceSamples * sourceOptions.streams.size(),
+        "one pass reads each source sample once, a pass per track once per track");
+
+    // Streams left without an output are read and dropped, not misrouted.
+    {
+        auto partial = run(sourceOptions, { 1, 4 });
+        checks.Expect(partial.sinks.size() == 2 && partial.sinks[0].inOrder && partial.sinks[1].inOrder
+            && partial.sinks[0].frames == frames && partial.dropped != 0, "unrouted streams are dropped");
+    }
+
+    // A failure in any track ends the whole read.
+    {
+        auto failing = sourceOptions;
+        failing.failAtRead = 20;
+        auto result = run(failing, all);
+        checks.Expect(result.reader.status == FAKE_SOURCE_READ_FAILED && result.reader.samples == 20, "a failed read ends every track");
+    }
+
+    checks.PrintSummary();
+    return checks.ExitCode();
+}
+
+int main(int argc, char** argv)
+{
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "make-wav")
+    {
+        return MakeWav(argc, argv);
+    }
+    if (command == "source")
+    {
+        return BenchSource(argc, argv);
+    }
+    if (command == "pool")
+    {
+        return BenchPool(argc, argv);
+    }
+    if (command == "writer")
+    {
+        return BenchWriter(argc, argv);
+    }
+    if (command == "guids")
+    {
+        return BenchGuids(argc, argv);
+    }
+    if (command == "frames")
+    {
+        return BenchFrames(argc, argv);
+    }
+    if (command == "decode")
+    {
+        return BenchDecode(argc, argv);
+    }
+    if (command == "batch")
+    {
+        return BenchBatch(argc, argv);
+    }
+    if (command == "pipeline")
+    {
+        return BenchPipeline(argc, argv);
+    }
+    if (command == "convert")
+    {
+        return BenchConvert(argc, argv);
+    }
+    if (command == "mix")
+    {
+        return BenchMix(argc, argv);
+    }
+    if (command == "planar")
+    {
+        return BenchPlanar(argc, argv);
+    }
+    if (command == "timeline")
+    {
+        return BenchTimeline(argc, argv);
+    }
+    if (command == "seek")
+    {
+        return BenchSeek(argc, argv);
+    }
+    if (command == "index")
+    {
+        return BenchIndex(argc, argv);
+    }
+    if (command == "parallel")
+    {
+        return BenchParallel(argc, argv);
+    }
+    if (command == "negotiate")
+    {
+        return BenchNegotiate(argc, argv);
+    }
+    if (command == "decoderpool")
+    {
+        return BenchDecoderPool(argc, argv);
+    }
+    if (command == "latency")
+    {
+        return BenchLatency(argc, argv);
+    }
+    if (command == "metrics")
+    {
+        return BenchMetrics(argc, argv);
+    }
+    if (command == "suite")
+    {
+        return BenchSuite(argc, argv);
+    }
+    if (command == "asyncread")
+    {
+        return BenchAsyncRead(argc, argv);
+    }
+    if (command == "demux")
+    {
+        return BenchDemux(argc, argv);
+    }
+    std::cout << "usage: DDP_Bench <command> ...\n"
+        << "  suite [dir] [--quick] [--json f] [--baseline f] [--threshold 0.1]  every stage and end to end, JSON and baseline check\n"
+        << "  make-wav <file> <sizeMB>                 synthetic WAV/RF64 input\n"
+        << "  source <legacy|copy|mapped> <file>       bitstream feed copies and RSS\n"
+        << "  frames [sizeMB] [dependent]              E-AC-3 frame splitter throughput\n"
+        << "  decode [sizeMB] [queue] [refuseEvery]    pump loop over the stand-in decoder\n"
+        << "  batch <dir> [files] [sizeMB] [threads]   manifest decode on the work-stealing pool\n"
+        << "  pipeline <dir> [sizeMB] [sinkDelayUs] [inDepth] [outDepth]  serial vs read/decode/write stages\n"
+        << "  convert [sizeMB]                         float -> s16/s24/s32 kernels: checks and GB/s\n"
+        << "  mix [sizeMB]                             downmix/reorder kernels: checks and frames/s\n"
+        << "  planar [dir] [sizeMB]                    deinterleave to per-channel planes vs naive loops\n"
+        << "  timeline [sizeMB]                        gap/overlap detection and repair on a lossy feed\n"
+        << "  seek [sizeMB]                            time-range decode through the frame index vs full decode\n"
+        << "  index [dir] [sizeMB]                     frame index sidecar: scan vs load, validation\n"
+        << "  parallel [sizeMB] [threads] [chunkUnits] [dir]  chunked decode on a decoder pool vs serial\n"
+        << "  negotiate [files] [threads]              decoder setup per file with and without the type cache\n"
+        << "  decoderpool [dir] [files] [threads]      per-file decoder startup with and without pooling\n"
+        << "  latency [sizeMB] [queue] [jsonFile]      low-latency input granularity: latency histograms\n"
+        << "  metrics [sizeMB] [threads] [jsonFile]    decode counters and stage timers: agreement and cost\n"
+        << "  asyncread [seconds] [latencyMs] [writeDelayUs]  source reads in flight over a fake source vs blocking\n"
+        << "  demux [seconds] [latencyMs]              every audio track in one read pass vs a pass per track\n"
+        << "  pool [threads]                           buffer pool churn, zero steady-state allocations\n"
+        << "  writer <stdio|buffered|write-behind> <file> [sizeMB] [chunkBytes]  PCM output writers\n"
+        << "  guids                                    GUID name lookup: compare chain vs hash table\n";
+    return 1;
+}
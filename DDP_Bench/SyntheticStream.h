@@ -0,0 +1,99 @@
+#pragma once
+// Synthetic E-AC-3 bitstreams: valid sync frame headers (so the frame
+// parser and stand-in decoder accept them) around pseudo-random payload.
+#include "../Common/DdpFrameParser.h"
+#include <cstdint>
+#include <vector>
+
+struct SyntheticStreamOptions
+{
+    uint32_t minFrameBytes = 384;
+    uint32_t maxFrameBytes = 2560;
+    uint8_t acmod = 7;              // 3/2
+    uint8_t lfeon = 1;
+    uint8_t numblkscod = 3;         // 6 blocks, 1536 samples
+    bool dependentSubstream = false; // add a dependent frame (7.1 style) per access unit
+    uint32_t seed = 0x0B77;
+};
+
+class SyntheticStreamWriter
+{
+public:
+    explicit SyntheticStreamWriter(const SyntheticStreamOptions& options) : options(options), seed(options.seed) {}
+
+    // Appends one access unit; returns the number of bytes appended.
+    size_t AppendAccessUnit(std::vector<uint8_t>& out)
+    {
+        auto before = out.size();
+        AppendFrame(out, 0, options.acmod, options.lfeon);
+        if (options.dependentSubstream)
+        {
+            AppendFrame(out, 1, 2, 0);
+        }
+        return out.size() - before;
+    }
+
+    // Appends access units until at least size bytes have been added.
+    void Append(std::vector<uint8_t>& out, uint64_t size)
+    {
+        auto target = out.size() + size;
+        while (out.size() < target)
+        {
+            AppendAccessUnit(out);
+        }
+    }
+
+private:
+    uint32_t NextRandom()
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    void AppendFrame(std::vector<uint8_t>& out, uint8_t strmtyp, uint8_t acmod, uint8_t lfeon)
+    {
+        auto range = options.maxFrameBytes - options.minFrameBytes;
+        uint32_t frameSize = options.minFrameBytes + (range != 0 ? NextRandom() % range : 0);
+        frameSize &= ~1u;
+        if (frameSize < 16)
+        {
+            frameSize = 16;
+        }
+        auto frmsiz = frameSize / 2 - 1;
+
+        // syncword(16) strmtyp(2) substreamid(3) frmsiz(11) fscod(2)
+        // numblkscod(2) acmod(3) lfeon(1) bsid(5) dialnorm(5) ...
+        uint64_t bits = 0;
+        int count = 0;
+        auto put = [&](uint32_t value, int width)
+        {
+            bits = (bits << width) | (value & ((1u << width) - 1));
+            count += width;
+        };
+        put(DDP_SYNCWORD, 16);
+        put(strmtyp, 2);
+        put(0, 3);
+        put(frmsiz, 11);
+        put(0, 2);
+        put(options.numblkscod, 2);
+        put(acmod, 3);
+        put(lfeon, 1);
+        put(16, 5);
+        put(31, 5);
+        put(0, 14);
+
+        auto start = out.size();
+        out.resize(start + frameSize);
+        for (int i = 0; i < 8; i++)
+        {
+            out[start + i] = (uint8_t)(bits >> (count - 8 * (i + 1)));
+        }
+        for (size_t i = start + 8; i < out.size(); i++)
+        {
+            out[i] = (uint8_t)(NextRandom() >> 24);
+        }
+    }
+
+    SyntheticStreamOptions options;
+    uint32_t seed;
+};
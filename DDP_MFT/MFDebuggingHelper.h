@@ -7,8 +7,10 @@
 #include <wmcodecdsp.h>
 #include <Mferror.h>
 #include <strsafe.h>
+#include "../Common/GuidNameTable.h"
 
 LPCWSTR GetGUIDNameConst(const GUID& guid);
+void RegisterGUIDName(const GUID& guid, LPCWSTR name);
 HRESULT GetGUIDName(const GUID& guid, WCHAR** ppwsz);
 
 HRESULT LogAttributeValueByIndex(IMFAttributes* pAttr, DWORD index);
@@ -232,159 +234,182 @@ void DBGMSG(PCWSTR format, ...)
     }
 }
 
-#ifndef IF_EQUAL_RETURN
-#define IF_EQUAL_RETURN(param, val) if(val == param) return L#val
+#ifndef GUID_NAME_ENTRY
+#define GUID_NAME_ENTRY(val) table.Add(val, L#val)
 #endif
 
+typedef GuidNameTable<GUID, WCHAR> MFGuidNameTable;
 
-LPCWSTR GetGUIDNameConst(const GUID& guid)
+// Hash table of the known GUID names, built on first use. Lookups are O(1)
+// instead of walking ~130 GUID compares (all of them on a miss).
+MFGuidNameTable BuildGUIDNameTable()
 {
-    IF_EQUAL_RETURN(guid, MF_MT_MAJOR_TYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_MAJOR_TYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_SUBTYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_ALL_SAMPLES_INDEPENDENT);
-    IF_EQUAL_RETURN(guid, MF_MT_FIXED_SIZE_SAMPLES);
-    IF_EQUAL_RETURN(guid, MF_MT_COMPRESSED);
-    IF_EQUAL_RETURN(guid, MF_MT_SAMPLE_SIZE);
-    IF_EQUAL_RETURN(guid, MF_MT_WRAPPED_TYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_NUM_CHANNELS);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_SAMPLES_PER_SECOND);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_FLOAT_SAMPLES_PER_SECOND);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_AVG_BYTES_PER_SECOND);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_BLOCK_ALIGNMENT);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_BITS_PER_SAMPLE);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_VALID_BITS_PER_SAMPLE);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_SAMPLES_PER_BLOCK);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_CHANNEL_MASK);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_FOLDDOWN_MATRIX);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_WMADRC_PEAKREF);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_WMADRC_PEAKTARGET);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_WMADRC_AVGREF);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_WMADRC_AVGTARGET);
-    IF_EQUAL_RETURN(guid, MF_MT_AUDIO_PREFER_WAVEFORMATEX);
-    IF_EQUAL_RETURN(guid, MF_MT_AAC_PAYLOAD_TYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION);
-    IF_EQUAL_RETURN(guid, MF_MT_FRAME_SIZE);
-    IF_EQUAL_RETURN(guid, MF_MT_FRAME_RATE);
-    IF_EQUAL_RETURN(guid, MF_MT_FRAME_RATE_RANGE_MAX);
-    IF_EQUAL_RETURN(guid, MF_MT_FRAME_RATE_RANGE_MIN);
-    IF_EQUAL_RETURN(guid, MF_MT_PIXEL_ASPECT_RATIO);
-    IF_EQUAL_RETURN(guid, MF_MT_DRM_FLAGS);
-    IF_EQUAL_RETURN(guid, MF_MT_PAD_CONTROL_FLAGS);
-    IF_EQUAL_RETURN(guid, MF_MT_SOURCE_CONTENT_HINT);
-    IF_EQUAL_RETURN(guid, MF_MT_VIDEO_CHROMA_SITING);
-    IF_EQUAL_RETURN(guid, MF_MT_INTERLACE_MODE);
-    IF_EQUAL_RETURN(guid, MF_MT_TRANSFER_FUNCTION);
-    IF_EQUAL_RETURN(guid, MF_MT_VIDEO_PRIMARIES);
-    IF_EQUAL_RETURN(guid, MF_MT_CUSTOM_VIDEO_PRIMARIES);
-    IF_EQUAL_RETURN(guid, MF_MT_YUV_MATRIX);
-    IF_EQUAL_RETURN(guid, MF_MT_VIDEO_LIGHTING);
-    IF_EQUAL_RETURN(guid, MF_MT_VIDEO_NOMINAL_RANGE);
-    IF_EQUAL_RETURN(guid, MF_MT_GEOMETRIC_APERTURE);
-    IF_EQUAL_RETURN(guid, MF_MT_MINIMUM_DISPLAY_APERTURE);
-    IF_EQUAL_RETURN(guid, MF_MT_PAN_SCAN_APERTURE);
-    IF_EQUAL_RETURN(guid, MF_MT_PAN_SCAN_ENABLED);
-    IF_EQUAL_RETURN(guid, MF_MT_AVG_BITRATE);
-    IF_EQUAL_RETURN(guid, MF_MT_AVG_BIT_ERROR_RATE);
-    IF_EQUAL_RETURN(guid, MF_MT_MAX_KEYFRAME_SPACING);
-    IF_EQUAL_RETURN(guid, MF_MT_DEFAULT_STRIDE);
-    IF_EQUAL_RETURN(guid, MF_MT_PALETTE);
-    IF_EQUAL_RETURN(guid, MF_MT_USER_DATA);
-    IF_EQUAL_RETURN(guid, MF_MT_AM_FORMAT_TYPE);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG_START_TIME_CODE);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG2_PROFILE);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG2_LEVEL);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG2_FLAGS);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG_SEQUENCE_HEADER);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_AAUX_SRC_PACK_0);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_AAUX_CTRL_PACK_0);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_AAUX_SRC_PACK_1);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_AAUX_CTRL_PACK_1);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_VAUX_SRC_PACK);
-    IF_EQUAL_RETURN(guid, MF_MT_DV_VAUX_CTRL_PACK);
-    IF_EQUAL_RETURN(guid, MF_MT_ARBITRARY_HEADER);
-    IF_EQUAL_RETURN(guid, MF_MT_ARBITRARY_FORMAT);
-    IF_EQUAL_RETURN(guid, MF_MT_IMAGE_LOSS_TOLERANT);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG4_SAMPLE_DESCRIPTION);
-    IF_EQUAL_RETURN(guid, MF_MT_MPEG4_CURRENT_SAMPLE_ENTRY);
-    IF_EQUAL_RETURN(guid, MF_MT_ORIGINAL_4CC);
-    IF_EQUAL_RETURN(guid, MF_MT_ORIGINAL_WAVE_FORMAT_TAG);
+    MFGuidNameTable table;
+
+    GUID_NAME_ENTRY(MF_MT_MAJOR_TYPE);
+    GUID_NAME_ENTRY(MF_MT_MAJOR_TYPE);
+    GUID_NAME_ENTRY(MF_MT_SUBTYPE);
+    GUID_NAME_ENTRY(MF_MT_ALL_SAMPLES_INDEPENDENT);
+    GUID_NAME_ENTRY(MF_MT_FIXED_SIZE_SAMPLES);
+    GUID_NAME_ENTRY(MF_MT_COMPRESSED);
+    GUID_NAME_ENTRY(MF_MT_SAMPLE_SIZE);
+    GUID_NAME_ENTRY(MF_MT_WRAPPED_TYPE);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_NUM_CHANNELS);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_SAMPLES_PER_SECOND);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_FLOAT_SAMPLES_PER_SECOND);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_AVG_BYTES_PER_SECOND);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_BLOCK_ALIGNMENT);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_BITS_PER_SAMPLE);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_VALID_BITS_PER_SAMPLE);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_SAMPLES_PER_BLOCK);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_CHANNEL_MASK);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_FOLDDOWN_MATRIX);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_WMADRC_PEAKREF);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_WMADRC_PEAKTARGET);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_WMADRC_AVGREF);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_WMADRC_AVGTARGET);
+    GUID_NAME_ENTRY(MF_MT_AUDIO_PREFER_WAVEFORMATEX);
+    GUID_NAME_ENTRY(MF_MT_AAC_PAYLOAD_TYPE);
+    GUID_NAME_ENTRY(MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION);
+    GUID_NAME_ENTRY(MF_MT_FRAME_SIZE);
+    GUID_NAME_ENTRY(MF_MT_FRAME_RATE);
+    GUID_NAME_ENTRY(MF_MT_FRAME_RATE_RANGE_MAX);
+    GUID_NAME_ENTRY(MF_MT_FRAME_RATE_RANGE_MIN);
+    GUID_NAME_ENTRY(MF_MT_PIXEL_ASPECT_RATIO);
+    GUID_NAME_ENTRY(MF_MT_DRM_FLAGS);
+    GUID_NAME_ENTRY(MF_MT_PAD_CONTROL_FLAGS);
+    GUID_NAME_ENTRY(MF_MT_SOURCE_CONTENT_HINT);
+    GUID_NAME_ENTRY(MF_MT_VIDEO_CHROMA_SITING);
+    GUID_NAME_ENTRY(MF_MT_INTERLACE_MODE);
+    GUID_NAME_ENTRY(MF_MT_TRANSFER_FUNCTION);
+    GUID_NAME_ENTRY(MF_MT_VIDEO_PRIMARIES);
+    GUID_NAME_ENTRY(MF_MT_CUSTOM_VIDEO_PRIMARIES);
+    GUID_NAME_ENTRY(MF_MT_YUV_MATRIX);
+    GUID_NAME_ENTRY(MF_MT_VIDEO_LIGHTING);
+    GUID_NAME_ENTRY(MF_MT_VIDEO_NOMINAL_RANGE);
+    GUID_NAME_ENTRY(MF_MT_GEOMETRIC_APERTURE);
+    GUID_NAME_ENTRY(MF_MT_MINIMUM_DISPLAY_APERTURE);
+    GUID_NAME_ENTRY(MF_MT_PAN_SCAN_APERTURE);
+    GUID_NAME_ENTRY(MF_MT_PAN_SCAN_ENABLED);
+    GUID_NAME_ENTRY(MF_MT_AVG_BITRATE);
+    GUID_NAME_ENTRY(MF_MT_AVG_BIT_ERROR_RATE);
+    GUID_NAME_ENTRY(MF_MT_MAX_KEYFRAME_SPACING);
+    GUID_NAME_ENTRY(MF_MT_DEFAULT_STRIDE);
+    GUID_NAME_ENTRY(MF_MT_PALETTE);
+    GUID_NAME_ENTRY(MF_MT_USER_DATA);
+    GUID_NAME_ENTRY(MF_MT_AM_FORMAT_TYPE);
+    GUID_NAME_ENTRY(MF_MT_MPEG_START_TIME_CODE);
+    GUID_NAME_ENTRY(MF_MT_MPEG2_PROFILE);
+    GUID_NAME_ENTRY(MF_MT_MPEG2_LEVEL);
+    GUID_NAME_ENTRY(MF_MT_MPEG2_FLAGS);
+    GUID_NAME_ENTRY(MF_MT_MPEG_SEQUENCE_HEADER);
+    GUID_NAME_ENTRY(MF_MT_DV_AAUX_SRC_PACK_0);
+    GUID_NAME_ENTRY(MF_MT_DV_AAUX_CTRL_PACK_0);
+    GUID_NAME_ENTRY(MF_MT_DV_AAUX_SRC_PACK_1);
+    GUID_NAME_ENTRY(MF_MT_DV_AAUX_CTRL_PACK_1);
+    GUID_NAME_ENTRY(MF_MT_DV_VAUX_SRC_PACK);
+    GUID_NAME_ENTRY(MF_MT_DV_VAUX_CTRL_PACK);
+    GUID_NAME_ENTRY(MF_MT_ARBITRARY_HEADER);
+    GUID_NAME_ENTRY(MF_MT_ARBITRARY_FORMAT);
+    GUID_NAME_ENTRY(MF_MT_IMAGE_LOSS_TOLERANT);
+    GUID_NAME_ENTRY(MF_MT_MPEG4_SAMPLE_DESCRIPTION);
+    GUID_NAME_ENTRY(MF_MT_MPEG4_CURRENT_SAMPLE_ENTRY);
+    GUID_NAME_ENTRY(MF_MT_ORIGINAL_4CC);
+    GUID_NAME_ENTRY(MF_MT_ORIGINAL_WAVE_FORMAT_TAG);
 
     // Media types
 
-    IF_EQUAL_RETURN(guid, MFMediaType_Audio);
-    IF_EQUAL_RETURN(guid, MFMediaType_Video);
-    IF_EQUAL_RETURN(guid, MFMediaType_Protected);
-    IF_EQUAL_RETURN(guid, MFMediaType_SAMI);
-    IF_EQUAL_RETURN(guid, MFMediaType_Script);
-    IF_EQUAL_RETURN(guid, MFMediaType_Image);
-    IF_EQUAL_RETURN(guid, MFMediaType_HTML);
-    IF_EQUAL_RETURN(guid, MFMediaType_Binary);
-    IF_EQUAL_RETURN(guid, MFMediaType_FileTransfer);
-
-    IF_EQUAL_RETURN(guid, MFVideoFormat_AI44); //     FCC('AI44')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_ARGB32); //   D3DFMT_A8R8G8B8 
-    IF_EQUAL_RETURN(guid, MFVideoFormat_AYUV); //     FCC('AYUV')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_DV25); //     FCC('dv25')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_DV50); //     FCC('dv50')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_DVH1); //     FCC('dvh1')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_DVSD); //     FCC('dvsd')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_DVSL); //     FCC('dvsl')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_H264); //     FCC('H264')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_I420); //     FCC('I420')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_IYUV); //     FCC('IYUV')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_M4S2); //     FCC('M4S2')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MJPG);
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MP43); //     FCC('MP43')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MP4S); //     FCC('MP4S')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MP4V); //     FCC('MP4V')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MPG1); //     FCC('MPG1')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MSS1); //     FCC('MSS1')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_MSS2); //     FCC('MSS2')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_NV11); //     FCC('NV11')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_NV12); //     FCC('NV12')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_P010); //     FCC('P010')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_P016); //     FCC('P016')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_P210); //     FCC('P210')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_P216); //     FCC('P216')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_RGB24); //    D3DFMT_R8G8B8 
-    IF_EQUAL_RETURN(guid, MFVideoFormat_RGB32); //    D3DFMT_X8R8G8B8 
-    IF_EQUAL_RETURN(guid, MFVideoFormat_RGB555); //   D3DFMT_X1R5G5B5 
-    IF_EQUAL_RETURN(guid, MFVideoFormat_RGB565); //   D3DFMT_R5G6B5 
-    IF_EQUAL_RETURN(guid, MFVideoFormat_RGB8);
-    IF_EQUAL_RETURN(guid, MFVideoFormat_UYVY); //     FCC('UYVY')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_v210); //     FCC('v210')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_v410); //     FCC('v410')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_WMV1); //     FCC('WMV1')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_WMV2); //     FCC('WMV2')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_WMV3); //     FCC('WMV3')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_WVC1); //     FCC('WVC1')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y210); //     FCC('Y210')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y216); //     FCC('Y216')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y410); //     FCC('Y410')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y416); //     FCC('Y416')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y41P);
-    IF_EQUAL_RETURN(guid, MFVideoFormat_Y41T);
-    IF_EQUAL_RETURN(guid, MFVideoFormat_YUY2); //     FCC('YUY2')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_YV12); //     FCC('YV12')
-    IF_EQUAL_RETURN(guid, MFVideoFormat_YVYU);
-
-    IF_EQUAL_RETURN(guid, MFAudioFormat_PCM); //              WAVE_FORMAT_PCM 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_Float); //            WAVE_FORMAT_IEEE_FLOAT 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_DTS); //              WAVE_FORMAT_DTS 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_Dolby_AC3_SPDIF); //  WAVE_FORMAT_DOLBY_AC3_SPDIF 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_Dolby_AC3); //  MFAudioFormat_Dolby_DDPlus 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_Dolby_DDPlus); //  MFAudioFormat_Dolby_DDPlus 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_DRM); //              WAVE_FORMAT_DRM 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_WMAudioV8); //        WAVE_FORMAT_WMAUDIO2 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_WMAudioV9); //        WAVE_FORMAT_WMAUDIO3 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_WMAudio_Lossless); // WAVE_FORMAT_WMAUDIO_LOSSLESS 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_WMASPDIF); //         WAVE_FORMAT_WMASPDIF 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_MSP1); //             WAVE_FORMAT_WMAVOICE9 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_MP3); //              WAVE_FORMAT_MPEGLAYER3 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_MPEG); //             WAVE_FORMAT_MPEG 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_AAC); //              WAVE_FORMAT_MPEG_HEAAC 
-    IF_EQUAL_RETURN(guid, MFAudioFormat_ADTS); //             WAVE_FORMAT_MPEG_ADTS_AAC 
-
-    return NULL;
-}
\ No newline at end of file
+    GUID_NAME_ENTRY(MFMediaType_Audio);
+    GUID_NAME_ENTRY(MFMediaType_Video);
+    GUID_NAME_ENTRY(MFMediaType_Protected);
+    GUID_NAME_ENTRY(MFMediaType_SAMI);
+    GUID_NAME_ENTRY(MFMediaType_Script);
+    GUID_NAME_ENTRY(MFMediaType_Image);
+    GUID_NAME_ENTRY(MFMediaType_HTML);
+    GUID_NAME_ENTRY(MFMediaType_Binary);
+    GUID_NAME_ENTRY(MFMediaType_FileTransfer);
+
+    GUID_NAME_ENTRY(MFVideoFormat_AI44); //     FCC('AI44')
+    GUID_NAME_ENTRY(MFVideoFormat_ARGB32); //   D3DFMT_A8R8G8B8 
+    GUID_NAME_ENTRY(MFVideoFormat_AYUV); //     FCC('AYUV')
+    GUID_NAME_ENTRY(MFVideoFormat_DV25); //     FCC('dv25')
+    GUID_NAME_ENTRY(MFVideoFormat_DV50); //     FCC('dv50')
+    GUID_NAME_ENTRY(MFVideoFormat_DVH1); //     FCC('dvh1')
+    GUID_NAME_ENTRY(MFVideoFormat_DVSD); //     FCC('dvsd')
+    GUID_NAME_ENTRY(MFVideoFormat_DVSL); //     FCC('dvsl')
+    GUID_NAME_ENTRY(MFVideoFormat_H264); //     FCC('H264')
+    GUID_NAME_ENTRY(MFVideoFormat_I420); //     FCC('I420')
+    GUID_NAME_ENTRY(MFVideoFormat_IYUV); //     FCC('IYUV')
+    GUID_NAME_ENTRY(MFVideoFormat_M4S2); //     FCC('M4S2')
+    GUID_NAME_ENTRY(MFVideoFormat_MJPG);
+    GUID_NAME_ENTRY(MFVideoFormat_MP43); //     FCC('MP43')
+    GUID_NAME_ENTRY(MFVideoFormat_MP4S); //     FCC('MP4S')
+    GUID_NAME_ENTRY(MFVideoFormat_MP4V); //     FCC('MP4V')
+    GUID_NAME_ENTRY(MFVideoFormat_MPG1); //     FCC('MPG1')
+    GUID_NAME_ENTRY(MFVideoFormat_MSS1); //     FCC('MSS1')
+    GUID_NAME_ENTRY(MFVideoFormat_MSS2); //     FCC('MSS2')
+    GUID_NAME_ENTRY(MFVideoFormat_NV11); //     FCC('NV11')
+    GUID_NAME_ENTRY(MFVideoFormat_NV12); //     FCC('NV12')
+    GUID_NAME_ENTRY(MFVideoFormat_P010); //     FCC('P010')
+    GUID_NAME_ENTRY(MFVideoFormat_P016); //     FCC('P016')
+    GUID_NAME_ENTRY(MFVideoFormat_P210); //     FCC('P210')
+    GUID_NAME_ENTRY(MFVideoFormat_P216); //     FCC('P216')
+    GUID_NAME_ENTRY(MFVideoFormat_RGB24); //    D3DFMT_R8G8B8 
+    GUID_NAME_ENTRY(MFVideoFormat_RGB32); //    D3DFMT_X8R8G8B8 
+    GUID_NAME_ENTRY(MFVideoFormat_RGB555); //   D3DFMT_X1R5G5B5 
+    GUID_NAME_ENTRY(MFVideoFormat_RGB565); //   D3DFMT_R5G6B5 
+    GUID_NAME_ENTRY(MFVideoFormat_RGB8);
+    GUID_NAME_ENTRY(MFVideoFormat_UYVY); //     FCC('UYVY')
+    GUID_NAME_ENTRY(MFVideoFormat_v210); //     FCC('v210')
+    GUID_NAME_ENTRY(MFVideoFormat_v410); //     FCC('v410')
+    GUID_NAME_ENTRY(MFVideoFormat_WMV1); //     FCC('WMV1')
+    GUID_NAME_ENTRY(MFVideoFormat_WMV2); //     FCC('WMV2')
+    GUID_NAME_ENTRY(MFVideoFormat_WMV3); //     FCC('WMV3')
+    GUID_NAME_ENTRY(MFVideoFormat_WVC1); //     FCC('WVC1')
+    GUID_NAME_ENTRY(MFVideoFormat_Y210); //     FCC('Y210')
+    GUID_NAME_ENTRY(MFVideoFormat_Y216); //     FCC('Y216')
+    GUID_NAME_ENTRY(MFVideoFormat_Y410); //     FCC('Y410')
+    GUID_NAME_ENTRY(MFVideoFormat_Y416); //     FCC('Y416')
+    GUID_NAME_ENTRY(MFVideoFormat_Y41P);
+    GUID_NAME_ENTRY(MFVideoFormat_Y41T);
+    GUID_NAME_ENTRY(MFVideoFormat_YUY2); //     FCC('YUY2')
+    GUID_NAME_ENTRY(MFVideoFormat_YV12); //     FCC('YV12')
+    GUID_NAME_ENTRY(MFVideoFormat_YVYU);
+
+    GUID_NAME_ENTRY(MFAudioFormat_PCM); //              WAVE_FORMAT_PCM 
+    GUID_NAME_ENTRY(MFAudioFormat_Float); //            WAVE_FORMAT_IEEE_FLOAT 
+    GUID_NAME_ENTRY(MFAudioFormat_DTS); //              WAVE_FORMAT_DTS 
+    GUID_NAME_ENTRY(MFAudioFormat_Dolby_AC3_SPDIF); //  WAVE_FORMAT_DOLBY_AC3_SPDIF 
+    GUID_NAME_ENTRY(MFAudioFormat_Dolby_AC3); //  MFAudioFormat_Dolby_DDPlus 
+    GUID_NAME_ENTRY(MFAudioFormat_Dolby_DDPlus); //  MFAudioFormat_Dolby_DDPlus 
+    GUID_NAME_ENTRY(MFAudioFormat_DRM); //              WAVE_FORMAT_DRM 
+    GUID_NAME_ENTRY(MFAudioFormat_WMAudioV8); //        WAVE_FORMAT_WMAUDIO2 
+    GUID_NAME_ENTRY(MFAudioFormat_WMAudioV9); //        WAVE_FORMAT_WMAUDIO3 
+    GUID_NAME_ENTRY(MFAudioFormat_WMAudio_Lossless); // WAVE_FORMAT_WMAUDIO_LOSSLESS 
+    GUID_NAME_ENTRY(MFAudioFormat_WMASPDIF); //         WAVE_FORMAT_WMASPDIF 
+    GUID_NAME_ENTRY(MFAudioFormat_MSP1); //             WAVE_FORMAT_WMAVOICE9 
+    GUID_NAME_ENTRY(MFAudioFormat_MP3); //              WAVE_FORMAT_MPEGLAYER3 
+    GUID_NAME_ENTRY(MFAudioFormat_MPEG); //             WAVE_FORMAT_MPEG 
+    GUID_NAME_ENTRY(MFAudioFormat_AAC); //              WAVE_FORMAT_MPEG_HEAAC 
+    GUID_NAME_ENTRY(MFAudioFormat_ADTS); //             WAVE_FORMAT_MPEG_ADTS_AAC
+
+    return table;
+}
+
+MFGuidNameTable& GetGUIDNameTable()
+{
+    static MFGuidNameTable table = BuildGUIDNameTable();
+    return table;
+}
+
+// Adds a vendor GUID so it shows up by name in media type dumps. Call this
+// before decoding starts; registration is not synchronized with lookups.
+void RegisterGUIDName(const GUID& guid, LPCWSTR name)
+{
+    GetGUIDNameTable().Add(guid, name);
+}
+
+LPCWSTR GetGUIDNameConst(const GUID& guid)
+{
+    return GetGUIDNameTable().Find(guid);
+}
@@ -0,0 +1,194 @@
+#pragma once
+// DecoderTransform backed by a Media Foundation decoder MFT whose input and
+// output types have already been set. Input access units are wrapped in
+// MediaBufferView samples without copying; output goes straight into the
+// caller's buffer through one recycled sample whose buffer is retargeted
+// before every ProcessOutput call.
+#include "MediaBufferView.h"
+#include "../Common/DecodeMetrics.h"
+#include "../Common/DecoderTransform.h"
+#include <mfapi.h>
+#include <mferror.h>
+#include <mftransform.h>
+#include <wil/com.h>
+#include <climits>
+
+class MFDecoderTransform : public DecoderTransform
+{
+public:
+    MFDecoderTransform(wil::com_ptr<IMFTransform> transform, const PcmFormat& outputFormat)
+        : transform(std::move(transform)), outputFormat(outputFormat)
+    {
+        MFT_OUTPUT_STREAM_INFO outputInfo = {};
+        if (SUCCEEDED(this->transform->GetOutputStreamInfo(0, &outputInfo)))
+        {
+            maxOutputBytes = outputInfo.cbSize;
+        }
+        MediaBufferView* view = nullptr;
+        if (SUCCEEDED(MediaBufferView::CreateRetargetable(&view)))
+        {
+            outputView = view;
+            outputBuffer.attach(view);
+            if (SUCCEEDED(MFCreateSample(&outputSample)))
+            {
+                outputSample->AddBuffer(outputBuffer.get());
+            }
+        }
+    }
+
+    PcmFormat OutputFormat() const override { return outputFormat; }
+    size_t MaxOutputBytes() const override { return maxOutputBytes; }
+    IMFTransform* Transform() const { return transform.get(); }
+
+    // Asks the MFT to hold back as little output as it can (MF_LOW_LATENCY).
+    // A hint: decoders without a low-latency path ignore it.
+    bool SetLowLatency(bool enable)
+    {
+        wil::com_ptr<IMFAttributes> attributes;
+        return SUCCEEDED(transform->GetAttributes(&attributes)) && attributes != nullptr
+            && SUCCEEDED(attributes->SetUINT32(MF_LOW_LATENCY, enable ? TRUE : FALSE));
+    }
+
+    DecodeResult BeginStreaming() override
+    {
+        auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+        if (SUCCEEDED(hr))
+        {
+            hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
+        }
+        return Result(hr);
+    }
+
+    DecodeResult ProcessInput(const DecoderInput& input) override
+    {
+        wil::com_ptr<IMFSample> sample;
+        wil::com_ptr<IMFMediaBuffer> buffer;
+        auto hr = MFCreateSample(&sample);
+        if (SUCCEEDED(hr))
+        {
+            hr = MediaBufferView::Create(input.slice.data, (DWORD)input.slice.size, input.owner, &buffer);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = sample->AddBuffer(buffer.get());
+        }
+        if (SUCCEEDED(hr) && input.sampleTime >= 0)
+        {
+            hr = sample->SetSampleTime(ToHundredNanoseconds(input.sampleTime));
+        }
+        if (SUCCEEDED(hr) && input.sampleCount != 0)
+        {
+            hr = sample->SetSampleDuration(ToHundredNanoseconds(input.sampleCount));
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = transform->ProcessInput(0, sample.get(), 0);
+        }
+        if (hr == MF_E_NOTACCEPTING)
+        {
+            return DecodeResult::NotAccepting;
+        }
+        return Result(hr);
+    }
+
+    DecodeResult ProcessOutput(DecoderOutput& output) override
+    {
+        output.size = 0;
+        if (outputSample == nullptr)
+        {
+            return DecodeResult::Error;
+        }
+        outputView->Retarget(output.buffer, (DWORD)output.capacity);
+        // The recycled sample keeps the last time it was given; an MFT that
+        // does not stamp this buffer (drain output, for one) must not make
+        // it look like a repeat of the previous one.
+        outputSample->SetSampleTime(NoSampleTime);
+
+        MFT_OUTPUT_DATA_BUFFER data = {};
+        data.pSample = outputSample.get();
+        DWORD status = 0;
+        auto hr = transform->ProcessOutput(0, 1, &data, &status);
+        if (data.pEvents != nullptr)
+        {
+            data.pEvents->Release();
+        }
+        if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT)
+        {
+            return DecodeResult::NeedMoreInput;
+        }
+        if (FAILED(hr))
+        {
+            return Result(hr);
+        }
+
+        DWORD length = 0;
+        outputBuffer->GetCurrentLength(&length);
+        output.size = length;
+        auto blockAlign = outputFormat.BlockAlign();
+        output.sampleCount = blockAlign != 0 ? (uint32_t)(length / blockAlign) : 0;
+        LONGLONG time = NoSampleTime;
+        output.sampleTime = SUCCEEDED(outputSample->GetSampleTime(&time)) && time != NoSampleTime ? FromHundredNanoseconds(time) : -1;
+        return DecodeResult::Ok;
+    }
+
+    DecodeResult Drain() override
+    {
+        auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
+        if (SUCCEEDED(hr))
+        {
+            hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
+        }
+        return Result(hr);
+    }
+
+    DecodeResult Flush() override
+    {
+        auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
+        return Result(hr);
+    }
+
+    // Lets the MFT release its streaming resources while it waits in a
+    // pool; BeginStreaming allocates them again.
+    DecodeResult Reset() override
+    {
+        auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
+        if (SUCCEEDED(hr))
+        {
+            hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+        }
+        return Result(hr);
+    }
+
+private:
+    // Stands for "not stamped" on the recycled output sample.
+    static const LONGLONG NoSampleTime = LLONG_MIN;
+
+    // Failures are tallied by code (see DecodeMetrics.h) before they are
+    // folded into DecodeResult::Error.
+    static DecodeResult Result(HRESULT hr)
+    {
+        if (FAILED(hr))
+        {
+            DDP_COUNT_HRESULT(hr);
+            return DecodeResult::Error;
+        }
+        return DecodeResult::Ok;
+    }
+
+    LONGLONG ToHundredNanoseconds(int64_t samples) const
+    {
+        return outputFormat.sampleRate != 0 ? samples * 10000000 / outputFormat.sampleRate : 0;
+    }
+
+    int64_t FromHundredNanoseconds(LONGLONG time) const
+    {
+        return (time * outputFormat.sampleRate + 5000000) / 10000000;
+    }
+
+    wil::com_ptr<IMFTransform> transform;
+    PcmFormat outputFormat;
+    size_t maxOutputBytes = 0;
+    wil::com_ptr<IMFSample> outputSample;
+    wil::com_ptr<IMFMediaBuffer> outputBuffer;
+    MediaBufferView* outputView = nullptr;     // owned by outputBuffer
+};
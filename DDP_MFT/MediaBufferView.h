@@ -0,0 +1,185 @@
+#pragma once
+// IMFMediaBuffer that exposes memory owned by someone else (a slice of the
+// mapped bitstream, a BufferPool buffer, or a caller's output buffer)
+// instead of copying it into an MFCreateMemoryBuffer allocation. The owner reference keeps the memory alive
+// for as long as the decoder holds on to the buffer; pooled memory goes back
+// to its pool when the last reference is released.
+#include "../Common/BufferPool.h"
+#include <mfapi.h>
+#include <mfidl.h>
+#include <memory>
+#include <new>
+
+class MediaBufferView : public IMFMediaBuffer
+{
+public:
+    static HRESULT Create(const BYTE* data, DWORD length, std::shared_ptr<const void> owner, IMFMediaBuffer** ppBuffer)
+    {
+        if (ppBuffer == nullptr)
+        {
+            return E_POINTER;
+        }
+        auto view = new (std::nothrow) MediaBufferView(data, length, std::move(owner));
+        if (view == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+        *ppBuffer = view;
+        return S_OK;
+    }
+
+    // Writable, initially empty buffer backed by pool memory.
+    static HRESULT CreateFromPool(BufferPool& pool, IMFMediaBuffer** ppBuffer)
+    {
+        if (ppBuffer == nullptr)
+        {
+            return E_POINTER;
+        }
+        auto memory = pool.Acquire();
+        if (memory == nullptr)
+        {
+            return MF_E_SAMPLEALLOCATOR_EMPTY;
+        }
+        auto view = new (std::nothrow) MediaBufferView(memory, (DWORD)pool.BufferSize(), nullptr);
+        if (view == nullptr)
+        {
+            pool.Release(memory);
+            return E_OUTOFMEMORY;
+        }
+        view->pool = &pool;
+        view->currentLength = 0;
+        *ppBuffer = view;
+        return S_OK;
+    }
+
+    // Writable buffer with no memory yet; Retarget() points it at the
+    // caller's output buffer before each ProcessOutput.
+    static HRESULT CreateRetargetable(MediaBufferView** ppView)
+    {
+        if (ppView == nullptr)
+        {
+            return E_POINTER;
+        }
+        auto view = new (std::nothrow) MediaBufferView(nullptr, 0, nullptr);
+        if (view == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+        *ppView = view;
+        return S_OK;
+    }
+
+    void Retarget(BYTE* memory, DWORD length)
+    {
+        data = memory;
+        maxLength = length;
+        currentLength = 0;
+    }
+
+    // IUnknown
+    STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override
+    {
+        if (ppv == nullptr)
+        {
+            return E_POINTER;
+        }
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IMFMediaBuffer))
+        {
+            *ppv = static_cast<IMFMediaBuffer*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() override
+    {
+        return InterlockedIncrement(&refCount);
+    }
+
+    STDMETHODIMP_(ULONG) Release() override
+    {
+        auto count = InterlockedDecrement(&refCount);
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    // IMFMediaBuffer. Views over the bitstream are only ever read by the
+    // decoder; SetCurrentLength is bounded by the view or pool buffer size.
+    STDMETHODIMP Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) override
+    {
+        if (ppbBuffer == nullptr)
+        {
+            return E_POINTER;
+        }
+        *ppbBuffer = const_cast<BYTE*>(data);
+        if (pcbMaxLength != nullptr)
+        {
+            *pcbMaxLength = maxLength;
+        }
+        if (pcbCurrentLength != nullptr)
+        {
+            *pcbCurrentLength = currentLength;
+        }
+        return S_OK;
+    }
+
+    STDMETHODIMP Unlock() override
+    {
+        return S_OK;
+    }
+
+    STDMETHODIMP GetCurrentLength(DWORD* pcbCurrentLength) override
+    {
+        if (pcbCurrentLength == nullptr)
+        {
+            return E_POINTER;
+        }
+        *pcbCurrentLength = currentLength;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetCurrentLength(DWORD cbCurrentLength) override
+    {
+        if (cbCurrentLength > maxLength)
+        {
+            return E_INVALIDARG;
+        }
+        currentLength = cbCurrentLength;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetMaxLength(DWORD* pcbMaxLength) override
+    {
+        if (pcbMaxLength == nullptr)
+        {
+            return E_POINTER;
+        }
+        *pcbMaxLength = maxLength;
+        return S_OK;
+    }
+
+private:
+    MediaBufferView(const BYTE* data, DWORD length, std::shared_ptr<const void> owner)
+        : data(data), maxLength(length), currentLength(length), owner(std::move(owner))
+    {
+    }
+    virtual ~MediaBufferView()
+    {
+        if (pool != nullptr)
+        {
+            pool->Release(const_cast<BYTE*>(data));
+        }
+    }
+
+    LONG refCount = 1;
+    const BYTE* data;
+    DWORD maxLength;
+    DWORD currentLength;
+    std::shared_ptr<const void> owner;
+    BufferPool* pool = nullptr;
+};
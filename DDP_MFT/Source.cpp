@@ -1,4 +1,12 @@
 #include "MFDebuggingHelper.h"
+#include "MFDecoderTransform.h"
+#include "../Common/BatchDecoder.h"
+#include "../Common/BufferPool.h"
+#include "../Common/DecodeMetrics.h"
+#include "../Common/NegotiationCache.h"
+#include <cctype>
+#include <chrono>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <wil/com.h>
@@ -103,75 +111,31 @@ void DemoMediaSource()
     }
 }
 
-std::vector<byte> getRawBitStream(const char* wavPath)
-{
-    std::vector<byte> data;
-    FILE* file;
-    fopen_s(&file, wavPath, "rb");
-
-    fseek(file, 0, SEEK_END);
-    auto size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    auto wavBuffer = (byte*)malloc(size);
-    auto readed = fread(wavBuffer, 1, size, file);
-
-    byte* pData = nullptr;
-    int dataSize = 0;
-    for (size_t i = 0; i < size - 4; i++)
-    {
-        if (wavBuffer[i] == 'd'
-            && wavBuffer[i + 1] == 'a'
-            && wavBuffer[i + 2] == 't'
-            && wavBuffer[i + 3] == 'a')
-        {
-            auto pSize = &wavBuffer[i + 4];
-            dataSize = *(int*)pSize;
-            pData = (byte*)(pSize + sizeof(int));
-            break;
-        }
-    }
-
-    data = { pData,pData + dataSize };
-    fclose(file);
-    return data;
-}
+#define DDPIN_PIPELINE_DEPTH 32
+#define DDPOUT_PIPELINE_DEPTH 8
 
-class PCMWriter
+// Outcome of decoder negotiation for one source format: which MFT, and the
+// input and output types it accepted.
+struct NegotiatedTypes
 {
-public:
-    PCMWriter(std::string path)
-    {
-        fopen_s(&outputPCMFile, path.c_str(), "wb");
-    }
-    ~PCMWriter()
-    {
-        Close();
-    }
-    void Write(byte* buffer, int size)
-    {
-        fwrite(buffer, 1, size, outputPCMFile);
-    }
-    void Close()
-    {
-        if (outputPCMFile != nullptr)
-        {
-            fclose(outputPCMFile);
-            outputPCMFile = nullptr;
-        }
-    }
-private:
-    FILE* outputPCMFile = nullptr;
+    wil::com_ptr<IMFActivate> activate;
+    wil::com_ptr<IMFMediaType> inputType;
+    wil::com_ptr<IMFMediaType> outputType;
+    PcmFormat outputFormat;
 };
 
-#define DDPIN_BUFFER_SIZE 1024
-
-
-void DecodeAudio(const char* sourceFile, const char* targetFile)
+NegotiationCache<NegotiatedTypes>& DecoderTypeCache()
 {
-    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
-    hr = MFStartup(MF_VERSION);
+    static NegotiationCache<NegotiatedTypes> cache;
+    return cache;
+}
 
+// Finds the DD+ decoder and walks its available types for DD+ in and
+// 6-channel float out. COM and Media Foundation must already be initialized
+// on the calling thread.
+bool NegotiateDecoderTypes(const StreamSignature& source, NegotiatedTypes& negotiated)
+{
+    HRESULT hr = S_OK;
     MFT_REGISTER_TYPE_INFO inputType;
     inputType.guidMajorType = MFMediaType_Audio;
     inputType.guidSubtype = MFAudioFormat_Dolby_DDPlus;
@@ -184,20 +148,42 @@ void DecodeAudio(const char* sourceFile, const char* targetFile)
     CLSID* mftTypes = nullptr;
     UINT count = 0;
     hr = MFTEnum(MFT_CATEGORY_AUDIO_DECODER, 0, &inputType, &outputType, 0, &mftTypes, &count);
+    DDP_COUNT_HRESULT(hr);
+    CoTaskMemFree(mftTypes);
 
     INT32 unFlags = MFT_ENUM_FLAG_FIELDOFUSE;
     IMFActivate** ppActivate = NULL;    // Array of activation objects.
     hr = MFTEnumEx(MFT_CATEGORY_AUDIO_DECODER, unFlags, &inputType, &outputType, &ppActivate, &count);
+    DDP_COUNT_HRESULT(hr);
+    if (FAILED(hr) || count == 0)
+    {
+        return false;
+    }
 
-    IMFTransform* mft;
-    hr = ppActivate[0]->ActivateObject(IID_PPV_ARGS(&mft));
+    // The activation object is kept for later decoders; the rest of the
+    // array is released rather than leaked.
+    negotiated.activate = ppActivate[0];
+    for (UINT32 i = 0; i < count; i++)
+    {
+        ppActivate[i]->Release();
+    }
+    CoTaskMemFree(ppActivate);
+    wil::com_ptr<IMFTransform> mft;
+    hr = negotiated.activate->ActivateObject(IID_PPV_ARGS(&mft));
+    if (FAILED(hr))
+    {
+        DDP_COUNT_HRESULT(hr);
+        return false;
+    }
 
     DWORD inputStreams, outputStream;
     hr = mft->GetStreamCount(&inputStreams, &outputStream);
+    DDP_COUNT_HRESULT(hr);
 
     DWORD inputIds[2];
     DWORD outputIds[2];
     hr = mft->GetStreamIDs(inputStreams, inputIds, outputStream, outputIds);
+    DDP_COUNT_HRESULT(hr);
     
 #pragma region Set Input Media Type
     wil::com_ptr<IMFMediaType> inputMediaType;
@@ -223,6 +209,11 @@ void DecodeAudio(const char* sourceFile, const char* targetFile)
         }
         CoTaskMemFree(wavFormat);
     }
+    if (!inputMediaType)
+    {
+        negotiated.activate->DetachObject();
+        return false;
+    }
 
     WAVEFORMATEX* inputWavFormat;
     UINT32 inputWavFormatSize = 0;
@@ -231,27 +222,29 @@ void DecodeAudio(const char* sourceFile, const char* targetFile)
     {
         auto extensible = (WAVEFORMATEXTENSIBLE*)inputWavFormat;
         inputWavFormat->nChannels = 6;
-        inputWavFormat->nSamplesPerSec = 48000;
+        inputWavFormat->nSamplesPerSec = source.sampleRate;
         inputWavFormat->nBlockAlign = sizeof(float) * inputWavFormat->nChannels;
         inputWavFormat->wBitsPerSample = sizeof(float) * 8;
         inputWavFormat->nAvgBytesPerSec = inputWavFormat->nSamplesPerSec * inputWavFormat->nBlockAlign;
         hr = MFInitMediaTypeFromWaveFormatEx(inputMediaType.get(), inputWavFormat, inputWavFormatSize);
+        DDP_COUNT_HRESULT(hr);
     }
     CoTaskMemFree(inputWavFormat);
-    inputWavFormatSize = 0;
-    inputWavFormat = nullptr;
-    hr = MFCreateWaveFormatExFromMFMediaType(inputMediaType.get(), &inputWavFormat, &inputWavFormatSize);
     hr = mft->SetInputType(0, inputMediaType.get(), NULL);
+    DDP_COUNT_HRESULT(hr);
 #pragma endregion
 
 #pragma region Set Ouput Media Type
     wil::com_ptr<IMFMediaType> outputMediaType;
-    for (size_t i = 0; i < 10; i++)
+    for (size_t i = 0; SUCCEEDED(hr) && i < 10; i++)
     {
         wil::com_ptr<IMFMediaType> mediaType;
         hr = mft->GetOutputAvailableType(0, i, &mediaType);
         if (hr != S_OK)
+        {
+            hr = S_OK;
             break;
+        }
         WAVEFORMATEX* wavFormat;
         UINT32 wavFormatSize = 0;
         hr = MFCreateWaveFormatExFromMFMediaType(mediaType.get(), &wavFormat, &wavFormatSize);
@@ -268,121 +261,418 @@ void DecodeAudio(const char* sourceFile, const char* targetFile)
         CoTaskMemFree(wavFormat);
     }
 
-    WAVEFORMATEX* wavFormat;
-    UINT32 wavFormatSize = 0;
-    hr = MFCreateWaveFormatExFromMFMediaType(outputMediaType.get(), &wavFormat, &wavFormatSize);
-    if (sizeof(WAVEFORMATEX) < wavFormatSize)
+    if (SUCCEEDED(hr) && outputMediaType)
     {
-        auto extensible = (WAVEFORMATEXTENSIBLE*)wavFormat;
-        wavFormatSize = 0;
+        WAVEFORMATEX* wavFormat;
+        UINT32 wavFormatSize = 0;
+        hr = MFCreateWaveFormatExFromMFMediaType(outputMediaType.get(), &wavFormat, &wavFormatSize);
+        if (SUCCEEDED(hr))
+        {
+            ParsePcmFormat((const uint8_t*)wavFormat, wavFormatSize, negotiated.outputFormat);
+            CoTaskMemFree(wavFormat);
+        }
     }
-    CoTaskMemFree(wavFormat);
-    hr = mft->SetOutputType(0, outputMediaType.get(), NULL);
 #pragma endregion
 
+    // This instance only served the negotiation; decoders are activated
+    // fresh from the cached activation object.
+    negotiated.activate->DetachObject();
+    negotiated.inputType = inputMediaType;
+    negotiated.outputType = outputMediaType;
+    DDP_COUNT_HRESULT(hr);
+    return SUCCEEDED(hr) && outputMediaType;
+}
+
+// Creates a decoder MFT from negotiated types: no enumeration, just
+// activation and two SetType calls on copies of the cached types.
+std::unique_ptr<MFDecoderTransform> ActivateDecoder(const NegotiatedTypes& negotiated)
+{
+    // Activate and detach as a pair, so the next activation (maybe on
+    // another worker) creates a new instance instead of returning this one.
+    static std::mutex activation;
+    wil::com_ptr<IMFTransform> mft;
+    HRESULT hr = S_OK;
+    {
+        std::lock_guard<std::mutex> lock(activation);
+        hr = negotiated.activate->ActivateObject(IID_PPV_ARGS(&mft));
+        negotiated.activate->DetachObject();
+    }
+    if (FAILED(hr))
+    {
+        DDP_COUNT_HRESULT(hr);
+        return nullptr;
+    }
+
+    wil::com_ptr<IMFMediaType> inputType, outputType;
+    hr = MFCreateMediaType(&inputType);
+    if (SUCCEEDED(hr))
+    {
+        hr = negotiated.inputType->CopyAllItems(inputType.get());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = mft->SetInputType(0, inputType.get(), NULL);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = MFCreateMediaType(&outputType);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = negotiated.outputType->CopyAllItems(outputType.get());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = mft->SetOutputType(0, outputType.get(), NULL);
+    }
+    if (FAILED(hr))
+    {
+        DDP_COUNT_HRESULT(hr);
+        return nullptr;
+    }
+    return std::unique_ptr<MFDecoderTransform>(new MFDecoderTransform(mft, negotiated.outputFormat));
+}
 
-    hr = mft->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+// Creates and configures a decoder MFT for the source format (DD+ in,
+// 6-channel float out). Negotiation runs once per source format; later
+// decoders reuse it from DecoderTypeCache. COM and Media Foundation must
+// already be initialized on the calling thread.
+std::unique_ptr<MFDecoderTransform> CreateDecoder(const StreamSignature& source = StreamSignature(), DecoderSetupStats* setup = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto& cache = DecoderTypeCache();
+    std::unique_ptr<MFDecoderTransform> decoder;
+    NegotiatedTypes negotiated;
+    if (cache.Get(source, negotiated, NegotiateDecoderTypes, setup))
+    {
+        decoder = ActivateDecoder(negotiated);
+        if (decoder == nullptr && (setup == nullptr || setup->cached))
+        {
+            // The cached types no longer work (decoder updated?): once more from scratch.
+            cache.Forget(source);
+            if (cache.Get(source, negotiated, NegotiateDecoderTypes, setup))
+            {
+                decoder = ActivateDecoder(negotiated);
+            }
+        }
+    }
+    if (setup != nullptr)
+    {
+        setup->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return decoder;
+}
 
-    MFT_INPUT_STREAM_INFO inputInfo;
-    hr = mft->GetInputStreamInfo(0, &inputInfo);
+void DecodeAudio(const char* sourceFile, const char* targetFile, DecodeFileOptions options, const char* latencyFile = nullptr)
+{
+    // The decoder is set up for the format of the stream's first frame.
+    StreamSignature signature;
+    {
+        MappedBitstreamSource probe;
+        if (!probe.Open(sourceFile) || !ReadStreamSignature(probe.Data(), probe.Size(), signature))
+        {
+            std::cout << "No AC-3/E-AC-3 frames in " << sourceFile << std::endl;
+            return;
+        }
+    }
+    DecoderSetupStats setup;
+    auto decoder = CreateDecoder(signature, &setup);
+    if (decoder == nullptr)
+    {
+        std::cout << "Failed to create the DD+ decoder" << std::endl;
+        return;
+    }
+    std::cout << "Decoder setup: " << setup.seconds * 1000 << " ms ("
+        << (setup.cached ? std::string("cached types") : "negotiated in " + std::to_string(setup.negotiateSeconds * 1000) + " ms")
+        << ")" << std::endl;
+    ParallelDecodeOptions parallel;
+    if (options.parallel != nullptr)
+    {
+        // Chunk decoders are set up for the same format, from the cache.
+        parallel = *options.parallel;
+        parallel.createDecoder = [signature]() -> std::unique_ptr<DecoderTransform> { return CreateDecoder(signature); };
+        options.parallel = &parallel;
+    }
 
-    MFT_OUTPUT_STREAM_INFO outputInfo;
-    hr = mft->GetOutputStreamInfo(0, &outputInfo);
+    // Reading, decoding and writing run as overlapped stages. Output goes
+    // from the decoder straight into pooled, aligned buffers rather than a
+    // fresh MFCreateMemoryBuffer per timeslice. In low-latency mode the
+    // stage queues would only add delay, so everything stays on this
+    // thread and input alternates with output.
+    PipelineOptions pipeline;
+    pipeline.inputDepth = DDPIN_PIPELINE_DEPTH;
+    pipeline.outputDepth = DDPOUT_PIPELINE_DEPTH;
+    bool lowLatency = options.loop.unitsPerPull != 0;
+    if (lowLatency)
+    {
+        decoder->SetLowLatency(true);
+    }
+    else
+    {
+        options.pipeline = &pipeline;
+    }
+    BufferPool outputPool{ decoder->MaxOutputBytes(), pipeline.OutputBuffers() };
+    outputPool.Reserve(pipeline.OutputBuffers());
+
+    DecodeFileStats fileStats;
+    const auto& stats = fileStats.decode;
+    const auto& pipelineStats = fileStats.pipeline;
+    const auto& writeStats = fileStats.writer;
+    if (!DecodeFile(sourceFile, targetFile, *decoder, outputPool, fileStats, options))
+    {
+        std::cout << "Failed to decode " << sourceFile << " to " << targetFile << " after "
+            << stats.inputUnits << " access units" << std::endl;
+    }
+    std::cout << "Decoded " << stats.inputUnits << " access units (" << stats.inputFrames << " frames, "
+        << stats.inputBytes << " bytes) to " << stats.outputSamples << " samples, "
+        << stats.RealtimeFactor(decoder->OutputFormat().sampleRate) << "x realtime, "
+        << stats.notAccepting << " refused inputs" << std::endl;
+    if (options.measureLatency)
+    {
+        const auto& latency = fileStats.latency;
+        const auto& units = latency.unitLatency;
+        std::cout << "Latency: first output after " << latency.firstOutputSeconds * 1000 << " ms, per unit p50 "
+            << units.PercentileSeconds(0.5) * 1000 << " ms, p99 " << units.PercentileSeconds(0.99) * 1000 << " ms, max "
+            << units.MaxSeconds() * 1000 << " ms, up to " << latency.maxUnitsInFlight << " units in flight" << std::endl;
+        if (latencyFile != nullptr && !WriteTextFile(latencyFile, latency.ToJson() + "\n"))
+        {
+            std::cout << "Failed to write " << latencyFile << std::endl;
+        }
+    }
+    std::cout << "Input ring: " << pipelineStats.inputRing.MeanOccupancy() << "/" << pipelineStats.inputRing.capacity
+        << " mean occupancy, " << pipelineStats.inputRing.emptyStalls << " decoder stalls ("
+        << pipelineStats.inputRing.emptyStallSeconds << " s), " << pipelineStats.inputRing.fullStalls << " reader stalls" << std::endl;
+    std::cout << "Output ring: " << pipelineStats.outputRing.MeanOccupancy() << "/" << pipelineStats.outputRing.capacity
+        << " mean occupancy, " << pipelineStats.outputRing.fullStalls << " decoder stalls ("
+        << pipelineStats.outputRing.fullStallSeconds << " s), " << pipelineStats.outputRing.emptyStalls << " writer stalls" << std::endl;
+    if (options.parallel != nullptr)
+    {
+        const auto& parallelStats = fileStats.parallel;
+        std::cout << "Parallel: " << parallelStats.chunks << " chunks on " << parallelStats.workers << " decoders, "
+            << parallelStats.prerollUnits << " pre-roll units decoded twice, writer waited "
+            << parallelStats.writerWaitSeconds << " s" << std::endl;
+    }
+    const auto& range = fileStats.range;
+    if (range.units != 0 || options.indexFile)
+    {
+        std::cout << "Frame index " << (fileStats.indexLoaded ? "loaded from " : "built, saved to ") << FrameIndexPath(sourceFile)
+            << " in " << fileStats.indexSeconds * 1000 << " ms" << std::endl;
+    }
+    if (range.units != 0)
+    {
+        std::cout << "Range: samples " << range.startSample << " to " << range.endSample << " from "
+            << range.units << " access units (bytes " << range.beginOffset << " to " << range.endOffset
+            << ", first sample " << range.firstSample << ")" << std::endl;
+    }
+    std::cout << "Wrote " << writeStats.bytes << " bytes in " << writeStats.syscalls << " writes ("
+        << writeStats.BytesPerSecond() / (1024 * 1024) << " MiB/s, "
+        << writeStats.SyscallsPerSecond() << " writes/s, "
+        << writeStats.stalls << " stalls)" << std::endl;
+
+    const auto& timeline = fileStats.timeline;
+    std::cout << "Timeline: samples " << timeline.startSample << " to " << timeline.endSample << ", "
+        << timeline.gaps << " gaps (" << timeline.gapSamples << " samples, " << timeline.filledSamples << " filled), "
+        << timeline.overlaps << " overlaps (" << timeline.overlapSamples << " samples, " << timeline.trimmedSamples << " trimmed), "
+        << timeline.untimedBuffers << " untimed buffers" << std::endl;
+    for (const auto& event : timeline.log)
+    {
+        std::cout << "  " << (event.kind == DiscontinuityKind::Gap ? "gap" : "overlap") << " of " << event.samples
+            << " samples at " << event.expected << " (buffer stamped " << event.actual << ")" << std::endl;
+    }
+}
 
-    auto bitStreamBuffer = getRawBitStream(sourceFile);
-    auto index = 0;
-    uint32_t totalSize = bitStreamBuffer.size();
-    uint32_t avaliableSize = totalSize;
-    uint32_t processedSize = 0;
-    bool endOfProcess = false;
+// Decodes every (input, output) pair in the manifest on a pool of workers.
+int DecodeManifest(const char* manifestFile, unsigned threads, const DecodeFileOptions& options)
+{
+    std::vector<BatchJob> jobs;
+    if (!LoadBatchManifest(manifestFile, jobs))
+    {
+        std::cout << "Failed to read " << manifestFile << std::endl;
+        return 1;
+    }
 
-    PCMWriter writer{ targetFile };
+    // Worker threads join the process-wide multithreaded apartment;
+    // MFStartup has already run once in main.
+    WorkStealingPool pool{ threads,
+        [](unsigned) { CoInitializeEx(0, COINIT_MULTITHREADED); },
+        [](unsigned) { CoUninitialize(); } };
+    // Decoders are leased per file for its format and reset between files
+    // rather than activated again.
+    DecoderPool decoders{ [](const StreamSignature& signature) -> std::unique_ptr<DecoderTransform> { return CreateDecoder(signature); } };
+    auto result = DecodeBatch(std::move(jobs), pool, decoders, options);
+
+    for (const auto& file : result.files)
+    {
+        std::cout << (file.ok ? "ok     " : "FAILED ") << file.job.input << " -> " << file.job.output
+            << ": " << file.AudioSeconds() << " s audio in " << file.stats.seconds << " s, "
+            << file.RealtimeFactor() << "x realtime, " << file.timeline.Discontinuities()
+            << " discontinuities, setup " << file.setupSeconds * 1000 << " ms" << (file.reusedDecoder ? " (pooled)" : "")
+            << " (worker " << file.worker << ")" << std::endl;
+    }
+    auto& cache = DecoderTypeCache();
+    std::cout << "Decoder types: " << cache.Misses() << " negotiated, " << cache.Hits() << " from cache" << std::endl;
+    auto pooled = decoders.Stats();
+    std::cout << "Decoders: " << pooled.created << " created, " << pooled.reused << " reused, "
+        << pooled.resetFailures + pooled.discarded << " dropped, " << pooled.leased << " still leased" << std::endl;
+    std::cout << result.files.size() << " files, " << result.Failures() << " failed, "
+        << result.AudioSeconds() << " s audio in " << result.seconds << " s on " << result.workers << " workers: "
+        << result.RealtimeFactor() << "x realtime aggregate, " << result.steals << " steals" << std::endl;
+    return result.Failures() == 0 ? 0 : 1;
+}
 
-    while (!endOfProcess)
+int main(int argc, char** argv)
+{
+    // DDP_MFT [--format f32|s16|s24|s32] [--no-dither] [--downmix loro|ltrt] [--lfe-gain <gain>]
+    //     [--order FL,FR,FC,LFE,BL,BR,SL,SR] [--planar] [--fill-gaps] [--trim-overlaps]
+    //     [--start <seconds>] [--end <seconds>] [--index] [--parallel [threads]]
+    //     [--low-latency [unitsPerPull]] [--latency-json <file>] [--metrics-json <file>]
+    //     [--batch <manifest> [threads]]
+    // Batch and parallel threads default to the core count.
+    DecodeFileOptions options;
+    const char* manifestFile = nullptr;
+    unsigned threads = 0;
+    bool parallel = false;
+    unsigned parallelThreads = 0;
+    const char* latencyFile = nullptr;
+    const char* metricsFile = nullptr;
+    for (int i = 1; i < argc; i++)
     {
-        bool isTimesliceComplete = false;
-        while (!isTimesliceComplete)
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc)
         {
-            wil::com_ptr<IMFSample> inputSample;
-            hr = MFCreateSample(&inputSample);
-            wil::com_ptr<IMFMediaBuffer> buffer;
-            hr = MFCreateMemoryBuffer(DDPIN_BUFFER_SIZE, &buffer);
-            hr = inputSample->AddBuffer(buffer.get());
-
-            byte* tempBuffer = nullptr;
-            DWORD maxBufferLength = 0;
-            DWORD currentLength = 0;
-            auto loadedSize = DDPIN_BUFFER_SIZE;
-            hr = buffer->Lock(&tempBuffer, &maxBufferLength, &currentLength);
+            manifestFile = argv[++i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
             {
-                if (index + DDPIN_BUFFER_SIZE > totalSize)
-                {
-                    loadedSize = totalSize - index;
-                    endOfProcess = true;
-                }
-                memcpy(tempBuffer, bitStreamBuffer.data() + index, loadedSize);
-                index += loadedSize;
-                avaliableSize -= loadedSize;
-                hr = buffer->SetCurrentLength(loadedSize);
+                threads = (unsigned)std::stoul(argv[++i]);
             }
-            hr = buffer->Unlock();
-            
-            DWORD inputBufferLength = 0;
-            hr = buffer->GetCurrentLength(&inputBufferLength);
-            std::cout << "Load buffer from bitstream: " << inputBufferLength << " bytes" << std::endl;
-
-            hr = mft->ProcessInput(0, inputSample.get(), NULL);
-            if (hr == MF_E_NOTACCEPTING)
+        }
+        else if (arg == "--format" && i + 1 < argc && ParsePcmSampleType(argv[i + 1], options.outputType))
+        {
+            i++;
+        }
+        else if (arg == "--no-dither")
+        {
+            options.dither = false;
+        }
+        else if (arg == "--planar")
+        {
+            options.planar = true;
+        }
+        else if (arg == "--fill-gaps")
+        {
+            options.timeline.fillGaps = true;
+        }
+        else if (arg == "--trim-overlaps")
+        {
+            options.timeline.trimOverlaps = true;
+        }
+        else if (arg == "--start" && i + 1 < argc)
+        {
+            options.startSeconds = std::stod(argv[++i]);
+        }
+        else if (arg == "--end" && i + 1 < argc)
+        {
+            options.endSeconds = std::stod(argv[++i]);
+        }
+        else if (arg == "--index")
+        {
+            options.indexFile = true;
+        }
+        else if (arg == "--parallel")
+        {
+            parallel = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
             {
-                index -= loadedSize;
-                avaliableSize += loadedSize;
-                isTimesliceComplete = true;
-                endOfProcess = false;
+                parallelThreads = (unsigned)std::stoul(argv[++i]);
             }
-            if (hr == S_OK && endOfProcess)
+        }
+        else if (arg == "--low-latency")
+        {
+            options.loop.unitsPerPull = 1;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
             {
-                isTimesliceComplete = true;
+                options.loop.unitsPerPull = (uint32_t)std::stoul(argv[++i]);
             }
+            options.measureLatency = true;
+        }
+        else if (arg == "--metrics-json" && i + 1 < argc)
+        {
+            metricsFile = argv[++i];
+        }
+        else if (arg == "--latency-json" && i + 1 < argc)
+        {
+            latencyFile = argv[++i];
+            options.measureLatency = true;
+        }
+        else if (arg == "--downmix" && i + 1 < argc && ParseMixPreset(argv[i + 1], options.mix.preset))
+        {
+            i++;
+        }
+        else if (arg == "--lfe-gain" && i + 1 < argc)
+        {
+            options.mix.lfeGain = std::stof(argv[++i]);
+        }
+        else if (arg == "--order" && i + 1 < argc && ParseSpeakerOrder(argv[i + 1], options.mix.order))
+        {
+            options.mix.preset = MixPreset::Reorder;
+            i++;
         }
+        else
         {
-            MFT_OUTPUT_DATA_BUFFER output;
-            memset(&output, 0, sizeof(output));
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
 
-            hr = MFCreateSample(&output.pSample);
-            wil::com_ptr<IMFMediaBuffer> buffer;
-            hr = MFCreateMemoryBuffer(outputInfo.cbSize, &buffer);
-            hr = output.pSample->AddBuffer(buffer.get());
+    // Process-wide initialization happens once, not per decode.
+    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+    DDP_COUNT_HRESULT(hr);
+    hr = MFStartup(MF_VERSION);
+    DDP_COUNT_HRESULT(hr);
 
-            bool isTimeliceConsumed = false;
-            while (!isTimeliceConsumed)
-            {
-                DWORD status = 0;
-                hr = mft->ProcessOutput(NULL, 1, &output, &status);
-                if (hr == S_OK)
-                {
-                    byte* tempBuffer = nullptr;
-                    DWORD currentLength;
-                    hr = buffer->Lock(&tempBuffer, nullptr, &currentLength);
-                    writer.Write(tempBuffer, currentLength);
-                    hr = buffer->Unlock();
-                }
-                else
-                {
-                    isTimeliceConsumed = true;
-                }
-            }
-            
+    int result = 0;
+    if (manifestFile != nullptr)
+    {
+        result = DecodeManifest(manifestFile, threads, options);
+    }
+    else
+    {
+        const char* sourceFile = "C:\\Users\\xx\\Desktop\\decoded\\output_joc.wav"; //try to parse bitstream from wav
+        const char* targetFile = "C:\\Users\\xx\\Desktop\\decoded\\MFStreamReader_output.wav";
+
+        // One long file on several decoder instances, each on a worker in
+        // the multithreaded apartment; DecodeAudio supplies the factory.
+        std::unique_ptr<WorkStealingPool> pool;
+        ParallelDecodeOptions parallelOptions;
+        if (parallel)
+        {
+            pool.reset(new WorkStealingPool(parallelThreads,
+                [](unsigned) { CoInitializeEx(0, COINIT_MULTITHREADED); },
+                [](unsigned) { CoUninitialize(); }));
+            parallelOptions.pool = pool.get();
+            options.parallel = &parallelOptions;
         }
-        
+        DecodeAudio(sourceFile, targetFile, options, latencyFile);
     }
-    hr = mft->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
-    hr = mft->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
-}
 
-int main()
-{
-    const char* sourceFile = "C:\\Users\\xx\\Desktop\\decoded\\output_joc.wav"; //try to parse bitstream from wav
-    const char* targetFile = "C:\\Users\\xx\\Desktop\\decoded\\MFStreamReader_output.raw";
+    // Counters from every thread of the job, decoder failures by HRESULT.
+    auto metrics = TakeMetricsSnapshot();
+    if (metrics.enabled)
+    {
+        std::cout << "Metrics: " << metrics.Counter(DecodeCounter::NotAccepting) << " not accepting, "
+            << metrics.Counter(DecodeCounter::NeedMoreInput) << " need more input, "
+            << metrics.Counter(DecodeCounter::DecodeErrors) << " decode errors" << std::endl;
+        for (const auto& failure : metrics.hresults)
+        {
+            std::cout << "  HRESULT 0x" << std::hex << (uint32_t)failure.first << std::dec << ": " << failure.second << " times" << std::endl;
+        }
+    }
+    if (metricsFile != nullptr && !WriteTextFile(metricsFile, metrics.ToJson() + "\n"))
+    {
+        std::cout << "Failed to write " << metricsFile << std::endl;
+    }
 
-    DecodeAudio(sourceFile, targetFile);
-}
\ No newline at end of file
+    MFShutdown();
+    CoUninitialize();
+    return result;
+}
@@ -0,0 +1,304 @@
+#pragma once
+// AsyncSampleSource over a Media Foundation source reader in callback mode.
+// The reader has to be created with this object's callback set as
+// MF_SOURCE_READER_ASYNC_CALLBACK; ReadSample then returns at once and the
+// decoded sample arrives in OnReadSample on a Media Foundation work queue
+// thread. Samples are handed on with their buffers locked; the locks and
+// the buffers are released when the consumer drops the sample.
+//
+// A sample with several media buffers is passed on as a buffer list, not
+// through ConvertToContiguousBuffer, which would allocate and copy. Only
+// samples with more than SourceSample::MaxBuffers buffers still take that
+// path; ReadSamplesAsync counts them as contiguous copies.
+#include "../Common/AsyncSampleReader.h"
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+
+class MFAsyncSampleSource : public AsyncSampleSource
+{
+public:
+    MFAsyncSampleSource()
+    {
+        callback = new (std::nothrow) Callback();
+    }
+
+    ~MFAsyncSampleSource() override
+    {
+        if (reader != NULL)
+        {
+            reader->Release();
+        }
+        if (callback != NULL)
+        {
+            callback->Release();
+        }
+    }
+
+    MFAsyncSampleSource(const MFAsyncSampleSource&) = delete;
+    MFAsyncSampleSource& operator=(const MFAsyncSampleSource&) = delete;
+
+    // Creates the source reader in callback mode; the caller may use it
+    // synchronously (stream selection, media types, seeking) until the first
+    // RequestSample.
+    HRESULT Open(const WCHAR* sourceFile)
+    {
+        if (callback == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        IMFAttributes* attributes = NULL;
+        HRESULT hr = MFCreateAttributes(&attributes, 1);
+        if (SUCCEEDED(hr))
+        {
+            hr = attributes->SetUnknown(MF_SOURCE_READER_ASYNC_CALLBACK, callback);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = MFCreateSourceReaderFromURL(sourceFile, attributes, &reader);
+        }
+        if (attributes != NULL)
+        {
+            attributes->Release();
+        }
+        return hr;
+    }
+
+    IMFSourceReader* Reader() const { return reader; }
+
+    // Stream that reads come from: the first audio stream by default, or
+    // MF_SOURCE_READER_ANY_STREAM to read every selected stream in one pass
+    // (samples then carry their stream index).
+    void SetReadStream(DWORD stream) { readStream = stream; }
+
+    void SetCompletion(Completion completion) override
+    {
+        std::lock_guard<std::mutex> lock(callback->mutex);
+        callback->completion = std::move(completion);
+        callback->cancelled = false;
+    }
+
+    int32_t RequestSample() override
+    {
+        return reader->ReadSample(readStream, 0, NULL, NULL, NULL, NULL);
+    }
+
+    // Flush cancels the pending requests without calling OnReadSample for
+    // them and reports completion through OnFlush.
+    void CancelPending() override
+    {
+        auto flushStream = readStream == (DWORD)MF_SOURCE_READER_ANY_STREAM ? (DWORD)MF_SOURCE_READER_ALL_STREAMS : readStream;
+        if (SUCCEEDED(reader->Flush(flushStream)))
+        {
+            WaitForSingleObject(callback->flushed, INFINITE);
+        }
+        // Completions already on their way are dropped from here on; one
+        // that is running is waited for.
+        std::unique_lock<std::mutex> lock(callback->mutex);
+        callback->cancelled = true;
+        callback->idle.wait(lock, [&] { return callback->running == 0; });
+    }
+
+private:
+    class Callback : public IMFSourceReaderCallback
+    {
+    public:
+        Callback()
+        {
+            flushed = CreateEventW(NULL, FALSE, FALSE, NULL);
+        }
+
+        ~Callback()
+        {
+            if (flushed != NULL)
+            {
+                CloseHandle(flushed);
+            }
+        }
+
+        // IUnknown
+        STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override
+        {
+            if (ppv == nullptr)
+            {
+                return E_POINTER;
+            }
+            if (riid == __uuidof(IUnknown) || riid == __uuidof(IMFSourceReaderCallback))
+            {
+                *ppv = static_cast<IMFSourceReaderCallback*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHODIMP_(ULONG) AddRef() override
+        {
+            return InterlockedIncrement(&refCount);
+        }
+
+        STDMETHODIMP_(ULONG) Release() override
+        {
+            auto count = InterlockedDecrement(&refCount);
+            if (count == 0)
+            {
+                delete this;
+            }
+            return count;
+        }
+
+        // IMFSourceReaderCallback
+        STDMETHODIMP OnReadSample(HRESULT hrStatus, DWORD dwStreamIndex, DWORD dwStreamFlags, LONGLONG llTimestamp, IMFSample* pSample) override
+        {
+            SourceSample sample;
+            sample.status = hrStatus;
+            sample.timestamp = llTimestamp;
+            sample.streamIndex = dwStreamIndex;
+            if ((dwStreamFlags & MF_SOURCE_READERF_ENDOFSTREAM) != 0)
+            {
+                sample.flags |= SourceSampleFlags::EndOfStream;
+            }
+            if ((dwStreamFlags & MF_SOURCE_READERF_STREAMTICK) != 0)
+            {
+                sample.flags |= SourceSampleFlags::StreamTick;
+            }
+            if ((dwStreamFlags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED) != 0)
+            {
+                sample.flags |= SourceSampleFlags::TypeChanged;
+            }
+            if (SUCCEEDED(hrStatus) && pSample != NULL)
+            {
+                auto hr = LockBuffers(pSample, sample);
+                if (FAILED(hr))
+                {
+                    sample.status = hr;
+                    sample.bufferCount = 0;
+                    sample.size = 0;
+                    sample.owner.reset();
+                }
+            }
+
+            // Called unlocked: the completion may start the next read, and a
+            // ReadSample that fails at once or calls back on this thread
+            // must not find the mutex held.
+            Completion call;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cancelled || !completion)
+                {
+                    return S_OK;
+                }
+                call = completion;
+                running++;
+            }
+            call(sample);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+            }
+            idle.notify_all();
+            return S_OK;
+        }
+
+        // The media buffers of a sample, held locked until the last
+        // reference to the sample's owner goes away.
+        struct LockedBuffers
+        {
+            IMFMediaBuffer* buffers[SourceSample::MaxBuffers] = {};
+            DWORD count = 0;
+
+            ~LockedBuffers()
+            {
+                for (DWORD i = 0; i < count; i++)
+                {
+                    buffers[i]->Unlock();
+                    buffers[i]->Release();
+                }
+            }
+        };
+
+        static HRESULT LockBuffers(IMFSample* pSample, SourceSample& sample)
+        {
+            auto locked = std::make_shared<LockedBuffers>();
+            DWORD count = 0;
+            HRESULT hr = pSample->GetBufferCount(&count);
+            if (SUCCEEDED(hr) && count > SourceSample::MaxBuffers)
+            {
+                // Fallback: one contiguous copy.
+                IMFMediaBuffer* buffer = NULL;
+                hr = pSample->ConvertToContiguousBuffer(&buffer);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+                sample.copied = true;
+                hr = Lock(buffer, *locked, sample);
+                sample.owner = locked;
+                return hr;
+            }
+            for (DWORD i = 0; SUCCEEDED(hr) && i < count; i++)
+            {
+                IMFMediaBuffer* buffer = NULL;
+                hr = pSample->GetBufferByIndex(i, &buffer);
+                if (SUCCEEDED(hr))
+                {
+                    hr = Lock(buffer, *locked, sample);
+                }
+            }
+            sample.owner = locked;
+            return hr;
+        }
+
+        // Takes over the reference to buffer.
+        static HRESULT Lock(IMFMediaBuffer* buffer, LockedBuffers& locked, SourceSample& sample)
+        {
+            BYTE* data = NULL;
+            DWORD length = 0;
+            HRESULT hr = buffer->Lock(&data, NULL, &length);
+            if (FAILED(hr))
+            {
+                buffer->Release();
+                return hr;
+            }
+            locked.buffers[locked.count++] = buffer;
+            if (length != 0)
+            {
+                sample.buffers[sample.bufferCount].data = data;
+                sample.buffers[sample.bufferCount].size = length;
+                sample.bufferCount++;
+                sample.size += length;
+            }
+            return S_OK;
+        }
+
+        STDMETHODIMP OnFlush(DWORD) override
+        {
+            SetEvent(flushed);
+            return S_OK;
+        }
+
+        STDMETHODIMP OnEvent(DWORD, IMFMediaEvent*) override
+        {
+            return S_OK;
+        }
+
+        std::mutex mutex;           // guards completion, cancelled and running
+        std::condition_variable idle;   // running dropped to zero
+        Completion completion;
+        bool cancelled = false;
+        uint32_t running = 0;       // completions being called
+        HANDLE flushed = NULL;
+
+    private:
+        long refCount = 1;
+    };
+
+    Callback* callback = NULL;
+    IMFSourceReader* reader = NULL;
+    DWORD readStream = (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM;
+};
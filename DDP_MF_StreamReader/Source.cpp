@@ -11,6 +11,39 @@
 #include <iostream>
 #include <iomanip>
 
+#include "MFAsyncSampleSource.h"
+#include "../Common/BatchDecoder.h"
+#include "../Common/ChannelMixer.h"
+#include "../Common/PcmConverter.h"
+#include "../Common/PlanarPcm.h"
+#include "../Common/SampleClock.h"
+#include "../Common/WaveFileWriter.h"
+#include "../Common/WorkStealingPool.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Samples decoded ahead of a seek target: one E-AC-3 frame (6 blocks).
+#define DDP_PREROLL_SAMPLES 1536
+
+// Options of this tool's source reader, on top of the DecodeFileOptions it
+// shares with the batch decoders.
+struct StreamReaderOptions
+{
+    // Reads the source reader keeps in flight, and samples it may read
+    // ahead of the writer (see AsyncSampleReader.h).
+    AsyncReaderOptions reader;
+
+    // Every audio track of the source, each to its own file named after the
+    // target (out.wav -> out.track1.wav, ...), read in a single pass.
+    bool allAudioStreams = false;
+};
+
 template <class T>
 void SafeRelease(T** ppT)
 {
@@ -35,31 +68,22 @@ std::string GuidToString(GUID* guid) {
 
 
 //-------------------------------------------------------------------
-// ConfigureAudioStream
+// ConfigureDecodedStream
 //
-// Selects an audio stream from the source file, and configures the
-// stream to deliver decoded PCM audio.
+// Configures one stream to deliver decoded PCM audio and selects it.
+// The source reader loads a decoder for the stream.
 //-------------------------------------------------------------------
-HRESULT ConfigureAudioStream(
+HRESULT ConfigureDecodedStream(
     IMFSourceReader* pReader,   // Pointer to the source reader.
+    DWORD dwStreamIndex,        // Stream index, or MF_SOURCE_READER_FIRST_AUDIO_STREAM.
     IMFMediaType** ppPCMAudio   // Receives the audio format.
 )
 {
     IMFMediaType* pUncompressedAudioType = NULL;
     IMFMediaType* pPartialType = NULL;
 
-    // Select the first audio stream, and deselect all other streams.
-    HRESULT hr = pReader->SetStreamSelection(
-        (DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
-
-    if (SUCCEEDED(hr))
-    {
-        hr = pReader->SetStreamSelection(
-            (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, TRUE);
-    }
-
     // Create a partial media type that specifies uncompressed PCM audio.
-    hr = MFCreateMediaType(&pPartialType);
+    HRESULT hr = MFCreateMediaType(&pPartialType);
 
     if (SUCCEEDED(hr))
     {
@@ -75,25 +99,19 @@ HRESULT ConfigureAudioStream(
     // load the necessary decoder.
     if (SUCCEEDED(hr))
     {
-        hr = pReader->SetCurrentMediaType(
-            (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM,
-            NULL, pPartialType);
+        hr = pReader->SetCurrentMediaType(dwStreamIndex, NULL, pPartialType);
     }
 
     // Get the complete uncompressed format.
     if (SUCCEEDED(hr))
     {
-        hr = pReader->GetCurrentMediaType(
-            (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM,
-            &pUncompressedAudioType);
+        hr = pReader->GetCurrentMediaType(dwStreamIndex, &pUncompressedAudioType);
     }
 
     // Ensure the stream is selected.
     if (SUCCEEDED(hr))
     {
-        hr = pReader->SetStreamSelection(
-            (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM,
-            TRUE);
+        hr = pReader->SetStreamSelection(dwStreamIndex, TRUE);
     }
 
     // Return the PCM format to the caller.
@@ -108,123 +126,223 @@ HRESULT ConfigureAudioStream(
     return hr;
 }
 
-HRESULT WriteToFile(HANDLE hFile, void* p, DWORD cb)
+//-------------------------------------------------------------------
+// ConfigureAudioStream
+//
+// Selects an audio stream from the source file, and configures the
+// stream to deliver decoded PCM audio.
+//-------------------------------------------------------------------
+HRESULT ConfigureAudioStream(
+    IMFSourceReader* pReader,   // Pointer to the source reader.
+    IMFMediaType** ppPCMAudio   // Receives the audio format.
+)
 {
-    DWORD cbWritten = 0;
-    HRESULT hr = S_OK;
+    // Select the first audio stream, and deselect all other streams.
+    HRESULT hr = pReader->SetStreamSelection(
+        (DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
 
-    BOOL bResult = WriteFile(hFile, p, cb, &cbWritten, NULL);
-    if (!bResult)
+    if (SUCCEEDED(hr))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
+        hr = ConfigureDecodedStream(pReader, (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, ppPCMAudio);
     }
     return hr;
 }
 
-HRESULT WriteWaveData(
-    HANDLE hFile,               // Output file.
-    IMFSourceReader* pReader,   // Source reader.
-    DWORD* pcbDataWritten       // Receives the amount of data written.
+//-------------------------------------------------------------------
+// FindAudioStreams
+//
+// Lists the indices of every audio stream in the source, in stream
+// order: the main mix, language and commentary tracks of a container.
+//-------------------------------------------------------------------
+HRESULT FindAudioStreams(
+    IMFSourceReader* pReader,   // Pointer to the source reader.
+    std::vector<DWORD>& streams // Receives the audio stream indices.
 )
 {
-    HRESULT hr = S_OK;
-    DWORD cbAudioData = 0;
-    DWORD cbBuffer = 0;
-    BYTE* pAudioData = NULL;
-
-    IMFSample* pSample = NULL;
-    IMFMediaBuffer* pBuffer = NULL;
-
-    // Get audio samples from the source reader.
-    while (true)
+    streams.clear();
+    for (DWORD i = 0; ; i++)
     {
-        DWORD dwFlags = 0;
-
-        // Read the next sample.
-        hr = pReader->ReadSample(
-            (DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM,
-            0, NULL, &dwFlags, NULL, &pSample);
-
-        if (FAILED(hr)) { break; }
-
-        if (dwFlags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED)
+        IMFMediaType* pNativeType = NULL;
+        HRESULT hr = pReader->GetNativeMediaType(i, 0, &pNativeType);
+        if (hr == MF_E_INVALIDSTREAMNUMBER)
         {
-            printf("Type change - not supported by WAVE file format.\n");
-            break;
+            return S_OK;
         }
-        if (dwFlags & MF_SOURCE_READERF_ENDOFSTREAM)
+        if (FAILED(hr))
         {
-            printf("End of input file.\n");
-            break;
+            return hr;
         }
-
-        if (pSample == NULL)
+        GUID majorType = GUID_NULL;
+        if (SUCCEEDED(pNativeType->GetGUID(MF_MT_MAJOR_TYPE, &majorType)) && majorType == MFMediaType_Audio)
         {
-            printf("No sample\n");
-            continue;
+            streams.push_back(i);
         }
+        SafeRelease(&pNativeType);
+    }
+}
 
-        // Get a pointer to the audio data in the sample.
-
-        hr = pSample->ConvertToContiguousBuffer(&pBuffer);
-
-        if (FAILED(hr)) { break; }
-
-        DWORD currentLength = 0;
-        pBuffer->GetCurrentLength(&currentLength);
-        hr = pBuffer->Lock(&pAudioData, NULL, &cbBuffer);
-
-        currentLength = 0;
-        pBuffer->GetCurrentLength(&currentLength);
-        if (FAILED(hr)) { break; }
-
-        // Write this data to the output file.
-        hr = WriteToFile(hFile, pAudioData, cbBuffer);
-
-        if (FAILED(hr)) { break; }
+// Decoded format of a configured stream. The WAVEFORMATEX fields are
+// printed when verbose.
+HRESULT GetDecodedFormat(IMFMediaType* pAudioType, PcmFormat& format, bool verbose)
+{
+    // Convert the PCM audio format into a WAVEFORMATEX structure.
+    WAVEFORMATEX* wavFormat;
+    UINT32 wavFormatSize = 0;
+    HRESULT hr = MFCreateWaveFormatExFromMFMediaType(pAudioType, &wavFormat, &wavFormatSize);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    if (verbose)
+    {
+        std::cout << std::setfill(' ') << std::setw(20) << "wFormatTag" << ": " << wavFormat->wFormatTag << std::endl;
+        std::cout << std::setfill(' ') << std::setw(20) << "nChannels" << ": " << wavFormat->nChannels << std::endl;
+        std::cout << std::setfill(' ') << std::setw(20) << "nSamplesPerSec" << ": " << wavFormat->nSamplesPerSec << std::endl;
+        std::cout << std::setfill(' ') << std::setw(20) << "nAvgBytesPerSec" << ": " << wavFormat->nAvgBytesPerSec << std::endl;
+        std::cout << std::setfill(' ') << std::setw(20) << "nBlockAlign" << ": " << wavFormat->nBlockAlign << std::endl;
+        std::cout << std::setfill(' ') << std::setw(20) << "wBitsPerSample" << ": " << wavFormat->wBitsPerSample << std::endl;
+
+        if (sizeof(WAVEFORMATEX) < wavFormatSize)
+        {
+            auto extensible = (WAVEFORMATEXTENSIBLE*)wavFormat;
 
-        // Unlock the buffer.
-        hr = pBuffer->Unlock();
+            std::cout << std::setfill(' ') << std::setw(20) << "SubFormat" << ": " << GuidToString(&(extensible->SubFormat)).c_str() << std::endl;
+        }
+    }
+    bool parsed = ParsePcmFormat((const uint8_t*)wavFormat, wavFormatSize, format);
+    CoTaskMemFree(wavFormat);
+    if (!parsed)
+    {
+        printf("Unsupported output format.\n");
+        return MF_E_INVALIDMEDIATYPE;
+    }
+    return S_OK;
+}
 
-        currentLength = 0;
-        pBuffer->GetCurrentLength(&currentLength);
+// File format for decoded float output: the requested sample type, and the
+// channel layout after the optional mix, whose mixer is returned. False if
+// the mix cannot be built for this layout.
+bool PlanOutputFormat(const PcmFormat& format, const DecodeFileOptions& options, PcmFormat& fileFormat, std::unique_ptr<ChannelMixer>& mixer)
+{
+    fileFormat = format;
+    mixer.reset();
+    if (format.sampleType == PcmSampleType::Float32)
+    {
+        fileFormat.sampleType = options.outputType;
+        if (options.mix.preset != MixPreset::None)
+        {
+            mixer.reset(new ChannelMixer(BuildMixMatrix(format.channelMask, format.channels, options.mix)));
+            if (mixer->Outputs() == 0)
+            {
+                return false;
+            }
+            fileFormat.channels = mixer->Outputs();
+            fileFormat.channelMask = mixer->Matrix().outputMask;
+            std::cout << "Channel mix: " << format.channels << " -> " << fileFormat.channels << " (" << mixer->KernelName() << ")" << std::endl;
+        }
+    }
+    return true;
+}
 
-        pAudioData = NULL;
+// Sink is anything with Write(const void*, size_t); it must be the concrete
+// writer type (not a BufferedPcmWriter reference) so WaveFileWriter can
+// count the data bytes it patches into the header.
+//
+// The source reader runs in callback mode with several reads in flight (see
+// AsyncSampleReader.h), so demux and decode of the next samples overlap
+// with converting and writing this one.
+template <class Sink>
+HRESULT WriteWaveData(
+    Sink& writer,               // Output: RangeSink over the timeline check and file writer.
+    AsyncSampleSource& source,  // Source reader in callback mode.
+    const PcmFormat& format,    // Decoded format, to turn timestamps into samples.
+    const AsyncReaderOptions& readerOptions,    // Reads in flight and queued.
+    AsyncReaderStats& readerStats,              // Receives the read-ahead report.
+    DWORD* pcbDataWritten       // Receives the amount of data written.
+)
+{
+    DWORD cbAudioData = 0;
+    std::vector<uint8_t> staging;   // a frame split across two media buffers
 
-        if (FAILED(hr)) { break; }
+    readerStats = ReadSamplesAsync(source, [&](const SourceSample& sample)
+    {
+        // Write this data to the output file, with its position in samples
+        // so gaps and overlaps are caught. The sample's media buffers are
+        // written in place, one after the other, without first being copied
+        // into one. The writer coalesces them into large blocks and flushes
+        // them from a background thread.
+        auto sampleTime = (sample.timestamp * (LONGLONG)format.sampleRate + 5000000) / 10000000;
+        WriteGathered(writer, sample.buffers, sample.bufferCount, format.BlockAlign(), sampleTime, staging);
 
         // Update running total of audio data.
-        cbAudioData += cbBuffer;
+        cbAudioData += (DWORD)sample.size;
 
-        SafeRelease(&pSample);
-        SafeRelease(&pBuffer);
+        // Past the end of the requested range: stop reading.
+        return !writer.Done();
+    }, readerOptions);
+
+    if (readerStats.typeChanged)
+    {
+        printf("Type change - not supported by WAVE file format.\n");
+    }
+    if (readerStats.endOfStream)
+    {
+        printf("End of input file.\n");
+    }
+    if (readerStats.ticks != 0)
+    {
+        // The source reported gaps; the timeline check measures them.
+        printf("%llu stream ticks\n", readerStats.ticks);
     }
 
+    HRESULT hr = readerStats.status;
     if (SUCCEEDED(hr))
     {
         printf("Wrote %d bytes of audio data.\n", cbAudioData);
 
         *pcbDataWritten = cbAudioData;
     }
+    return hr;
+}
 
-    if (pAudioData)
+// Moves the reader to one frame before startSample, so the decoder is warm
+// by the time the range starts; the output is cut to the exact sample
+// afterwards. Sources that cannot seek are decoded from the start.
+HRESULT SeekToSample(IMFSourceReader* pReader, int64_t startSample, uint32_t sampleRate)
+{
+    PROPVARIANT prop;
+    PropVariantInit(&prop);
+    HRESULT hr = pReader->GetPresentationAttribute(MF_SOURCE_READER_MEDIASOURCE, MF_SOURCE_READER_MEDIASOURCE_CHARACTERISTICS, &prop);
+    bool canSeek = SUCCEEDED(hr) && prop.vt == VT_UI4 && (prop.ulVal & MFMEDIASOURCE_CAN_SEEK) != 0;
+    PropVariantClear(&prop);
+    if (!canSeek)
     {
-        pBuffer->Unlock();
+        printf("Source cannot seek; decoding from the start.\n");
+        return S_OK;
     }
 
-    SafeRelease(&pBuffer);
-    SafeRelease(&pSample);
+    auto target = startSample - DDP_PREROLL_SAMPLES;
+    prop.vt = VT_I8;
+    prop.hVal.QuadPart = target > 0 ? target * 10000000 / sampleRate : 0;
+    hr = pReader->SetCurrentPosition(GUID_NULL, prop);
+    PropVariantClear(&prop);
     return hr;
 }
 
-HRESULT WriteRawFile(
-    IMFSourceReader* pReader,   // Pointer to the source reader.
-    HANDLE hFile
+template <class Writer>          // WaveFileWriter, or PlanarWaveWriter for one file per channel
+HRESULT WriteWaveFile(
+    MFAsyncSampleSource& source,    // Source reader in callback mode.
+    const WCHAR* targetFile,    // Output file, or base name for planar output.
+    Writer& writer,
+    const DecodeFileOptions& options,   // Output sample format, dither, channel mix and timeline repair.
+    const AsyncReaderOptions& readerOptions,    // Reads in flight and queued.
+    TimelineStats& timeline,            // Receives the continuity report.
+    AsyncReaderStats& readerStats       // Receives the read-ahead report.
 )
 {
     HRESULT hr = S_OK;
+    IMFSourceReader* pReader = source.Reader();
 
-    DWORD cbHeader = 0;         // Size of the WAVE file header, in bytes.
     DWORD cbAudioData = 0;      // Total bytes of PCM audio data written to the file.
     DWORD cbMaxAudioData = 0;
 
@@ -233,88 +351,509 @@ HRESULT WriteRawFile(
     // Configure the source reader to get uncompressed PCM audio from the source file.
     hr = ConfigureAudioStream(pReader, &pAudioType);
 
-    // Convert the PCM audio format into a WAVEFORMATEX structure.
-    WAVEFORMATEX* wavFormat;
-    UINT32 wavFormatSize = 0;
-    hr = MFCreateWaveFormatExFromMFMediaType(pAudioType, &wavFormat, &wavFormatSize);
-    std::cout << std::setfill(' ') << std::setw(20) << "wFormatTag" << ": " << wavFormat->wFormatTag << std::endl;
-    std::cout << std::setfill(' ') << std::setw(20) << "nChannels" << ": " << wavFormat->nChannels << std::endl;
-    std::cout << std::setfill(' ') << std::setw(20) << "nSamplesPerSec" << ": " << wavFormat->nSamplesPerSec << std::endl;
-    std::cout << std::setfill(' ') << std::setw(20) << "nAvgBytesPerSec" << ": " << wavFormat->nAvgBytesPerSec << std::endl;
-    std::cout << std::setfill(' ') << std::setw(20) << "nBlockAlign" << ": " << wavFormat->nBlockAlign << std::endl;
-    std::cout << std::setfill(' ') << std::setw(20) << "wBitsPerSample" << ": " << wavFormat->wBitsPerSample << std::endl;
+    PcmFormat format;
+    if (SUCCEEDED(hr))
+    {
+        hr = GetDecodedFormat(pAudioType, format, true);
+    }
+    SafeRelease(&pAudioType);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
 
-    if (sizeof(WAVEFORMATEX) < wavFormatSize)
+    // Open the output file. The WAVE header is written now and its sizes are
+    // patched when the writer is closed.
+    PcmFormat fileFormat;
+    std::unique_ptr<ChannelMixer> mixer;
+    if (!PlanOutputFormat(format, options, fileFormat, mixer))
     {
-        auto extensible = (WAVEFORMATEXTENSIBLE*)wavFormat;
-        
-        std::cout << std::setfill(' ') << std::setw(20) << "SubFormat" << ": " << GuidToString(&(extensible->SubFormat)).c_str()<< std::endl;
+        return E_INVALIDARG;
+    }
+    // Time range: seek near the start, keep [startSample, endSample).
+    auto startSample = (int64_t)std::llround(options.startSeconds * format.sampleRate);
+    auto endSample = options.endSeconds > 0 ? (int64_t)std::llround(options.endSeconds * format.sampleRate) : INT64_MAX;
+    if (startSample >= endSample)
+    {
+        return E_INVALIDARG;
+    }
+    if (startSample > 0)
+    {
+        hr = SeekToSample(pReader, startSample, format.sampleRate);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
     }
-    CoTaskMemFree(wavFormat);
 
-    SafeRelease(&pAudioType);
+    if constexpr (std::is_same<Writer, PlanarWaveWriter>::value)
+    {
+        // Planar files are split from the float output, then converted.
+        if (format.sampleType != PcmSampleType::Float32 || !writer.Open(targetFile, fileFormat, options.dither))
+        {
+            return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+        }
+        MixingSink<PlanarWaveWriter> mixing{ writer, mixer.get() };
+        TimelineSink<MixingSink<PlanarWaveWriter>> checked{ mixing, format.BlockAlign(), options.timeline };
+        RangeSink<TimelineSink<MixingSink<PlanarWaveWriter>>> sink{ checked, format.BlockAlign(), startSample, endSample };
+        hr = WriteWaveData(sink, source, format, readerOptions, readerStats, &cbAudioData);
+        timeline = checked.Stats();
+        return hr;
+    }
+    else
+    {
+        if (!writer.Open(targetFile, fileFormat))
+        {
+            return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+        }
 
-    // Decode audio data to the file.
-    hr = WriteWaveData(hFile, pReader, &cbAudioData);
-    return hr;
+        // Decode audio data to the file, mixing channels and converting
+        // float to the requested integer format on the way.
+        PcmConverter converter{ fileFormat.sampleType, options.dither };
+        ConvertingSink<WaveFileWriter> converting{ writer, converter };
+        MixingSink<ConvertingSink<WaveFileWriter>> mixing{ converting, mixer.get() };
+        TimelineSink<MixingSink<ConvertingSink<WaveFileWriter>>> checked{ mixing, format.BlockAlign(), options.timeline };
+        RangeSink<TimelineSink<MixingSink<ConvertingSink<WaveFileWriter>>>> sink{ checked, format.BlockAlign(), startSample, endSample };
+        hr = WriteWaveData(sink, source, format, readerOptions, readerStats, &cbAudioData);
+        timeline = checked.Stats();
+        return hr;
+    }
 }
 
-void DecodeAudio(const WCHAR* sourceFile, const WCHAR* targetFile)
+struct DecodeAudioResult
 {
-    HRESULT hr = S_OK;
+    bool ok = false;
+    double audioSeconds = 0;
+    double seconds = 0;
+    double durationSeconds = 0;     // of the whole source
+    PcmWriterStats writeStats;
+    TimelineStats timeline;
+    AsyncReaderStats reader;
+
+    double RealtimeFactor() const { return seconds > 0 ? audioSeconds / seconds : 0; }
+};
 
-    IMFSourceReader* pReader = NULL;
-    HANDLE hFile = INVALID_HANDLE_VALUE;
+// Output of one audio track when every track is decoded: its own file and
+// sink chain, fed from the shared read loop by stream index.
+struct TrackOutput
+{
+    TrackOutput(DWORD streamIndex, const PcmFormat& format, const PcmFormat& fileFormat, std::unique_ptr<ChannelMixer> trackMixer,
+        const DecodeFileOptions& options)
+        : streamIndex(streamIndex), format(format), mixer(std::move(trackMixer)), converter{ fileFormat.sampleType, options.dither },
+        converting{ writer, converter }, mixing{ converting, mixer.get() }, checked{ mixing, format.BlockAlign(), options.timeline },
+        sink{ checked, format.BlockAlign(), (int64_t)std::llround(options.startSeconds * format.sampleRate),
+            options.endSeconds > 0 ? (int64_t)std::llround(options.endSeconds * format.sampleRate) : INT64_MAX }
+    {
+    }
 
-    // Initialize the COM library.
-    hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
-    assert(SUCCEEDED(hr));
-    // Initialize the Media Foundation platform.
-    hr = MFStartup(MF_VERSION);
-    assert(SUCCEEDED(hr));
+    TrackOutput(const TrackOutput&) = delete;
+    TrackOutput& operator=(const TrackOutput&) = delete;
+
+    DWORD streamIndex;
+    PcmFormat format;                   // decoded format of the track
+    std::unique_ptr<ChannelMixer> mixer;
+    WaveFileWriter writer;
+    PcmConverter converter;
+    ConvertingSink<WaveFileWriter> converting;
+    MixingSink<ConvertingSink<WaveFileWriter>> mixing;
+    TimelineSink<MixingSink<ConvertingSink<WaveFileWriter>>> checked;
+    RangeSink<TimelineSink<MixingSink<ConvertingSink<WaveFileWriter>>>> sink;
+    std::vector<uint8_t> staging;       // a frame split across two media buffers
+    uint64_t bytes = 0;                 // decoded bytes routed to the track
+};
 
-    // Create the source reader to read the input file.
-    hr = MFCreateSourceReaderFromURL(sourceFile, NULL, &pReader);
-    assert(SUCCEEDED(hr));
+// Decodes every audio track of the source in one pass: all audio streams are
+// selected and read with MF_SOURCE_READER_ANY_STREAM, so the container is
+// demuxed once instead of once per track, and each sample is routed by its
+// stream index to that track's file (out.wav -> out.track1.wav, ...).
+// Reading ends once every track has ended or has written its range.
+HRESULT WriteTrackFiles(
+    MFAsyncSampleSource& source,    // Source reader in callback mode.
+    const WCHAR* targetFile,        // Base name of the track files.
+    const DecodeFileOptions& options,
+    const AsyncReaderOptions& readerOptions,    // Reads in flight and queued.
+    DecodeAudioResult& result       // Receives the totals across the tracks.
+)
+{
+    IMFSourceReader* pReader = source.Reader();
+    std::vector<DWORD> streams;
+    HRESULT hr = FindAudioStreams(pReader, streams);
+    if (SUCCEEDED(hr) && streams.empty())
+    {
+        printf("No audio streams.\n");
+        hr = MF_E_INVALIDSTREAMNUMBER;
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    std::vector<std::unique_ptr<TrackOutput>> tracks;
+    for (auto streamIndex : streams)
+    {
+        IMFMediaType* pAudioType = NULL;
+        PcmFormat format;
+        hr = ConfigureDecodedStream(pReader, streamIndex, &pAudioType);
+        if (SUCCEEDED(hr))
+        {
+            hr = GetDecodedFormat(pAudioType, format, false);
+        }
+        SafeRelease(&pAudioType);
+        PcmFormat fileFormat;
+        std::unique_ptr<ChannelMixer> mixer;
+        if (SUCCEEDED(hr) && (format.sampleType != PcmSampleType::Float32 || !PlanOutputFormat(format, options, fileFormat, mixer)))
+        {
+            hr = E_INVALIDARG;
+        }
+        if (FAILED(hr))
+        {
+            printf("Stream %lu: cannot decode to float PCM.\n", streamIndex);
+            return hr;
+        }
+        tracks.emplace_back(new TrackOutput(streamIndex, format, fileFormat, std::move(mixer), options));
+        auto path = SuffixedWaveFileName(targetFile, ".track" + std::to_string(streamIndex));
+        if (!tracks.back()->writer.Open(path.c_str(), fileFormat))
+        {
+            return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+        }
+        printf("Stream %lu: %u channels at %u Hz.\n", streamIndex, format.channels, format.sampleRate);
+    }
 
-    // Open the output file for writing.
-    hFile = CreateFile(targetFile, GENERIC_WRITE, FILE_SHARE_READ, NULL,
-        CREATE_ALWAYS, 0, NULL);
-    assert(hFile != INVALID_HANDLE_VALUE);
+    // Time range: one seek for all tracks.
+    if (options.startSeconds > 0)
+    {
+        const auto& first = tracks.front()->format;
+        hr = SeekToSample(pReader, (int64_t)std::llround(options.startSeconds * first.sampleRate), first.sampleRate);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
 
-    // Read duration of current audio
-    IMFPresentationDescriptor* pPD = NULL;
-    MFTIME pDuration = 0;
+    // Route by stream index; streams are few, so a table indexed by it.
+    std::vector<TrackOutput*> route(streams.back() + 1, nullptr);
+    for (auto& track : tracks)
+    {
+        route[track->streamIndex] = track.get();
+    }
+    size_t tracksDone = 0;
+    auto anyStream = readerOptions;
+    anyStream.streams = (uint32_t)tracks.size();
+    source.SetReadStream((DWORD)MF_SOURCE_READER_ANY_STREAM);
+    result.reader = ReadSamplesAsync(source, [&](const SourceSample& sample)
+    {
+        auto track = sample.streamIndex < route.size() ? route[sample.streamIndex] : nullptr;
+        if (track == nullptr || track->sink.Done())
+        {
+            // Past the end of this track's range; the others go on.
+            return true;
+        }
+        const auto& format = track->format;
+        auto sampleTime = (sample.timestamp * (LONGLONG)format.sampleRate + 5000000) / 10000000;
+        WriteGathered(track->sink, sample.buffers, sample.bufferCount, format.BlockAlign(), sampleTime, track->staging);
+        track->bytes += sample.size;
+        tracksDone += track->sink.Done() ? 1 : 0;
+        return tracksDone < tracks.size();
+    }, anyStream);
+    hr = result.reader.status;
+    if (result.reader.typeChanged)
+    {
+        printf("Type change - not supported by WAVE file format.\n");
+        hr = MF_E_INVALIDMEDIATYPE;
+    }
+
+    // Close the files; totals across the tracks, the timeline log of the first.
+    result.ok = SUCCEEDED(hr);
+    for (auto& track : tracks)
+    {
+        track->writer.Close();
+        result.ok = result.ok && !track->writer.Failed();
+        auto writeStats = track->writer.GetStats();
+        result.writeStats.bytes += writeStats.bytes;
+        result.writeStats.syscalls += writeStats.syscalls;
+        result.writeStats.stalls += writeStats.stalls;
+        result.writeStats.seconds = std::max(result.writeStats.seconds, writeStats.seconds);
+        const auto& fileFormat = track->writer.Format();
+        auto bytesPerSecond = (double)fileFormat.sampleRate * fileFormat.BlockAlign();
+        auto audioSeconds = bytesPerSecond > 0 ? track->writer.DataBytes() / bytesPerSecond : 0;
+        result.audioSeconds += audioSeconds;
+        auto timeline = track->checked.Stats();
+        if (track == tracks.front())
+        {
+            result.timeline = timeline;
+        }
+        else
+        {
+            result.timeline.buffers += timeline.buffers;
+            result.timeline.untimedBuffers += timeline.untimedBuffers;
+            result.timeline.gaps += timeline.gaps;
+            result.timeline.overlaps += timeline.overlaps;
+            result.timeline.gapSamples += timeline.gapSamples;
+            result.timeline.overlapSamples += timeline.overlapSamples;
+            result.timeline.filledSamples += timeline.filledSamples;
+            result.timeline.trimmedSamples += timeline.trimmedSamples;
+            result.timeline.unfilledGaps += timeline.unfilledGaps;
+        }
+        printf("Stream %lu: decoded %llu bytes, wrote %.3f s of audio, %llu discontinuities.\n", track->streamIndex,
+            track->bytes, audioSeconds, timeline.Discontinuities());
+    }
+    printf("%zu tracks decoded in one pass, %llu samples read.\n", tracks.size(), result.reader.samples);
+    return hr;
+}
+
+// Decodes one file. COM and Media Foundation must already be initialized on
+// the calling thread; every call owns its own source reader.
+DecodeAudioResult DecodeAudio(const WCHAR* sourceFile, const WCHAR* targetFile, const DecodeFileOptions& options,
+    const StreamReaderOptions& streamOptions)
+{
+    HRESULT hr = S_OK;
+    DecodeAudioResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    // Create the source reader to read the input file, in callback mode.
+    MFAsyncSampleSource source;
+    hr = source.Open(sourceFile);
+    if (FAILED(hr))
+    {
+        return result;
+    }
+    IMFSourceReader* pReader = source.Reader();
+
+    // Read duration of current audio (100 ns units, 64-bit).
+    MFTIME duration = 0;
     PROPVARIANT prop;
     PropVariantInit(&prop);
     hr = pReader->GetPresentationAttribute(MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &prop);
-    assert(SUCCEEDED(hr));
-    if (prop.vt == VT_UI8)
+    if (SUCCEEDED(hr) && prop.vt == VT_UI8)
+    {
+        duration = (MFTIME)prop.uhVal.QuadPart;
+    }
+    PropVariantClear(&prop);
+    result.durationSeconds = duration / 1e7;
+    if (duration > 0 && options.startSeconds >= result.durationSeconds)
     {
-        pDuration = prop.ulVal;
+        printf("Start time %.3f s is past the end (%.3f s).\n", options.startSeconds, result.durationSeconds);
+        return result;
     }
-    LONG MAX_AUDIO_DURATION_MSEC = pDuration / 10000;
 
-    // Write the WAVE file.
-    hr = WriteRawFile(pReader, hFile);
-    assert(SUCCEEDED(hr));
+    // Every audio track, each to its own file.
+    if (streamOptions.allAudioStreams)
+    {
+        WriteTrackFiles(source, targetFile, options, streamOptions.reader, result);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
 
-    // Clean up.
-    if (hFile != INVALID_HANDLE_VALUE)
+    // Write the WAVE file(s).
+    auto writeFile = [&](auto& writer)
+    {
+        hr = WriteWaveFile(source, targetFile, writer, options, streamOptions.reader, result.timeline, result.reader);
+        writer.Close();
+        result.ok = SUCCEEDED(hr) && !writer.Failed();
+        result.writeStats = writer.GetStats();
+        auto bytesPerSecond = (double)writer.Format().sampleRate * writer.Format().BlockAlign();
+        result.audioSeconds = bytesPerSecond > 0 ? writer.DataBytes() / bytesPerSecond : 0;
+    };
+    if (options.planar)
     {
-        CloseHandle(hFile);
+        PlanarWaveWriter writer;
+        writeFile(writer);
+    }
+    else
+    {
+        WaveFileWriter writer;
+        writeFile(writer);
     }
 
-    SafeRelease(&pReader);
-    MFShutdown();
-    CoUninitialize();
+    // Clean up.
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
 };
 
-int main()
+std::wstring ToWide(const std::string& text)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), &wide[0], length);
+    return wide;
+}
+
+// Decodes every (input, output) pair of a UTF-8 manifest concurrently; each
+// worker decodes with its own source reader.
+int DecodeManifest(const char* manifestFile, unsigned threads, const DecodeFileOptions& options,
+    const StreamReaderOptions& streamOptions)
+{
+    std::vector<BatchJob> jobs;
+    if (!LoadBatchManifest(manifestFile, jobs))
+    {
+        printf("Failed to read %s\n", manifestFile);
+        return 1;
+    }
+    SortLargestFirst(jobs);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DecodeAudioResult> results(jobs.size());
+    {
+        WorkStealingPool pool{ threads,
+            [](unsigned) { CoInitializeEx(NULL, COINIT_MULTITHREADED | COINIT_DISABLE_OLE1DDE); },
+            [](unsigned) { CoUninitialize(); } };
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            pool.Submit([&, i](unsigned)
+            {
+                results[i] = DecodeAudio(ToWide(jobs[i].input).c_str(), ToWide(jobs[i].output).c_str(), options, streamOptions);
+            });
+        }
+        pool.Wait();
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double audioSeconds = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const auto& result = results[i];
+        printf("%s %s -> %s: %.1f s audio in %.2f s, %.1fx realtime, %llu discontinuities\n", result.ok ? "ok    " : "FAILED",
+            jobs[i].input.c_str(), jobs[i].output.c_str(), result.audioSeconds, result.seconds, result.RealtimeFactor(),
+            result.timeline.Discontinuities());
+        audioSeconds += result.audioSeconds;
+        failures += result.ok ? 0 : 1;
+    }
+    printf("%zu files, %zu failed, %.1f s audio in %.2f s: %.1fx realtime aggregate\n",
+        jobs.size(), failures, audioSeconds, seconds, seconds > 0 ? audioSeconds / seconds : 0);
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
     HeapSetInformation(NULL, HeapEnableTerminationOnCorruption, NULL, 0);
-    const WCHAR* sourceFile = L"C:\\Users\\xx\\Desktop\\SpatialSoundContent\\Amaze_DD+JOC.mp4";
-    const WCHAR* targetFile = L"C:\\Users\\xx\\Desktop\\decoded\\MFStreamReader_output.raw";
-    DecodeAudio(sourceFile, targetFile);
-    return 0;
-}
\ No newline at end of file
+
+    // DDP_MF_StreamReader [--format f32|s16|s24|s32] [--no-dither] [--downmix loro|ltrt] [--lfe-gain <gain>]
+    //     [--order FL,FR,FC,LFE,BL,BR,SL,SR] [--planar] [--fill-gaps] [--trim-overlaps]
+    //     [--start <seconds>] [--end <seconds>] [--reads-in-flight <n>] [--all-streams]
+    //     [--batch <manifest> [threads]]
+    // --all-streams writes every audio track to its own file (out.track1.wav, ...).
+    // Batch threads default to the core count.
+    DecodeFileOptions options;
+    StreamReaderOptions streamOptions;
+    const char* manifestFile = nullptr;
+    unsigned threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc)
+        {
+            manifestFile = argv[++i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+            {
+                threads = (unsigned)std::stoul(argv[++i]);
+            }
+        }
+        else if (arg == "--format" && i + 1 < argc && ParsePcmSampleType(argv[i + 1], options.outputType))
+        {
+            i++;
+        }
+        else if (arg == "--no-dither")
+        {
+            options.dither = false;
+        }
+        else if (arg == "--planar")
+        {
+            options.planar = true;
+        }
+        else if (arg == "--fill-gaps")
+        {
+            options.timeline.fillGaps = true;
+        }
+        else if (arg == "--trim-overlaps")
+        {
+            options.timeline.trimOverlaps = true;
+        }
+        else if (arg == "--start" && i + 1 < argc)
+        {
+            options.startSeconds = std::stod(argv[++i]);
+        }
+        else if (arg == "--end" && i + 1 < argc)
+        {
+            options.endSeconds = std::stod(argv[++i]);
+        }
+        else if (arg == "--all-streams")
+        {
+            streamOptions.allAudioStreams = true;
+        }
+        else if (arg == "--reads-in-flight" && i + 1 < argc)
+        {
+            streamOptions.reader.readsInFlight = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (arg == "--downmix" && i + 1 < argc && ParseMixPreset(argv[i + 1], options.mix.preset))
+        {
+            i++;
+        }
+        else if (arg == "--lfe-gain" && i + 1 < argc)
+        {
+            options.mix.lfeGain = std::stof(argv[++i]);
+        }
+        else if (arg == "--order" && i + 1 < argc && ParseSpeakerOrder(argv[i + 1], options.mix.order))
+        {
+            options.mix.preset = MixPreset::Reorder;
+            i++;
+        }
+        else
+        {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (streamOptions.allAudioStreams && options.planar)
+    {
+        printf("--all-streams cannot be combined with --planar.\n");
+        return 1;
+    }
+
+    // Process-wide initialization happens once, not per decode.
+    HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+    assert(SUCCEEDED(hr));
+    hr = MFStartup(MF_VERSION);
+    assert(SUCCEEDED(hr));
+
+    int exitCode = 0;
+    if (manifestFile != nullptr)
+    {
+        exitCode = DecodeManifest(manifestFile, threads, options, streamOptions);
+    }
+    else
+    {
+        const WCHAR* sourceFile = L"C:\\Users\\xx\\Desktop\\SpatialSoundContent\\Amaze_DD+JOC.mp4";
+        const WCHAR* targetFile = L"C:\\Users\\xx\\Desktop\\decoded\\MFStreamReader_output.wav";
+        auto result = DecodeAudio(sourceFile, targetFile, options, streamOptions);
+        assert(result.ok);
+        printf("Source duration %.3f s.\n", result.durationSeconds);
+        printf("Wrote %llu bytes in %llu writes (%.1f MiB/s, %.1f writes/s, %llu stalls).\n",
+            result.writeStats.bytes, result.writeStats.syscalls, result.writeStats.BytesPerSecond() / (1024 * 1024),
+            result.writeStats.SyscallsPerSecond(), result.writeStats.stalls);
+        const auto& reader = result.reader;
+        printf("Reader: %llu samples, %u reads in flight at most, %u queued at most; writer waited %llu times (%.3f s), reader held back %llu times.\n",
+            reader.samples, reader.maxInFlight, reader.maxQueued, reader.consumerWaits, reader.consumerWaitSeconds, reader.sourceStalls);
+        printf("Buffers: %llu samples in several buffers written in place, %llu contiguous copies (%llu bytes).\n",
+            reader.gatheredSamples, reader.contiguousCopies, reader.copiedBytes);
+        const auto& timeline = result.timeline;
+        printf("Timeline: samples %lld to %lld, %llu gaps (%llu samples, %llu filled), %llu overlaps (%llu samples, %llu trimmed).\n",
+            timeline.startSample, timeline.endSample, timeline.gaps, timeline.gapSamples, timeline.filledSamples,
+            timeline.overlaps, timeline.overlapSamples, timeline.trimmedSamples);
+        for (const auto& event : timeline.log)
+        {
+            printf("  %s of %llu samples at %lld (sample stamped %lld)\n", event.kind == DiscontinuityKind::Gap ? "gap" : "overlap",
+                event.samples, event.expected, event.actual);
+        }
+        exitCode = result.ok ? 0 : 1;
+    }
+
+    MFShutdown();
+    CoUninitialize();
+    return exitCode;
+}